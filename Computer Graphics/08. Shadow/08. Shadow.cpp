@@ -31,6 +31,9 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 
     // 전역 문자열을 초기화합니다.
     g_title = Settings::TitleName;
+    // The startup reports go to the debugger as well as to the console, if there is one.
+    static Utiles::DebugOutputBuffer debugOutput{ cout.rdbuf() };
+    cout.rdbuf(&debugOutput);
     LoadStringW(hInstance, IDC_MY08SHADOW, szWindowClass, MAX_LOADSTRING);
     MyRegisterClass(hInstance);
 
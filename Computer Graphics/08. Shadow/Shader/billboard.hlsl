@@ -72,7 +72,7 @@ void GEOMETRY_MAIN(point GEOMETRY_INPUT input[1],
 
 float4 PIXEL_MAIN(PIXEL_INPUT input) : SV_TARGET
 {
-    float4 diffuse = g_texture[input.textureIndex].Sample(g_sampler, input.uv);
+    float4 diffuse = g_textureArray.Sample(g_sampler, float3(input.uv, input.textureIndex));
     return Lighting(input.positionW, input.normal, g_cameraPosition, diffuse, g_material[input.materialIndex]);
 }
 
@@ -125,6 +125,6 @@ void SHADOW_GEOMETRY_MAIN(point GEOMETRY_INPUT input[1],
 
 void SHADOW_PIXEL_MAIN(PIXEL_INPUT input)
 {
-    float4 diffuse = g_texture[input.textureIndex].Sample(g_sampler, input.uv);
+    float4 diffuse = g_textureArray.Sample(g_sampler, float3(input.uv, input.textureIndex));
     clip(diffuse.a - 0.1f);
 }
\ No newline at end of file
@@ -16,11 +16,13 @@ cbuffer Shadow : register(b2)
     matrix g_lightProjectionMatrix : packoffset(c4);
 }
 
+#include "permutation.hlsl"
 #include "lighting.hlsl"
 
 TextureCube g_textureCube : register(t0);
 Texture2D g_shadowMap : register(t1);
 Texture2D g_texture[4] : register(t2);
+Texture2DArray g_textureArray : register(t0, space2);
 
 struct InstanceData
 {
@@ -33,6 +35,12 @@ StructuredBuffer<InstanceData> g_instanceData : register(t0, space1);
 SamplerState g_sampler : register(s0);
 SamplerComparisonState g_shadowSampler : register(s1);
 
+// Taps per side of the shadow filter, odd; 0 turns shadows off. Set by lighting permutations.
+#ifndef SHADOW_PCF_KERNEL
+#define SHADOW_PCF_KERNEL DEFAULT_SHADOW_PCF_KERNEL
+#endif
+
+#if SHADOW_PCF_KERNEL > 0
 float CalcShadowFactor(float4 shadowPosH)
 {
     shadowPosH.xyz /= shadowPosH.w;
@@ -44,30 +52,30 @@ float CalcShadowFactor(float4 shadowPosH)
     
     // Texel size.
     float dx = 1.f / (float)width;
-    const float2 offsets[9] =
-    {
-        float2(-dx, -dx), float2(0.f, -dx), float2(dx, -dx),
-        float2(-dx, 0.f), float2(0.f, 0.f), float2(dx, 0.f),
-        float2(-dx, +dx), float2(0.f, +dx), float2(dx, +dx)
-    };
     
     float output = 0.f;
     
     [unroll]
-    for (int i = 0; i < 9; ++i)
+    for (int y = -SHADOW_PCF_KERNEL / 2; y <= SHADOW_PCF_KERNEL / 2; ++y)
     {
-        output += g_shadowMap.SampleCmpLevelZero(g_shadowSampler,
-            shadowPosH.xy + offsets[i], depth).r;
+        [unroll]
+        for (int x = -SHADOW_PCF_KERNEL / 2; x <= SHADOW_PCF_KERNEL / 2; ++x)
+        {
+            output += g_shadowMap.SampleCmpLevelZero(g_shadowSampler,
+                shadowPosH.xy + float2(x, y) * dx, depth).r;
+        }
     }
     
-    return output / 9.f;
+    return output / (float)(SHADOW_PCF_KERNEL * SHADOW_PCF_KERNEL);
 }
+#endif
 
 float4 Lighting(float3 objectPosition, float3 normal,
     float3 toEye, float4 diffuse, MaterialData material)
 {
     float3 output = float3(0.f, 0.f, 0.f);
     
+#if SHADOW_PCF_KERNEL > 0
     matrix ndc;
     ndc._11_12_13_14 = float4(+0.5f, +0.0f, 0.f, 0.f);
     ndc._21_22_23_24 = float4(+0.0f, -0.5f, 0.f, 0.f);
@@ -79,16 +87,19 @@ float4 Lighting(float3 objectPosition, float3 normal,
     shadowPos = mul(shadowPos, g_lightProjectionMatrix);
     shadowPos = mul(shadowPos, ndc);
     float shadowFactor = CalcShadowFactor(shadowPos);
+#else
+    float shadowFactor = 1.f;
+#endif
 
-    for (int i = 0; i < g_lightNum.x; ++i)
+    FOR_EACH_DIRECTIONAL_LIGHT(i)
     {
         output += ComputeDirectionalLight(g_directionalLights[i], normal, toEye, diffuse.rgb, material) * shadowFactor;
     }
-    for (int j = 0; j < g_lightNum.y; ++j)
+    FOR_EACH_POINT_LIGHT(j)
     {
         output += ComputePointLight(g_pointLights[j], objectPosition, normal, toEye, diffuse.rgb, material);
     }
-    for (int k = 0; k < g_lightNum.z; ++k)
+    FOR_EACH_SPOT_LIGHT(k)
     {
         output += ComputeSpotLight(g_spotLights[k], objectPosition, normal, toEye, diffuse.rgb, material);
     }
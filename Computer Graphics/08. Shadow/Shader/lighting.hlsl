@@ -1,6 +1,16 @@
-#define MaxDirectionalLight 5
-#define MaxPointLight 10
-#define MaxSpotLight 130
+// The sizes of the Light cbuffer come from permutation.hlsl.
+
+// A lighting permutation (LightingPermutation in shader.h) fixes how many lights of each kind
+// Lighting() visits: the loop is unrolled to that bucket, and -1 leaves it to g_lightNum.
+#ifndef DIRECTIONAL_LIGHTS
+#define DIRECTIONAL_LIGHTS -1
+#endif
+#ifndef POINT_LIGHTS
+#define POINT_LIGHTS -1
+#endif
+#ifndef SPOT_LIGHTS
+#define SPOT_LIGHTS -1
+#endif
 
 struct MaterialData
 {
@@ -43,9 +53,47 @@ struct SpotLightData
 cbuffer Light : register(b0, space2)
 {
     uint4 g_lightNum; // x : directional, y : point, z : spot
-    DirectionalLightData g_directionalLights[MaxDirectionalLight];
-    PointLightData g_pointLights[MaxPointLight];
-    SpotLightData g_spotLights[MaxSpotLight];
+    DirectionalLightData g_directionalLights[MAX_DIRECTIONAL_LIGHTS];
+    PointLightData g_pointLights[MAX_POINT_LIGHTS];
+    SpotLightData g_spotLights[MAX_SPOT_LIGHTS];
+}
+
+#if DIRECTIONAL_LIGHTS < 0
+#define FOR_EACH_DIRECTIONAL_LIGHT(i) [loop] for (uint i = 0; i < g_lightNum.x; ++i)
+#else
+#define FOR_EACH_DIRECTIONAL_LIGHT(i) [unroll] for (uint i = 0; i < DIRECTIONAL_LIGHTS; ++i) if (i < g_lightNum.x)
+#endif
+#if POINT_LIGHTS < 0
+#define FOR_EACH_POINT_LIGHT(i) [loop] for (uint i = 0; i < g_lightNum.y; ++i)
+#else
+#define FOR_EACH_POINT_LIGHT(i) [unroll] for (uint i = 0; i < POINT_LIGHTS; ++i) if (i < g_lightNum.y)
+#endif
+#if SPOT_LIGHTS < 0
+#define FOR_EACH_SPOT_LIGHT(i) [loop] for (uint i = 0; i < g_lightNum.z; ++i)
+#else
+#define FOR_EACH_SPOT_LIGHT(i) [unroll] for (uint i = 0; i < SPOT_LIGHTS; ++i) if (i < g_lightNum.z)
+#endif
+
+// DXC with -enable-16bit-types (Shader Model 6.2) computes light colors and factors in half
+// precision; positions, distances and the specular power stay in float.
+#ifdef __HLSL_ENABLE_16_BIT
+typedef float16_t real;
+typedef float16_t3 real3;
+#else
+typedef float real;
+typedef float3 real3;
+#endif
+
+// Whether to skip a light out of reach. Below Shader Model 6 each lane decides; from 6 the wave
+// skips it only when no lane is reached, which keeps the branch uniform. The lanes out of reach
+// then attenuate it to zero anyway.
+bool SkipLight(bool outOfReach)
+{
+#if __SHADER_TARGET_MAJOR >= 6
+    return !any(WaveActiveBallot(!outOfReach));
+#else
+    return outOfReach;
+#endif
 }
 
 float CalcAttenuation(float d, float fallOffStart, float fallOffEnd)
@@ -54,12 +102,12 @@ float CalcAttenuation(float d, float fallOffStart, float fallOffEnd)
 }
 
 // r0 = ((n-1)/(n+1))^2, n  ̴. 
-float3 SchlickFresnel(float3 r0, float3 normal, float3 lightVector)
+real3 SchlickFresnel(real3 r0, float3 normal, float3 lightVector)
 {
-    float cosIncidentAngle = saturate(dot(normal, lightVector));
+    real cosIncidentAngle = (real)saturate(dot(normal, lightVector));
     
-    float f0 = 1.f - cosIncidentAngle;
-    float3 reflectPercent = r0 + (1.f - r0) * (f0 * f0 * f0 * f0 * f0);
+    real f0 = (real)1 - cosIncidentAngle;
+    real3 reflectPercent = r0 + ((real)1 - r0) * (f0 * f0 * f0 * f0 * f0);
 
     return reflectPercent;
 }
@@ -71,14 +119,14 @@ float3 BlinnPhong(float3 lightStrength, float3 lightVector, float3 normal,
     const float m = shininess * 256.f;
     float3 halfVector = normalize(toEye + lightVector);
 
-    float roughnessFactor = (m + 8.f) * pow(max(dot(halfVector, normal), 0.f), m) / 8.f;
-    float3 fresnelFactor = SchlickFresnel(material.fresnelR0, halfVector, lightVector);
+    real roughnessFactor = (real)((m + 8.f) * pow(max(dot(halfVector, normal), 0.f), m) / 8.f);
+    real3 fresnelFactor = SchlickFresnel((real3)material.fresnelR0, halfVector, lightVector);
 
-    float3 specular = fresnelFactor * roughnessFactor;
+    real3 specular = fresnelFactor * roughnessFactor;
 
-    specular = specular / (specular + 1.f);
+    specular = specular / (specular + (real)1);
 
-    return (diffuse + specular) * lightStrength;
+    return ((real3)diffuse + specular) * (real3)lightStrength;
 }
 
 float3 ComputeDirectionalLight(DirectionalLightData light, float3 normal, 
@@ -98,7 +146,7 @@ float3 ComputePointLight(PointLightData light, float3 objectPosition, float3 nor
     float3 lightVector = light.position - objectPosition;
     float d = length(lightVector);
 
-    if (d > light.fallOffEnd) return float3(0.f, 0.f, 0.f);
+    if (SkipLight(d > light.fallOffEnd)) return float3(0.f, 0.f, 0.f);
 
     lightVector /= d;
     float ndotl = max(dot(lightVector, normal), 0.f);
@@ -116,7 +164,7 @@ float3 ComputeSpotLight(SpotLightData light, float3 objectPosition, float3 norma
     float3 lightVector = light.position - objectPosition;
     float d = length(lightVector);
 
-    if (d > light.fallOffEnd) return 0.0f;
+    if (SkipLight(d > light.fallOffEnd)) return 0.0f;
 
     lightVector /= d;
     float ndotl = max(dot(lightVector, normal), 0.0f);
@@ -0,0 +1,10 @@
+// What the shaders and the game must agree on. settings.h and shader.cpp include this file too, so
+// it must hold nothing but preprocessor lines.
+
+// Sizes of the Light cbuffer, which Settings::MaxDirectionalLight and the others take.
+#define MAX_DIRECTIONAL_LIGHTS 5
+#define MAX_POINT_LIGHTS 10
+#define MAX_SPOT_LIGHTS 130
+
+// Default of the lighting permutations' filter; LitShader passes only the values that differ.
+#define DEFAULT_SHADOW_PCF_KERNEL 3
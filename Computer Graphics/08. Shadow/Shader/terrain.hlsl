@@ -1,26 +1,27 @@
 #include "common.hlsl"
+#ifdef VIRTUAL_TEXTURE
+#include "virtualtexture.hlsl"
+#endif
 
+// A sample of the grid, indexed by every patch it is a control point of.
 struct VERTEX_INPUT
 {
     float3 position : POSITION;
     float2 uv0 : TEXCOORD0;
-    float2 uv1 : TEXCOORD1;
-    uint density : DENSITY;
+    uint patch : PATCH;
 };
 
 struct HULL_INPUT
 {
     float4 position : POSITION;
     float2 uv0 : TEXCOORD0;
-    float2 uv1 : TEXCOORD1;
-    uint density : DENSITY;
+    uint patch : PATCH;
 };
 
 struct DOMAIN_INPUT
 {
     float4 position : POSITION;
     float2 uv0 : TEXCOORD0;
-    float2 uv1 : TEXCOORD1;
 };
 
 struct PIXEL_INPUT
@@ -37,8 +38,7 @@ HULL_INPUT VERTEX_MAIN(VERTEX_INPUT input)
     HULL_INPUT output;
     output.position = float4(input.position, 1.0f);
     output.uv0 = input.uv0;
-    output.uv1 = input.uv1;
-    output.density = input.density;
+    output.patch = input.patch;
     
     return output;
 }
@@ -49,45 +49,26 @@ struct PatchTess
     float InsideTess[2] : SV_InsideTessFactor;
 };
 
-float GetMaxTessFactor(uint dencity)
+// Chosen per patch each frame by TerrainMesh::Tessellate, in SV_TessFactor order.
+struct PatchFactors
 {
-    if (dencity == 0)
-        return 1.f;
-    if (dencity >= 1 && dencity <= 2)
-        return 3.f;
-    if (dencity >= 3 && dencity <= 5)
-        return 10.f;
-    return 64.f;
-}
-
-float CalcTessFactor(float4 center, uint maxDencity)
-{
-    float maxTessFactor = GetMaxTessFactor(maxDencity);
-    float3 d = distance(g_cameraPosition, center.xyz);
-    const float d0 = 20.f;
-    const float d1 = 100.f;
-    return clamp(20.f * saturate((d1 - d) / (d1 - d0)), 3.f, 64.f);
-}
+    float edges[4];
+    float inside[2];
+};
+StructuredBuffer<PatchFactors> g_tessFactors : register(t2, space1);
 
+// Each draw starts its instances at its first patch, which every control point carries.
 PatchTess CONSTANT_HULL(InputPatch<HULL_INPUT, 25> patch, uint patchID : SV_PrimitiveID)
 {
-    PatchTess output;
+    PatchFactors factors = g_tessFactors[patch[0].patch + patchID];
 
-    uint maxDencity = 0;
-    for (int i = 0; i < 25; ++i)
-        maxDencity = max(maxDencity, patch[i].density);
-    
-    output.EdgeTess[0] = CalcTessFactor(0.5f * mul((patch[0].position + patch[4].position), g_worldMatrix), maxDencity);
-    output.EdgeTess[1] = CalcTessFactor(0.5f * mul((patch[0].position + patch[20].position), g_worldMatrix), maxDencity);
-    output.EdgeTess[2] = CalcTessFactor(0.5f * mul((patch[4].position + patch[24].position), g_worldMatrix), maxDencity);
-    output.EdgeTess[3] = CalcTessFactor(0.5f * mul((patch[20].position + patch[24].position), g_worldMatrix), maxDencity);
-    
-    float3 sum = float3(0.f, 0.f, 0.f);
-    
-    output.InsideTess[0] = CalcTessFactor(0.25f * mul((patch[0].position + patch[4].position +
-        patch[20].position + patch[24].position), g_worldMatrix), maxDencity);
-    output.InsideTess[1] = output.InsideTess[0];
-    
+    PatchTess output;
+    output.EdgeTess[0] = factors.edges[0];
+    output.EdgeTess[1] = factors.edges[1];
+    output.EdgeTess[2] = factors.edges[2];
+    output.EdgeTess[3] = factors.edges[3];
+    output.InsideTess[0] = factors.inside[0];
+    output.InsideTess[1] = factors.inside[1];
     return output;
 }
 
@@ -103,7 +84,6 @@ DOMAIN_INPUT HULL_MAIN(InputPatch<HULL_INPUT, 25> p,
     DOMAIN_INPUT output;
     output.position = p[i].position;
     output.uv0 = p[i].uv0;
-    output.uv1 = p[i].uv1;
     return output;
 }
 
@@ -185,28 +165,73 @@ PIXEL_INPUT DOMAIN_MAIN(PatchTess patchTess,
     output.position = mul(output.position, g_viewMatrix);
     output.position = mul(output.position, g_projectionMatrix);
     
+#ifdef NORMAL_MAP
+    // The pixel shader reads the baked normal; this one only keeps the signature.
+    output.normal = float3(0.f, 1.f, 0.f);
+#else
     output.normal = normalize(cross(dULineBezierSum(patch, basisV, domainLocation.x),
                                     dVLineBezierSum(patch, basisU, domainLocation.y)));
     output.normal = mul(output.normal, (float3x3)g_worldMatrix);    
+#endif
     
     output.uv0 = lerp(
     lerp(patch[0].uv0, patch[4].uv0, domainLocation.x),
     lerp(patch[20].uv0, patch[24].uv0, domainLocation.x),
     domainLocation.y);
-    output.uv1 = lerp(
-    lerp(patch[0].uv1, patch[4].uv1, domainLocation.x),
-    lerp(patch[20].uv1, patch[24].uv1, domainLocation.x),
-    domainLocation.y);
+    // The detail layer spans each patch once.
+    output.uv1 = domainLocation;
     
     return output;
 }
 
+#ifdef NORMAL_MAP
+// TerrainNormals::Bake's texels: the normal's x and z in the mesh's space as R16G16_SNORM, every
+// TerrainNormalTexelsPerCell-th of a grid cell from the grid's low corner.
+StructuredBuffer<uint> g_terrainNormals : register(t3, space1);
+
+float2 UnpackTerrainNormal(uint texel)
+{
+    return max(float2(int2(texel << 16, texel) >> 16) / 32767.f, -1.f);
+}
+
+// Bilinear between the packed x and z of the baked texels at uv0 across the map, y rebuilt from them.
+float3 GetTerrainNormal(float2 uv)
+{
+    uint count, stride;
+    g_terrainNormals.GetDimensions(count, stride);
+    uint side = (uint)round(sqrt((float)count));
+    float2 texel = clamp(float2(uv.x, 1.f - uv.y) * (side - 1), 0.f, side - 1.f);
+    uint2 corner = min((uint2)texel, side - 2);
+    float2 t = texel - corner;
+    uint index = corner.y * side + corner.x;
+    float2 normal = lerp(
+        lerp(UnpackTerrainNormal(g_terrainNormals[index]), UnpackTerrainNormal(g_terrainNormals[index + 1]), t.x),
+        lerp(UnpackTerrainNormal(g_terrainNormals[index + side]), UnpackTerrainNormal(g_terrainNormals[index + side + 1]), t.x),
+        t.y);
+    return float3(normal.x, sqrt(saturate(1.f - dot(normal, normal))), normal.y);
+}
+#endif
+
+// Hidden pixels must not report pages, so depth is tested before the feedback write.
+#ifdef VIRTUAL_TEXTURE
+[earlydepthstencil]
+#endif
 float4 PIXEL_MAIN(PIXEL_INPUT input) : SV_TARGET
 {
     //return float4(input.normal, 1.f);
+#ifdef VIRTUAL_TEXTURE
+    // The exporter's vtbake has already blended the detail layer into the pages.
+    float4 diffuse = SampleVirtualTexture(input.uv0, input.position.xy);
+#else
     float4 diffuse = lerp(g_texture[0].Sample(g_sampler, input.uv0),
         g_texture[1].Sample(g_sampler, input.uv1), 0.5f);
-    return Lighting(input.positionW, input.normal, g_cameraPosition, diffuse, g_material[0]);
+#endif
+#ifdef NORMAL_MAP
+    float3 normal = normalize(mul(GetTerrainNormal(input.uv0), (float3x3)g_worldMatrix));
+#else
+    float3 normal = input.normal;
+#endif
+    return Lighting(input.positionW, normal, g_cameraPosition, diffuse, g_material[0]);
 }
 
 
@@ -257,4 +282,84 @@ PIXEL_INPUT SHADOW_DOMAIN_MAIN(PatchTess patchTess,
     output.position = mul(output.position, g_lightProjectionMatrix);
     
     return output;
-}
\ No newline at end of file
+}
+
+// The CDLOD path: instanced grids over the quadtree nodes TerrainMesh::SelectLods keeps, displaced
+// by heights baked at level 0's vertex spacing.
+StructuredBuffer<float> g_terrainHeights : register(t1, space1);
+
+static const float g_cdlodGrid = 8.f;                       // TerrainMesh::CdlodGrid
+static const float g_cdlodSpacing = 4.f / g_cdlodGrid;      // Between height samples; a patch is 4 cells.
+
+struct CDLOD_VERTEX_INPUT
+{
+    float2 grid : POSITION;
+    float3 node : NODE;
+    float2 morph : MORPH;
+};
+
+// Height samples per side of the baked grid.
+uint GetCdlodSide()
+{
+    uint count, stride;
+    g_terrainHeights.GetDimensions(count, stride);
+    return (uint)round(sqrt((float)count));
+}
+
+// Bilinear between the baked samples, at a point of the mesh's space.
+float GetCdlodHeight(float2 position)
+{
+    uint side = GetCdlodSide();
+    float2 texel = clamp(position / g_cdlodSpacing + (side - 1) * 0.5f, 0.f, side - 1.f);
+    uint2 corner = min((uint2)texel, side - 2);
+    float2 t = texel - corner;
+    uint index = corner.y * side + corner.x;
+    return lerp(lerp(g_terrainHeights[index], g_terrainHeights[index + 1], t.x),
+        lerp(g_terrainHeights[index + side], g_terrainHeights[index + side + 1], t.x), t.y);
+}
+
+// The vertex in the mesh's space, morphed towards the next level's grid over the node's range.
+float3 GetCdlodPosition(CDLOD_VERTEX_INPUT input)
+{
+    float2 position = input.node.xy + input.grid * input.node.z;
+    float3 positionW = mul(float4(position.x, GetCdlodHeight(position), position.y, 1.f), g_worldMatrix).xyz;
+    float morph = saturate((distance(positionW, g_cameraPosition) - input.morph.x) / (input.morph.y - input.morph.x));
+    
+    // Odd vertices slide onto their even neighbours, which make up the next level's grid.
+    float2 grid = input.grid - frac(input.grid * (g_cdlodGrid * 0.5f)) * (2.f / g_cdlodGrid) * morph;
+    position = input.node.xy + grid * input.node.z;
+    return float3(position.x, GetCdlodHeight(position), position.y);
+}
+
+PIXEL_INPUT CDLOD_VERTEX_MAIN(CDLOD_VERTEX_INPUT input)
+{
+    PIXEL_INPUT output;
+    
+    float3 position = GetCdlodPosition(input);
+    output.position = mul(float4(position, 1.f), g_worldMatrix);
+    output.positionW = output.position.xyz;
+    output.position = mul(output.position, g_viewMatrix);
+    output.position = mul(output.position, g_projectionMatrix);
+    
+    float left = GetCdlodHeight(position.xz - float2(g_cdlodSpacing, 0.f));
+    float right = GetCdlodHeight(position.xz + float2(g_cdlodSpacing, 0.f));
+    float back = GetCdlodHeight(position.xz - float2(0.f, g_cdlodSpacing));
+    float front = GetCdlodHeight(position.xz + float2(0.f, g_cdlodSpacing));
+    output.normal = normalize(float3(left - right, 2.f * g_cdlodSpacing, back - front));
+    output.normal = mul(output.normal, (float3x3)g_worldMatrix);
+    
+    // As the patches' domain shader sets them: the base layer across the map, the detail layer per patch.
+    float extent = (GetCdlodSide() - 1) * g_cdlodSpacing;
+    float2 cell = position.xz + extent * 0.5f;
+    output.uv0 = float2(cell.x / extent, 1.f - cell.y / extent);
+    output.uv1 = float2(cell.x, -cell.y) / 4.f;
+    
+    return output;
+}
+
+float4 CDLOD_SHADOW_VERTEX_MAIN(CDLOD_VERTEX_INPUT input) : SV_POSITION
+{
+    float4 position = mul(float4(GetCdlodPosition(input), 1.f), g_worldMatrix);
+    position = mul(position, g_lightViewMatrix);
+    return mul(position, g_lightProjectionMatrix);
+}
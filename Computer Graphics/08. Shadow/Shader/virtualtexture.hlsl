@@ -0,0 +1,57 @@
+// Sampling side of VirtualTexture; include after common.hlsl.
+
+cbuffer VirtualTexture : register(b3)
+{
+    uint g_vtPagesPerSide;
+    uint g_vtMipCount;
+    uint g_vtPageSize;
+    uint g_vtBorder;
+    uint g_vtSlotsPerRow;
+    uint g_vtPhysicalSize;
+    uint g_vtFeedbackWidth;
+    uint g_vtFeedbackHeight;
+    uint g_vtFeedbackScale;
+    uint g_vtFeedbackOffset;
+};
+
+Texture2D g_vtPhysical : register(t0, space3);
+Texture2D<uint> g_vtPageTable : register(t1, space3);
+RWBuffer<uint> g_vtFeedback : register(u0, space3);
+
+// One pixel of each feedback block reports the page it wants: mip << 28 | y << 14 | x.
+void WriteVirtualTextureFeedback(float2 screenPosition, uint mip, uint2 page)
+{
+    uint2 pixel = uint2(screenPosition);
+    uint2 offset = uint2(g_vtFeedbackOffset & 0xFFFF, g_vtFeedbackOffset >> 16);
+    if (any(pixel % g_vtFeedbackScale != offset))
+        return;
+
+    uint2 cell = pixel / g_vtFeedbackScale;
+    if (cell.x < g_vtFeedbackWidth && cell.y < g_vtFeedbackHeight)
+        g_vtFeedback[cell.y * g_vtFeedbackWidth + cell.x] = mip << 28 | page.y << 14 | page.x;
+}
+
+float4 SampleVirtualTexture(float2 uv, float2 screenPosition)
+{
+    uv = saturate(uv);
+    float2 texel = uv * (float)(g_vtPagesPerSide * g_vtPageSize);
+    float2 dx = ddx(texel);
+    float2 dy = ddy(texel);
+    float lod = 0.5f * log2(max(dot(dx, dx), dot(dy, dy)));
+    uint mip = (uint)clamp(lod, 0.f, (float)(g_vtMipCount - 1));
+
+    uint pages = g_vtPagesPerSide >> mip;
+    uint2 page = min(uint2(uv * pages), pages - 1);
+    WriteVirtualTextureFeedback(screenPosition, mip, page);
+
+    // The page table names the finest resident page covering this one, possibly a coarser mip.
+    uint entry = g_vtPageTable.Load(int3(page, mip));
+    uint slot = entry & 0xFFFF;
+    uint residentPages = g_vtPagesPerSide >> (entry >> 16);
+    float2 inPage = uv * residentPages - min(floor(uv * residentPages), residentPages - 1);
+
+    float slotSize = (float)(g_vtPageSize + 2 * g_vtBorder);
+    float2 slotOrigin = float2(slot % g_vtSlotsPerRow, slot / g_vtSlotsPerRow) * slotSize + g_vtBorder;
+    float2 physicalUv = (slotOrigin + inPage * g_vtPageSize) / g_vtPhysicalSize;
+    return g_vtPhysical.SampleLevel(g_sampler, physicalUv, 0.f);
+}
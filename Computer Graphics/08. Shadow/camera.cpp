@@ -29,6 +29,12 @@ void Camera::SetLens(FLOAT fovy, FLOAT aspect, FLOAT minZ, FLOAT maxZ)
 	XMStoreFloat4x4(&m_projectionMatrix, XMMatrixPerspectiveFovLH(fovy, aspect, minZ, maxZ));
 }
 
+XMMATRIX Camera::GetViewProjectionMatrix() const
+{
+	return XMMatrixLookAtLH(XMLoadFloat3(&m_eye), XMLoadFloat3(&m_at), XMLoadFloat3(&m_up)) *
+		XMLoadFloat4x4(&m_projectionMatrix);
+}
+
 XMFLOAT3 Camera::GetEye() const
 {
 	return m_eye;
@@ -24,6 +24,8 @@ public:
 
 	void SetLens(FLOAT fovy, FLOAT aspect, FLOAT minZ, FLOAT maxZ);
 
+	// World to clip space for the current eye, which the constant buffer only takes up later.
+	XMMATRIX GetViewProjectionMatrix() const;
 	XMFLOAT3 GetEye() const;
 	XMFLOAT3 GetU() const;
 	XMFLOAT3 GetV() const;
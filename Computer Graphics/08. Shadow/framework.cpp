@@ -5,7 +5,7 @@ GameFramework::GameFramework(UINT windowWidth, UINT windowHeight) :
 	m_aspectRatio{ static_cast<FLOAT>(windowWidth) / static_cast<FLOAT>(windowHeight) },
 	m_viewport{0.f, 0.f, static_cast<FLOAT>(windowWidth), static_cast<FLOAT>(windowHeight), 0.f, 1.f},
 	m_scissorRect{0, 0, static_cast<LONG>(windowWidth), static_cast<LONG>(windowHeight)},
-	m_frameIndex{0}
+	m_frameIndex{0}, m_firstFramePresented{ false }
 {
 
 }
@@ -17,6 +17,7 @@ GameFramework::~GameFramework()
 
 void GameFramework::OnCreate(HINSTANCE hInstance, HWND hWnd)
 {
+	m_createTime = chrono::steady_clock::now();
 	m_hInstance = hInstance;
 	m_hWnd = hWnd;
 
@@ -27,6 +28,9 @@ void GameFramework::OnCreate(HINSTANCE hInstance, HWND hWnd)
 void GameFramework::OnDestroy()
 {
 	WaitForGpuComplete();
+
+	// Pipelines created after the build, and those the build no longer asked for, reach the file here.
+	if (m_pipelineCache) m_pipelineCache->Save();
 }
 
 void GameFramework::FrameAdvance()
@@ -239,15 +243,21 @@ void GameFramework::CreateDepthStencilView()
 
 void GameFramework::CreateRootSignature()
 {
-	CD3DX12_DESCRIPTOR_RANGE descriptorRange[3];
+	CD3DX12_DESCRIPTOR_RANGE descriptorRange[6];
 	descriptorRange[DescriptorRange::TextureCube].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 	descriptorRange[DescriptorRange::TextureShadow].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1);
 	descriptorRange[DescriptorRange::Texture].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4, 2);
-
-	CD3DX12_ROOT_PARAMETER rootParameter[9];
+	descriptorRange[DescriptorRange::TextureArray].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 2);
+	descriptorRange[DescriptorRange::VirtualTexture].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 0, 3);
+	descriptorRange[DescriptorRange::VirtualTextureFeedback].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 3);
+
+	CD3DX12_ROOT_PARAMETER rootParameter[15];
 	rootParameter[RootParameter::GameObject].InitAsConstantBufferView(0);
 	rootParameter[RootParameter::Camera].InitAsConstantBufferView(1);
 	rootParameter[RootParameter::Shadow].InitAsConstantBufferView(2);
@@ -260,6 +270,15 @@ void GameFramework::CreateRootSignature()
 		&descriptorRange[DescriptorRange::TextureShadow], D3D12_SHADER_VISIBILITY_PIXEL);
 	rootParameter[RootParameter::Texture].InitAsDescriptorTable(1,
 		&descriptorRange[DescriptorRange::Texture], D3D12_SHADER_VISIBILITY_PIXEL);
+	rootParameter[RootParameter::TextureArray].InitAsDescriptorTable(1,
+		&descriptorRange[DescriptorRange::TextureArray], D3D12_SHADER_VISIBILITY_PIXEL);
+	rootParameter[RootParameter::VirtualTexture].InitAsDescriptorTable(2,
+		&descriptorRange[DescriptorRange::VirtualTexture], D3D12_SHADER_VISIBILITY_PIXEL);
+	rootParameter[RootParameter::VirtualTextureConstants].InitAsConstants(
+		VirtualTexture::ConstantCount, 3, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	rootParameter[RootParameter::TerrainHeights].InitAsShaderResourceView(1, 1, D3D12_SHADER_VISIBILITY_VERTEX);
+	rootParameter[RootParameter::TerrainTessFactors].InitAsShaderResourceView(2, 1, D3D12_SHADER_VISIBILITY_HULL);
+	rootParameter[RootParameter::TerrainNormals].InitAsShaderResourceView(3, 1, D3D12_SHADER_VISIBILITY_PIXEL);
 
 	CD3DX12_STATIC_SAMPLER_DESC samplerDesc[2];
 	samplerDesc[0].Init(
@@ -297,6 +316,8 @@ void GameFramework::CreateRootSignature()
 		D3D_ROOT_SIGNATURE_VERSION_1, &signature, &error));
 	Utiles::ThrowIfFailed(m_device->CreateRootSignature(0, signature->GetBufferPointer(), 
 		signature->GetBufferSize(), IID_PPV_ARGS(&m_rootSignature)));
+
+	m_pipelineCache = make_unique<PipelineCache>(m_device, m_rootSignature, signature, Settings::PipelineCacheFile);
 }
 
 void GameFramework::BuildObjects()
@@ -304,11 +325,13 @@ void GameFramework::BuildObjects()
 	m_commandList->Reset(m_commandAllocator.Get(), nullptr);
 
 	m_scene = make_unique<Scene>();
-	m_scene->BuildObjects(m_device, m_commandList, m_rootSignature);
+	m_scene->BuildObjects(m_device, m_commandQueue, m_commandList, m_rootSignature, *m_pipelineCache);
+	m_pipelineCache->Save();
 
 	m_commandList->Close();
-	ID3D12CommandList* ppCommandList[] = { m_commandList.Get() };
-	m_commandQueue->ExecuteCommandLists(_countof(ppCommandList), ppCommandList);
+	vector<ID3D12CommandList*> commandLists = m_scene->GetBuildCommandLists();
+	commandLists.push_back(m_commandList.Get());
+	m_commandQueue->ExecuteCommandLists(static_cast<UINT>(commandLists.size()), commandLists.data());
 
 	WaitForGpuComplete();
 
@@ -348,6 +371,8 @@ void GameFramework::Render()
 	Utiles::ThrowIfFailed(m_commandAllocator->Reset());
 	Utiles::ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), nullptr));
 
+	m_scene->UpdateTextureStreaming(m_commandList);
+
 	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), 
 		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
 
@@ -380,4 +405,11 @@ void GameFramework::Render()
 	Utiles::ThrowIfFailed(m_swapChain->Present(1, 0));
 
 	WaitForGpuComplete();
+
+	if (!m_firstFramePresented) {
+		m_firstFramePresented = true;
+		const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - m_createTime;
+		cout << "Time to first frame: " << elapsed.count() << " ms ("
+			<< (Settings::ParallelAssetBuild ? "parallel" : "sequential") << " asset build)" << endl;
+	}
 }
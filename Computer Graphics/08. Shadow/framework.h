@@ -70,6 +70,7 @@ private:
 	ComPtr<ID3D12Resource>				m_depthStencil;
 	ComPtr<ID3D12DescriptorHeap>		m_dsvHeap;
 	ComPtr<ID3D12RootSignature>			m_rootSignature;
+	unique_ptr<PipelineCache>			m_pipelineCache;
 
 	ComPtr<ID3D12Fence>					m_fence;
 	UINT								m_frameIndex;
@@ -77,6 +78,8 @@ private:
 	HANDLE								m_fenceEvent;
 
 	Timer								m_timer;
+	chrono::steady_clock::time_point	m_createTime;
+	BOOL								m_firstFramePresented;
 
 	unique_ptr<Scene>					m_scene;
 };
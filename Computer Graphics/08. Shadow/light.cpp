@@ -19,6 +19,11 @@ void Light::SetStrength(XMFLOAT3 strength)
 	m_strength = strength;
 }
 
+XMMATRIX Light::GetViewProjectionMatrix() const
+{
+	return XMLoadFloat4x4(&m_viewMatrix) * XMLoadFloat4x4(&m_projectionMatrix);
+}
+
 void Light::UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandList>& commandList)
 {
 	ShadowData buffer;
@@ -35,16 +40,32 @@ void Light::UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandList>& comman
 DirectionalLight::DirectionalLight(const ComPtr<ID3D12Device>& device) : Light(device), 
 	m_direction{ 0.f, -1.f, 0.f }
 {
+	UpdateMatrices();
 }
 
 DirectionalLight::DirectionalLight(const ComPtr<ID3D12Device>& device,
 	XMFLOAT3 strength, XMFLOAT3 direction) : Light(device, strength), m_direction{ direction }
 {
 	m_direction = Utiles::Vector3::Normalize(m_direction);
+	UpdateMatrices();
 }
 
 void DirectionalLight::UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandList>& commandList, 
 	DirectionalLightData& buffer)
+{
+	Light::UpdateShaderVariable(commandList);
+	buffer.strength = m_strength;
+	buffer.direction = m_direction;
+}
+
+void DirectionalLight::SetDirection(XMFLOAT3 direction)
+{
+	m_direction = Utiles::Vector3::Normalize(direction);
+	UpdateMatrices();
+}
+
+// Kept current with the direction, so the shadow frustum can be culled against before rendering.
+void DirectionalLight::UpdateMatrices()
 {
 	BoundingSphere sceneSphere{ XMFLOAT3{ 0.0f, 0.0f, 0.0f }, 128.5f * sqrt(2.f) };
 
@@ -65,15 +86,6 @@ void DirectionalLight::UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandLi
 	float f = sphereCenterLS.z + sceneSphere.Radius;
 
 	XMStoreFloat4x4(&m_projectionMatrix, XMMatrixOrthographicOffCenterLH(l, r, b, t, n, f));
-
-	Light::UpdateShaderVariable(commandList);
-	buffer.strength = m_strength;
-	buffer.direction = m_direction;
-}
-
-void DirectionalLight::SetDirection(XMFLOAT3 direction)
-{
-	m_direction = Utiles::Vector3::Normalize(direction);
 }
 
 PointLight::PointLight(const ComPtr<ID3D12Device>& device) : Light(device), 
@@ -185,6 +197,11 @@ void LightSystem::UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandList>&
 	m_constantBuffer->UpdateRootConstantBuffer(commandList);
 }
 
+XMUINT4 LightSystem::GetLightNum() const
+{
+	return m_lightNum;
+}
+
 void LightSystem::SetDirectionalLight(shared_ptr<DirectionalLight> directionalLight)
 {
 	if (m_directionalLights.size() == Settings::MaxDirectionalLight) assert("");
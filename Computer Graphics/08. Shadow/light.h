@@ -17,6 +17,9 @@ public:
 
     void SetStrength(XMFLOAT3 strength);
 
+    // World to the shadow map's clip space.
+    XMMATRIX GetViewProjectionMatrix() const;
+
 protected:
     void UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandList>& commandList);
 
@@ -48,6 +51,9 @@ public:
 
     void SetDirection(XMFLOAT3 direction);
 
+private:
+    void UpdateMatrices();
+
 private:
     XMFLOAT3    m_direction;
 };
@@ -131,6 +137,8 @@ public:
 
     void UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandList>& commandList);
 
+    XMUINT4 GetLightNum() const;
+
     void SetDirectionalLight(shared_ptr<DirectionalLight> directionalLight);
     void SetPointLight(shared_ptr<PointLight> pointLight);
     void SetSpotLight(shared_ptr<SpotLight> spotLight);
@@ -12,6 +12,20 @@ void MeshBase::ReleaseUploadBuffer()
 	if (m_vertexUploadBuffer) m_vertexUploadBuffer.Reset();
 }
 
+UINT MeshBase::ReadCount(span<const std::byte> data, size_t& offset)
+{
+	const char* first = reinterpret_cast<const char*>(data.data());
+	const char* last = first + data.size();
+	first += offset;
+	while (first < last && isspace(static_cast<unsigned char>(*first))) ++first;
+
+	UINT count{};
+	auto [end, error] = from_chars(first, last, count);
+	if (error != errc{}) throw runtime_error{ "mesh: missing element count" };
+	offset = static_cast<size_t>(end - reinterpret_cast<const char*>(data.data()));
+	return count;
+}
+
 TerrainMesh::TerrainMesh(const ComPtr<ID3D12Device>& device,
 	const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName) :
 	m_patchLength{ 4 }
@@ -20,110 +34,688 @@ TerrainMesh::TerrainMesh(const ComPtr<ID3D12Device>& device,
 	LoadMesh(device, commandList, fileName);
 }
 
-FLOAT TerrainMesh::GetHeight(FLOAT x, FLOAT z)
+void TerrainMesh::LoadMesh(const ComPtr<ID3D12Device>& device, 
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName)
 {
-	const XMFLOAT2 range = XMFLOAT2{
-		static_cast<FLOAT>(-m_length / 2),
-		static_cast<FLOAT>(+m_length / 2) };
-	if (range.x > x || range.y < x || range.x > z || range.y < z) return 0.f;
-	const INT nx = static_cast<INT>(x + m_length / 2);
-	const INT nz = static_cast<INT>(z + m_length / 2);
-	const INT sx = nx - nx % 4;
-	const INT sz = nz - nz % 4;
-	const FLOAT fx = x + m_length / 2;
-	const FLOAT fz = z + m_length / 2;
+	// A tiled map on disk is never read whole: the overview stands in for it, and each tile around
+	// the camera is drawn from its slot's buffers once it arrives.
+	if (IsStreamed(fileName)) {
+		m_tileQueue = make_unique<IoQueue>(1);
+		m_tileStream = make_unique<TerrainTileStream>(*m_tileQueue, fileName,
+			Settings::TerrainTileSlots, Settings::TerrainTileLoadBudget);
+		m_length = static_cast<INT>(m_tileStream->GetHeader().length);
+		CreateOverview(device, commandList);
+		CreateTileSlots(device, commandList);
+		m_tileStream->Preload(0.f, 0.f, Settings::TerrainTileRadius);
+		UpdateTileSlots();
+		return;
+	}
 
-	const XMFLOAT2 domainLocation{ (fx - sx) / 4.f, (fz - sz) / 4.f };
+	const AssetData asset = Assets::Load(fileName);
+	const auto height = asset.GetData();
 
-	FLOAT basisU[5], basisV[5];
-	BernsteinBasis(domainLocation.x, basisU);
-	BernsteinBasis(domainLocation.y, basisV);
+	// A cooked terrain from the exporter's cook command is restored and uploaded as it is mapped.
+	if (TerrainPackage::IsPackage(height)) {
+		const auto package = TerrainPackage::Read(height);
+		m_length = static_cast<INT>(package.header.length);
+		m_heightfield = make_unique<Heightfield>(vector<FLOAT>(package.heights.begin(), package.heights.end()), m_length);
+		m_quadtree = make_unique<TerrainQuadtree>(package.quadtree);
+		m_tessellation = make_unique<TerrainTessellation>(package.tessellation);
+		m_heightPyramid = make_unique<HeightPyramid>(*m_heightfield, package.pyramid);
 
-	return GetBezierSumHeight(sx, sz, basisU, basisV);
+		static_assert(sizeof(TerrainVertex) == sizeof(TerrainPackage::GridVertex));
+		CreateVertexBuffer(device, commandList,
+			span{ reinterpret_cast<const TerrainVertex*>(package.vertices.data()), package.vertices.size() });
+		CreateIndexBuffer(device, commandList, package.indices);
+		CreateIndirectBuffers(device);
+		CreatePatchBuffers(device, commandList, static_cast<UINT>(m_quadtree->GetPatchOrder().size()));
+		if (Settings::TerrainNormalMap) CreateNormalBuffer(device, commandList, package.normals);
+		if (package.header.lodSamplesPerCell == CdlodGrid / m_patchLength) CreateLodBuffers(device, commandList, package.lodHeights);
+		else CreateLodBuffers(device, commandList, TerrainPatches::GetLodHeights(*m_heightfield, CdlodGrid / m_patchLength));
+		return;
+	}
+
+	// A tiled map from the asset pack is decoded whole; a plain one is a square of bytes.
+	vector<FLOAT> heights;
+	TerrainTiling::FileHeader header;
+	if (height.size() >= sizeof(header) && memcmp(height.data(), &TerrainTiling::FileMagic, sizeof(UINT)) == 0) {
+		heights = TerrainTiling::ReadHeights(height, header);
+		m_length = static_cast<INT>(header.length);
+	}
+	else {
+		m_length = static_cast<int>(sqrt(height.size()));
+		heights.resize(static_cast<size_t>(m_length) * m_length);
+		for (size_t offset = 0; auto& dot : heights) {
+			dot = static_cast<FLOAT>(to_integer<BYTE>(height[offset++]));
+			dot /= 3.f;
+		}
+	}
+	CreateGrid(device, commandList, move(heights));
 }
 
-void TerrainMesh::LoadMesh(const ComPtr<ID3D12Device>& device, 
-	const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName)
+void TerrainMesh::CreateGrid(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, vector<FLOAT> heights)
 {
-	ifstream in(fileName, ios::binary);
-	in.seekg(0, ios::end);
-	size_t size = static_cast<size_t>(in.tellg());
-	m_length = static_cast<int>(sqrt(size));
-	INT half = m_length / 2;
+	m_heightfield = make_unique<Heightfield>(move(heights), m_length);
+	m_quadtree = make_unique<TerrainQuadtree>(*m_heightfield);
+	m_tessellation = make_unique<TerrainTessellation>(*m_heightfield, m_quadtree->GetPatchOrder());
+	m_heightPyramid = make_unique<HeightPyramid>(*m_heightfield);
 
-	m_height.resize(m_length, vector<FLOAT>(m_length));
-	vector<BYTE> height(m_length);
+	vector<TerrainVertex> vertices(static_cast<size_t>(m_length) * m_length);
+	TerrainPatches::WriteGrid<TerrainVertex>(*m_heightfield, vertices);
+	// In the quadtree's order, so every node it keeps is one run of indices.
+	const auto& patchOrder = m_quadtree->GetPatchOrder();
+	vector<UINT> indices(patchOrder.size() * TerrainPatches::PatchVertices);
+	TerrainPatches::WritePatchIndices(m_length, patchOrder, indices);
 
-	in.seekg(0, ios::beg);
-	for (auto& line : m_height) {
-		in.read(reinterpret_cast<char*>(height.data()), m_length * sizeof(BYTE));
-		for (size_t i = 0; auto& dot : line) {
-			dot = static_cast<FLOAT>(height[i++]);
-			dot /= 3.f;
+	CreateVertexBuffer(device, commandList, vertices);
+	CreateIndexBuffer(device, commandList, indices);
+	CreateIndirectBuffers(device);
+	CreatePatchBuffers(device, commandList, static_cast<UINT>(patchOrder.size()));
+	if (Settings::TerrainNormalMap) {
+		CreateNormalBuffer(device, commandList, TerrainNormals::Bake(*m_heightfield, Settings::TerrainNormalTexelsPerCell));
+	}
+	CreateLodBuffers(device, commandList, TerrainPatches::GetLodHeights(*m_heightfield, CdlodGrid / m_patchLength));
+}
+
+void TerrainMesh::CreateOverview(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList)
+{
+	// Whole patches per tile with samples about as far apart as the overview's, a power of two so
+	// each tile's patches are one aligned run of the quadtree's order.
+	const auto& header = m_tileStream->GetHeader();
+	const UINT patchLength = static_cast<UINT>(m_patchLength);
+	m_overviewTilePatches = bit_floor(max(header.tileCells / (patchLength * header.overviewStep), 1u));
+	const UINT tileSamples = m_overviewTilePatches * patchLength;
+	const INT length = static_cast<INT>(header.tilesPerSide * tileSamples + 1);
+	m_overviewScale = static_cast<FLOAT>(header.tileCells) / static_cast<FLOAT>(tileSamples);
+	m_overviewOffset = static_cast<FLOAT>(length / 2) * m_overviewScale - static_cast<FLOAT>(m_length / 2);
+
+	vector<FLOAT> heights(static_cast<size_t>(length) * length);
+	for (INT z = 0; z < length; ++z) {
+		for (INT x = 0; x < length; ++x) {
+			heights[static_cast<size_t>(z) * length + x] = m_tileStream->GetOverviewHeight(
+				static_cast<FLOAT>(x) * m_overviewScale, static_cast<FLOAT>(z) * m_overviewScale);
 		}
 	}
-	
-	auto filter = views::filter([=](INT x) noexcept { return (x % m_patchLength) == 0; });
+	m_heightfield = make_unique<Heightfield>(move(heights), length);
+	m_quadtree = make_unique<TerrainQuadtree>(*m_heightfield);
+	m_heightPyramid = make_unique<HeightPyramid>(*m_heightfield);
 
-	vector<TerrainVertex> vertices;
-	for (const auto& pz : views::iota(m_patchLength, m_length) | views::reverse) {
-		if (pz % m_patchLength != 0) continue;
-		for (const auto& px : views::iota(0, m_length - m_patchLength) | filter) {
-			CreatePatch(vertices, pz, pz - m_patchLength, px, px + m_patchLength);
+	// In mesh space already, with the uv the whole grid has there.
+	const FLOAT half = static_cast<FLOAT>(m_length / 2), last = static_cast<FLOAT>(max(m_length - 1, 1));
+	vector<TerrainVertex> vertices(static_cast<size_t>(length) * length);
+	for (INT z = 0; z < length; ++z) {
+		for (INT x = 0; x < length; ++x) {
+			const FLOAT fx = static_cast<FLOAT>(x) * m_overviewScale, fz = static_cast<FLOAT>(z) * m_overviewScale;
+			vertices[static_cast<size_t>(z) * length + x] = TerrainVertex{
+				XMFLOAT3{ fx - half, m_heightfield->GetSample(x, z), fz - half }, XMFLOAT2{ fx / last, 1.f - fz / last } };
 		}
 	}
+	const auto& patchOrder = m_quadtree->GetPatchOrder();
+	vector<UINT> indices(patchOrder.size() * TerrainPatches::PatchVertices);
+	TerrainPatches::WritePatchIndices(length, patchOrder, indices);
 
 	CreateVertexBuffer(device, commandList, vertices);
+	CreateIndexBuffer(device, commandList, indices);
+	CreateIndirectBuffers(device);
+	// The instance stream serves the tiles' patches too.
+	const UINT tilePatches = header.tileCells / patchLength * (header.tileCells / patchLength);
+	CreatePatchBuffers(device, commandList, max(static_cast<UINT>(patchOrder.size()), tilePatches));
+	// Never near the camera while its tile is resident, so one sample per segment is enough.
+	const FLOAT factor = static_cast<FLOAT>(m_patchLength);
+	fill_n(m_tessFactors, patchOrder.size(),
+		TerrainTessellation::PatchFactors{ { factor, factor, factor, factor }, { factor, factor } });
+}
+
+void TerrainMesh::CreateTileSlots(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList)
+{
+	// Every tile's quadtree orders its patches alike, so a flat tile gives the order they share.
+	const auto& header = m_tileStream->GetHeader();
+	const INT side = static_cast<INT>(TerrainTiling::GetTileSide(header));
+	const Heightfield flat{ vector<FLOAT>(static_cast<size_t>(side) * side), side };
+	const TerrainQuadtree quadtree{ flat };
+	const auto& patchOrder = quadtree.GetPatchOrder();
+	vector<UINT> indices(patchOrder.size() * TerrainPatches::PatchVertices);
+	TerrainPatches::WritePatchIndices(side, patchOrder, indices);
+	// A valid tile holds at least one patch.
+	const UINT indexSize = static_cast<UINT>(indices.size() * sizeof(UINT));
+	CreateDefaultBuffer(device, commandList, indices.data(), indexSize,
+		D3D12_RESOURCE_STATE_INDEX_BUFFER, m_tileIndexBuffer, m_tileIndexUploadBuffer);
+	m_tileIndexBufferView.BufferLocation = m_tileIndexBuffer->GetGPUVirtualAddress();
+	m_tileIndexBufferView.Format = DXGI_FORMAT_R32_UINT;
+	m_tileIndexBufferView.SizeInBytes = indexSize;
+
+	const UINT patchesPerSide = header.tileCells / static_cast<UINT>(m_patchLength);
+	m_tilePatchPlaces.resize(patchOrder.size());
+	for (UINT place = 0; const auto& patch : patchOrder) m_tilePatchPlaces[patch.y * patchesPerSide + patch.x] = place++;
+
+	const UINT vertexSize = static_cast<UINT>(static_cast<size_t>(side) * side * sizeof(TerrainVertex));
+	const UINT factorSize = static_cast<UINT>(patchOrder.size() * sizeof(TerrainTessellation::PatchFactors));
+	m_tileSlots.resize(m_tileStream->GetCache().GetSlotCount());
+	for (auto& slot : m_tileSlots) {
+		Utiles::ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(vertexSize),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(&slot.vertexBuffer)));
+		Utiles::ThrowIfFailed(slot.vertexBuffer->Map(0, nullptr, reinterpret_cast<void**>(&slot.vertices)));
+		slot.vertexBufferView.BufferLocation = slot.vertexBuffer->GetGPUVirtualAddress();
+		slot.vertexBufferView.SizeInBytes = vertexSize;
+		slot.vertexBufferView.StrideInBytes = sizeof(TerrainVertex);
+
+		Utiles::ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(factorSize),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(&slot.tessFactorBuffer)));
+		Utiles::ThrowIfFailed(slot.tessFactorBuffer->Map(0, nullptr, reinterpret_cast<void**>(&slot.tessFactors)));
+	}
+}
+
+void TerrainMesh::UpdateTileSlots()
+{
+	const auto& header = m_tileStream->GetHeader();
+	const auto& cache = m_tileStream->GetCache();
+	const INT side = static_cast<INT>(TerrainTiling::GetTileSide(header));
+	const FLOAT half = static_cast<FLOAT>(m_length / 2), last = static_cast<FLOAT>(max(m_length - 1, 1));
+	const FLOAT tileHalf = static_cast<FLOAT>(header.tileCells / 2);
+	const UINT patches = static_cast<UINT>(m_tilePatchPlaces.size());
+	for (UINT index = 0; index < m_tileSlots.size(); ++index) {
+		TileSlot& slot = m_tileSlots[index];
+		const UINT tile = cache.GetSlotTile(index);
+		if (tile == slot.tile) continue;
+
+		// A slot whose tile was evicted draws nothing until the next one arrives.
+		slot.tile = tile;
+		slot.quadtree.reset();
+		slot.tessellation.reset();
+		slot.heightPyramid.reset();
+		for (auto& ranges : slot.ranges) ranges.clear();
+		if (tile == TerrainTileCache::NoSlot) continue;
+
+		const Heightfield& heightfield = m_tileStream->GetSlot(index);
+		const FLOAT originX = static_cast<FLOAT>(tile % header.tilesPerSide * header.tileCells);
+		const FLOAT originZ = static_cast<FLOAT>(tile / header.tilesPerSide * header.tileCells);
+		slot.centre = XMFLOAT3{ originX + tileHalf - half, 0.f, originZ + tileHalf - half };
+		slot.quadtree = make_unique<TerrainQuadtree>(heightfield);
+		slot.tessellation = make_unique<TerrainTessellation>(heightfield, slot.quadtree->GetPatchOrder());
+		slot.heightPyramid = make_unique<HeightPyramid>(heightfield);
+
+		// The GPU finished with the slot's buffers at the end of the last frame.
+		for (INT z = 0; z < side; ++z) {
+			for (INT x = 0; x < side; ++x) {
+				const FLOAT fx = originX + static_cast<FLOAT>(x), fz = originZ + static_cast<FLOAT>(z);
+				slot.vertices[static_cast<size_t>(z) * side + x] = TerrainVertex{
+					XMFLOAT3{ fx - half, heightfield.GetSample(x, z), fz - half }, XMFLOAT2{ fx / last, 1.f - fz / last } };
+			}
+		}
+		fill_n(slot.tessFactors, patches, TerrainTessellation::PatchFactors{ { 1.f, 1.f, 1.f, 1.f }, { 1.f, 1.f } });
+		for (auto& ranges : slot.ranges) ranges = { TerrainQuadtree::Range{ 0, patches } };
+	}
+}
+
+void TerrainMesh::MatchTileEdges()
+{
+	// A tile's densities stop at its border and its eye is its own, so two tiles can cap or round
+	// a shared edge differently. Edge 2 (high x) meets the next tile in x's edge 0, and edge 1
+	// (high z) the next tile in z's edge 3.
+	const auto& cache = m_tileStream->GetCache();
+	const UINT tilesPerSide = cache.GetTilesPerSide();
+	const UINT side = m_tileStream->GetHeader().tileCells / static_cast<UINT>(m_patchLength);
+	const auto match = [](FLOAT& a, FLOAT& b) { a = b = max(a, b); };
+	for (const auto& slot : m_tileSlots) {
+		if (!slot.tessellation) continue;
+		const UINT tx = slot.tile % tilesPerSide, tz = slot.tile / tilesPerSide;
+		const UINT nextX = tx + 1 < tilesPerSide ? cache.GetResidentSlot(slot.tile + 1) : TerrainTileCache::NoSlot;
+		const UINT nextZ = tz + 1 < tilesPerSide ? cache.GetResidentSlot(slot.tile + tilesPerSide) : TerrainTileCache::NoSlot;
+		if (nextX != TerrainTileCache::NoSlot) {
+			auto* neighbour = m_tileSlots[nextX].tessFactors;
+			for (UINT z = 0; z < side; ++z) {
+				match(slot.tessFactors[m_tilePatchPlaces[z * side + side - 1]].edges[2],
+					neighbour[m_tilePatchPlaces[z * side]].edges[0]);
+			}
+		}
+		if (nextZ != TerrainTileCache::NoSlot) {
+			auto* neighbour = m_tileSlots[nextZ].tessFactors;
+			for (UINT x = 0; x < side; ++x) {
+				match(slot.tessFactors[m_tilePatchPlaces[(side - 1) * side + x]].edges[1],
+					neighbour[m_tilePatchPlaces[x]].edges[3]);
+			}
+		}
+	}
+}
+
+BOOL TerrainMesh::IsStreamed(const wstring& fileName)
+{
+	// A map in the asset pack has no loose file to stream from and is loaded whole.
+	ifstream file{ filesystem::path{ fileName }, ios::binary };
+	UINT magic{};
+	return file.read(reinterpret_cast<char*>(&magic), sizeof(magic)) && magic == TerrainTiling::FileMagic;
+}
+
+void TerrainMesh::StreamTiles(FLOAT x, FLOAT z)
+{
+	if (!m_tileStream) return;
+	m_tileStream->Update(x, z, Settings::TerrainTileRadius);
+	UpdateTileSlots();
+}
+
+FLOAT TerrainMesh::GetHeight(FLOAT x, FLOAT z) const
+{
+	return m_tileStream ? m_tileStream->GetHeight(x, z) : m_heightfield->GetHeight(x, z);
+}
+
+void TerrainMesh::GetHeights(span<const XMFLOAT2> points, span<FLOAT> heights) const
+{
+	if (!m_tileStream) {
+		m_heightfield->GetHeights(points, heights);
+		return;
+	}
+	for (size_t i = 0; i < points.size(); ++i) heights[i] = m_tileStream->GetHeight(points[i].x, points[i].y);
+}
+
+FLOAT TerrainMesh::Intersect(const HeightPyramid::Ray& ray) const
+{
+	return m_tileStream ? IntersectTiles(ray) : m_heightPyramid->Intersect(ray);
+}
+
+void TerrainMesh::Intersect(span<const HeightPyramid::Ray> rays, span<FLOAT> distances) const
+{
+	if (!m_tileStream) {
+		m_heightPyramid->Intersect(rays, distances);
+		return;
+	}
+	Parallel::ForRange(0, rays.size(), [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i) distances[i] = IntersectTiles(rays[i]);
+		});
+}
+
+FLOAT TerrainMesh::IntersectTiles(const HeightPyramid::Ray& ray) const
+{
+	// Tile by tile along the ray, in grid units from the low corner: a resident tile answers from
+	// its own pyramid and any other from the overview's, each from where the ray enters the tile.
+	const auto& header = m_tileStream->GetHeader();
+	const auto& cache = m_tileStream->GetCache();
+	const FLOAT cells = static_cast<FLOAT>(header.tileCells), extent = cells * static_cast<FLOAT>(header.tilesPerSide);
+	const FLOAT half = static_cast<FLOAT>(m_length / 2);
+	const FLOAT ox = ray.origin.x + half, oz = ray.origin.z + half;
+	const XMFLOAT3& direction = ray.direction;
+
+	FLOAT first = 0.f, end = ray.length;
+	const auto clip = [&](FLOAT origin, FLOAT step) {
+		if (step == 0.f) return origin >= 0.f && origin <= extent;
+		FLOAT enter = -origin / step, leave = (extent - origin) / step;
+		if (enter > leave) swap(enter, leave);
+		first = max(first, enter);
+		end = min(end, leave);
+		return first <= end;
+	};
+	if (!clip(ox, direction.x) || !clip(oz, direction.z)) return HeightPyramid::Miss;
+
+	const UINT last = header.tilesPerSide - 1;
+	const auto tileAt = [&](FLOAT value) { return min(static_cast<UINT>(max(value, 0.f) / cells), last); };
+	UINT tx = tileAt(ox + first * direction.x), tz = tileAt(oz + first * direction.z);
+	for (FLOAT t = first;;) {
+		const FLOAT leaveX = direction.x != 0.f ?
+			(static_cast<FLOAT>(tx + (direction.x > 0.f)) * cells - ox) / direction.x : HeightPyramid::Miss;
+		const FLOAT leaveZ = direction.z != 0.f ?
+			(static_cast<FLOAT>(tz + (direction.z > 0.f)) * cells - oz) / direction.z : HeightPyramid::Miss;
+		const FLOAT leave = max(min({ leaveX, leaveZ, end }), t);
+
+		const XMFLOAT3 start{ ray.origin.x + t * direction.x, ray.origin.y + t * direction.y, ray.origin.z + t * direction.z };
+		const UINT slot = cache.GetResidentSlot(tz * header.tilesPerSide + tx);
+		FLOAT hit;
+		if (slot != TerrainTileCache::NoSlot && m_tileSlots[slot].heightPyramid) {
+			const XMFLOAT3& centre = m_tileSlots[slot].centre;
+			hit = m_tileSlots[slot].heightPyramid->Intersect(HeightPyramid::Ray{
+				XMFLOAT3{ start.x - centre.x, start.y, start.z - centre.z }, direction, leave - t });
+		}
+		else {
+			hit = m_heightPyramid->Intersect(HeightPyramid::Ray{
+				XMFLOAT3{ (start.x - m_overviewOffset) / m_overviewScale, start.y, (start.z - m_overviewOffset) / m_overviewScale },
+				XMFLOAT3{ direction.x / m_overviewScale, direction.y, direction.z / m_overviewScale }, leave - t });
+		}
+		if (hit != HeightPyramid::Miss) return t + hit;
+		if (leave >= end) break;
+
+		if (leaveX <= leaveZ) {
+			if (direction.x > 0.f ? tx == last : tx == 0) break;
+			tx = direction.x > 0.f ? tx + 1 : tx - 1;
+		}
+		else {
+			if (direction.z > 0.f ? tz == last : tz == 0) break;
+			tz = direction.z > 0.f ? tz + 1 : tz - 1;
+		}
+		t = leave;
+	}
+	return HeightPyramid::Miss;
 }
 
-void TerrainMesh::CreatePatch(vector<TerrainVertex>& vertices, INT zStart, INT zEnd, INT xStart, INT xEnd)
+void TerrainMesh::Cull(TerrainView view, FXMMATRIX objectToClip)
 {
-	constexpr INT dx[] = { -1, 0, 1, -1, 1, -1, 0, 1 };
-	constexpr INT dz[] = { 1, 1, 1, 0, 0, -1, -1, -1 };
-	for (INT z : views::iota(zEnd, zStart + 1) | views::reverse) {
-		for (INT x : views::iota(xStart, xEnd + 1)) {
-			const XMFLOAT2 uv0{ static_cast<FLOAT>(x) / (m_length - 1),
-				1.f - static_cast<FLOAT>(z) / (m_length - 1) };
-			const XMFLOAT2 uv1{ static_cast<FLOAT>(x - xStart) / m_patchLength,
-				static_cast<FLOAT>(zStart - z) / m_patchLength };
+	const auto index = static_cast<size_t>(view);
+	if (m_tileStream) {
+		for (auto& slot : m_tileSlots) {
+			if (slot.quadtree) {
+				slot.quadtree->Cull(XMMatrixTranslation(slot.centre.x, 0.f, slot.centre.z) * objectToClip, slot.ranges[index]);
+			}
+		}
 
-			INT density = 0;
-			for (INT i : views::iota(0, 8)) {
-				INT tz = z + dz[i], tx = x + dx[i];
-				if (tz < 0 || tz >= m_length || tx < 0 || tx >= m_length) continue;
-				density = max(density, static_cast<INT>(abs(m_height[z][x] - m_height[tz][tx])));
+		// The overview draws only the tiles that are not resident; each tile's patches are one run.
+		m_quadtree->Cull(XMMatrixScaling(m_overviewScale, 1.f, m_overviewScale) *
+			XMMatrixTranslation(m_overviewOffset, 0.f, m_overviewOffset) * objectToClip, m_overviewRanges);
+		const auto& patchOrder = m_quadtree->GetPatchOrder();
+		const auto& cache = m_tileStream->GetCache();
+		const UINT run = m_overviewTilePatches * m_overviewTilePatches;
+		m_ranges[index].clear();
+		for (const auto& range : m_overviewRanges) {
+			for (UINT first = range.first, last = range.first + range.count; first < last;) {
+				const UINT end = min((first / run + 1) * run, last);
+				const XMUINT2& patch = patchOrder[first];
+				const UINT tile = patch.y / m_overviewTilePatches * cache.GetTilesPerSide() + patch.x / m_overviewTilePatches;
+				if (!cache.IsResident(tile)) {
+					auto& ranges = m_ranges[index];
+					if (!ranges.empty() && ranges.back().first + ranges.back().count == first) ranges.back().count += end - first;
+					else ranges.push_back(TerrainQuadtree::Range{ first, end - first });
+				}
+				first = end;
 			}
+		}
+	}
+	else m_quadtree->Cull(objectToClip, m_ranges[index]);
 
-			FLOAT nx = static_cast<FLOAT>(x - m_length / 2);
-			FLOAT nz = static_cast<FLOAT>(z - m_length / 2);
-			vertices.emplace_back(
-				XMFLOAT3{ nx, m_height[z][x], nz }, uv0, uv1, density);
+	const UINT patchVertices = (m_patchLength + 1) * (m_patchLength + 1);
+	for (size_t i = 0; const auto& range : m_ranges[index]) {
+		m_arguments[index][i++] = D3D12_DRAW_INDEXED_ARGUMENTS{
+			range.count * patchVertices, 1, range.first * patchVertices, 0, range.first };
+	}
+	m_argumentCounts[index] = static_cast<UINT>(m_ranges[index].size());
+}
+
+void TerrainMesh::Tessellate(const XMFLOAT3& eye, FLOAT pixelsPerUnit)
+{
+	// The shadow pass draws its patches untessellated, so only the camera's need factors.
+	const auto camera = static_cast<size_t>(TerrainView::Camera);
+	if (m_tileStream) {
+		// Each tile against the eye in its own space; the overview keeps its factors.
+		for (auto& slot : m_tileSlots) {
+			if (!slot.tessellation) continue;
+			const XMFLOAT3 tileEye{ eye.x - slot.centre.x, eye.y, eye.z - slot.centre.z };
+			slot.tessellation->Compute(tileEye, pixelsPerUnit, Settings::TerrainPixelError, slot.ranges[camera], slot.tessFactors);
 		}
+		MatchTileEdges();
+		return;
 	}
+	m_tessellation->Compute(eye, pixelsPerUnit, Settings::TerrainPixelError, m_ranges[camera], m_tessFactors);
 }
 
-void TerrainMesh::BernsteinBasis(FLOAT t, FLOAT* basis)
+void TerrainMesh::Render(const ComPtr<ID3D12GraphicsCommandList>& commandList, size_t) const
 {
-	const FLOAT invT = 1.f - t;
-	basis[0] = invT * invT * invT * invT;
-	basis[1] = 4.f * t * invT * invT * invT;
-	basis[2] = 6.f * t * t * invT * invT;
-	basis[3] = 4.f * t * t * t * invT;
-	basis[4] = t * t * t * t;
+	// A streamed map's overview would cover its tiles until culled.
+	if (m_tileStream) {
+		Render(commandList, TerrainView::Camera);
+		return;
+	}
+	if (m_indices == 0) return;
+
+	const D3D12_VERTEX_BUFFER_VIEW vertexBufferViews[]{ m_vertexBufferView, m_patchBufferView };
+	commandList->IASetPrimitiveTopology(m_primitiveTopology);
+	commandList->IASetVertexBuffers(0, _countof(vertexBufferViews), vertexBufferViews);
+	commandList->IASetIndexBuffer(&m_indexBufferView);
+	commandList->SetGraphicsRootShaderResourceView(RootParameter::TerrainTessFactors,
+		m_tessFactorBuffer->GetGPUVirtualAddress());
+	if (m_normalBuffer) {
+		commandList->SetGraphicsRootShaderResourceView(RootParameter::TerrainNormals,
+			m_normalBuffer->GetGPUVirtualAddress());
+	}
+	commandList->DrawIndexedInstanced(m_indices, 1, 0, 0, 0);
 }
 
-FLOAT TerrainMesh::GetBezierSumHeight(INT sx, INT sz, FLOAT* basisU, FLOAT* basisV)
+void TerrainMesh::Render(const ComPtr<ID3D12GraphicsCommandList>& commandList, TerrainView view) const
 {
-	FLOAT sum = 0.f;
-	sum += basisV[0] * (basisU[0] * m_height[sz][sx] + basisU[1] * m_height[sz][sx + 1] + basisU[2] * 
-		m_height[sz][sx + 2] + basisU[3] * m_height[sz][sx + 3] + basisU[4] * m_height[sz][sx + 4]);
-	sum += basisV[1] * (basisU[0] * m_height[sz + 1][sx] + basisU[1] * m_height[sz + 1][sx + 1] + basisU[2] * 
-		m_height[sz + 1][sx + 2] + basisU[3] * m_height[sz + 1][sx + 3] + basisU[4] * m_height[sz + 1][sx + 4]);
-	sum += basisV[2] * (basisU[0] * m_height[sz + 2][sx] + basisU[1] * m_height[sz + 2][sx + 1] + basisU[2] * 
-		m_height[sz + 2][sx + 2] + basisU[3] * m_height[sz + 2][sx + 3] + basisU[4] * m_height[sz + 2][sx + 4]);
-	sum += basisV[3] * (basisU[0] * m_height[sz + 3][sx] + basisU[1] * m_height[sz + 3][sx + 1] + basisU[2] * 
-		m_height[sz + 3][sx + 2] + basisU[3] * m_height[sz + 3][sx + 3] + basisU[4] * m_height[sz + 3][sx + 4]);
-	sum += basisV[4] * (basisU[0] * m_height[sz + 4][sx] + basisU[1] * m_height[sz + 4][sx + 1] + basisU[2] * 
-		m_height[sz + 4][sx + 2] + basisU[3] * m_height[sz + 4][sx + 3] + basisU[4] * m_height[sz + 4][sx + 4]);
-	return sum;
+	const auto index = static_cast<size_t>(view);
+	if (m_tileStream) RenderTiles(commandList, index);
+	if (m_argumentCounts[index] == 0) return;
+
+	const D3D12_VERTEX_BUFFER_VIEW vertexBufferViews[]{ m_vertexBufferView, m_patchBufferView };
+	commandList->IASetPrimitiveTopology(m_primitiveTopology);
+	commandList->IASetVertexBuffers(0, _countof(vertexBufferViews), vertexBufferViews);
+	commandList->IASetIndexBuffer(&m_indexBufferView);
+	commandList->SetGraphicsRootShaderResourceView(RootParameter::TerrainTessFactors,
+		m_tessFactorBuffer->GetGPUVirtualAddress());
+	if (m_normalBuffer) {
+		commandList->SetGraphicsRootShaderResourceView(RootParameter::TerrainNormals,
+			m_normalBuffer->GetGPUVirtualAddress());
+	}
+	commandList->ExecuteIndirect(m_commandSignature.Get(), m_argumentCounts[index],
+		m_argumentBuffers[index].Get(), 0, nullptr, 0);
+}
+
+void TerrainMesh::RenderTiles(const ComPtr<ID3D12GraphicsCommandList>& commandList, size_t view) const
+{
+	// A tile keeps few runs, so they are drawn directly.
+	const UINT patchVertices = (m_patchLength + 1) * (m_patchLength + 1);
+	commandList->IASetPrimitiveTopology(m_primitiveTopology);
+	commandList->IASetIndexBuffer(&m_tileIndexBufferView);
+	for (const auto& slot : m_tileSlots) {
+		if (slot.ranges[view].empty()) continue;
+		const D3D12_VERTEX_BUFFER_VIEW vertexBufferViews[]{ slot.vertexBufferView, m_patchBufferView };
+		commandList->IASetVertexBuffers(0, _countof(vertexBufferViews), vertexBufferViews);
+		commandList->SetGraphicsRootShaderResourceView(RootParameter::TerrainTessFactors,
+			slot.tessFactorBuffer->GetGPUVirtualAddress());
+		for (const auto& range : slot.ranges[view]) {
+			commandList->DrawIndexedInstanced(range.count * patchVertices, 1, range.first * patchVertices, 0, range.first);
+		}
+	}
+}
+
+void TerrainMesh::SelectLods(TerrainView view, const XMFLOAT3& eye, FXMMATRIX objectToClip)
+{
+	const auto index = static_cast<size_t>(view);
+	m_quadtree->SelectLods(eye, Settings::TerrainLodRange, objectToClip, m_lodNodes);
+
+	// Bucketed by draw, so each draw takes one run of instances.
+	array<UINT, LodDrawCount> counts{};
+	for (const auto& node : m_lodNodes) ++counts[node.quadrant];
+	for (UINT first = 0; size_t draw : views::iota(size_t{ 0 }, LodDrawCount)) {
+		m_lodDraws[index][draw] = { first, 0 };
+		first += counts[draw];
+	}
+	for (const auto& node : m_lodNodes) {
+		auto& draw = m_lodDraws[index][node.quadrant];
+		m_lodInstances[index][draw.first + draw.count++] = LodInstance{
+			XMFLOAT3{ node.x, node.z, node.size }, XMFLOAT2{ node.morphStart, node.morphEnd } };
+	}
+}
+
+void TerrainMesh::RenderLods(const ComPtr<ID3D12GraphicsCommandList>& commandList, TerrainView view) const
+{
+	const auto index = static_cast<size_t>(view);
+	const D3D12_VERTEX_BUFFER_VIEW vertexBufferViews[]{ m_gridBufferView, m_lodInstanceBufferViews[index] };
+	commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	commandList->IASetVertexBuffers(0, _countof(vertexBufferViews), vertexBufferViews);
+	commandList->SetGraphicsRootShaderResourceView(RootParameter::TerrainHeights,
+		m_lodHeightBuffer->GetGPUVirtualAddress());
+
+	const UINT quarterVertices = m_gridVertices / 4;
+	for (UINT draw = 0; const auto& [first, count] : m_lodDraws[index]) {
+		if (count) {
+			if (draw == TerrainQuadtree::WholeNode) commandList->DrawInstanced(m_gridVertices, count, 0, first);
+			else commandList->DrawInstanced(quarterVertices, count, draw * quarterVertices, first);
+		}
+		++draw;
+	}
+}
+
+void TerrainMesh::ReleaseUploadBuffer()
+{
+	MeshBase::ReleaseUploadBuffer();
+	if (m_indexUploadBuffer) m_indexUploadBuffer.Reset();
+	if (m_tileIndexUploadBuffer) m_tileIndexUploadBuffer.Reset();
+	if (m_patchUploadBuffer) m_patchUploadBuffer.Reset();
+	if (m_normalUploadBuffer) m_normalUploadBuffer.Reset();
+	if (m_gridUploadBuffer) m_gridUploadBuffer.Reset();
+	if (m_lodHeightUploadBuffer) m_lodHeightUploadBuffer.Reset();
+}
+
+void TerrainMesh::CreateIndexBuffer(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, span<const UINT> indices)
+{
+	m_indices = static_cast<UINT>(indices.size());
+	// A terrain without patches still gets a buffer to view.
+	const UINT zero = 0;
+	const UINT size = max(m_indices, 1u) * sizeof(UINT);
+	CreateDefaultBuffer(device, commandList, m_indices ? indices.data() : &zero, size,
+		D3D12_RESOURCE_STATE_INDEX_BUFFER, m_indexBuffer, m_indexUploadBuffer);
+	m_indexBufferView.BufferLocation = m_indexBuffer->GetGPUVirtualAddress();
+	m_indexBufferView.Format = DXGI_FORMAT_R32_UINT;
+	m_indexBufferView.SizeInBytes = size;
+}
+
+void TerrainMesh::CreateIndirectBuffers(const ComPtr<ID3D12Device>& device)
+{
+	D3D12_INDIRECT_ARGUMENT_DESC argument{};
+	argument.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+	D3D12_COMMAND_SIGNATURE_DESC signatureDesc{};
+	signatureDesc.ByteStride = sizeof(D3D12_DRAW_INDEXED_ARGUMENTS);
+	signatureDesc.NumArgumentDescs = 1;
+	signatureDesc.pArgumentDescs = &argument;
+	Utiles::ThrowIfFailed(device->CreateCommandSignature(&signatureDesc, nullptr, IID_PPV_ARGS(&m_commandSignature)));
+
+	// Merged runs never outnumber the patches.
+	const UINT patches = static_cast<UINT>(m_quadtree->GetPatchOrder().size());
+	for (size_t view = 0; view < ViewCount; ++view) {
+		Utiles::ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(max(patches, 1u) * sizeof(D3D12_DRAW_INDEXED_ARGUMENTS)),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(&m_argumentBuffers[view])));
+		Utiles::ThrowIfFailed(m_argumentBuffers[view]->Map(0, nullptr, reinterpret_cast<void**>(&m_arguments[view])));
+
+		m_arguments[view][0] = D3D12_DRAW_INDEXED_ARGUMENTS{ m_indices, 1, 0, 0, 0 };
+		m_argumentCounts[view] = m_indices ? 1 : 0;
+		m_ranges[view] = { TerrainQuadtree::Range{ 0, patches } };
+	}
+}
+
+void TerrainMesh::CreatePatchBuffers(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, UINT patches)
+{
+	patches = max(patches, 1u);
+	vector<UINT> indices(patches);
+	for (UINT patch = 0; auto& index : indices) index = patch++;
+	CreateDefaultBuffer(device, commandList, indices.data(), patches * sizeof(UINT),
+		D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, m_patchBuffer, m_patchUploadBuffer);
+	m_patchBufferView.BufferLocation = m_patchBuffer->GetGPUVirtualAddress();
+	m_patchBufferView.SizeInBytes = patches * sizeof(UINT);
+	m_patchBufferView.StrideInBytes = sizeof(UINT);
+
+	// Every patch starts untessellated until the first Tessellate.
+	Utiles::ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(patches * sizeof(TerrainTessellation::PatchFactors)),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&m_tessFactorBuffer)));
+	Utiles::ThrowIfFailed(m_tessFactorBuffer->Map(0, nullptr, reinterpret_cast<void**>(&m_tessFactors)));
+	fill_n(m_tessFactors, patches, TerrainTessellation::PatchFactors{ { 1.f, 1.f, 1.f, 1.f }, { 1.f, 1.f } });
+}
+
+void TerrainMesh::CreateNormalBuffer(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, span<const UINT> normals)
+{
+	// Only a grid without samples has no texels, and it has no patches to draw either.
+	if (normals.empty()) return;
+	CreateDefaultBuffer(device, commandList, normals.data(), static_cast<UINT>(normals.size_bytes()),
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, m_normalBuffer, m_normalUploadBuffer);
+}
+
+void TerrainMesh::CreateLodBuffers(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, span<const FLOAT> heights)
+{
+	// Quads quarter by quarter (x in bit 0 of the quarter, z in bit 1), so every quarter is one run
+	// of vertices; each quad is two clockwise triangles.
+	constexpr UINT half = CdlodGrid / 2;
+	vector<GridVertex> grid;
+	for (UINT quadrant : views::iota(0u, 4u)) {
+		for (UINT z : views::iota(0u, half)) {
+			for (UINT x : views::iota(0u, half)) {
+				const FLOAT x0 = static_cast<FLOAT>((quadrant & 1) * half + x) / CdlodGrid;
+				const FLOAT z0 = static_cast<FLOAT>((quadrant >> 1) * half + z) / CdlodGrid;
+				const FLOAT x1 = x0 + 1.f / CdlodGrid, z1 = z0 + 1.f / CdlodGrid;
+				for (const XMFLOAT2& corner : { XMFLOAT2{ x0, z0 }, XMFLOAT2{ x0, z1 }, XMFLOAT2{ x1, z0 },
+					XMFLOAT2{ x1, z0 }, XMFLOAT2{ x0, z1 }, XMFLOAT2{ x1, z1 } }) {
+					grid.emplace_back(corner);
+				}
+			}
+		}
+	}
+	m_gridVertices = static_cast<UINT>(grid.size());
+	CreateDefaultBuffer(device, commandList, grid.data(), m_gridVertices * sizeof(GridVertex),
+		D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, m_gridBuffer, m_gridUploadBuffer);
+	m_gridBufferView.BufferLocation = m_gridBuffer->GetGPUVirtualAddress();
+	m_gridBufferView.SizeInBytes = m_gridVertices * sizeof(GridVertex);
+	m_gridBufferView.StrideInBytes = sizeof(GridVertex);
+
+	// The surface at level 0's vertices, which read their samples exactly; coarser levels land on
+	// samples too, and only vertices in the middle of a morph interpolate.
+	CreateDefaultBuffer(device, commandList, heights.data(), static_cast<UINT>(heights.size() * sizeof(FLOAT)),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, m_lodHeightBuffer, m_lodHeightUploadBuffer);
+
+	// Nodes and quarters never overlap and none is smaller than a patch.
+	const UINT capacity = max(static_cast<UINT>(m_quadtree->GetPatchOrder().size()), 1u);
+	for (size_t view = 0; view < ViewCount; ++view) {
+		Utiles::ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(capacity * sizeof(LodInstance)),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(&m_lodInstanceBuffers[view])));
+		Utiles::ThrowIfFailed(m_lodInstanceBuffers[view]->Map(0, nullptr, reinterpret_cast<void**>(&m_lodInstances[view])));
+
+		m_lodInstanceBufferViews[view].BufferLocation = m_lodInstanceBuffers[view]->GetGPUVirtualAddress();
+		m_lodInstanceBufferViews[view].SizeInBytes = capacity * sizeof(LodInstance);
+		m_lodInstanceBufferViews[view].StrideInBytes = sizeof(LodInstance);
+		m_lodDraws[view] = {};
+	}
+}
+
+void TerrainMesh::CreateDefaultBuffer(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, const void* data, UINT size,
+	D3D12_RESOURCE_STATES state, ComPtr<ID3D12Resource>& buffer, ComPtr<ID3D12Resource>& uploadBuffer)
+{
+	Utiles::ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&buffer)));
+
+	Utiles::ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&uploadBuffer)));
+
+	D3D12_SUBRESOURCE_DATA subresourceData{};
+	subresourceData.pData = data;
+	subresourceData.RowPitch = size;
+	subresourceData.SlicePitch = subresourceData.RowPitch;
+	UpdateSubresources<1>(commandList.Get(), buffer.Get(), uploadBuffer.Get(), 0, 0, 1, &subresourceData);
+
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(buffer.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, state));
 }
@@ -1,6 +1,15 @@
 #pragma once
 #include "stdafx.h"
 #include "vertex.h"
+#include "../Common/assetpack.h"
+#include "../Common/heightfield.h"
+#include "../Common/heightpyramid.h"
+#include "../Common/terrainnormals.h"
+#include "../Common/terrainpackage.h"
+#include "../Common/terrainpatches.h"
+#include "../Common/terrainquadtree.h"
+#include "../Common/terraintessellation.h"
+#include "../Common/terraintiles.h"
 
 class MeshBase abstract
 {
@@ -11,6 +20,12 @@ public:
 	virtual void Render(const ComPtr<ID3D12GraphicsCommandList>& commandList, size_t count = 1) const;
 	virtual void ReleaseUploadBuffer();
 
+protected:
+	// Element count written as text by the Exporter, immediately followed by the raw elements.
+	static UINT ReadCount(span<const std::byte> data, size_t& offset);
+	template <typename E>
+	static span<const E> ReadElements(span<const std::byte> data, size_t& offset, UINT count);
+
 protected:
 	UINT						m_vertices;
 	ComPtr<ID3D12Resource>		m_vertexBuffer;
@@ -20,6 +35,15 @@ protected:
 	D3D12_PRIMITIVE_TOPOLOGY	m_primitiveTopology;
 };
 
+template <typename E>
+inline span<const E> MeshBase::ReadElements(span<const std::byte> data, size_t& offset, UINT count)
+{
+	if (data.size() - offset < static_cast<size_t>(count) * sizeof(E)) throw runtime_error{ "mesh: truncated file" };
+	const E* elements = reinterpret_cast<const E*>(data.data() + offset);
+	offset += static_cast<size_t>(count) * sizeof(E);
+	return { elements, count };
+}
+
 template <typename T> requires derived_from<T, VertexBase>
 class Mesh : public MeshBase
 {
@@ -35,7 +59,7 @@ protected:
 		const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName);
 
 	void CreateVertexBuffer(const ComPtr<ID3D12Device>& device,
-		const ComPtr<ID3D12GraphicsCommandList>& commandList, const vector<T>& vertices);
+		const ComPtr<ID3D12GraphicsCommandList>& commandList, span<const T> vertices);
 };
 
 template<typename T> requires derived_from<T, VertexBase>
@@ -51,21 +75,18 @@ template<typename T> requires derived_from<T, VertexBase>
 inline void Mesh<T>::LoadMesh(const ComPtr<ID3D12Device>& device,
 	const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName)
 {
-	ifstream in(fileName, ios::binary);
+	const AssetData asset = Assets::Load(fileName);
+	size_t offset = 0;
 
-	UINT vertexNum;
-	in >> vertexNum;
-
-	vector<T> vertices;
-	vertices.resize(vertexNum);
-	in.read(reinterpret_cast<char*>(vertices.data()), vertexNum * sizeof(T));
+	const UINT vertexNum = ReadCount(asset.GetData(), offset);
+	const auto vertices = ReadElements<T>(asset.GetData(), offset, vertexNum);
 
 	CreateVertexBuffer(device, commandList, vertices);
 }
 
 template<typename T> requires derived_from<T, VertexBase>
 inline void Mesh<T>::CreateVertexBuffer(const ComPtr<ID3D12Device>& device, 
-	const ComPtr<ID3D12GraphicsCommandList>& commandList, const vector<T>& vertices)
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, span<const T> vertices)
 {
 	m_vertices = static_cast<UINT>(vertices.size());
 	const UINT vertexBufferSize = m_vertices * sizeof(T);
@@ -119,7 +140,7 @@ protected:
 		const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName) override;
 
 	void CreateIndexBuffer(const ComPtr<ID3D12Device>& device,
-		const ComPtr<ID3D12GraphicsCommandList>& commandList, const vector<UINT>& indices);
+		const ComPtr<ID3D12GraphicsCommandList>& commandList, span<const UINT> indices);
 
 protected:
 	UINT						m_indices;
@@ -157,21 +178,14 @@ template<typename T> requires derived_from<T, VertexBase>
 inline void IndexMesh<T>::LoadMesh(const ComPtr<ID3D12Device>& device, 
 	const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName)
 {
-	ifstream in(fileName, ios::binary);
-
-	UINT vertexNum;
-	in >> vertexNum;
-
-	vector<T> vertices;
-	vertices.resize(vertexNum);
-	in.read(reinterpret_cast<char*>(vertices.data()), vertexNum * sizeof(T));
+	const AssetData asset = Assets::Load(fileName);
+	size_t offset = 0;
 
-	UINT indiceNum;
-	in >> indiceNum;
+	const UINT vertexNum = this->ReadCount(asset.GetData(), offset);
+	const auto vertices = this->template ReadElements<T>(asset.GetData(), offset, vertexNum);
 
-	vector<UINT> indices;
-	indices.resize(indiceNum);
-	in.read(reinterpret_cast<char*>(indices.data()), indiceNum * sizeof(UINT));
+	const UINT indiceNum = this->ReadCount(asset.GetData(), offset);
+	const auto indices = this->template ReadElements<UINT>(asset.GetData(), offset, indiceNum);
 
 	CreateVertexBuffer(device, commandList, vertices);
 	CreateIndexBuffer(device, commandList, indices);
@@ -179,7 +193,7 @@ inline void IndexMesh<T>::LoadMesh(const ComPtr<ID3D12Device>& device,
 
 template<typename T> requires derived_from<T, VertexBase>
 inline void IndexMesh<T>::CreateIndexBuffer(const ComPtr<ID3D12Device>& device, 
-	const ComPtr<ID3D12GraphicsCommandList>& commandList, const vector<UINT>& indices)
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, span<const UINT> indices)
 {
 	m_indices = static_cast<UINT>(indices.size());
 	const UINT indexBufferSize = m_indices * sizeof(UINT);
@@ -214,6 +228,9 @@ inline void IndexMesh<T>::CreateIndexBuffer(const ComPtr<ID3D12Device>& device,
 	m_indexBufferView.SizeInBytes = indexBufferSize;
 }
 
+// The frustums the terrain is culled against every frame.
+enum class TerrainView : UINT { Camera, Light, Count };
+
 class TerrainMesh : public Mesh<TerrainVertex>
 {
 public:
@@ -221,19 +238,170 @@ public:
 		const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName);
 	~TerrainMesh() override = default;
 
-	FLOAT GetHeight(FLOAT x, FLOAT z);
+	// Keeps the patches of `view` that the frustum of `objectToClip` (mesh to clip space) may
+	// see. Render draws them with one indirect indexed draw per run of the index buffer, and every
+	// patch until the view is first culled; a streamed map draws its overview only where no tile
+	// is resident once culled, so it must be culled every frame.
+	void Cull(TerrainView view, FXMMATRIX objectToClip);
+
+	// Chooses the tessellation factors of the camera's patches for an eye at `eye` (mesh space),
+	// keeping the surface within Settings::TerrainPixelError pixels; `pixelsPerUnit` is the projected
+	// size of one unit at distance 1. The hull shader only reads them.
+	void Tessellate(const XMFLOAT3& eye, FLOAT pixelsPerUnit);
+	// Every patch, as the camera's pipeline expects them. With Settings::TerrainNormalMap the pixel
+	// shader reads the normal map from RootParameter::TerrainNormals.
+	void Render(const ComPtr<ID3D12GraphicsCommandList>& commandList, size_t count = 1) const override;
+	void Render(const ComPtr<ID3D12GraphicsCommandList>& commandList, TerrainView view) const;
+
+	// The CDLOD path: a grid of CdlodGrid x CdlodGrid quads over every node SelectLods keeps for
+	// `view`, displaced in the vertex shader by heights baked at level 0's vertex spacing. `eye`
+	// (mesh space) picks the levels and `objectToClip` culls. RenderLods draws the nodes instanced,
+	// once per quarter of the grid and once for whole nodes.
+	static constexpr UINT CdlodGrid = 8;
+	void SelectLods(TerrainView view, const XMFLOAT3& eye, FXMMATRIX objectToClip);
+	void RenderLods(const ComPtr<ID3D12GraphicsCommandList>& commandList, TerrainView view) const;
+
+	void ReleaseUploadBuffer() override;
+
+	// A tiled height map on disk, which the mesh streams instead of loading whole. A streamed map
+	// draws each resident tile from its own buffers and a coarse mesh of the overview elsewhere; it
+	// has no whole grid, so no normal map and no CDLOD path.
+	static BOOL IsStreamed(const wstring& fileName);
+	BOOL IsStreamed() const { return m_tileStream != nullptr; }
+	// Streams the tiles of a streamed map around (x, z) (mesh space) and uploads the ones that
+	// arrived; nothing for other maps.
+	void StreamTiles(FLOAT x, FLOAT z);
+
+	// A streamed map answers from its resident tiles, and from its overview beyond them.
+	FLOAT GetHeight(FLOAT x, FLOAT z) const;
+	void GetHeights(span<const XMFLOAT2> points, span<FLOAT> heights) const;
+	// Ray queries in mesh space; see HeightPyramid::Intersect.
+	FLOAT Intersect(const HeightPyramid::Ray& ray) const;
+	void Intersect(span<const HeightPyramid::Ray> rays, span<FLOAT> distances) const;
+	INT GetLength() const { return m_length; }
+	INT GetPatchLength() const { return m_patchLength; }
 
 private:
 	void LoadMesh(const ComPtr<ID3D12Device>& device,
 		const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName) override;
 
-	void CreatePatch(vector<TerrainVertex>& vertices, INT zStart, INT zEnd, INT xStart, INT xEnd);
-
-	void BernsteinBasis(FLOAT t, FLOAT* basis);
-	FLOAT GetBezierSumHeight(INT sx, INT sz, FLOAT* basisU, FLOAT* basisV);
+	// Everything drawn and queried from `heights`, m_length rows of m_length.
+	void CreateGrid(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12GraphicsCommandList>& commandList,
+		vector<FLOAT> heights);
+	// A streamed map's grid is its overview, resampled to whole patches per tile; the tiles get
+	// buffers per slot, filled as they arrive.
+	void CreateOverview(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12GraphicsCommandList>& commandList);
+	void CreateTileSlots(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12GraphicsCommandList>& commandList);
+	void UpdateTileSlots();
+	// Raises the factors of edges that resident tiles share to the larger side's, so they meet
+	// without cracks.
+	void MatchTileEdges();
+	void RenderTiles(const ComPtr<ID3D12GraphicsCommandList>& commandList, size_t view) const;
+	FLOAT IntersectTiles(const HeightPyramid::Ray& ray) const;
+	void CreateIndexBuffer(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12GraphicsCommandList>& commandList,
+		span<const UINT> indices);
+	void CreateIndirectBuffers(const ComPtr<ID3D12Device>& device);
+	// Patch indices 0 to `patches` - 1 and factors for as many patches.
+	void CreatePatchBuffers(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12GraphicsCommandList>& commandList,
+		UINT patches);
+	// `normals` are TerrainNormals::Bake's, at any texels per cell.
+	void CreateNormalBuffer(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12GraphicsCommandList>& commandList,
+		span<const UINT> normals);
+	// `heights` are TerrainPatches::GetLodHeights' at CdlodGrid / m_patchLength samples per cell.
+	void CreateLodBuffers(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12GraphicsCommandList>& commandList,
+		span<const FLOAT> heights);
+	static void CreateDefaultBuffer(const ComPtr<ID3D12Device>& device,
+		const ComPtr<ID3D12GraphicsCommandList>& commandList, const void* data, UINT size,
+		D3D12_RESOURCE_STATES state, ComPtr<ID3D12Resource>& buffer, ComPtr<ID3D12Resource>& uploadBuffer);
 
 private:
-	vector<vector<FLOAT>> m_height;
+	static constexpr size_t ViewCount = static_cast<size_t>(TerrainView::Count);
+	// The four quarters of the grid, then whole nodes.
+	static constexpr size_t LodDrawCount = TerrainQuadtree::WholeNode + 1;
+
+	struct LodInstance
+	{
+		XMFLOAT3 node;		// Low corner x, z and size.
+		XMFLOAT2 morph;		// TerrainQuadtree::LodNode's morphStart and morphEnd.
+	};
+
+	// The tile a slot of the stream holds, drawn and queried on its own. Its quadtree and
+	// tessellation see the tile centred on `centre`; its vertices are already in mesh space.
+	struct TileSlot
+	{
+		UINT tile = TerrainTileCache::NoSlot;
+		XMFLOAT3 centre{};
+		unique_ptr<TerrainQuadtree> quadtree;
+		unique_ptr<TerrainTessellation> tessellation;
+		unique_ptr<HeightPyramid> heightPyramid;
+		array<vector<TerrainQuadtree::Range>, ViewCount> ranges;
+		// Upload buffers mapped for the mesh's lifetime, rewritten when another tile arrives.
+		ComPtr<ID3D12Resource> vertexBuffer;
+		TerrainVertex* vertices = nullptr;
+		D3D12_VERTEX_BUFFER_VIEW vertexBufferView{};
+		ComPtr<ID3D12Resource> tessFactorBuffer;
+		TerrainTessellation::PatchFactors* tessFactors = nullptr;
+	};
+
+	unique_ptr<Heightfield> m_heightfield;
+	unique_ptr<TerrainQuadtree> m_quadtree;
+	unique_ptr<TerrainTessellation> m_tessellation;
+	unique_ptr<HeightPyramid> m_heightPyramid;
+	// Null unless the map is streamed, when the grid above is the overview's: its x and z are
+	// scaled by m_overviewScale and moved by m_overviewOffset into mesh space, and each tile's
+	// patches are an aligned run of m_overviewTilePatches squared in the quadtree's order.
+	unique_ptr<IoQueue> m_tileQueue;
+	unique_ptr<TerrainTileStream> m_tileStream;
+	FLOAT m_overviewScale;
+	FLOAT m_overviewOffset;
+	UINT m_overviewTilePatches;
+	vector<TerrainQuadtree::Range> m_overviewRanges;
+	vector<TileSlot> m_tileSlots;
+	// Every tile's patches share one order, so one index buffer; m_tilePatchPlaces finds patch
+	// (x, z)'s place in it at z * side + x.
+	ComPtr<ID3D12Resource> m_tileIndexBuffer;
+	ComPtr<ID3D12Resource> m_tileIndexUploadBuffer;
+	D3D12_INDEX_BUFFER_VIEW m_tileIndexBufferView;
+	vector<UINT> m_tilePatchPlaces;
+
+	// The vertex buffer holds the grid's samples once; patch i's 25 control points are indices
+	// i * 25 onwards, in the quadtree's order.
+	UINT m_indices;
+	ComPtr<ID3D12Resource> m_indexBuffer;
+	ComPtr<ID3D12Resource> m_indexUploadBuffer;
+	D3D12_INDEX_BUFFER_VIEW m_indexBufferView;
+
+	// Draw arguments of every view in upload buffers mapped for the mesh's lifetime.
+	ComPtr<ID3D12CommandSignature> m_commandSignature;
+	array<ComPtr<ID3D12Resource>, ViewCount> m_argumentBuffers;
+	array<D3D12_DRAW_INDEXED_ARGUMENTS*, ViewCount> m_arguments;
+	array<UINT, ViewCount> m_argumentCounts;
+	array<vector<TerrainQuadtree::Range>, ViewCount> m_ranges;
+
+	// Every patch's index, one per instance; each indirect draw starts its instances at its first
+	// patch, so the hull shader finds the patch's factors even though SV_PrimitiveID restarts per draw.
+	ComPtr<ID3D12Resource> m_patchBuffer;
+	ComPtr<ID3D12Resource> m_patchUploadBuffer;
+	D3D12_VERTEX_BUFFER_VIEW m_patchBufferView;
+	// The camera's factors, in an upload buffer mapped for the mesh's lifetime.
+	ComPtr<ID3D12Resource> m_tessFactorBuffer;
+	TerrainTessellation::PatchFactors* m_tessFactors;
+	// Null without Settings::TerrainNormalMap.
+	ComPtr<ID3D12Resource> m_normalBuffer;
+	ComPtr<ID3D12Resource> m_normalUploadBuffer;
+
+	UINT m_gridVertices;
+	ComPtr<ID3D12Resource> m_gridBuffer;
+	ComPtr<ID3D12Resource> m_gridUploadBuffer;
+	D3D12_VERTEX_BUFFER_VIEW m_gridBufferView;
+	ComPtr<ID3D12Resource> m_lodHeightBuffer;
+	ComPtr<ID3D12Resource> m_lodHeightUploadBuffer;
+	// Node instances of every view, bucketed by draw, in upload buffers mapped for the mesh's lifetime.
+	array<ComPtr<ID3D12Resource>, ViewCount> m_lodInstanceBuffers;
+	array<D3D12_VERTEX_BUFFER_VIEW, ViewCount> m_lodInstanceBufferViews;
+	array<LodInstance*, ViewCount> m_lodInstances;
+	array<array<TerrainQuadtree::Range, LodDrawCount>, ViewCount> m_lodDraws;
+	vector<TerrainQuadtree::LodNode> m_lodNodes;
 	INT m_length;
 	INT m_patchLength;
 };
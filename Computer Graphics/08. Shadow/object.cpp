@@ -115,7 +115,7 @@ void RotatingObject::Update(FLOAT timeElapsed)
 }
 
 Terrain::Terrain(const ComPtr<ID3D12Device>& device) : 
-	GameObject(device)
+	GameObject(device), m_cdlod{ Settings::TerrainCdlod }
 {
 }
 
@@ -123,7 +123,91 @@ FLOAT Terrain::GetHeight(FLOAT x, FLOAT z)
 {
 	const XMFLOAT3 position = GetPosition();
 	return static_pointer_cast<TerrainMesh>(m_mesh)->
-		GetHeight(x - position.x, z - position.z) + position.y + 0.3f;
+		GetHeight(x - position.x, z - position.z) + position.y;
+}
+
+void Terrain::GetHeights(span<const XMFLOAT2> points, span<FLOAT> heights)
+{
+	const XMFLOAT3 position = GetPosition();
+	vector<XMFLOAT2> local(points.begin(), points.end());
+	for (auto& point : local) {
+		point.x -= position.x;
+		point.y -= position.z;
+	}
+	static_pointer_cast<TerrainMesh>(m_mesh)->GetHeights(local, heights);
+	for (auto& height : heights.first(points.size())) height += position.y;
+}
+
+void Terrain::StreamTiles(const XMFLOAT3& eye)
+{
+	const XMFLOAT3 position = GetPosition();
+	static_pointer_cast<TerrainMesh>(m_mesh)->StreamTiles(eye.x - position.x, eye.z - position.z);
+}
+
+FLOAT Terrain::Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, FLOAT maxDistance)
+{
+	const XMFLOAT3 position = GetPosition();
+	const HeightPyramid::Ray ray{ XMFLOAT3{ origin.x - position.x, origin.y - position.y, origin.z - position.z },
+		direction, maxDistance };
+	return static_pointer_cast<TerrainMesh>(m_mesh)->Intersect(ray);
+}
+
+BOOL Terrain::IsVisible(const XMFLOAT3& from, const XMFLOAT3& to)
+{
+	const XMFLOAT3 position = GetPosition();
+	const HeightPyramid::Ray ray{ XMFLOAT3{ from.x - position.x, from.y - position.y, from.z - position.z },
+		XMFLOAT3{ to.x - from.x, to.y - from.y, to.z - from.z }, 1.f };
+	return static_pointer_cast<TerrainMesh>(m_mesh)->Intersect(ray) == HeightPyramid::Miss;
+}
+
+BOOL Terrain::GetCdlod() const
+{
+	return m_cdlod && !IsStreamed();
+}
+
+BOOL Terrain::IsStreamed() const
+{
+	return static_pointer_cast<TerrainMesh>(m_mesh)->IsStreamed();
+}
+
+void Terrain::Cull(const XMFLOAT3& eye, FXMMATRIX cameraViewProjection, CXMMATRIX lightViewProjection)
+{
+	const XMMATRIX worldMatrix = XMLoadFloat4x4(&m_worldMatrix);
+	const auto mesh = static_pointer_cast<TerrainMesh>(m_mesh);
+	if (GetCdlod()) {
+		// The shadow map takes the camera's levels, so it holds the surface the camera sees.
+		XMFLOAT3 localEye;
+		XMStoreFloat3(&localEye, XMVector3TransformCoord(XMLoadFloat3(&eye), XMMatrixInverse(nullptr, worldMatrix)));
+		mesh->SelectLods(TerrainView::Camera, localEye, worldMatrix * cameraViewProjection);
+		mesh->SelectLods(TerrainView::Light, localEye, worldMatrix * lightViewProjection);
+		return;
+	}
+	mesh->Cull(TerrainView::Camera, worldMatrix * cameraViewProjection);
+	mesh->Cull(TerrainView::Light, worldMatrix * lightViewProjection);
+}
+
+void Terrain::Tessellate(const XMFLOAT3& eye, FLOAT pixelsPerUnit)
+{
+	XMFLOAT3 localEye;
+	XMStoreFloat3(&localEye, XMVector3TransformCoord(XMLoadFloat3(&eye),
+		XMMatrixInverse(nullptr, XMLoadFloat4x4(&m_worldMatrix))));
+	static_pointer_cast<TerrainMesh>(m_mesh)->Tessellate(localEye, pixelsPerUnit);
+}
+
+void Terrain::Render(const ComPtr<ID3D12GraphicsCommandList>& commandList) const
+{
+	UpdateShaderVariable(commandList);
+	const auto mesh = static_pointer_cast<TerrainMesh>(m_mesh);
+	if (GetCdlod()) mesh->RenderLods(commandList, TerrainView::Camera);
+	else mesh->Render(commandList, TerrainView::Camera);
+}
+
+void Terrain::RenderShadow(const ComPtr<ID3D12GraphicsCommandList>& commandList) const
+{
+	UpdateShaderVariable(commandList);
+	const auto mesh = static_pointer_cast<TerrainMesh>(m_mesh);
+	if (GetCdlod()) mesh->RenderLods(commandList, TerrainView::Light);
+	else mesh->Render(commandList, TerrainView::Light);
 }
 
 LightObject::LightObject(const shared_ptr<SpotLight>& light) : 
@@ -103,6 +103,31 @@ public:
 	~Terrain() override = default;
 
 	FLOAT GetHeight(FLOAT x, FLOAT z);
+	void GetHeights(span<const XMFLOAT2> points, span<FLOAT> heights);
+	// The distance along `direction` (a unit vector) to the surface within `maxDistance`, or
+	// HeightPyramid::Miss.
+	FLOAT Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, FLOAT maxDistance);
+	// Whether the segment between two points clears the surface.
+	BOOL IsVisible(const XMFLOAT3& from, const XMFLOAT3& to);
+	// Streams the height map's tiles around `eye`; see TerrainMesh::StreamTiles.
+	void StreamTiles(const XMFLOAT3& eye);
+
+	// Draws CDLOD grids instead of tessellated patches; see TerrainMesh::SelectLods. A streamed
+	// map always draws patches.
+	void SetCdlod(BOOL cdlod) { m_cdlod = cdlod; }
+	BOOL GetCdlod() const;
+	BOOL IsStreamed() const;
+
+	// Culls the patches, or selects the CDLOD nodes around `eye`, for the camera and the shadow
+	// map; Render and RenderShadow draw what each of them may see.
+	void Cull(const XMFLOAT3& eye, FXMMATRIX cameraViewProjection, CXMMATRIX lightViewProjection);
+	// Chooses the patches' tessellation factors for the camera at `eye`; see TerrainMesh::Tessellate.
+	void Tessellate(const XMFLOAT3& eye, FLOAT pixelsPerUnit);
+	void Render(const ComPtr<ID3D12GraphicsCommandList>& commandList) const override;
+	void RenderShadow(const ComPtr<ID3D12GraphicsCommandList>& commandList) const;
+
+private:
+	BOOL m_cdlod;
 };
 
 class Sun : public InstanceObject
@@ -112,6 +137,7 @@ public:
 	~Sun() override = default;
 
 	void SetStrength(XMFLOAT3 strength);
+	const shared_ptr<DirectionalLight>& GetLight() const { return m_light; }
 
 	void Update(FLOAT timeElapsed) override;
 
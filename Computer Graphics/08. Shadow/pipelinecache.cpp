@@ -0,0 +1,121 @@
+#include "pipelinecache.h"
+#include "../Common/pipelinehash.h"
+
+namespace
+{
+	wstring GetPipelineName(UINT64 key)
+	{
+		WCHAR name[17];
+		swprintf_s(name, L"%016llx", key);
+		return name;
+	}
+}
+
+PipelineCache::PipelineCache(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12RootSignature>& rootSignature,
+	const ComPtr<ID3DBlob>& rootSignatureBlob, const filesystem::path& fileName) :
+	m_device{ device }, m_rootSignature{ rootSignature }, m_fileName{ fileName }, m_storedCount{ 0 }, m_savedCount{ 0 },
+	m_dirty{ FALSE }
+{
+	m_seed = PipelineHash::HashBytes(rootSignatureBlob->GetBufferPointer(), rootSignatureBlob->GetBufferSize());
+
+	if (SUCCEEDED(m_device.As(&m_libraryDevice))) OpenLibrary();
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	if (desc.pRootSignature != m_rootSignature.Get()) Utiles::ThrowIfFailed(E_INVALIDARG);
+
+	const UINT64 key = PipelineHash::Hash(desc, m_seed);
+	{
+		lock_guard lock{ m_mutex };
+		if (const auto it = m_pipelines.find(key); it != m_pipelines.end()) {
+			++m_statistics.shared;
+			return it->second;
+		}
+	}
+
+	// The library compares the description with the stored one, so a collision cannot load a
+	// wrong pipeline; it is created instead.
+	const wstring name = GetPipelineName(key);
+	ComPtr<ID3D12PipelineState> pipelineState;
+	BOOL loaded = m_previousLibrary &&
+		SUCCEEDED(m_previousLibrary->LoadGraphicsPipeline(name.c_str(), &desc, IID_PPV_ARGS(&pipelineState)));
+	if (!loaded) {
+		Utiles::ThrowIfFailed(m_device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pipelineState)));
+	}
+
+	lock_guard lock{ m_mutex };
+	const auto [it, inserted] = m_pipelines.emplace(key, pipelineState);
+	if (!inserted) {
+		++m_statistics.shared;
+		return it->second;
+	}
+	if (loaded) ++m_statistics.loaded;
+	else ++m_statistics.created;
+	// Fails when the name is taken by a mismatching pipeline; that one simply stays uncached.
+	if (m_library && SUCCEEDED(m_library->StorePipeline(name.c_str(), pipelineState.Get()))) {
+		++m_storedCount;
+		if (!loaded) m_dirty = TRUE;
+	}
+	return pipelineState;
+}
+
+void PipelineCache::Save()
+{
+	lock_guard lock{ m_mutex };
+	if (!m_library || (!m_dirty && m_storedCount == m_savedCount)) return;
+
+	const FileHeader header{ FileMagic, 2, m_library->GetSerializedSize(), m_storedCount };
+	vector<BYTE> data(sizeof(header) + header.size);
+	memcpy(data.data(), &header, sizeof(header));
+	if (FAILED(m_library->Serialize(data.data() + sizeof(header), header.size))) return;
+
+	// Written under a temporary name first, so an interrupted save leaves the previous file.
+	filesystem::path temporary = m_fileName;
+	temporary += TEXT(".tmp");
+	error_code error;
+	filesystem::create_directories(m_fileName.parent_path(), error);
+	{
+		ofstream out{ temporary, ios::binary | ios::trunc };
+		out.write(reinterpret_cast<const char*>(data.data()), static_cast<streamsize>(data.size()));
+	}
+	filesystem::rename(temporary, m_fileName, error);
+	if (error) {
+		filesystem::remove(temporary, error);
+		return;
+	}
+	m_savedCount = m_storedCount;
+	m_dirty = FALSE;
+}
+
+PipelineCache::Statistics PipelineCache::GetStatistics() const
+{
+	lock_guard lock{ m_mutex };
+	return m_statistics;
+}
+
+void PipelineCache::OpenLibrary()
+{
+	ifstream in{ m_fileName, ios::binary };
+	FileHeader header{};
+	if (in.read(reinterpret_cast<char*>(&header), sizeof(header)) && header.magic == FileMagic && header.version == 2) {
+		m_previousData.resize(static_cast<size_t>(header.size));
+		if (!in.read(reinterpret_cast<char*>(m_previousData.data()), static_cast<streamsize>(header.size))) {
+			m_previousData.clear();
+		}
+	}
+
+	// The driver refuses a library from another driver version or adapter; start over then.
+	if (!m_previousData.empty()) m_previousLibrary = CreateLibrary(m_previousData);
+	if (m_previousLibrary) m_savedCount = header.pipelineCount;
+	else m_previousData.clear();
+	m_library = CreateLibrary({});
+}
+
+ComPtr<ID3D12PipelineLibrary> PipelineCache::CreateLibrary(span<const BYTE> data) const
+{
+	// Also fails where pipeline libraries are unsupported, which leaves only the in-process sharing.
+	ComPtr<ID3D12PipelineLibrary> library;
+	if (FAILED(m_libraryDevice->CreatePipelineLibrary(data.data(), data.size(), IID_PPV_ARGS(&library)))) return nullptr;
+	return library;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "stdafx.h"
+
+// Graphics pipeline states keyed by a hash of everything their description points to: shader
+// bytecode, input layout, fixed-function state and formats (see PipelineHash). Identical descriptions share one
+// pipeline within a run, and pipelines are kept in an ID3D12PipelineLibrary saved between runs.
+// The driver rejects a library written by another driver or adapter, and edited shaders change
+// the key, so stale pipelines are never loaded. Each run stores the pipelines it loads or creates
+// in a fresh library, so Save drops the ones no longer requested instead of piling them up.
+class PipelineCache
+{
+public:
+	struct Statistics
+	{
+		UINT	loaded = 0;			// From the library on disk.
+		UINT	created = 0;
+		UINT	shared = 0;			// Same description as an earlier request this run.
+	};
+
+	// Serves pipelines of `rootSignature` only; `rootSignatureBlob` is its serialized form, hashed
+	// into every key so a changed root signature misses too.
+	PipelineCache(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12RootSignature>& rootSignature,
+		const ComPtr<ID3DBlob>& rootSignatureBlob, const filesystem::path& fileName);
+	~PipelineCache() = default;
+
+	// Thread-safe.
+	ComPtr<ID3D12PipelineState> CreateGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+
+	// Writes this run's pipelines when one was created or the file holds others; a failed write
+	// keeps the previous file. Safe to call again later in the run, and at shutdown.
+	void Save();
+
+	Statistics GetStatistics() const;
+
+private:
+	struct FileHeader
+	{
+		UINT32	magic;
+		UINT32	version;
+		UINT64	size;				// Bytes of serialized library that follow.
+		UINT64	pipelineCount;
+	};
+	static constexpr UINT32 FileMagic = 0x4C4F5350; // "PSOL"
+
+	void OpenLibrary();
+	ComPtr<ID3D12PipelineLibrary> CreateLibrary(span<const BYTE> data) const;
+
+private:
+	ComPtr<ID3D12Device>								m_device;
+	ComPtr<ID3D12Device1>								m_libraryDevice;	// Null before Windows 10 1709.
+	ComPtr<ID3D12RootSignature>							m_rootSignature;
+	UINT64												m_seed;
+	filesystem::path									m_fileName;
+
+	// The previous run's library reads from this memory for as long as it exists.
+	vector<BYTE>										m_previousData;
+	ComPtr<ID3D12PipelineLibrary>						m_previousLibrary;
+	ComPtr<ID3D12PipelineLibrary>						m_library;			// What Save writes.
+
+	mutable mutex										m_mutex;
+	unordered_map<UINT64, ComPtr<ID3D12PipelineState>>	m_pipelines;
+	UINT64												m_storedCount;		// In m_library.
+	UINT64												m_savedCount;		// In the file.
+	BOOL												m_dirty;			// A pipeline the file lacks was stored.
+	Statistics											m_statistics;
+};
@@ -2,7 +2,7 @@
 #include "stdafx.h"
 #include "framework.h"
 
-Scene::Scene()
+Scene::Scene() : m_virtualTexturing{ FALSE }
 {
 }
 
@@ -44,6 +44,37 @@ void Scene::Update(FLOAT timeElapsed)
 		object->Update(timeElapsed);
 	}
 	m_skybox->SetPosition(m_camera->GetEye());
+	m_terrain->StreamTiles(m_camera->GetEye());
+	// The CDLOD grids need their nodes every frame, and a streamed map's overview must leave out
+	// its resident tiles; other patches are only culled to save work.
+	if (Settings::TerrainCulling || m_terrain->GetCdlod() || m_terrain->IsStreamed()) {
+		m_terrain->Cull(m_camera->GetEye(), m_camera->GetViewProjectionMatrix(),
+			m_sun->GetLight()->GetViewProjectionMatrix());
+	}
+	if (!m_terrain->GetCdlod()) {
+		m_terrain->Tessellate(m_camera->GetEye(), MipStreaming::GetPixelsPerUnit(
+			1.f, Settings::CameraFovY, static_cast<FLOAT>(g_framework->GetWindowHeight())));
+	}
+
+	// The permutations were built with the scene, so this only swaps pipelines. The DXIL set holds
+	// the generic programs only, whose wave-uniform light loops stand in for the unrolled permutations.
+	if (!m_shaderCache->UsesDxil()) {
+		const auto permutation = LightingPermutation::Select(m_lightSystem->GetLightNum(), Settings::ShadowPcfKernel);
+		for (const auto& shader : { m_objectShader, m_terrainShader, m_cdlodShader, m_billboardShader }) {
+			static_pointer_cast<LitShader>(m_shaders.Get(shader))->SetPermutation(permutation);
+		}
+	}
+
+	RequestTextureMips();
+}
+
+void Scene::UpdateTextureStreaming(const ComPtr<ID3D12GraphicsCommandList>& commandList)
+{
+	if (m_virtualTexture) m_virtualTexture->Update(commandList);
+	if (!m_textureStreamer) return;
+
+	m_textureStreamer->Update(commandList);
+	m_textures.ForEach([](const auto& texture) { texture->UpdateResidency(); });
 }
 
 void Scene::PreProcess(const ComPtr<ID3D12GraphicsCommandList>& commandList) const
@@ -52,13 +83,13 @@ void Scene::PreProcess(const ComPtr<ID3D12GraphicsCommandList>& commandList) con
 	m_lightSystem->UpdateShaderVariable(commandList);
 	m_shadowMap->UpdateShaderVariable(commandList);
 
-	m_shaders.at("OBJECTSHADOW")->UpdateShaderVariable(commandList);
+	m_shaders.Get(m_objectShadowShader)->UpdateShaderVariable(commandList);
 	m_instanceObject->Render(commandList);
 
-	m_shaders.at("TERRAINSHADOW")->UpdateShaderVariable(commandList);
-	m_terrain->Render(commandList);
+	m_shaders.Get(m_terrain->GetCdlod() ? m_cdlodShadowShader : m_terrainShadowShader)->UpdateShaderVariable(commandList);
+	m_terrain->RenderShadow(commandList);
 
-	m_shaders.at("BILLBOARDSHADOW")->UpdateShaderVariable(commandList);
+	m_shaders.Get(m_billboardShadowShader)->UpdateShaderVariable(commandList);
 	m_instanceBillboard->Render(commandList);
 
 	m_shadowMap->Close(commandList);
@@ -66,124 +97,297 @@ void Scene::PreProcess(const ComPtr<ID3D12GraphicsCommandList>& commandList) con
 
 void Scene::Render(const ComPtr<ID3D12GraphicsCommandList>& commandList) const
 {
-	m_shaders.at("OBJECT")->UpdateShaderVariable(commandList);
+	m_shaders.Get(m_objectShader)->UpdateShaderVariable(commandList);
 	m_instanceObject->Render(commandList);
 
-	m_shaders.at("TERRAIN")->UpdateShaderVariable(commandList);
+	m_shaders.Get(m_terrain->GetCdlod() ? m_cdlodShader : m_terrainShader)->UpdateShaderVariable(commandList);
 	m_terrain->Render(commandList);
+	if (m_virtualTexture) m_virtualTexture->ResolveFeedback(commandList);
 
-	m_shaders.at("BILLBOARD")->UpdateShaderVariable(commandList);
+	m_shaders.Get(m_billboardShader)->UpdateShaderVariable(commandList);
 	m_instanceBillboard->Render(commandList);
 
-	m_shaders.at("SKYBOX")->UpdateShaderVariable(commandList);
+	m_shaders.Get(m_skyboxShader)->UpdateShaderVariable(commandList);
 	m_skybox->Render(commandList);
 }
 
+// The exporter's packed array when there is one, otherwise the loose files stacked at load time.
+static vector<wstring> GetGrassTextureFiles()
+{
+	if (Assets::Exists(AssetPath::GrassArray)) return { AssetPath::GrassArray };
+	return { AssetPath::Grass01, AssetPath::Grass02, AssetPath::Grass03, AssetPath::Grass04 };
+}
+
+// The exporter's cooked terrain when there is one, otherwise the height map the mesh is built from.
+static wstring GetTerrainFile()
+{
+	return Assets::Exists(AssetPath::CookedTerrain) ? AssetPath::CookedTerrain : AssetPath::HeightMap;
+}
+
+// The DXIL set relies on Shader Model 6.2 with native 16-bit operations and on wave intrinsics.
+static BOOL SupportsShaderModel6(const ComPtr<ID3D12Device>& device)
+{
+	D3D12_FEATURE_DATA_SHADER_MODEL shaderModel{ D3D_SHADER_MODEL_6_2 };
+	D3D12_FEATURE_DATA_D3D12_OPTIONS1 options1{};
+	D3D12_FEATURE_DATA_D3D12_OPTIONS4 options4{};
+	return SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL, &shaderModel, sizeof(shaderModel))) &&
+		shaderModel.HighestShaderModel >= D3D_SHADER_MODEL_6_2 &&
+		SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS1, &options1, sizeof(options1))) &&
+		options1.WaveOps &&
+		SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS4, &options4, sizeof(options4))) &&
+		options4.Native16BitShaderOpsSupported;
+}
+
 void Scene::BuildObjects(const ComPtr<ID3D12Device>& device, 
+	const ComPtr<ID3D12CommandQueue>& commandQueue,
 	const ComPtr<ID3D12GraphicsCommandList>& commandList,
-	const ComPtr<ID3D12RootSignature>& rootSignature)
+	const ComPtr<ID3D12RootSignature>& rootSignature, PipelineCache& pipelineCache)
 {
-	BuildShaders(device, commandList, rootSignature);
-	BuildMeshes(device, commandList);
-	BuildTextures(device, commandList);
-	BuildMaterials(device, commandList);
+	if (filesystem::exists(Settings::AssetPackFile)) {
+		m_assetPack = make_shared<AssetPack>(Settings::AssetPackFile);
+		Assets::Mount(m_assetPack, Settings::AssetRoot);
+	}
+
+	// Pages are read straight from the loose file at their offsets, so it is not taken from the pack.
+	m_virtualTexturing = Settings::VirtualTexturing && filesystem::exists(AssetPath::TerrainVirtualTexture);
+
+	// File reads and decompression run on the I/O queue while the shaders compile.
+	m_ioQueue = make_unique<IoQueue>();
+	vector<filesystem::path> assets{
+		AssetPath::CubeMesh, AssetPath::SkyboxMesh, AssetPath::BillboardMesh,
+		AssetPath::Checkboard, AssetPath::Brick, AssetPath::Skybox };
+	// A streamed height map reads only the tiles it needs.
+	if (!TerrainMesh::IsStreamed(GetTerrainFile())) assets.push_back(GetTerrainFile());
+	Assets::Prefetch(*m_ioQueue, assets);
+	if (!m_virtualTexturing) {
+		const filesystem::path terrainLayers[]{ AssetPath::TerrainBase, AssetPath::TerrainDetail };
+		Assets::Prefetch(*m_ioQueue, terrainLayers);
+	}
+	const auto grassFiles = GetGrassTextureFiles();
+	Assets::Prefetch(*m_ioQueue, vector<filesystem::path>(grassFiles.begin(), grassFiles.end()));
+
+	// Bytecode comes from the cache the exporter's shaders command fills; misses compile and are stored.
+#if defined(_DEBUG)
+	const UINT shaderFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+	const UINT shaderFlags = 0;
+#endif
+	m_shaderCache = make_unique<ShaderCache>(Settings::ShaderDirectory, Settings::ShaderCacheDirectory, shaderFlags);
+	if (Settings::ShaderModel6 && SupportsShaderModel6(device)) m_shaderCache->UseDxil(Settings::DxilDirectory);
+
+	if (Settings::TextureStreaming && TextureStreamer::IsSupported(device)) {
+		m_textureStreamer = make_unique<TextureStreamer>(device, commandQueue);
+	}
+
+	// Shader compilation, file parsing and upload recording are independent tasks. In a parallel
+	// build every upload task records into a command list of its own; the object setup only
+	// waits for the resources it references, so it overlaps the remaining shader compiles.
+	TaskGraph graph;
+	const auto litShaderTasks = BuildShaders(graph, pipelineCache, rootSignature);
+	vector<TaskGraph::TaskId> dependencies;
+	for (const auto& tasks : { BuildMeshes(graph, device, commandList),
+		BuildTextures(graph, device, commandList), BuildMaterials(graph, device) }) {
+		dependencies.insert(dependencies.end(), tasks.begin(), tasks.end());
+	}
+	const auto objectsTask = graph.Add("OBJECTS", [&] { BuildObjects(device); }, dependencies);
+
+	// The lights are placed with the objects; then each lit shader compiles the permutation they
+	// select, so the first frame finds its pipeline ready.
+	const AssetHandle<Shader>* litShaders[]{ &m_objectShader, &m_terrainShader, &m_cdlodShader, &m_billboardShader };
+	UINT instructionCounts[size(litShaders)]{};
+	if (!m_shaderCache->UsesDxil()) {
+		for (size_t i = 0; i < size(litShaders); ++i) {
+			graph.Add(graph.GetName(litShaderTasks[i]) + " permutation", [&, i] {
+				const auto permutation = LightingPermutation::Select(m_lightSystem->GetLightNum(), Settings::ShadowPcfKernel);
+				instructionCounts[i] = static_pointer_cast<LitShader>(m_shaders.Get(*litShaders[i]))->CreatePermutation(permutation);
+				}, { litShaderTasks[i], objectsTask });
+		}
+	}
 
-	BuildObjects(device);
+	const auto start = chrono::steady_clock::now();
+	const size_t workerCount = Settings::ParallelAssetBuild ? Parallel::GetWorkerCount() : 1;
+	graph.Run(workerCount);
+	const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+	// Join: the upload lists are closed here and submitted ahead of the frame's list.
+	for (const auto& buildCommandList : m_buildCommandLists) {
+		Utiles::ThrowIfFailed(buildCommandList->Close());
+	}
+
+	TaskGraph::TaskId slowest = 0;
+	for (TaskGraph::TaskId task = 1; task < graph.GetTaskCount(); ++task) {
+		if (graph.GetSeconds(task) > graph.GetSeconds(slowest)) slowest = task;
+	}
+	cout << "Scene build: " << elapsed.count() << " ms, " << graph.GetTaskCount() << " tasks on "
+		<< workerCount << " workers (slowest " << graph.GetName(slowest) << ": "
+		<< graph.GetSeconds(slowest) * 1000.0 << " ms)" << endl;
+	const auto shaderStatistics = m_shaderCache->GetStatistics();
+	cout << "Shaders: " << shaderStatistics.hits << " from cache, " << shaderStatistics.misses << " compiled ("
+		<< shaderStatistics.compileSeconds * 1000.0 << " ms in the compiler), " << shaderStatistics.filesRead
+		<< " files read, " << shaderStatistics.preprocessed << " preprocessed" << (m_shaderCache->UsesDxil() ? ", DXIL" : "") << endl;
+	if (!m_shaderCache->UsesDxil()) {
+		const auto permutation = LightingPermutation::Select(m_lightSystem->GetLightNum(), Settings::ShadowPcfKernel);
+		cout << "Lighting permutation " << permutation.GetName() << ":";
+		for (size_t i = 0; i < size(litShaders); ++i) {
+			cout << (i ? ", " : " ") << graph.GetName(litShaderTasks[i]) << " " << instructionCounts[i] << " instructions (generic "
+				<< static_pointer_cast<LitShader>(m_shaders.Get(*litShaders[i]))->GetGenericInstructionCount() << ")";
+		}
+		cout << endl;
+	}
+	const auto pipelineStatistics = pipelineCache.GetStatistics();
+	cout << "Pipelines: " << pipelineStatistics.loaded << " loaded from the library, " << pipelineStatistics.created
+		<< " created, " << pipelineStatistics.shared << " shared" << endl;
+	// The grass table used to hold one Texture2D descriptor per kind.
+	const UINT grassKinds = m_textures.Get(m_grassTexture)->GetArraySize(0);
+	cout << "Grass textures: " << grassKinds << " slices in one Texture2DArray, 1 descriptor instead of "
+		<< grassKinds << endl;
+	if (m_virtualTexture) {
+		cout << "Terrain virtual texture: " << (m_virtualTexture->GetVirtualBytes() >> 20) << " MB virtual, "
+			<< (m_virtualTexture->GetPhysicalBytes() >> 20) << " MB physical ("
+			<< m_virtualTexture->GetPageCache().GetSlotCount() << " pages)" << endl;
+	}
 }
 
-inline void Scene::BuildShaders(const ComPtr<ID3D12Device>& device,
-	const ComPtr<ID3D12GraphicsCommandList>& commandList,
+inline vector<TaskGraph::TaskId> Scene::BuildShaders(TaskGraph& graph, PipelineCache& pipelineCache,
 	const ComPtr<ID3D12RootSignature>& rootSignature)
 {
-	auto objectShader = make_shared<ObjectShader>(device, rootSignature);
-	m_shaders.insert({ "OBJECT", objectShader });
-	auto skyboxShader = make_shared<SkyboxShader>(device, rootSignature);
-	m_shaders.insert({ "SKYBOX", skyboxShader });
-	auto terrainShader = make_shared<TerrainShader>(device, rootSignature);
-	m_shaders.insert({ "TERRAIN", terrainShader });
-	auto billboardShader = make_shared<BillboardShader>(device, rootSignature);
-	m_shaders.insert({ "BILLBOARD", billboardShader });
-
-	auto objectShadowShader = make_shared<ObjectShadowShader>(device, rootSignature);
-	m_shaders.insert({ "OBJECTSHADOW", objectShadowShader });
-	auto billboardShadowShader = make_shared<BillboardShadowShader>(device, rootSignature);
-	m_shaders.insert({ "BILLBOARDSHADOW", billboardShadowShader });
-	auto terrainShadowShader = make_shared<TerrainShadowShader>(device, rootSignature);
-	m_shaders.insert({ "TERRAINSHADOW", terrainShadowShader });
+	vector<TaskGraph::TaskId> litShaderTasks;
+	litShaderTasks.push_back(graph.Add("OBJECT", [&] { m_objectShader = m_shaders.Acquire("OBJECT",
+		[&] { return make_shared<ObjectShader>(pipelineCache, rootSignature, *m_shaderCache); }); }));
+	graph.Add("SKYBOX", [&] { m_skyboxShader = m_shaders.Acquire("SKYBOX",
+		[&] { return make_shared<SkyboxShader>(pipelineCache, rootSignature, *m_shaderCache); }); });
+	litShaderTasks.push_back(graph.Add("TERRAIN", [&] { m_terrainShader = m_shaders.Acquire("TERRAIN",
+		[&] { return make_shared<TerrainShader>(pipelineCache, rootSignature, *m_shaderCache, m_virtualTexturing,
+			Settings::TerrainNormalMap && !TerrainMesh::IsStreamed(GetTerrainFile())); }); }));
+	litShaderTasks.push_back(graph.Add("CDLOD", [&] { m_cdlodShader = m_shaders.Acquire("CDLOD",
+		[&] { return make_shared<CdlodShader>(pipelineCache, rootSignature, *m_shaderCache, m_virtualTexturing); }); }));
+	litShaderTasks.push_back(graph.Add("BILLBOARD", [&] { m_billboardShader = m_shaders.Acquire("BILLBOARD",
+		[&] { return make_shared<BillboardShader>(pipelineCache, rootSignature, *m_shaderCache); }); }));
+
+	graph.Add("OBJECTSHADOW", [&] { m_objectShadowShader = m_shaders.Acquire("OBJECTSHADOW",
+		[&] { return make_shared<ObjectShadowShader>(pipelineCache, rootSignature, *m_shaderCache); }); });
+	graph.Add("BILLBOARDSHADOW", [&] { m_billboardShadowShader = m_shaders.Acquire("BILLBOARDSHADOW",
+		[&] { return make_shared<BillboardShadowShader>(pipelineCache, rootSignature, *m_shaderCache); }); });
+	graph.Add("TERRAINSHADOW", [&] { m_terrainShadowShader = m_shaders.Acquire("TERRAINSHADOW",
+		[&] { return make_shared<TerrainShadowShader>(pipelineCache, rootSignature, *m_shaderCache); }); });
+	graph.Add("CDLODSHADOW", [&] { m_cdlodShadowShader = m_shaders.Acquire("CDLODSHADOW",
+		[&] { return make_shared<CdlodShadowShader>(pipelineCache, rootSignature, *m_shaderCache); }); });
+	return litShaderTasks;
 }
 
-inline void Scene::BuildMeshes(const ComPtr<ID3D12Device>& device,
+inline vector<TaskGraph::TaskId> Scene::BuildMeshes(TaskGraph& graph, const ComPtr<ID3D12Device>& device,
 	const ComPtr<ID3D12GraphicsCommandList>& commandList)
 {
-	auto cubeMesh = make_shared<Mesh<TextureVertex>>(device, commandList,
-		TEXT("../Resources/Meshes/CubeNormalMesh.binary"));
-	m_meshes.insert({ "CUBE", cubeMesh });
-	auto skyboxMesh = make_shared<Mesh<Vertex>>(device, commandList,
-		TEXT("../Resources/Meshes/SkyboxMesh.binary"));
-	m_meshes.insert({ "SKYBOX", skyboxMesh });
-	auto terrainMesh = make_shared<TerrainMesh>(device, commandList,
-		TEXT("../Resources/Terrain/HeightMap.binary"));
-	m_meshes.insert({ "TERRAIN", terrainMesh });
-	auto billboardMesh = make_shared<Mesh<TextureVertex>>(device, commandList,
-		TEXT("../Resources/Meshes/billboardMesh.binary"), D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
-	m_meshes.insert({ "BILLBOARD", billboardMesh });
+	// Meshes are keyed by file, so a second request for the same file shares the first upload.
+	vector<TaskGraph::TaskId> tasks;
+	tasks.push_back(graph.Add("CUBE mesh", [&] {
+		m_meshes.Acquire(Assets::GetKey(AssetPath::CubeMesh), [&] {
+			return make_shared<Mesh<TextureVertex>>(device, CreateBuildCommandList(device, commandList),
+				AssetPath::CubeMesh); });
+		}));
+	tasks.push_back(graph.Add("SKYBOX mesh", [&] {
+		m_meshes.Acquire(Assets::GetKey(AssetPath::SkyboxMesh), [&] {
+			return make_shared<Mesh<Vertex>>(device, CreateBuildCommandList(device, commandList),
+				AssetPath::SkyboxMesh); });
+		}));
+	tasks.push_back(graph.Add("TERRAIN mesh", [&] {
+		m_terrainMesh = m_meshes.Acquire(Assets::GetKey(GetTerrainFile()), [&] {
+			return make_shared<TerrainMesh>(device, CreateBuildCommandList(device, commandList),
+				GetTerrainFile()); });
+		}));
+	tasks.push_back(graph.Add("BILLBOARD mesh", [&] {
+		m_meshes.Acquire(Assets::GetKey(AssetPath::BillboardMesh), [&] {
+			return make_shared<Mesh<TextureVertex>>(device, CreateBuildCommandList(device, commandList),
+				AssetPath::BillboardMesh, D3D_PRIMITIVE_TOPOLOGY_POINTLIST); });
+		}));
+	return tasks;
 }
 
-inline void Scene::BuildTextures(const ComPtr<ID3D12Device>& device,
+inline vector<TaskGraph::TaskId> Scene::BuildTextures(TaskGraph& graph, const ComPtr<ID3D12Device>& device,
 	const ComPtr<ID3D12GraphicsCommandList>& commandList)
 {
-	auto cubeTexture = make_shared<Texture>(device);
-	cubeTexture->LoadTexture(device, commandList,
-		TEXT("../Resources/Textures/Checkboard.dds"), RootParameter::Texture);
-	cubeTexture->LoadTexture(device, commandList,
-		TEXT("../Resources/Textures/Brick.dds"), RootParameter::Texture);
-	cubeTexture->CreateShaderVariable(device);
-	m_textures.insert({ "CUBE", cubeTexture });
-
-	auto skyboxTexture = make_shared<Texture>(device, commandList,
-		TEXT("../Resources/Textures/Skybox.dds"), RootParameter::TextureCube);
-	m_textures.insert({ "SKYBOX", skyboxTexture });
-
-	auto terrainTexture = make_shared<Texture>(device);
-	terrainTexture->LoadTexture(device, commandList,
-		TEXT("../Resources/Textures/TerrainBase.dds"), RootParameter::Texture);
-	terrainTexture->LoadTexture(device, commandList,
-		TEXT("../Resources/Textures/TerrainDetail.dds"), RootParameter::Texture);
-	terrainTexture->CreateShaderVariable(device);
-	m_textures.insert({ "TERRAIN", terrainTexture });
-
-	auto grassTexture = make_shared<Texture>(device);
-	grassTexture->LoadTexture(device, commandList,
-		TEXT("../Resources/Textures/Grass01.dds"), RootParameter::Texture);
-	grassTexture->LoadTexture(device, commandList,
-		TEXT("../Resources/Textures/Grass02.dds"), RootParameter::Texture);
-	grassTexture->LoadTexture(device, commandList,
-		TEXT("../Resources/Textures/Grass03.dds"), RootParameter::Texture);
-	grassTexture->LoadTexture(device, commandList,
-		TEXT("../Resources/Textures/Grass04.dds"), RootParameter::Texture);
-	grassTexture->CreateShaderVariable(device);
-	m_textures.insert({ "GRASS", grassTexture });
-
-	m_shadowMap = make_unique<ShadowMap>(device, 4096 * 2, 4096 * 2);
+	vector<TaskGraph::TaskId> tasks;
+	tasks.push_back(graph.Add("CUBE texture", [&] {
+		m_cubeTexture = m_textures.Acquire("CUBE", [&] {
+			auto buildCommandList = CreateBuildCommandList(device, commandList);
+			auto cubeTexture = make_shared<Texture>(device, m_textureResources, m_textureStreamer.get());
+			cubeTexture->LoadTexture(device, buildCommandList,
+				AssetPath::Checkboard, RootParameter::Texture);
+			cubeTexture->LoadTexture(device, buildCommandList,
+				AssetPath::Brick, RootParameter::Texture);
+			cubeTexture->CreateShaderVariable(device);
+			return cubeTexture;
+			});
+		}));
+
+	tasks.push_back(graph.Add("SKYBOX texture", [&] {
+		m_textures.Acquire("SKYBOX", [&] {
+			return make_shared<Texture>(device, m_textureResources, CreateBuildCommandList(device, commandList),
+				AssetPath::Skybox, RootParameter::TextureCube);
+			});
+		}));
+
+	tasks.push_back(graph.Add("TERRAIN texture", [&] {
+		m_terrainTexture = m_textures.Acquire("TERRAIN", [&]() -> shared_ptr<Texture> {
+			auto buildCommandList = CreateBuildCommandList(device, commandList);
+			if (m_virtualTexturing) {
+				const UINT scale = Settings::VirtualTextureFeedbackScale;
+				m_virtualTexture = make_shared<VirtualTexture>(device, buildCommandList,
+					AssetPath::TerrainVirtualTexture, (g_framework->GetWindowWidth() + scale - 1) / scale,
+					(g_framework->GetWindowHeight() + scale - 1) / scale);
+				return m_virtualTexture;
+			}
+			auto terrainTexture = make_shared<Texture>(device, m_textureResources, m_textureStreamer.get());
+			terrainTexture->LoadTexture(device, buildCommandList,
+				AssetPath::TerrainBase, RootParameter::Texture);
+			terrainTexture->LoadTexture(device, buildCommandList,
+				AssetPath::TerrainDetail, RootParameter::Texture);
+			terrainTexture->CreateShaderVariable(device);
+			return terrainTexture;
+			});
+		}));
+
+	tasks.push_back(graph.Add("GRASS texture", [&] {
+		m_grassTexture = m_textures.Acquire("GRASS", [&] {
+			auto buildCommandList = CreateBuildCommandList(device, commandList);
+			auto grassTexture = make_shared<Texture>(device, m_textureResources, m_textureStreamer.get());
+			grassTexture->LoadTextureArray(device, buildCommandList,
+				GetGrassTextureFiles(), RootParameter::TextureArray);
+			grassTexture->CreateShaderVariable(device);
+			return grassTexture;
+			});
+		}));
+
+	graph.Add("SHADOWMAP", [&] {
+		m_shadowMap = make_unique<ShadowMap>(device, 4096 * 2, 4096 * 2);
+		});
+	return tasks;
 }
 
-inline void Scene::BuildMaterials(const ComPtr<ID3D12Device>& device, 
-	const ComPtr<ID3D12GraphicsCommandList>& commandList)
+inline vector<TaskGraph::TaskId> Scene::BuildMaterials(TaskGraph& graph, const ComPtr<ID3D12Device>& device)
 {
-	auto cubeMaterial = make_shared<Material>();
-	cubeMaterial->SetMaterial(XMFLOAT3{0.95f, 0.93f, 0.88f}, 0.125f, XMFLOAT3{ 0.1f, 0.1f, 0.1f });
-	cubeMaterial->CreateShaderVariable(device);
-	m_materials.insert({ "CUBE", cubeMaterial });
-
-	auto terrainMaterial = make_shared<Material>();
-	terrainMaterial->SetMaterial(XMFLOAT3{ 0.01f, 0.01f, 0.01f }, 0.9f, XMFLOAT3{ 0.3f, 0.3f, 0.3f });
-	terrainMaterial->CreateShaderVariable(device);
-	m_materials.insert({ "TERRAIN", terrainMaterial });
-
-	auto grassMaterial = make_shared<Material>();
-	grassMaterial->SetMaterial(XMFLOAT3{ 0.01f, 0.01f, 0.01f }, 0.9f, XMFLOAT3{ 0.3f, 0.3f, 0.3f });
-	grassMaterial->CreateShaderVariable(device);
-	m_materials.insert({ "GRASS", grassMaterial });
+	return { graph.Add("MATERIALS", [&] {
+		m_materials.Acquire("CUBE", [&] {
+			auto cubeMaterial = make_shared<Material>();
+			cubeMaterial->SetMaterial(XMFLOAT3{0.95f, 0.93f, 0.88f}, 0.125f, XMFLOAT3{ 0.1f, 0.1f, 0.1f });
+			cubeMaterial->CreateShaderVariable(device);
+			return cubeMaterial;
+			});
+
+		m_materials.Acquire("TERRAIN", [&] {
+			auto terrainMaterial = make_shared<Material>();
+			terrainMaterial->SetMaterial(XMFLOAT3{ 0.01f, 0.01f, 0.01f }, 0.9f, XMFLOAT3{ 0.3f, 0.3f, 0.3f });
+			terrainMaterial->CreateShaderVariable(device);
+			return terrainMaterial;
+			});
+
+		m_materials.Acquire("GRASS", [&] {
+			auto grassMaterial = make_shared<Material>();
+			grassMaterial->SetMaterial(XMFLOAT3{ 0.01f, 0.01f, 0.01f }, 0.9f, XMFLOAT3{ 0.3f, 0.3f, 0.3f });
+			grassMaterial->CreateShaderVariable(device);
+			return grassMaterial;
+			});
+		}) };
 }
 
 inline void Scene::BuildObjects(const ComPtr<ID3D12Device>& device)
@@ -219,64 +423,115 @@ inline void Scene::BuildObjects(const ComPtr<ID3D12Device>& device)
 		}
 	}
 	m_instanceObject = make_unique<Instance>(device,
-		static_pointer_cast<Mesh<TextureVertex>>(m_meshes["CUBE"]), static_cast<UINT>(m_objects.size() + 1));
+		static_pointer_cast<Mesh<TextureVertex>>(FindAsset(m_meshes, Assets::GetKey(AssetPath::CubeMesh))),
+		static_cast<UINT>(m_objects.size() + 1));
 	m_instanceObject->SetObjects(m_objects);
 	m_instanceObject->SetObject(m_player);
-	m_instanceObject->SetTexture(m_textures["CUBE"]);
-	m_instanceObject->SetMaterial(m_materials["CUBE"]);
+	m_instanceObject->SetTexture(FindAsset(m_textures, "CUBE"));
+	m_instanceObject->SetMaterial(FindAsset(m_materials, "CUBE"));
 
 	m_camera = make_shared<ThirdPersonCamera>(device);
-	m_camera->SetLens(0.25 * XM_PI, g_framework->GetAspectRatio(), 0.1f, 1000.f);
+	m_camera->SetLens(Settings::CameraFovY, g_framework->GetAspectRatio(), 0.1f, 1000.f);
 	m_player->SetCamera(m_camera);
 
 	m_skybox = make_shared<GameObject>(device);
-	m_skybox->SetMesh(m_meshes["SKYBOX"]);
-	m_skybox->SetTexture(m_textures["SKYBOX"]);
+	m_skybox->SetMesh(FindAsset(m_meshes, Assets::GetKey(AssetPath::SkyboxMesh)));
+	m_skybox->SetTexture(FindAsset(m_textures, "SKYBOX"));
 
 	m_terrain = make_shared<Terrain>(device);
-	m_terrain->SetMesh(m_meshes["TERRAIN"]);
-	m_terrain->SetTexture(m_textures["TERRAIN"]);
-	m_terrain->SetMaterial(m_materials["TERRAIN"]);
+	m_terrain->SetMesh(FindAsset(m_meshes, Assets::GetKey(GetTerrainFile())));
+	m_terrain->SetTexture(FindAsset(m_textures, "TERRAIN"));
+	m_terrain->SetMaterial(FindAsset(m_materials, "TERRAIN"));
 	m_terrain->SetPosition(XMFLOAT3{ 0.f, -30.f, 0.f });
 
-	vector<shared_ptr<InstanceObject>> grasses;
+	// Each grass kind is a slice of one array, so adding kinds costs no descriptors.
+	const UINT grassKinds = m_textures.Get(m_grassTexture)->GetArraySize(0);
+	// One batched query for every blade instead of a surface evaluation each.
+	vector<XMFLOAT2> grassPoints;
 	for (int x = -127; x <= 127; x += 1) {
 		for (int z = -127; z <= 127; z += 1) {
-			FLOAT fx = static_cast<FLOAT>(x);
-			FLOAT fz = static_cast<FLOAT>(z);
-			auto grass0 = make_shared<InstanceObject>();
-			grass0->SetPosition(XMFLOAT3{ fx, m_terrain->GetHeight(fx, fz), fz });
-			grass0->SetTextureIndex(grasses.size() % 4);
-			grasses.push_back(grass0);
-			//auto grass1 = make_shared<InstanceObject>();
-			//grass1->SetPosition(XMFLOAT3{ fx + 0.5f, m_terrain->GetHeight(fx + 0.5f, fz), fz });
-			//grass1->SetTextureIndex(grasses.size() % 4);
-			//grasses.push_back(grass1);
-			//auto grass2 = make_shared<InstanceObject>();
-			//grass2->SetPosition(XMFLOAT3{ fx, m_terrain->GetHeight(fx, fz + 0.5f), fz + 0.5f });
-			//grass2->SetTextureIndex(grasses.size() % 4);
-			//grasses.push_back(grass2);
-			//auto grass3 = make_shared<InstanceObject>();
-			//grass3->SetPosition(XMFLOAT3{ fx + 0.5f, m_terrain->GetHeight(fx + 0.5f, fz + 0.5f), fz + 0.5f });
-			//grass3->SetTextureIndex(grasses.size() % 4);
-			//grasses.push_back(grass3);
+			grassPoints.emplace_back(static_cast<FLOAT>(x), static_cast<FLOAT>(z));
 		}
 	}
+	vector<FLOAT> grassHeights(grassPoints.size());
+	m_terrain->GetHeights(grassPoints, grassHeights);
+
+	// The billboards are centred on their position, so each stands this far above the surface.
+	constexpr FLOAT grassLift = 0.3f;
+	vector<shared_ptr<InstanceObject>> grasses;
+	for (size_t i = 0; i < grassPoints.size(); ++i) {
+		auto grass = make_shared<InstanceObject>();
+		grass->SetPosition(XMFLOAT3{ grassPoints[i].x, grassHeights[i] + grassLift, grassPoints[i].y });
+		grass->SetTextureIndex(grasses.size() % grassKinds);
+		grasses.push_back(grass);
+	}
 	m_instanceBillboard = make_unique<Instance>(device,
-		static_pointer_cast<Mesh<TextureVertex>>(m_meshes["BILLBOARD"]), static_cast<UINT>(grasses.size()));
+		static_pointer_cast<Mesh<TextureVertex>>(FindAsset(m_meshes, Assets::GetKey(AssetPath::BillboardMesh))),
+		static_cast<UINT>(grasses.size()));
 	m_instanceBillboard->SetObjects(move(grasses));
-	m_instanceBillboard->SetTexture(m_textures["GRASS"]);
-	m_instanceBillboard->SetMaterial(m_materials["GRASS"]);
+	m_instanceBillboard->SetTexture(FindAsset(m_textures, "GRASS"));
+	m_instanceBillboard->SetMaterial(FindAsset(m_materials, "GRASS"));
 }
 
-void Scene::ReleaseUploadBuffer()
+void Scene::RequestTextureMips()
 {
-	for (auto& mesh : views::values(m_meshes)) {
-		mesh->ReleaseUploadBuffer();
+	if (!m_textureStreamer) return;
+
+	// Texel density is estimated on the nearest surface each texture is drawn on: the ground below
+	// the camera for the terrain, the player for the cubes.
+	const FLOAT viewportHeight = static_cast<FLOAT>(g_framework->GetWindowHeight());
+	const XMFLOAT3 eye = m_camera->GetEye();
+	const XMFLOAT3 player = m_player->GetPosition();
+	const FLOAT groundPixelsPerUnit = MipStreaming::GetPixelsPerUnit(
+		max(eye.y - m_terrain->GetHeight(eye.x, eye.z), 1.f), Settings::CameraFovY, viewportHeight);
+	const FLOAT playerPixelsPerUnit = MipStreaming::GetPixelsPerUnit(
+		XMVectorGetX(XMVector3Length(XMLoadFloat3(&eye) - XMLoadFloat3(&player))), Settings::CameraFovY, viewportHeight);
+
+	const auto terrainMesh = static_pointer_cast<TerrainMesh>(m_meshes.Get(m_terrainMesh));
+	const auto& terrainTexture = m_textures.Get(m_terrainTexture);
+	terrainTexture->RequestMips(0, 1.f / static_cast<FLOAT>(terrainMesh->GetLength() - 1), groundPixelsPerUnit);
+	terrainTexture->RequestMips(1, 1.f / static_cast<FLOAT>(terrainMesh->GetPatchLength()), groundPixelsPerUnit);
+
+	const auto& cubeTexture = m_textures.Get(m_cubeTexture);
+	for (UINT index = 0; index < 2; ++index) {
+		cubeTexture->RequestMips(index, 1.f, playerPixelsPerUnit);
 	}
-	for (auto& texture : views::values(m_textures)) {
-		texture->ReleaseUploadBuffer();
+}
+
+ComPtr<ID3D12GraphicsCommandList> Scene::CreateBuildCommandList(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList)
+{
+	if (!Settings::ParallelAssetBuild) return commandList;
+
+	ComPtr<ID3D12CommandAllocator> allocator;
+	ComPtr<ID3D12GraphicsCommandList> buildCommandList;
+	Utiles::ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+		IID_PPV_ARGS(&allocator)));
+	Utiles::ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+		allocator.Get(), nullptr, IID_PPV_ARGS(&buildCommandList)));
+
+	lock_guard lock{ m_buildMutex };
+	m_buildAllocators.push_back(allocator);
+	m_buildCommandLists.push_back(buildCommandList);
+	return buildCommandList;
+}
+
+vector<ID3D12CommandList*> Scene::GetBuildCommandLists() const
+{
+	vector<ID3D12CommandList*> commandLists;
+	for (const auto& buildCommandList : m_buildCommandLists) {
+		commandLists.push_back(buildCommandList.Get());
 	}
+	return commandLists;
+}
+
+void Scene::ReleaseUploadBuffer()
+{
+	m_buildCommandLists.clear();
+	m_buildAllocators.clear();
+
+	m_meshes.ForEach([](const auto& mesh) { mesh->ReleaseUploadBuffer(); });
+	m_textures.ForEach([](const auto& texture) { texture->ReleaseUploadBuffer(); });
 }
 
 void Scene::MouseEvent(UINT message, LPARAM lParam)
@@ -285,4 +540,9 @@ void Scene::MouseEvent(UINT message, LPARAM lParam)
 
 void Scene::KeyboardEvent(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
+	// T switches the terrain between its two paths, for comparing them.
+	if (message == WM_KEYDOWN && wParam == 'T') {
+		m_terrain->SetCdlod(!m_terrain->GetCdlod());
+		cout << "Terrain: " << (m_terrain->GetCdlod() ? "CDLOD grids" : "tessellated patches") << endl;
+	}
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "shader.h"
 #include "mesh.h"
 #include "texture.h"
+#include "virtualtexture.h"
 #include "material.h"
 #include "object.h"
 #include "player.h"
@@ -10,6 +11,8 @@
 #include "Instance.h"
 #include "light.h"
 #include "shadow.h"
+#include "../Common/ioqueue.h"
+#include "../Common/taskgraph.h"
 
 class Scene
 {
@@ -23,32 +26,77 @@ public:
 	void PreProcess(const ComPtr<ID3D12GraphicsCommandList>& commandList) const;
 	void Render(const ComPtr<ID3D12GraphicsCommandList>& commandList) const;
 
+	// Streams texture mips requested during Update and virtual texture pages the last frame asked
+	// for; call first thing in the frame's command list.
+	void UpdateTextureStreaming(const ComPtr<ID3D12GraphicsCommandList>& commandList);
+
 	void BuildObjects(const ComPtr<ID3D12Device>& device, 
+		const ComPtr<ID3D12CommandQueue>& commandQueue,
 		const ComPtr<ID3D12GraphicsCommandList>& commandList, 
-		const ComPtr<ID3D12RootSignature>& rootSignature);
+		const ComPtr<ID3D12RootSignature>& rootSignature, PipelineCache& pipelineCache);
 	void ReleaseUploadBuffer();
 
+	// Upload lists recorded by the build tasks; submit them together with the frame's list.
+	vector<ID3D12CommandList*> GetBuildCommandLists() const;
+
 	void MouseEvent(UINT message, LPARAM lParam);
 	void KeyboardEvent(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 
 private:
-	inline void BuildShaders(const ComPtr<ID3D12Device>& device,
-		const ComPtr<ID3D12GraphicsCommandList>& commandList,
+	// Returns the tasks of the lit shaders: OBJECT, TERRAIN, CDLOD and BILLBOARD.
+	inline vector<TaskGraph::TaskId> BuildShaders(TaskGraph& graph, PipelineCache& pipelineCache,
 		const ComPtr<ID3D12RootSignature>& rootSignature);
-	inline void BuildMeshes(const ComPtr<ID3D12Device>& device,
+	inline vector<TaskGraph::TaskId> BuildMeshes(TaskGraph& graph, const ComPtr<ID3D12Device>& device,
 		const ComPtr<ID3D12GraphicsCommandList>& commandList);
-	inline void BuildTextures(const ComPtr<ID3D12Device>& device,
-		const ComPtr<ID3D12GraphicsCommandList>& commandList);
-	inline void BuildMaterials(const ComPtr<ID3D12Device>& device,
+	inline vector<TaskGraph::TaskId> BuildTextures(TaskGraph& graph, const ComPtr<ID3D12Device>& device,
 		const ComPtr<ID3D12GraphicsCommandList>& commandList);
+	inline vector<TaskGraph::TaskId> BuildMaterials(TaskGraph& graph, const ComPtr<ID3D12Device>& device);
 	inline void BuildObjects(const ComPtr<ID3D12Device>& device);
 
+	void RequestTextureMips();
+
+	ComPtr<ID3D12GraphicsCommandList> CreateBuildCommandList(const ComPtr<ID3D12Device>& device,
+		const ComPtr<ID3D12GraphicsCommandList>& commandList);
+	template <typename T>
+	static shared_ptr<T> FindAsset(const AssetRegistry<T>& registry, string_view key)
+	{
+		return registry.Get(registry.Find(key));
+	}
 
 private:
-	unordered_map<string, shared_ptr<Shader>> m_shaders;
-	unordered_map<string, shared_ptr<MeshBase>> m_meshes;
-	unordered_map<string, shared_ptr<Texture>> m_textures;
-	unordered_map<string, shared_ptr<Material>> m_materials;
+	shared_ptr<AssetPack> m_assetPack;
+	unique_ptr<IoQueue> m_ioQueue;
+	unique_ptr<ShaderCache> m_shaderCache;
+
+	mutex m_buildMutex;
+	vector<ComPtr<ID3D12CommandAllocator>> m_buildAllocators;
+	vector<ComPtr<ID3D12GraphicsCommandList>> m_buildCommandLists;
+
+	// Declared ahead of everything holding a Texture, which releases its files here on destruction.
+	unique_ptr<TextureStreamer> m_textureStreamer;
+	TextureRegistry m_textureResources;
+	AssetRegistry<Shader> m_shaders;
+	AssetRegistry<MeshBase> m_meshes;
+	AssetRegistry<Texture> m_textures;
+	AssetRegistry<Material> m_materials;
+
+	AssetHandle<Shader> m_objectShader;
+	AssetHandle<Shader> m_skyboxShader;
+	AssetHandle<Shader> m_terrainShader;
+	AssetHandle<Shader> m_cdlodShader;
+	AssetHandle<Shader> m_billboardShader;
+	AssetHandle<Shader> m_objectShadowShader;
+	AssetHandle<Shader> m_billboardShadowShader;
+	AssetHandle<Shader> m_terrainShadowShader;
+	AssetHandle<Shader> m_cdlodShadowShader;
+
+	AssetHandle<MeshBase> m_terrainMesh;
+	AssetHandle<Texture> m_cubeTexture;
+	AssetHandle<Texture> m_terrainTexture;
+	AssetHandle<Texture> m_grassTexture;
+	// Set when the terrain samples the baked virtual texture instead of its base and detail layers.
+	BOOL m_virtualTexturing;
+	shared_ptr<VirtualTexture> m_virtualTexture;
 
 	unique_ptr<LightSystem> m_lightSystem;
 	unique_ptr<Sun>		m_sun;
@@ -1,4 +1,5 @@
 #pragma once
+#include "Shader/permutation.hlsl"
 
 namespace Settings
 {
@@ -6,6 +7,7 @@ namespace Settings
     constexpr UINT DefaultWindowWidth = 1920;
     constexpr UINT DefaultWindowHeight = 1080;
 
+    constexpr FLOAT CameraFovY = 0.25f * XM_PI;
     constexpr FLOAT DefaultCameraPitch = XM_PIDIV2 - 0.3f;
     constexpr FLOAT DefaultCameraYaw = 0.f;
     constexpr FLOAT DefaultCameraRadius = 10.f;
@@ -16,9 +18,70 @@ namespace Settings
 
     constexpr FLOAT PlayerSpeed = 10.f;
 
-    constexpr UINT MaxDirectionalLight = 5;
-    constexpr UINT MaxPointLight = 10;
-    constexpr UINT MaxSpotLight = 130;
+    constexpr wstring_view AssetRoot = TEXT("../Resources");
+    constexpr wstring_view AssetPackFile = TEXT("../Resources/Assets.pack");
+    constexpr BOOL ParallelAssetBuild = TRUE;
+
+    // Shader sources, and the bytecode cache Exporter shaders Shader/shaders.json writes offline.
+    constexpr wstring_view ShaderDirectory = TEXT("Shader");
+    constexpr wstring_view ShaderCacheDirectory = TEXT("Shader/Cache");
+    constexpr wstring_view PipelineCacheFile = TEXT("Shader/Cache/Pipelines.bin");
+
+    // The Shader Model 6.2 set Exporter dxc Shader/shaders.json builds, used instead of FXC bytecode
+    // when the device has wave intrinsics and 16-bit operations and the set matches the sources.
+    constexpr BOOL ShaderModel6 = TRUE;
+    constexpr wstring_view DxilDirectory = TEXT("Shader/Cache/DXIL");
+
+    // Resident bytes of streamed textures, and bytes streamed in per frame.
+    constexpr BOOL TextureStreaming = TRUE;
+    constexpr UINT64 TextureStreamingBudget = 128ull << 20;
+    constexpr UINT64 TextureStreamingFrameBudget = 8ull << 20;
+
+    // Terrain pages kept in the physical atlas, pages uploaded per frame, and the feedback buffer's
+    // downscale from the window (one pixel of every scale x scale block reports its page).
+    constexpr BOOL VirtualTexturing = TRUE;
+    constexpr UINT VirtualTexturePhysicalPages = 1024;
+    constexpr UINT VirtualTexturePageUploads = 16;
+    constexpr UINT VirtualTextureFeedbackScale = 8;
+
+    // Draws only the terrain patches the camera and the shadow map may see, found each frame on a
+    // quadtree of the patches' bounds.
+    constexpr BOOL TerrainCulling = TRUE;
+
+    // Tessellation factors are chosen each frame, patch edge by patch edge, so the tessellated
+    // surface stays within TerrainPixelError pixels of the true one on screen.
+    constexpr FLOAT TerrainPixelError = 1.f;
+
+    // Draws the terrain as CDLOD grids, instanced over quadtree nodes and morphed between levels in
+    // the vertex shader, instead of tessellated patches; T switches between the two at runtime.
+    // Level 0 reaches TerrainLodRange from the eye and every level doubles it.
+    constexpr BOOL TerrainCdlod = FALSE;
+    constexpr FLOAT TerrainLodRange = 32.f;
+
+    // The tessellated terrain's pixel shader reads its normals from a map baked from the patches'
+    // surface, TerrainNormalTexelsPerCell texels per grid cell, instead of the domain shader
+    // differentiating every patch per vertex. A cooked terrain brings its own map.
+    constexpr BOOL TerrainNormalMap = TRUE;
+    constexpr INT TerrainNormalTexelsPerCell = 2;
+
+    // A tiled height map from the exporter's tile command is streamed from its loose file instead
+    // of loaded whole: the tiles within TerrainTileRadius units of the camera are kept in
+    // TerrainTileSlots slots, with at most TerrainTileLoadBudget reads started per frame.
+    constexpr FLOAT TerrainTileRadius = 128.f;
+    constexpr UINT TerrainTileSlots = 48;
+    constexpr UINT TerrainTileLoadBudget = 8;
+
+    // The Light cbuffer's sizes, shared with the shaders through permutation.hlsl.
+    constexpr UINT MaxDirectionalLight = MAX_DIRECTIONAL_LIGHTS;
+    constexpr UINT MaxPointLight = MAX_POINT_LIGHTS;
+    constexpr UINT MaxSpotLight = MAX_SPOT_LIGHTS;
+
+    // Lit pixel shaders are compiled per bucket of light counts and shadow filter. Counts above
+    // MaxUnrolledLights keep a runtime loop, and a shader holding MaxShaderPermutations pipelines
+    // serves new permutations with its generic one. The kernel is in taps per side; 0 is unshadowed.
+    constexpr UINT ShadowPcfKernel = 3;
+    constexpr UINT MaxUnrolledLights = 32;
+    constexpr UINT MaxShaderPermutations = 16;
 
     namespace Light
     {
@@ -29,6 +92,27 @@ namespace Settings
     }
 }
 
+namespace AssetPath
+{
+    constexpr LPCWSTR CubeMesh = TEXT("../Resources/Meshes/CubeNormalMesh.binary");
+    constexpr LPCWSTR SkyboxMesh = TEXT("../Resources/Meshes/SkyboxMesh.binary");
+    constexpr LPCWSTR BillboardMesh = TEXT("../Resources/Meshes/billboardMesh.binary");
+    constexpr LPCWSTR HeightMap = TEXT("../Resources/Terrain/HeightMap.binary");
+    constexpr LPCWSTR CookedTerrain = TEXT("../Resources/Terrain/HeightMap.terrain");
+
+    constexpr LPCWSTR Checkboard = TEXT("../Resources/Textures/Checkboard.dds");
+    constexpr LPCWSTR Brick = TEXT("../Resources/Textures/Brick.dds");
+    constexpr LPCWSTR Skybox = TEXT("../Resources/Textures/Skybox.dds");
+    constexpr LPCWSTR TerrainBase = TEXT("../Resources/Textures/TerrainBase.dds");
+    constexpr LPCWSTR TerrainDetail = TEXT("../Resources/Textures/TerrainDetail.dds");
+    constexpr LPCWSTR Grass01 = TEXT("../Resources/Textures/Grass01.dds");
+    constexpr LPCWSTR Grass02 = TEXT("../Resources/Textures/Grass02.dds");
+    constexpr LPCWSTR Grass03 = TEXT("../Resources/Textures/Grass03.dds");
+    constexpr LPCWSTR Grass04 = TEXT("../Resources/Textures/Grass04.dds");
+    constexpr LPCWSTR GrassArray = TEXT("../Resources/Textures/GrassArray.dds");
+    constexpr LPCWSTR TerrainVirtualTexture = TEXT("../Resources/Textures/Terrain.vt");
+}
+
 namespace RootParameter
 {
     constexpr UINT GameObject = 0;
@@ -40,6 +124,12 @@ namespace RootParameter
     constexpr UINT TextureCube = 6;
     constexpr UINT TextureShadow = 7;
     constexpr UINT Texture = 8;
+    constexpr UINT TextureArray = 9;
+    constexpr UINT VirtualTexture = 10;
+    constexpr UINT VirtualTextureConstants = 11;
+    constexpr UINT TerrainHeights = 12;
+    constexpr UINT TerrainTessFactors = 13;
+    constexpr UINT TerrainNormals = 14;
 }
 
 namespace DescriptorRange
@@ -47,4 +137,7 @@ namespace DescriptorRange
     constexpr UINT TextureCube = 0;
     constexpr UINT TextureShadow = 1;
     constexpr UINT Texture = 2;
+    constexpr UINT TextureArray = 3;
+    constexpr UINT VirtualTexture = 4;
+    constexpr UINT VirtualTextureFeedback = 5;
 }
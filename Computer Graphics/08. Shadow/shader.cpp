@@ -1,29 +1,128 @@
 #include "shader.h"
+#include "Shader/permutation.hlsl"
 
 void Shader::UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandList>& commandList)
 {
 	commandList->SetPipelineState(m_pipelineState.Get());
 }
 
-ObjectShader::ObjectShader(const ComPtr<ID3D12Device>& device, 
-	const ComPtr<ID3D12RootSignature>& rootSignature)
+LightingPermutation LightingPermutation::Select(XMUINT4 lightNum, UINT shadowPcfKernel)
+{
+	const auto bucket = [](UINT count, UINT maxCount) {
+		if (count > Settings::MaxUnrolledLights) return -1;
+		return static_cast<INT>(count == 0 ? 0 : min(bit_ceil(count), maxCount));
+	};
+	return { bucket(lightNum.x, Settings::MaxDirectionalLight), bucket(lightNum.y, Settings::MaxPointLight),
+		bucket(lightNum.z, Settings::MaxSpotLight), lightNum.x > 0 ? shadowPcfKernel : 0 };
+}
+
+UINT LightingPermutation::GetKey() const
+{
+	return static_cast<UINT>(directionalLights + 1) | static_cast<UINT>(pointLights + 1) << 8 |
+		static_cast<UINT>(spotLights + 1) << 16 | shadowPcfKernel << 24;
+}
+
+string LightingPermutation::GetName() const
+{
+	const auto count = [](INT bucket) { return bucket < 0 ? string{ "*" } : to_string(bucket); };
+	return "D" + count(directionalLights) + " P" + count(pointLights) + " S" + count(spotLights) +
+		" K" + to_string(shadowPcfKernel);
+}
+
+LitShader::LitShader(PipelineCache& pipelineCache, ShaderCache& shaderCache, const string& fileName,
+	vector<D3D_SHADER_MACRO> defines) :
+	m_pipelineCache{ pipelineCache }, m_shaderCache{ shaderCache }, m_fileName{ fileName },
+	m_defines{ move(defines) }, m_desc{}, m_genericInstructionCount{ 0 }, m_missing{ FALSE }
+{
+}
+
+UINT LitShader::CreatePermutation(const LightingPermutation& permutation)
+{
+	const UINT key = permutation.GetKey();
+	if (const auto it = m_pipelines.find(key); it != m_pipelines.end()) return it->second.instructionCount;
+	if (m_pipelines.size() >= Settings::MaxShaderPermutations) return m_genericInstructionCount;
+
+	Permutation created{};
+	created.pipeline = CreatePipeline(permutation, created.instructionCount);
+	m_pipelines.emplace(key, created);
+	return created.instructionCount;
+}
+
+void LitShader::SetPermutation(const LightingPermutation& permutation)
+{
+	if (const auto it = m_pipelines.find(permutation.GetKey()); it != m_pipelines.end()) {
+		m_pipelineState = it->second.pipeline;
+		return;
+	}
+
+	// Compiling here would stall the frame, so the generic pipeline stands in.
+	if (!m_missing) {
+		cout << "Lighting permutations: " << m_fileName << " " << permutation.GetName()
+			<< " was not built with the scene, using the generic pipeline" << endl;
+		m_missing = TRUE;
+	}
+	m_pipelineState = m_genericPipeline;
+}
+
+void LitShader::CreatePipelines(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+	vector<D3D12_INPUT_ELEMENT_DESC> inputLayout, vector<ComPtr<ID3DBlob>> byteCodes)
+{
+	m_inputLayout = move(inputLayout);
+	m_byteCodes = move(byteCodes);
+	m_desc = desc;
+	m_desc.InputLayout = { m_inputLayout.data(), (UINT)m_inputLayout.size() };
+
+	const LightingPermutation generic;
+	m_genericPipeline = CreatePipeline(generic, m_genericInstructionCount);
+	m_pipelines.emplace(generic.GetKey(), Permutation{ m_genericPipeline, m_genericInstructionCount });
+	m_pipelineState = m_genericPipeline;
+}
+
+ComPtr<ID3D12PipelineState> LitShader::CreatePipeline(const LightingPermutation& permutation,
+	UINT& instructionCount)
+{
+	const string directionalLights = to_string(permutation.directionalLights);
+	const string pointLights = to_string(permutation.pointLights);
+	const string spotLights = to_string(permutation.spotLights);
+	const string shadowPcfKernel = to_string(permutation.shadowPcfKernel);
+	// Only what differs from the defaults in lighting.hlsl and common.hlsl, so the generic
+	// permutation is the plain program shaders.json lists.
+	vector<D3D_SHADER_MACRO> defines = m_defines;
+	if (permutation.directionalLights >= 0) defines.push_back({ "DIRECTIONAL_LIGHTS", directionalLights.c_str() });
+	if (permutation.pointLights >= 0) defines.push_back({ "POINT_LIGHTS", pointLights.c_str() });
+	if (permutation.spotLights >= 0) defines.push_back({ "SPOT_LIGHTS", spotLights.c_str() });
+	if (permutation.shadowPcfKernel != DEFAULT_SHADOW_PCF_KERNEL) defines.push_back({ "SHADOW_PCF_KERNEL", shadowPcfKernel.c_str() });
+	defines.push_back({ nullptr, nullptr });
+
+	ComPtr<ID3DBlob> mpsByteCode;
+	mpsByteCode = m_shaderCache.Compile(m_fileName, defines.data(), "PIXEL_MAIN", "ps_5_1");
+
+	ComPtr<ID3D12ShaderReflection> reflection;
+	D3D12_SHADER_DESC shaderDesc{};
+	if (SUCCEEDED(D3DReflect(mpsByteCode->GetBufferPointer(), mpsByteCode->GetBufferSize(),
+		IID_PPV_ARGS(&reflection)))) {
+		reflection->GetDesc(&shaderDesc);
+	}
+	instructionCount = shaderDesc.InstructionCount;
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = m_desc;
+	psoDesc.PS = {
+		reinterpret_cast<BYTE*>(mpsByteCode->GetBufferPointer()),
+		mpsByteCode->GetBufferSize() };
+	return m_pipelineCache.CreateGraphicsPipelineState(psoDesc);
+}
+
+ObjectShader::ObjectShader(PipelineCache& pipelineCache,
+	const ComPtr<ID3D12RootSignature>& rootSignature, ShaderCache& shaderCache) :
+	LitShader{ pipelineCache, shaderCache, "object.hlsl" }
 {
 	vector<D3D12_INPUT_ELEMENT_DESC> inputLayout = {
 	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 } };
 
-#if defined(_DEBUG)
-	UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#else
-	UINT compileFlags = 0;
-#endif
-
-	ComPtr<ID3DBlob> mvsByteCode, mpsByteCode;
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/object.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "VERTEX_MAIN", "vs_5_1", compileFlags, 0, &mvsByteCode, nullptr));
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/object.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "PIXEL_MAIN", "ps_5_1", compileFlags, 0, &mpsByteCode, nullptr));
+	ComPtr<ID3DBlob> mvsByteCode;
+	mvsByteCode = shaderCache.Compile("object.hlsl", nullptr, "VERTEX_MAIN", "vs_5_1");
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
 	psoDesc.InputLayout = { inputLayout.data(), (UINT)inputLayout.size() };
@@ -31,9 +130,6 @@ ObjectShader::ObjectShader(const ComPtr<ID3D12Device>& device,
 	psoDesc.VS = {
 		reinterpret_cast<BYTE*>(mvsByteCode->GetBufferPointer()),
 		mvsByteCode->GetBufferSize() };
-	psoDesc.PS = {
-		reinterpret_cast<BYTE*>(mpsByteCode->GetBufferPointer()),
-		mpsByteCode->GetBufferSize() };
 	psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
 	psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
@@ -44,26 +140,18 @@ ObjectShader::ObjectShader(const ComPtr<ID3D12Device>& device,
 	psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	psoDesc.SampleDesc.Count = 1;
 	psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
-	Utiles::ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
+	CreatePipelines(psoDesc, move(inputLayout), { mvsByteCode });
 }
 
-SkyboxShader::SkyboxShader(const ComPtr<ID3D12Device>& device, 
-	const ComPtr<ID3D12RootSignature>& rootSignature)
+SkyboxShader::SkyboxShader(PipelineCache& pipelineCache,
+	const ComPtr<ID3D12RootSignature>& rootSignature, ShaderCache& shaderCache)
 {
 	vector<D3D12_INPUT_ELEMENT_DESC> inputLayout = {
 	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 } };
 
-#if defined(_DEBUG)
-	UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#else
-	UINT compileFlags = 0;
-#endif
-
 	ComPtr<ID3DBlob> mvsByteCode, mpsByteCode;
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/skybox.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "VERTEX_MAIN", "vs_5_1", compileFlags, 0, &mvsByteCode, nullptr));
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/skybox.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "PIXEL_MAIN", "ps_5_1", compileFlags, 0, &mpsByteCode, nullptr));
+	mvsByteCode = shaderCache.Compile("skybox.hlsl", nullptr, "VERTEX_MAIN", "vs_5_1");
+	mpsByteCode = shaderCache.Compile("skybox.hlsl", nullptr, "PIXEL_MAIN", "ps_5_1");
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
 	psoDesc.InputLayout = { inputLayout.data(), (UINT)inputLayout.size() };
@@ -86,33 +174,23 @@ SkyboxShader::SkyboxShader(const ComPtr<ID3D12Device>& device,
 	psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	psoDesc.SampleDesc.Count = 1;
 	psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
-	Utiles::ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
+	m_pipelineState = pipelineCache.CreateGraphicsPipelineState(psoDesc);
 }
 
-TerrainShader::TerrainShader(const ComPtr<ID3D12Device>& device,
-	const ComPtr<ID3D12RootSignature>& rootSignature)
+TerrainShader::TerrainShader(PipelineCache& pipelineCache,
+	const ComPtr<ID3D12RootSignature>& rootSignature, ShaderCache& shaderCache, BOOL virtualTexture, BOOL normalMap) :
+	LitShader{ pipelineCache, shaderCache, "terrain.hlsl", GetDefines(virtualTexture, normalMap) }
 {
 	vector<D3D12_INPUT_ELEMENT_DESC> inputLayout = {
 	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-	{ "TEXCOORD", 1, DXGI_FORMAT_R32G32_FLOAT, 0, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-	{ "DENSITY", 0, DXGI_FORMAT_R32_UINT, 0, 28, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 } };
-
-#if defined(_DEBUG)
-	UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#else
-	UINT compileFlags = 0;
-#endif
-
-	ComPtr<ID3DBlob> mvsByteCode, mhsByteCode, mdsByteCode, mpsByteCode;
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/terrain.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "VERTEX_MAIN", "vs_5_1", compileFlags, 0, &mvsByteCode, nullptr));
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/terrain.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "HULL_MAIN", "hs_5_1", compileFlags, 0, &mhsByteCode, nullptr));
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/terrain.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "DOMAIN_MAIN", "ds_5_1", compileFlags, 0, &mdsByteCode, nullptr));
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/terrain.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "PIXEL_MAIN", "ps_5_1", compileFlags, 0, &mpsByteCode, nullptr));
+	{ "PATCH", 0, DXGI_FORMAT_R32_UINT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 } };
+
+	ComPtr<ID3DBlob> mvsByteCode, mhsByteCode, mdsByteCode;
+	mvsByteCode = shaderCache.Compile("terrain.hlsl", nullptr, "VERTEX_MAIN", "vs_5_1");
+	mhsByteCode = shaderCache.Compile("terrain.hlsl", nullptr, "HULL_MAIN", "hs_5_1");
+	const D3D_SHADER_MACRO normalMapDefines[]{ { "NORMAL_MAP", "1" }, { nullptr, nullptr } };
+	mdsByteCode = shaderCache.Compile("terrain.hlsl", normalMap ? normalMapDefines : nullptr, "DOMAIN_MAIN", "ds_5_1");
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
 	psoDesc.InputLayout = { inputLayout.data(), (UINT)inputLayout.size() };
@@ -126,9 +204,6 @@ TerrainShader::TerrainShader(const ComPtr<ID3D12Device>& device,
 	psoDesc.DS = {
 		reinterpret_cast<BYTE*>(mdsByteCode->GetBufferPointer()),
 		mdsByteCode->GetBufferSize() };
-	psoDesc.PS = {
-		reinterpret_cast<BYTE*>(mpsByteCode->GetBufferPointer()),
-		mpsByteCode->GetBufferSize() };
 	psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	//psoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
 	psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
@@ -140,29 +215,61 @@ TerrainShader::TerrainShader(const ComPtr<ID3D12Device>& device,
 	psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	psoDesc.SampleDesc.Count = 1;
 	psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
-	Utiles::ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
+	CreatePipelines(psoDesc, move(inputLayout), { mvsByteCode, mhsByteCode, mdsByteCode });
 }
 
-BillboardShader::BillboardShader(const ComPtr<ID3D12Device>& device, 
-	const ComPtr<ID3D12RootSignature>& rootSignature)
+vector<D3D_SHADER_MACRO> TerrainShader::GetDefines(BOOL virtualTexture, BOOL normalMap)
+{
+	vector<D3D_SHADER_MACRO> defines;
+	if (virtualTexture) defines.push_back({ "VIRTUAL_TEXTURE", "1" });
+	if (normalMap) defines.push_back({ "NORMAL_MAP", "1" });
+	return defines;
+}
+
+CdlodShader::CdlodShader(PipelineCache& pipelineCache,
+	const ComPtr<ID3D12RootSignature>& rootSignature, ShaderCache& shaderCache, BOOL virtualTexture) :
+	LitShader{ pipelineCache, shaderCache, "terrain.hlsl",
+		virtualTexture ? vector<D3D_SHADER_MACRO>{ { "VIRTUAL_TEXTURE", "1" } } : vector<D3D_SHADER_MACRO>{} }
+{
+	// The grid per vertex, the node per instance.
+	vector<D3D12_INPUT_ELEMENT_DESC> inputLayout = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NODE", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+		{ "MORPH", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 12, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 } };
+
+	ComPtr<ID3DBlob> mvsByteCode;
+	mvsByteCode = shaderCache.Compile("terrain.hlsl", nullptr, "CDLOD_VERTEX_MAIN", "vs_5_1");
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
+	psoDesc.InputLayout = { inputLayout.data(), (UINT)inputLayout.size() };
+	psoDesc.pRootSignature = rootSignature.Get();
+	psoDesc.VS = {
+		reinterpret_cast<BYTE*>(mvsByteCode->GetBufferPointer()),
+		mvsByteCode->GetBufferSize() };
+	psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+	psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+	psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+	psoDesc.SampleMask = UINT_MAX;
+	psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	psoDesc.NumRenderTargets = 1;
+	psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+	psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	psoDesc.SampleDesc.Count = 1;
+	psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	CreatePipelines(psoDesc, move(inputLayout), { mvsByteCode });
+}
+
+BillboardShader::BillboardShader(PipelineCache& pipelineCache,
+	const ComPtr<ID3D12RootSignature>& rootSignature, ShaderCache& shaderCache) :
+	LitShader{ pipelineCache, shaderCache, "billboard.hlsl" }
 {
 	vector<D3D12_INPUT_ELEMENT_DESC> inputLayout = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 } };
 
-#if defined(_DEBUG)
-	UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#else
-	UINT compileFlags = 0;
-#endif
-
-	ComPtr<ID3DBlob> mvsByteCode, mgsByteCode, mpsByteCode;
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/billboard.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "VERTEX_MAIN", "vs_5_1", compileFlags, 0, &mvsByteCode, nullptr));
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/billboard.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "GEOMETRY_MAIN", "gs_5_1", compileFlags, 0, &mgsByteCode, nullptr));
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/billboard.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "PIXEL_MAIN", "ps_5_1", compileFlags, 0, &mpsByteCode, nullptr));
+	ComPtr<ID3DBlob> mvsByteCode, mgsByteCode;
+	mvsByteCode = shaderCache.Compile("billboard.hlsl", nullptr, "VERTEX_MAIN", "vs_5_1");
+	mgsByteCode = shaderCache.Compile("billboard.hlsl", nullptr, "GEOMETRY_MAIN", "gs_5_1");
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
 	psoDesc.InputLayout = { inputLayout.data(), (UINT)inputLayout.size() };
@@ -173,9 +280,6 @@ BillboardShader::BillboardShader(const ComPtr<ID3D12Device>& device,
 	psoDesc.GS = {
 		reinterpret_cast<BYTE*>(mgsByteCode->GetBufferPointer()),
 		mgsByteCode->GetBufferSize() };
-	psoDesc.PS = {
-		reinterpret_cast<BYTE*>(mpsByteCode->GetBufferPointer()),
-		mpsByteCode->GetBufferSize() };
 	psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
 	psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
@@ -187,26 +291,19 @@ BillboardShader::BillboardShader(const ComPtr<ID3D12Device>& device,
 	psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	psoDesc.SampleDesc.Count = 1;
 	psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
-	Utiles::ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
+	CreatePipelines(psoDesc, move(inputLayout), { mvsByteCode, mgsByteCode });
 }
 
-ObjectShadowShader::ObjectShadowShader(const ComPtr<ID3D12Device>& device, 
-	const ComPtr<ID3D12RootSignature>& rootSignature)
+ObjectShadowShader::ObjectShadowShader(PipelineCache& pipelineCache,
+	const ComPtr<ID3D12RootSignature>& rootSignature, ShaderCache& shaderCache)
 {
 	vector<D3D12_INPUT_ELEMENT_DESC> inputLayout = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 } };
 
-#if defined(_DEBUG)
-	UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#else
-	UINT compileFlags = 0;
-#endif
-
 	ComPtr<ID3DBlob> mvsByteCode;
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/object.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "SHADOW_VERTEX_MAIN", "vs_5_1", compileFlags, 0, &mvsByteCode, nullptr));
+	mvsByteCode = shaderCache.Compile("object.hlsl", nullptr, "SHADOW_VERTEX_MAIN", "vs_5_1");
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
 	psoDesc.InputLayout = { inputLayout.data(), (UINT)inputLayout.size() };
@@ -227,29 +324,20 @@ ObjectShadowShader::ObjectShadowShader(const ComPtr<ID3D12Device>& device,
 	psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	psoDesc.SampleDesc.Count = 1;
 	psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
-	Utiles::ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
+	m_pipelineState = pipelineCache.CreateGraphicsPipelineState(psoDesc);
 }
 
-BillboardShadowShader::BillboardShadowShader(const ComPtr<ID3D12Device>& device, 
-	const ComPtr<ID3D12RootSignature>& rootSignature)
+BillboardShadowShader::BillboardShadowShader(PipelineCache& pipelineCache,
+	const ComPtr<ID3D12RootSignature>& rootSignature, ShaderCache& shaderCache)
 {
 	vector<D3D12_INPUT_ELEMENT_DESC> inputLayout = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 } };
 
-#if defined(_DEBUG)
-	UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#else
-	UINT compileFlags = 0;
-#endif
-
 	ComPtr<ID3DBlob> mvsByteCode, mgsByteCode, mpsByteCode;
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/billboard.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "SHADOW_VERTEX_MAIN", "vs_5_1", compileFlags, 0, &mvsByteCode, nullptr));
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/billboard.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "SHADOW_GEOMETRY_MAIN", "gs_5_1", compileFlags, 0, &mgsByteCode, nullptr));
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/billboard.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "SHADOW_PIXEL_MAIN", "ps_5_1", compileFlags, 0, &mpsByteCode, nullptr));
+	mvsByteCode = shaderCache.Compile("billboard.hlsl", nullptr, "SHADOW_VERTEX_MAIN", "vs_5_1");
+	mgsByteCode = shaderCache.Compile("billboard.hlsl", nullptr, "SHADOW_GEOMETRY_MAIN", "gs_5_1");
+	mpsByteCode = shaderCache.Compile("billboard.hlsl", nullptr, "SHADOW_PIXEL_MAIN", "ps_5_1");
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
 	psoDesc.InputLayout = { inputLayout.data(), (UINT)inputLayout.size() };
@@ -277,31 +365,21 @@ BillboardShadowShader::BillboardShadowShader(const ComPtr<ID3D12Device>& device,
 	psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	psoDesc.SampleDesc.Count = 1;
 	psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
-	Utiles::ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
+	m_pipelineState = pipelineCache.CreateGraphicsPipelineState(psoDesc);
 }
 
-TerrainShadowShader::TerrainShadowShader(const ComPtr<ID3D12Device>& device, 
-	const ComPtr<ID3D12RootSignature>& rootSignature)
+TerrainShadowShader::TerrainShadowShader(PipelineCache& pipelineCache,
+	const ComPtr<ID3D12RootSignature>& rootSignature, ShaderCache& shaderCache)
 {
 	vector<D3D12_INPUT_ELEMENT_DESC> inputLayout = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 1, DXGI_FORMAT_R32G32_FLOAT, 0, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "DENSITY", 0, DXGI_FORMAT_R32_UINT, 0, 28, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 } };
-
-#if defined(_DEBUG)
-	UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#else
-	UINT compileFlags = 0;
-#endif
+		{ "PATCH", 0, DXGI_FORMAT_R32_UINT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 } };
 
 	ComPtr<ID3DBlob> mvsByteCode, mhsByteCode, mdsByteCode;
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/terrain.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "SHADOW_VERTEX_MAIN", "vs_5_1", compileFlags, 0, &mvsByteCode, nullptr));
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/terrain.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "SHADOW_HULL_MAIN", "hs_5_1", compileFlags, 0, &mhsByteCode, nullptr));
-	Utiles::ThrowIfFailed(D3DCompileFromFile(TEXT("Shader/terrain.hlsl"), nullptr,
-		D3D_COMPILE_STANDARD_FILE_INCLUDE, "SHADOW_DOMAIN_MAIN", "ds_5_1", compileFlags, 0, &mdsByteCode, nullptr));
+	mvsByteCode = shaderCache.Compile("terrain.hlsl", nullptr, "SHADOW_VERTEX_MAIN", "vs_5_1");
+	mhsByteCode = shaderCache.Compile("terrain.hlsl", nullptr, "SHADOW_HULL_MAIN", "hs_5_1");
+	mdsByteCode = shaderCache.Compile("terrain.hlsl", nullptr, "SHADOW_DOMAIN_MAIN", "ds_5_1");
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
 	psoDesc.InputLayout = { inputLayout.data(), (UINT)inputLayout.size() };
@@ -328,5 +406,38 @@ TerrainShadowShader::TerrainShadowShader(const ComPtr<ID3D12Device>& device,
 	psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	psoDesc.SampleDesc.Count = 1;
 	psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
-	Utiles::ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
+	m_pipelineState = pipelineCache.CreateGraphicsPipelineState(psoDesc);
+}
+
+CdlodShadowShader::CdlodShadowShader(PipelineCache& pipelineCache,
+	const ComPtr<ID3D12RootSignature>& rootSignature, ShaderCache& shaderCache)
+{
+	vector<D3D12_INPUT_ELEMENT_DESC> inputLayout = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NODE", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+		{ "MORPH", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 12, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 } };
+
+	ComPtr<ID3DBlob> mvsByteCode;
+	mvsByteCode = shaderCache.Compile("terrain.hlsl", nullptr, "CDLOD_SHADOW_VERTEX_MAIN", "vs_5_1");
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
+	psoDesc.InputLayout = { inputLayout.data(), (UINT)inputLayout.size() };
+	psoDesc.pRootSignature = rootSignature.Get();
+	psoDesc.VS = {
+		reinterpret_cast<BYTE*>(mvsByteCode->GetBufferPointer()),
+		mvsByteCode->GetBufferSize() };
+	psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+	psoDesc.RasterizerState.DepthBias = 100000;
+	psoDesc.RasterizerState.DepthBiasClamp = 0.0f;
+	psoDesc.RasterizerState.SlopeScaledDepthBias = 1.0f;
+	psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+	psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+	psoDesc.SampleMask = UINT_MAX;
+	psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	psoDesc.NumRenderTargets = 0;
+	psoDesc.RTVFormats[0] = DXGI_FORMAT_UNKNOWN;
+	psoDesc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	psoDesc.SampleDesc.Count = 1;
+	psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	m_pipelineState = pipelineCache.CreateGraphicsPipelineState(psoDesc);
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "stdafx.h"
+#include "../Common/shadercache.h"
+#include "pipelinecache.h"
 
 class Shader abstract
 {
@@ -13,51 +15,148 @@ protected:
 	ComPtr<ID3D12PipelineState> m_pipelineState;
 };
 
-class ObjectShader : public Shader
+// The light counts and shadow filter a lit pixel shader is compiled for; lighting.hlsl and
+// common.hlsl read them as DIRECTIONAL_LIGHTS, POINT_LIGHTS, SPOT_LIGHTS and SHADOW_PCF_KERNEL.
+struct LightingPermutation
+{
+	INT		directionalLights = -1;		// Loops are unrolled to these; -1 loops over the runtime count.
+	INT		pointLights = -1;
+	INT		spotLights = -1;
+	UINT	shadowPcfKernel = Settings::ShadowPcfKernel;
+
+	// The tightest permutation for these counts: each is rounded up to a power of two, and one above
+	// Settings::MaxUnrolledLights keeps the runtime loop. Only directional lights are shadowed.
+	static LightingPermutation Select(XMUINT4 lightNum, UINT shadowPcfKernel);
+
+	UINT GetKey() const;
+	string GetName() const;
+};
+
+// A shader whose pixel stage calls Lighting(). It keeps a pipeline per LightingPermutation, all
+// sharing the other stages; the scene creates the ones its lights select while it builds.
+class LitShader abstract : public Shader
+{
+public:
+	~LitShader() override = default;
+
+	// Compiles the permutation's pixel shader and creates its pipeline, unless the shader already
+	// holds Settings::MaxShaderPermutations pipelines. Not to be called on one shader from two
+	// threads at once. Returns the permutation's instruction count, the generic one's when skipped.
+	UINT CreatePermutation(const LightingPermutation& permutation);
+
+	// Binds the permutation's pipeline from the next UpdateShaderVariable on. One that was never
+	// created falls back to the generic pipeline, which loops over the runtime counts.
+	void SetPermutation(const LightingPermutation& permutation);
+
+	UINT GetGenericInstructionCount() const { return m_genericInstructionCount; }
+
+protected:
+	LitShader(PipelineCache& pipelineCache, ShaderCache& shaderCache, const string& fileName,
+		vector<D3D_SHADER_MACRO> defines = {});
+
+	// `desc` has every stage but the pixel shader; `byteCodes` back those stages and `inputLayout`
+	// its input layout, and both are kept for later permutations. Creates the generic pipeline.
+	void CreatePipelines(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+		vector<D3D12_INPUT_ELEMENT_DESC> inputLayout, vector<ComPtr<ID3DBlob>> byteCodes);
+
+private:
+	ComPtr<ID3D12PipelineState> CreatePipeline(const LightingPermutation& permutation, UINT& instructionCount);
+
+private:
+	PipelineCache&										m_pipelineCache;
+	ShaderCache&										m_shaderCache;
+	string												m_fileName;
+	vector<D3D_SHADER_MACRO>							m_defines;
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC					m_desc;
+	vector<D3D12_INPUT_ELEMENT_DESC>					m_inputLayout;
+	vector<ComPtr<ID3DBlob>>							m_byteCodes;
+
+	struct Permutation
+	{
+		ComPtr<ID3D12PipelineState>	pipeline;
+		UINT						instructionCount;
+	};
+	unordered_map<UINT, Permutation>					m_pipelines;
+	ComPtr<ID3D12PipelineState>							m_genericPipeline;
+	UINT												m_genericInstructionCount;
+	BOOL												m_missing;
+};
+
+class ObjectShader : public LitShader
 {
 public:
-	ObjectShader(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12RootSignature>& rootSignature);
+	ObjectShader(PipelineCache& pipelineCache, const ComPtr<ID3D12RootSignature>& rootSignature,
+		ShaderCache& shaderCache);
 	~ObjectShader() override = default;
 };
 
 class SkyboxShader : public Shader
 {
 public:
-	SkyboxShader(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12RootSignature>& rootSignature);
+	SkyboxShader(PipelineCache& pipelineCache, const ComPtr<ID3D12RootSignature>& rootSignature,
+		ShaderCache& shaderCache);
 	~SkyboxShader() override = default;
 };
 
-class TerrainShader : public Shader
+class TerrainShader : public LitShader
 {
 public:
-	TerrainShader(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12RootSignature>& rootSignature);
+	// With `virtualTexture` the pixel shader samples a VirtualTexture instead of the base and detail
+	// layers; with `normalMap` it reads the mesh's baked normals and the domain shader skips them.
+	TerrainShader(PipelineCache& pipelineCache, const ComPtr<ID3D12RootSignature>& rootSignature,
+		ShaderCache& shaderCache, BOOL virtualTexture = FALSE, BOOL normalMap = FALSE);
 	~TerrainShader() override = default;
+
+private:
+	static vector<D3D_SHADER_MACRO> GetDefines(BOOL virtualTexture, BOOL normalMap);
+};
+
+// The terrain's CDLOD path: instanced grids displaced in the vertex shader, lit like TerrainShader.
+class CdlodShader : public LitShader
+{
+public:
+	CdlodShader(PipelineCache& pipelineCache, const ComPtr<ID3D12RootSignature>& rootSignature,
+		ShaderCache& shaderCache, BOOL virtualTexture = FALSE);
+	~CdlodShader() override = default;
 };
 
-class BillboardShader : public Shader
+class BillboardShader : public LitShader
 {
 public:
-	BillboardShader(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12RootSignature>& rootSignature);
+	BillboardShader(PipelineCache& pipelineCache, const ComPtr<ID3D12RootSignature>& rootSignature,
+		ShaderCache& shaderCache);
 	~BillboardShader() override = default;
 };
 
 class ObjectShadowShader : public Shader
 {
 public:
-	ObjectShadowShader(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12RootSignature>& rootSignature);
+	ObjectShadowShader(PipelineCache& pipelineCache, const ComPtr<ID3D12RootSignature>& rootSignature,
+		ShaderCache& shaderCache);
 	~ObjectShadowShader() override = default;
 };
 
 class BillboardShadowShader : public Shader
 {
 public:
-	BillboardShadowShader(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12RootSignature>& rootSignature);
+	BillboardShadowShader(PipelineCache& pipelineCache, const ComPtr<ID3D12RootSignature>& rootSignature,
+		ShaderCache& shaderCache);
 	~BillboardShadowShader() override = default;
 };
 
 class TerrainShadowShader : public Shader
 {
 public:
-	TerrainShadowShader(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12RootSignature>& rootSignature);
+	TerrainShadowShader(PipelineCache& pipelineCache, const ComPtr<ID3D12RootSignature>& rootSignature,
+		ShaderCache& shaderCache);
 	~TerrainShadowShader() override = default;
+};
+
+class CdlodShadowShader : public Shader
+{
+public:
+	CdlodShadowShader(PipelineCache& pipelineCache, const ComPtr<ID3D12RootSignature>& rootSignature,
+		ShaderCache& shaderCache);
+	~CdlodShadowShader() override = default;
 };
\ No newline at end of file
@@ -23,7 +23,14 @@
 #include <random>
 #include <algorithm>
 #include <vector>
+#include <array>
 #include <unordered_map>
+#include <span>
+#include <charconv>
+#include <filesystem>
+#include <mutex>
+#include <chrono>
+#include <bit>
 
 #pragma comment(lib, "d3d12.lib")
 #pragma comment(lib, "dxgi.lib")
@@ -33,6 +40,7 @@
 #include <d3d12.h>
 #include <d3d12sdklayers.h>
 #include <d3dcompiler.h>
+#include <d3d12shader.h>
 #include <DirectXMath.h>
 #include <DirectXCollision.h>
 #include "../Common/d3dx12.h"
@@ -0,0 +1,165 @@
+#include "streaming.h"
+#include "../Common/DDSTextureLoader12.h"
+
+TextureStreamer::TextureStreamer(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12CommandQueue>& commandQueue) :
+	m_device{ device }, m_commandQueue{ commandQueue },
+	m_streamer{ Settings::TextureStreamingBudget, Settings::TextureStreamingFrameBudget }
+{
+}
+
+BOOL TextureStreamer::IsSupported(const ComPtr<ID3D12Device>& device)
+{
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options{};
+	if (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)))) return false;
+	return options.TiledResourcesTier != D3D12_TILED_RESOURCES_TIER_NOT_SUPPORTED;
+}
+
+BOOL TextureStreamer::CreateTexture(const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName,
+	ComPtr<ID3D12Resource>& texture, ComPtr<ID3D12Resource>& uploadBuffer, TextureId& id)
+{
+	StreamedTexture streamed;
+	streamed.data = Assets::Load(fileName);
+
+	D3D12_RESOURCE_DESC desc{};
+	bool isCubeMap{ false };
+	Utiles::ThrowIfFailed(DirectX::LoadDDSTextureDataFromMemory(m_device.Get(),
+		reinterpret_cast<const uint8_t*>(streamed.data.GetData().data()), streamed.data.GetSize(), 0,
+		DDS_LOADER_DEFAULT, &desc, streamed.subresources, nullptr, &isCubeMap));
+	if (isCubeMap || desc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D || desc.DepthOrArraySize != 1 ||
+		desc.MipLevels < 2 || streamed.subresources.size() != desc.MipLevels) return false;
+
+	desc.Layout = D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE;
+	if (FAILED(m_device->CreateReservedResource(&desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+		IID_PPV_ARGS(&streamed.texture)))) return false;
+
+	UINT tileCount{};
+	D3D12_PACKED_MIP_INFO packedMipInfo{};
+	D3D12_TILE_SHAPE tileShape{};
+	UINT subresourceTilingCount{ desc.MipLevels };
+	vector<D3D12_SUBRESOURCE_TILING> tilings(desc.MipLevels);
+	m_device->GetResourceTiling(streamed.texture.Get(), &tileCount, &packedMipInfo, &tileShape,
+		&subresourceTilingCount, 0, tilings.data());
+
+	const UINT tailMip = packedMipInfo.NumStandardMips;
+	if (tailMip == 0) return false;
+
+	vector<uint64_t> mipBytes(desc.MipLevels, 0);
+	for (UINT mip = 0; mip < tailMip; ++mip) {
+		const auto& tiling = tilings[mip];
+		streamed.tileCounts.push_back(tiling.WidthInTiles * tiling.HeightInTiles * tiling.DepthInTiles);
+		mipBytes[mip] = static_cast<uint64_t>(streamed.tileCounts.back()) * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+	}
+	mipBytes[tailMip] = static_cast<uint64_t>(packedMipInfo.NumTilesForPackedMips) * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+	streamed.heaps.resize(tailMip);
+
+	// The mip tail stays mapped for the texture's lifetime.
+	const UINT tailCount = desc.MipLevels - tailMip;
+	if (packedMipInfo.NumTilesForPackedMips > 0) {
+		streamed.tailHeap = CreateTileHeap(packedMipInfo.NumTilesForPackedMips);
+		lock_guard lock{ m_mutex };
+		MapTiles(streamed.texture.Get(), tailMip, packedMipInfo.NumTilesForPackedMips, streamed.tailHeap.Get());
+	}
+
+	Utiles::ThrowIfFailed(m_device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(GetRequiredIntermediateSize(streamed.texture.Get(), tailMip, tailCount)),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&uploadBuffer)));
+	UpdateSubresources(commandList.Get(), streamed.texture.Get(), uploadBuffer.Get(), 0, tailMip, tailCount,
+		streamed.subresources.data() + tailMip);
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(streamed.texture.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+
+	texture = streamed.texture;
+	lock_guard lock{ m_mutex };
+	id = m_streamer.Register(move(mipBytes), tailMip);
+	if (id >= m_textures.size()) m_textures.resize(id + 1);
+	m_textures[id] = move(streamed);
+	return true;
+}
+
+void TextureStreamer::Release(TextureId id)
+{
+	lock_guard lock{ m_mutex };
+	m_streamer.Unregister(id);
+	m_textures[id] = StreamedTexture{};
+}
+
+void TextureStreamer::Request(TextureId id, UINT mip)
+{
+	lock_guard lock{ m_mutex };
+	m_streamer.Request(id, mip);
+}
+
+UINT TextureStreamer::GetResidentMip(TextureId id) const
+{
+	lock_guard lock{ m_mutex };
+	return m_streamer.GetResidentMip(id);
+}
+
+void TextureStreamer::Update(const ComPtr<ID3D12GraphicsCommandList>& commandList)
+{
+	lock_guard lock{ m_mutex };
+	m_retiredHeaps.clear();
+	m_uploadBuffer.Reset();
+
+	const auto plan = m_streamer.Update();
+	for (const auto& eviction : plan.evictions) {
+		auto& streamed = m_textures[eviction.texture];
+		MapTiles(streamed.texture.Get(), eviction.mip, streamed.tileCounts[eviction.mip], nullptr);
+		m_retiredHeaps.push_back(move(streamed.heaps[eviction.mip]));
+	}
+	if (plan.uploads.empty()) return;
+
+	vector<UINT64> offsets;
+	UINT64 uploadSize{ 0 };
+	for (const auto& upload : plan.uploads) {
+		uploadSize = (uploadSize + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1) & ~static_cast<UINT64>(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+		offsets.push_back(uploadSize);
+		uploadSize += GetRequiredIntermediateSize(m_textures[upload.texture].texture.Get(), upload.mip, 1);
+	}
+	Utiles::ThrowIfFailed(m_device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&m_uploadBuffer)));
+
+	// Tile mappings go through the queue ahead of this frame's command list, so the copies land.
+	for (size_t i = 0; i < plan.uploads.size(); ++i) {
+		const auto& upload = plan.uploads[i];
+		auto& streamed = m_textures[upload.texture];
+		streamed.heaps[upload.mip] = CreateTileHeap(streamed.tileCounts[upload.mip]);
+		MapTiles(streamed.texture.Get(), upload.mip, streamed.tileCounts[upload.mip], streamed.heaps[upload.mip].Get());
+
+		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(streamed.texture.Get(),
+			D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST, upload.mip));
+		UpdateSubresources(commandList.Get(), streamed.texture.Get(), m_uploadBuffer.Get(), offsets[i],
+			upload.mip, 1, &streamed.subresources[upload.mip]);
+		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(streamed.texture.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ, upload.mip));
+	}
+}
+
+ComPtr<ID3D12Heap> TextureStreamer::CreateTileHeap(UINT tileCount)
+{
+	ComPtr<ID3D12Heap> heap;
+	const CD3DX12_HEAP_DESC heapDesc{ static_cast<UINT64>(tileCount) * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES,
+		D3D12_HEAP_TYPE_DEFAULT, 0, D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES };
+	Utiles::ThrowIfFailed(m_device->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap)));
+	return heap;
+}
+
+// Must be called with m_mutex held.
+void TextureStreamer::MapTiles(ID3D12Resource* texture, UINT subresource, UINT tileCount, ID3D12Heap* heap)
+{
+	const D3D12_TILED_RESOURCE_COORDINATE coordinate{ 0, 0, 0, subresource };
+	const D3D12_TILE_REGION_SIZE regionSize{ tileCount, FALSE, 0, 0, 0 };
+	const D3D12_TILE_RANGE_FLAGS flags{ heap ? D3D12_TILE_RANGE_FLAG_NONE : D3D12_TILE_RANGE_FLAG_NULL };
+	const UINT heapOffset{ 0 };
+	m_commandQueue->UpdateTileMappings(texture, 1, &coordinate, &regionSize, heap,
+		1, &flags, &heapOffset, &tileCount, D3D12_TILE_MAPPING_FLAG_NONE);
+}
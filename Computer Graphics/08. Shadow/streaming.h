@@ -0,0 +1,58 @@
+#pragma once
+#include "stdafx.h"
+#include "../Common/mipstreaming.h"
+#include "../Common/assetpack.h"
+
+// Backs 2D textures with reserved resources whose mips above the packed tail are mapped to heaps
+// on demand. Scheduling is MipStreamer's; this class maps tiles, records uploads and evicts.
+// Update must run at the start of a frame while the GPU is idle.
+class TextureStreamer
+{
+public:
+	using TextureId = MipStreamer::TextureId;
+
+	TextureStreamer(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12CommandQueue>& commandQueue);
+	~TextureStreamer() = default;
+
+	static BOOL IsSupported(const ComPtr<ID3D12Device>& device);
+
+	// Creates the texture with only its mip tail resident and records the tail upload. Returns false,
+	// leaving the outputs untouched, when the file is not a plain 2D texture with mips to stream.
+	BOOL CreateTexture(const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName,
+		ComPtr<ID3D12Resource>& texture, ComPtr<ID3D12Resource>& uploadBuffer, TextureId& id);
+	void Release(TextureId id);
+
+	void Request(TextureId id, UINT mip);
+	UINT GetResidentMip(TextureId id) const;
+
+	// Maps and uploads the mips scheduled for this frame into `commandList` and unmaps evicted ones.
+	void Update(const ComPtr<ID3D12GraphicsCommandList>& commandList);
+
+	const ComPtr<ID3D12Device>& GetDevice() const { return m_device; }
+
+private:
+	struct StreamedTexture
+	{
+		ComPtr<ID3D12Resource>				texture;
+		AssetData							data;
+		vector<D3D12_SUBRESOURCE_DATA>		subresources;
+		vector<UINT>						tileCounts;
+		vector<ComPtr<ID3D12Heap>>			heaps;
+		ComPtr<ID3D12Heap>					tailHeap;
+	};
+
+	ComPtr<ID3D12Heap> CreateTileHeap(UINT tileCount);
+	void MapTiles(ID3D12Resource* texture, UINT subresource, UINT tileCount, ID3D12Heap* heap);
+
+private:
+	ComPtr<ID3D12Device>					m_device;
+	ComPtr<ID3D12CommandQueue>				m_commandQueue;
+
+	mutable mutex							m_mutex;
+	MipStreamer								m_streamer;
+	vector<StreamedTexture>					m_textures;
+
+	// Released on the next Update, once the frame that last used them has finished.
+	vector<ComPtr<ID3D12Heap>>				m_retiredHeaps;
+	ComPtr<ID3D12Resource>					m_uploadBuffer;
+};
@@ -1,21 +1,34 @@
 #include "texture.h"
 #include "../Common/DDSTextureLoader12.h"
+#include "../Common/assetpack.h"
 
-Texture::Texture(const ComPtr<ID3D12Device>& device)
+Texture::Texture(const ComPtr<ID3D12Device>& device) : m_registry{ nullptr }, m_streamer{ nullptr }
 {
 	m_srvDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 }
 
-Texture::Texture(const ComPtr<ID3D12Device>& device,
-	const ComPtr<ID3D12GraphicsCommandList>& commandList, 
-	const wstring& fileName, UINT rootParameterIndex, BOOL createResourceView)
+Texture::Texture(const ComPtr<ID3D12Device>& device, TextureRegistry& registry, TextureStreamer* streamer) :
+	Texture(device)
 {
-	m_srvDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	m_registry = &registry;
+	m_streamer = streamer;
+}
 
+Texture::Texture(const ComPtr<ID3D12Device>& device, TextureRegistry& registry,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, 
+	const wstring& fileName, UINT rootParameterIndex, BOOL createResourceView) : Texture(device, registry)
+{
 	LoadTexture(device, commandList, fileName, rootParameterIndex);
 	if (createResourceView) CreateShaderVariable(device);
 }
 
+Texture::~Texture()
+{
+	for (const auto& handle : m_resourceHandles) {
+		m_registry->Release(handle);
+	}
+}
+
 void Texture::UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandList>& commandList) const
 {
 	ID3D12DescriptorHeap* ppHeaps[] = { m_srvDescriptorHeap.Get() };
@@ -31,6 +44,9 @@ void Texture::ReleaseUploadBuffer()
 		uploadBuffer.Reset();
 	}
 	m_textureUploadBuffer.clear();
+	for (const auto& handle : m_resourceHandles) {
+		m_registry->Get(handle)->uploadBuffer.Reset();
+	}
 }
 
 void Texture::LoadTexture(const ComPtr<ID3D12Device>& device,
@@ -39,34 +55,154 @@ void Texture::LoadTexture(const ComPtr<ID3D12Device>& device,
 {
 	m_rootParameterIndex = rootParameterIndex;
 
-	ComPtr<ID3D12Resource> texture;
-	ComPtr<ID3D12Resource> textureUploadBuffer;
+	if (!m_registry) {
+		auto resource = CreateTextureResource(device, commandList, fileName, nullptr);
+		m_textures.push_back(resource->texture);
+		m_textureUploadBuffer.push_back(resource->uploadBuffer);
+		return;
+	}
+
+	// Only the first texture to reference a file records its upload.
+	const auto handle = m_registry->Acquire(Assets::GetKey(fileName),
+		[&] { return CreateTextureResource(device, commandList, fileName, m_streamer); });
+	m_resourceHandles.push_back(handle);
+	m_textures.push_back(m_registry->Get(handle)->texture);
+}
+
+shared_ptr<TextureResource> Texture::CreateTextureResource(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName, TextureStreamer* streamer)
+{
+	auto resource = make_shared<TextureResource>();
+	auto& texture = resource->texture;
+	auto& textureUploadBuffer = resource->uploadBuffer;
+
+	if (streamer && streamer->CreateTexture(commandList, fileName, texture, textureUploadBuffer, resource->streamId)) {
+		resource->streamer = streamer;
+		return resource;
+	}
 
-	unique_ptr<uint8_t[]> ddsData;
+	// Large loose files and pack entries are mapped, so the header is parsed in place and the
+	// subresources point into the mapping, which must outlive the row copy below.
+	const AssetData ddsData = Assets::Load(fileName);
 	vector<D3D12_SUBRESOURCE_DATA> subresources;
 	DDS_ALPHA_MODE ddsAlphaMode{ DDS_ALPHA_MODE_UNKNOWN };
-	Utiles::ThrowIfFailed(DirectX::LoadDDSTextureFromFileEx(device.Get(), fileName.c_str(), 0,
-		D3D12_RESOURCE_FLAG_NONE, DDS_LOADER_DEFAULT, texture.GetAddressOf(), ddsData, subresources, &ddsAlphaMode));
+	Utiles::ThrowIfFailed(DirectX::LoadDDSTextureFromMemoryEx(device.Get(),
+		reinterpret_cast<const uint8_t*>(ddsData.GetData().data()), ddsData.GetSize(), 0,
+		D3D12_RESOURCE_FLAG_NONE, DDS_LOADER_DEFAULT, texture.GetAddressOf(), subresources, &ddsAlphaMode));
 
-	UINT nSubresources{ (UINT)subresources.size() };
-	const UINT64 TextureSize{ GetRequiredIntermediateSize(texture.Get(), 0, nSubresources) };
+	UploadSubresources(device, commandList, *resource, subresources);
+	return resource;
+}
+
+void Texture::LoadTextureArray(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList,
+	const vector<wstring>& fileNames, UINT rootParameterIndex)
+{
+	if (fileNames.size() == 1) {
+		LoadTexture(device, commandList, fileNames.front(), rootParameterIndex);
+		return;
+	}
+	m_rootParameterIndex = rootParameterIndex;
+
+	if (!m_registry) {
+		auto resource = CreateTextureArrayResource(device, commandList, fileNames);
+		m_textures.push_back(resource->texture);
+		m_textureUploadBuffer.push_back(resource->uploadBuffer);
+		return;
+	}
+
+	// The same files in the same order share one array.
+	string key;
+	for (const auto& fileName : fileNames) {
+		if (!key.empty()) key += '|';
+		key += Assets::GetKey(fileName);
+	}
+	const auto handle = m_registry->Acquire(key,
+		[&] { return CreateTextureArrayResource(device, commandList, fileNames); });
+	m_resourceHandles.push_back(handle);
+	m_textures.push_back(m_registry->Get(handle)->texture);
+}
+
+shared_ptr<TextureResource> Texture::CreateTextureArrayResource(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, const vector<wstring>& fileNames)
+{
+	// Every file stays loaded until its rows are written to the upload buffer. Slices follow each
+	// other in D3D12 subresource order, so the per-file subresources are simply appended.
+	vector<AssetData> files;
+	files.reserve(fileNames.size());
+	vector<D3D12_SUBRESOURCE_DATA> subresources;
+	D3D12_RESOURCE_DESC desc{};
+	for (const auto& fileName : fileNames) {
+		const AssetData& ddsData = files.emplace_back(Assets::Load(fileName));
+		D3D12_RESOURCE_DESC fileDesc{};
+		vector<D3D12_SUBRESOURCE_DATA> fileSubresources;
+		bool isCubeMap{};
+		Utiles::ThrowIfFailed(DirectX::LoadDDSTextureDataFromMemory(device.Get(),
+			reinterpret_cast<const uint8_t*>(ddsData.GetData().data()), ddsData.GetSize(), 0,
+			DDS_LOADER_DEFAULT, &fileDesc, fileSubresources, nullptr, &isCubeMap));
+
+		if (subresources.empty()) {
+			desc = fileDesc;
+			desc.DepthOrArraySize = 0;
+		}
+		if (isCubeMap || fileDesc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D || fileDesc.Format != desc.Format ||
+			fileDesc.Width != desc.Width || fileDesc.Height != desc.Height || fileDesc.MipLevels != desc.MipLevels) {
+			Utiles::ThrowIfFailed(E_INVALIDARG);
+		}
+		desc.DepthOrArraySize += fileDesc.DepthOrArraySize;
+		subresources.insert(subresources.end(), fileSubresources.begin(), fileSubresources.end());
+	}
+
+	auto resource = make_shared<TextureResource>();
+	Utiles::ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&desc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&resource->texture)
+	));
+
+	UploadSubresources(device, commandList, *resource, subresources);
+	return resource;
+}
+
+void Texture::UploadSubresources(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList, TextureResource& resource,
+	const vector<D3D12_SUBRESOURCE_DATA>& subresources)
+{
+	auto& texture = resource.texture;
+	auto& textureUploadBuffer = resource.uploadBuffer;
+
+	vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts;
+	vector<UINT> numRows;
+	UINT64 uploadSize{};
+	Utiles::ThrowIfFailed(DirectX::GetDDSUploadFootprints(texture->GetDesc(), 0, layouts, numRows, &uploadSize));
 
 	Utiles::ThrowIfFailed(device->CreateCommittedResource(
 		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
 		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(TextureSize),
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadSize),
 		D3D12_RESOURCE_STATE_GENERIC_READ,
 		nullptr,
 		IID_PPV_ARGS(&textureUploadBuffer)
 	));
 
-	UpdateSubresources(commandList.Get(), texture.Get(), textureUploadBuffer.Get(), 0, 0, nSubresources, subresources.data());
+	// Rows go from the file straight into upload memory at the aligned pitch, one copy in total.
+	uint8_t* uploadData{};
+	CD3DX12_RANGE readRange{ 0, 0 };
+	Utiles::ThrowIfFailed(textureUploadBuffer->Map(0, &readRange, reinterpret_cast<void**>(&uploadData)));
+	DirectX::WriteDDSSubresources(uploadData, layouts, numRows, subresources);
+	textureUploadBuffer->Unmap(0, nullptr);
+
+	for (UINT i = 0; i < static_cast<UINT>(layouts.size()); ++i) {
+		CD3DX12_TEXTURE_COPY_LOCATION destination{ texture.Get(), i };
+		CD3DX12_TEXTURE_COPY_LOCATION source{ textureUploadBuffer.Get(), layouts[i] };
+		commandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+	}
 
 	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
 		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
-
-	m_textures.push_back(texture);
-	m_textureUploadBuffer.push_back(textureUploadBuffer);
 }
 
 void Texture::CreateShaderVariable(const ComPtr<ID3D12Device>& device)
@@ -85,44 +221,90 @@ void Texture::CreateSrvDescriptorHeap(const ComPtr<ID3D12Device>& device)
 		&srvHeapDesc, IID_PPV_ARGS(&m_srvDescriptorHeap)));
 }
 
+void Texture::RequestMips(UINT index, FLOAT uvPerUnit, FLOAT pixelsPerUnit)
+{
+	const TextureResource* resource = GetStreamedResource(index);
+	if (!resource) return;
+
+	const auto desc = resource->texture->GetDesc();
+	resource->streamer->Request(resource->streamId, MipStreaming::GetRequiredMip(
+		static_cast<FLOAT>(desc.Width) * uvPerUnit, pixelsPerUnit, desc.MipLevels));
+}
+
+void Texture::UpdateResidency()
+{
+	if (!m_streamer || !m_srvDescriptorHeap) return;
+
+	for (UINT index = 0; index < m_viewMips.size(); ++index) {
+		const TextureResource* resource = GetStreamedResource(index);
+		if (!resource || resource->streamer->GetResidentMip(resource->streamId) == m_viewMips[index]) continue;
+		WriteShaderResourceView(m_streamer->GetDevice(), index);
+	}
+}
+
+const TextureResource* Texture::GetStreamedResource(UINT index) const
+{
+	if (!m_registry || index >= m_resourceHandles.size()) return nullptr;
+	const auto& resource = m_registry->Get(m_resourceHandles[index]);
+	return resource->streamer ? resource.get() : nullptr;
+}
+
 void Texture::CreateShaderResourceView(const ComPtr<ID3D12Device>& device)
+{
+	m_viewMips.assign(m_textures.size(), 0);
+	for (UINT index = 0; index < m_textures.size(); ++index) {
+		WriteShaderResourceView(device, index);
+	}
+}
+
+void Texture::WriteShaderResourceView(const ComPtr<ID3D12Device>& device, UINT index)
 {
 	CD3DX12_CPU_DESCRIPTOR_HANDLE descriptorHandle{ 
-		m_srvDescriptorHeap->GetCPUDescriptorHandleForHeapStart() };
-
-	for (const auto& texture : m_textures) {
-		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-
-		switch (m_rootParameterIndex)
-		{
-		case RootParameter::Texture:
-			srvDesc.Format = texture->GetDesc().Format;
-			srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-			srvDesc.Texture2D.MostDetailedMip = 0;
-			srvDesc.Texture2D.MipLevels = texture->GetDesc().MipLevels;
-			srvDesc.Texture2D.ResourceMinLODClamp = 0.f;
-			break;
-		case RootParameter::TextureCube:
-			srvDesc.Format = texture->GetDesc().Format;
-			srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
-			srvDesc.TextureCube.MostDetailedMip = 0;
-			srvDesc.TextureCube.MipLevels = texture->GetDesc().MipLevels;
-			srvDesc.TextureCube.ResourceMinLODClamp = 0.f;
-			break;
-		case RootParameter::TextureShadow:
-			srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
-			srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-			srvDesc.Texture2D.MostDetailedMip = 0;
-			srvDesc.Texture2D.MipLevels = texture->GetDesc().MipLevels;
-			srvDesc.Texture2D.ResourceMinLODClamp = 0.f;
-			srvDesc.Texture2D.PlaneSlice = 0;
-			break;
-		default:
-			break;
-		}
-		device->CreateShaderResourceView(texture.Get(), &srvDesc, descriptorHandle);
+		m_srvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), static_cast<INT>(index), m_srvDescriptorSize };
+	const auto& texture = m_textures[index];
+
+	// Streamed textures only expose their resident mips.
+	const TextureResource* resource = GetStreamedResource(index);
+	m_viewMips[index] = resource ? resource->streamer->GetResidentMip(resource->streamId) : 0;
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
-		descriptorHandle.Offset(1, m_srvDescriptorSize);
+	switch (m_rootParameterIndex)
+	{
+	case RootParameter::Texture:
+		srvDesc.Format = texture->GetDesc().Format;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = texture->GetDesc().MipLevels;
+		srvDesc.Texture2D.ResourceMinLODClamp = static_cast<FLOAT>(m_viewMips[index]);
+		break;
+	case RootParameter::TextureArray:
+		srvDesc.Format = texture->GetDesc().Format;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MostDetailedMip = 0;
+		srvDesc.Texture2DArray.MipLevels = texture->GetDesc().MipLevels;
+		srvDesc.Texture2DArray.FirstArraySlice = 0;
+		srvDesc.Texture2DArray.ArraySize = texture->GetDesc().DepthOrArraySize;
+		srvDesc.Texture2DArray.ResourceMinLODClamp = static_cast<FLOAT>(m_viewMips[index]);
+		break;
+	case RootParameter::TextureCube:
+		srvDesc.Format = texture->GetDesc().Format;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+		srvDesc.TextureCube.MostDetailedMip = 0;
+		srvDesc.TextureCube.MipLevels = texture->GetDesc().MipLevels;
+		srvDesc.TextureCube.ResourceMinLODClamp = 0.f;
+		break;
+	case RootParameter::TextureShadow:
+		srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = texture->GetDesc().MipLevels;
+		srvDesc.Texture2D.ResourceMinLODClamp = 0.f;
+		srvDesc.Texture2D.PlaneSlice = 0;
+		break;
+	default:
+		break;
 	}
+	device->CreateShaderResourceView(texture.Get(), &srvDesc, descriptorHandle);
 }
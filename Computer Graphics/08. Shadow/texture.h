@@ -1,15 +1,36 @@
 #pragma once
 #include "stdafx.h"
+#include "../Common/assetregistry.h"
+#include "streaming.h"
+
+// A DDS file uploaded to the GPU, shared by every Texture that references the file.
+struct TextureResource
+{
+	~TextureResource() { if (streamer) streamer->Release(streamId); }
+
+	ComPtr<ID3D12Resource> texture;
+	ComPtr<ID3D12Resource> uploadBuffer;
+
+	// Set when the mips above the tail are streamed in on demand.
+	TextureStreamer* streamer = nullptr;
+	TextureStreamer::TextureId streamId = 0;
+};
+using TextureRegistry = AssetRegistry<TextureResource>;
 
 class Texture
 {
 public:
 	Texture() = delete;
 	Texture(const ComPtr<ID3D12Device>& device);
-	Texture(const ComPtr<ID3D12Device>& device, 
+	// Files loaded through a registry are uploaded once and shared with other textures.
+	// With a streamer, 2D files start with their mip tail and stream finer mips on request.
+	Texture(const ComPtr<ID3D12Device>& device, TextureRegistry& registry, TextureStreamer* streamer = nullptr);
+	Texture(const ComPtr<ID3D12Device>& device, TextureRegistry& registry,
 		const ComPtr<ID3D12GraphicsCommandList>& commandList, 
 		const wstring& fileName, UINT rootParameterIndex, BOOL createResourceView = true);
-	~Texture() = default;
+	Texture(const Texture&) = delete;
+	Texture& operator=(const Texture&) = delete;
+	~Texture();
 
 	virtual void UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandList>& commandList) const;
 	void ReleaseUploadBuffer();
@@ -17,12 +38,37 @@ public:
 	void LoadTexture(const ComPtr<ID3D12Device>& device,
 		const ComPtr<ID3D12GraphicsCommandList>& commandList,
 		const wstring& fileName, UINT rootParameterIndex);
+	// Stacks same-format files of one size and mip count into a single Texture2DArray, in order, so
+	// the shader picks a slice instead of a descriptor. A single file that is already an array (see
+	// the exporter's array command) is loaded as is. Arrays are not streamed.
+	void LoadTextureArray(const ComPtr<ID3D12Device>& device,
+		const ComPtr<ID3D12GraphicsCommandList>& commandList,
+		const vector<wstring>& fileNames, UINT rootParameterIndex);
 	virtual void CreateShaderVariable(const ComPtr<ID3D12Device>& device);
 
+	// Asks for the mip of texture `index` that matches its on-screen texel density, where one world
+	// unit covers `uvPerUnit` of the texture and spans `pixelsPerUnit` pixels.
+	void RequestMips(UINT index, FLOAT uvPerUnit, FLOAT pixelsPerUnit);
+	// Clamps the views to the mips resident after TextureStreamer::Update.
+	void UpdateResidency();
+
+	UINT GetArraySize(UINT index) const { return m_textures[index]->GetDesc().DepthOrArraySize; }
+
 protected:
 	virtual void CreateSrvDescriptorHeap(const ComPtr<ID3D12Device>& device);
 	virtual void CreateShaderResourceView(const ComPtr<ID3D12Device>& device);
 
+	void WriteShaderResourceView(const ComPtr<ID3D12Device>& device, UINT index);
+	const TextureResource* GetStreamedResource(UINT index) const;
+
+	static shared_ptr<TextureResource> CreateTextureResource(const ComPtr<ID3D12Device>& device,
+		const ComPtr<ID3D12GraphicsCommandList>& commandList, const wstring& fileName, TextureStreamer* streamer);
+	static shared_ptr<TextureResource> CreateTextureArrayResource(const ComPtr<ID3D12Device>& device,
+		const ComPtr<ID3D12GraphicsCommandList>& commandList, const vector<wstring>& fileNames);
+	static void UploadSubresources(const ComPtr<ID3D12Device>& device,
+		const ComPtr<ID3D12GraphicsCommandList>& commandList, TextureResource& resource,
+		const vector<D3D12_SUBRESOURCE_DATA>& subresources);
+
 protected:
 	UINT m_srvDescriptorSize;
 
@@ -30,5 +76,10 @@ protected:
 	UINT										m_rootParameterIndex;
 	vector<ComPtr<ID3D12Resource>>				m_textures;
 	vector<ComPtr<ID3D12Resource>>				m_textureUploadBuffer;
+
+	TextureRegistry*							m_registry;
+	vector<AssetHandle<TextureResource>>		m_resourceHandles;
+	TextureStreamer*							m_streamer;
+	vector<UINT>								m_viewMips;
 };
 
@@ -11,6 +11,53 @@ namespace Utiles
         }
     }
 
+    // Hands what is written to it to the debugger's output window a line at a time and passes it
+    // on to `next`, so cout's reports reach a debugger whether or not the process has a console.
+    class DebugOutputBuffer : public streambuf
+    {
+    public:
+        explicit DebugOutputBuffer(streambuf* next) : m_next{ next } {}
+
+    protected:
+        int_type overflow(int_type c) override
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+            const char character = traits_type::to_char_type(c);
+            xsputn(&character, 1);
+            return c;
+        }
+        streamsize xsputn(const char* text, streamsize count) override
+        {
+            lock_guard lock{ m_mutex };
+            m_line.append(text, static_cast<size_t>(count));
+            if (m_line.find('\n') != string::npos) Flush();
+            return count;
+        }
+        int sync() override
+        {
+            lock_guard lock{ m_mutex };
+            Flush();
+            return 0;
+        }
+
+    private:
+        void Flush()
+        {
+            if (m_line.empty()) return;
+            OutputDebugStringA(m_line.c_str());
+            if (m_next) {
+                m_next->sputn(m_line.data(), static_cast<streamsize>(m_line.size()));
+                m_next->pubsync();
+            }
+            m_line.clear();
+        }
+
+    private:
+        streambuf*  m_next;
+        mutex       m_mutex;
+        string      m_line;
+    };
+
     namespace Random
     {
         inline INT GetInt(INT min, INT max)
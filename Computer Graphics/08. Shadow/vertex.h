@@ -21,13 +21,22 @@ struct TextureVertex : public VertexBase
 	XMFLOAT2 uv;
 };
 
+// A sample of the terrain's grid, shared by every patch it is a control point of; the domain
+// shader derives the per-patch detail uv from the domain location.
 struct TerrainVertex : public VertexBase
 {
 	TerrainVertex() = default;
-	TerrainVertex(XMFLOAT3 position, XMFLOAT2 uv0, XMFLOAT2 uv1, UINT density) :
-		position{ position }, uv0{ uv0 }, uv1{ uv1 }, density{ density } {}
+	TerrainVertex(XMFLOAT3 position, XMFLOAT2 uv0) :
+		position{ position }, uv0{ uv0 } {}
 	XMFLOAT3 position;
 	XMFLOAT2 uv0;
-	XMFLOAT2 uv1;
-	UINT density;
+};
+
+// A point of the CDLOD grid, from 0 to 1 across a quadtree node.
+struct GridVertex : public VertexBase
+{
+	GridVertex() = default;
+	GridVertex(XMFLOAT2 position) :
+		position{ position } {}
+	XMFLOAT2 position;
 };
\ No newline at end of file
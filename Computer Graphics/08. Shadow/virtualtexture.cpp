@@ -0,0 +1,307 @@
+#include "virtualtexture.h"
+
+using namespace VirtualTexturing;
+
+VirtualTexture::VirtualTexture(const ComPtr<ID3D12Device>& device,
+	const ComPtr<ID3D12GraphicsCommandList>& commandList,
+	const wstring& fileName, UINT feedbackWidth, UINT feedbackHeight) : Texture(device),
+	m_header{ ReadHeader(fileName) },
+	m_pageCache{ m_header.pagesPerSide, Settings::VirtualTexturePhysicalPages, Settings::VirtualTexturePageUploads },
+	m_slotSize{ m_header.pageSize + 2 * m_header.border },
+	m_slotsPerRow{ static_cast<UINT>(ceil(sqrt(static_cast<double>(Settings::VirtualTexturePhysicalPages)))) },
+	m_feedbackWidth{ feedbackWidth }, m_feedbackHeight{ feedbackHeight }, m_frame{ 0 }, m_uploadData{ nullptr }
+{
+	m_rootParameterIndex = RootParameter::VirtualTexture;
+	m_ioQueue = make_unique<IoQueue>(1);
+	m_file = m_ioQueue->Open(fileName);
+
+	CreateResources(device);
+	CreateShaderVariable(device);
+
+	// The coarsest page is read right away, so every lookup has a page to fall back on from the
+	// first frame; the whole page table is uploaded with it.
+	const auto uploads = m_pageCache.Update();
+	StartReads(uploads);
+	for (UINT index = 0; index < m_pending.size(); ++index) {
+		m_pending[index].ready.get();
+		CopyPage(commandList, m_pending[index], index);
+		m_pageCache.CompleteUpload(m_pending[index].page);
+	}
+	m_pending.clear();
+	UploadPageTable(commandList, m_pageCache.TakeDirtyMips());
+
+	const D3D12_RESOURCE_BARRIER barriers[]{
+		CD3DX12_RESOURCE_BARRIER::Transition(m_atlas.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(m_pageTable.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE) };
+	commandList->ResourceBarrier(_countof(barriers), barriers);
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	// Pending reads write into m_pending.
+	m_ioQueue->WaitIdle();
+	m_uploadBuffer->Unmap(0, nullptr);
+}
+
+FileHeader VirtualTexture::ReadHeader(const wstring& fileName)
+{
+	FileHeader header{};
+	ifstream in{ fileName, ios::binary };
+	in.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!in || header.magic != FileMagic || header.version != 1 || header.mipCount != GetMipCount(header.pagesPerSide)) {
+		Utiles::ThrowIfFailed(E_INVALIDARG);
+	}
+	return header;
+}
+
+void VirtualTexture::CreateResources(const ComPtr<ID3D12Device>& device)
+{
+	const auto format = static_cast<DXGI_FORMAT>(m_header.format);
+	const UINT atlasSize = m_slotsPerRow * m_slotSize;
+	Utiles::ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(format, atlasSize, atlasSize, 1, 1),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&m_atlas)));
+
+	const auto pageTableDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32_UINT,
+		m_header.pagesPerSide, m_header.pagesPerSide, 1, static_cast<UINT16>(m_header.mipCount));
+	Utiles::ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&pageTableDesc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&m_pageTable)));
+	m_textures = { m_atlas, m_pageTable };
+
+	// The feedback buffer is reset from a buffer of NoPage every frame and read back after the draw.
+	const UINT64 feedbackBytes = UINT64{ m_feedbackWidth } * m_feedbackHeight * sizeof(uint32_t);
+	Utiles::ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(feedbackBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&m_feedback)));
+	Utiles::ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(feedbackBytes),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&m_feedbackClear)));
+	Utiles::ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(feedbackBytes),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&m_feedbackReadback)));
+
+	void* clearData{};
+	CD3DX12_RANGE readRange{ 0, 0 };
+	Utiles::ThrowIfFailed(m_feedbackClear->Map(0, &readRange, &clearData));
+	memset(clearData, 0xFF, static_cast<size_t>(feedbackBytes));
+	m_feedbackClear->Unmap(0, nullptr);
+
+	// One page must match the footprint of a slot in the atlas format.
+	UINT64 pageTableBytes{}, pageBytes{};
+	vector<UINT> pageTableRows(m_header.mipCount);
+	vector<UINT64> pageTableRowBytes(m_header.mipCount);
+	m_pageTableLayouts.resize(m_header.mipCount);
+	device->GetCopyableFootprints(&pageTableDesc, 0, m_header.mipCount, 0,
+		m_pageTableLayouts.data(), pageTableRows.data(), pageTableRowBytes.data(), &pageTableBytes);
+	const auto slotDesc = CD3DX12_RESOURCE_DESC::Tex2D(format, m_slotSize, m_slotSize, 1, 1);
+	device->GetCopyableFootprints(&slotDesc, 0, 1, 0, &m_pageLayout, &m_pageRows, &m_pageRowBytes, &pageBytes);
+	if (m_pageRows * m_pageRowBytes != m_header.pageBytes) Utiles::ThrowIfFailed(E_INVALIDARG);
+
+	const auto atlasDesc = m_atlas->GetDesc();
+	device->GetCopyableFootprints(&atlasDesc, 0, 1, 0, nullptr, nullptr, nullptr, &m_atlasBytes);
+
+	constexpr UINT64 alignment = D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT;
+	m_pageStride = (pageBytes + alignment - 1) & ~(alignment - 1);
+	m_pageLayout.Offset = (pageTableBytes + alignment - 1) & ~(alignment - 1);
+	Utiles::ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(m_pageLayout.Offset + m_pageStride * Settings::VirtualTexturePageUploads),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&m_uploadBuffer)));
+	Utiles::ThrowIfFailed(m_uploadBuffer->Map(0, &readRange, reinterpret_cast<void**>(&m_uploadData)));
+}
+
+void VirtualTexture::CreateShaderVariable(const ComPtr<ID3D12Device>& device)
+{
+	// Atlas, page table and feedback, in the order of the root signature's table.
+	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+	heapDesc.NumDescriptors = 3;
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	Utiles::ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_srvDescriptorHeap)));
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE descriptorHandle{ m_srvDescriptorHeap->GetCPUDescriptorHandleForHeapStart() };
+	for (const auto& texture : m_textures) {
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.Format = texture->GetDesc().Format;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = texture->GetDesc().MipLevels;
+		device->CreateShaderResourceView(texture.Get(), &srvDesc, descriptorHandle);
+		descriptorHandle.Offset(1, m_srvDescriptorSize);
+	}
+
+	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_UINT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.NumElements = m_feedbackWidth * m_feedbackHeight;
+	device->CreateUnorderedAccessView(m_feedback.Get(), nullptr, &uavDesc, descriptorHandle);
+}
+
+void VirtualTexture::UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandList>& commandList) const
+{
+	Texture::UpdateShaderVariable(commandList);
+
+	// The feedback pixel of each block moves every frame, so over scale^2 frames every pixel reports.
+	const UINT scale = Settings::VirtualTextureFeedbackScale;
+	const UINT jitter = static_cast<UINT>(m_frame * 7 % (scale * scale));
+	const UINT constants[ConstantCount]{
+		m_header.pagesPerSide, m_header.mipCount, m_header.pageSize, m_header.border,
+		m_slotsPerRow, m_slotsPerRow * m_slotSize,
+		m_feedbackWidth, m_feedbackHeight, scale, (jitter / scale) << 16 | jitter % scale };
+	commandList->SetGraphicsRoot32BitConstants(RootParameter::VirtualTextureConstants,
+		ConstantCount, constants, 0);
+}
+
+void VirtualTexture::Update(const ComPtr<ID3D12GraphicsCommandList>& commandList)
+{
+	// Last frame has finished, so its feedback is in the readback buffer.
+	if (m_frame > 0) {
+		const UINT count = m_feedbackWidth * m_feedbackHeight;
+		const uint32_t* feedback{};
+		CD3DX12_RANGE readRange{ 0, count * sizeof(uint32_t) };
+		Utiles::ThrowIfFailed(m_feedbackReadback->Map(0, &readRange, reinterpret_cast<void**>(&feedback)));
+		m_pageCache.AddFeedback({ feedback, count });
+		CD3DX12_RANGE writeRange{ 0, 0 };
+		m_feedbackReadback->Unmap(0, &writeRange);
+	}
+	++m_frame;
+
+	// Pages whose reads finished go into their slots, at most one upload buffer's worth per frame.
+	vector<uint32_t> completed;
+	for (auto it = m_pending.begin(); it != m_pending.end() && completed.size() < Settings::VirtualTexturePageUploads;) {
+		if (it->ready.wait_for(chrono::seconds{ 0 }) != future_status::ready) {
+			++it;
+			continue;
+		}
+		it->ready.get();
+		if (completed.empty()) {
+			commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_atlas.Get(),
+				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+		}
+		CopyPage(commandList, *it, static_cast<UINT>(completed.size()));
+		completed.push_back(it->page);
+		it = m_pending.erase(it);
+	}
+	if (!completed.empty()) {
+		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_atlas.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+	}
+	for (const uint32_t page : completed) {
+		m_pageCache.CompleteUpload(page);
+	}
+
+	StartReads(m_pageCache.Update());
+
+	if (const uint32_t dirtyMips = m_pageCache.TakeDirtyMips()) {
+		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_pageTable.Get(),
+			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+		UploadPageTable(commandList, dirtyMips);
+		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_pageTable.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+	}
+
+	commandList->CopyResource(m_feedback.Get(), m_feedbackClear.Get());
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_feedback.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+}
+
+void VirtualTexture::ResolveFeedback(const ComPtr<ID3D12GraphicsCommandList>& commandList) const
+{
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_feedback.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
+	commandList->CopyResource(m_feedbackReadback.Get(), m_feedback.Get());
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_feedback.Get(),
+		D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+}
+
+UINT64 VirtualTexture::GetVirtualBytes() const
+{
+	return GetPageIndex(m_header.pagesPerSide, PackPage(m_header.mipCount, 0, 0)) * m_header.pageBytes;
+}
+
+UINT64 VirtualTexture::GetPhysicalBytes() const
+{
+	return m_atlasBytes;
+}
+
+void VirtualTexture::StartReads(const vector<PageCache::Upload>& uploads)
+{
+	// Coarse pages are read first; they stand in for the most pixels.
+	for (const auto& upload : uploads) {
+		PendingPage& pending = m_pending.emplace_back();
+		pending.page = upload.page;
+		pending.slot = upload.slot;
+		pending.data.resize(m_header.pageBytes);
+
+		IoQueue::Request request;
+		request.file = m_file;
+		request.offset = GetPageOffset(m_header, upload.page);
+		request.size = m_header.pageBytes;
+		request.destination = pending.data;
+		request.priority = static_cast<int>(UnpackPage(upload.page).mip);
+		pending.ready = m_ioQueue->Enqueue(request);
+	}
+}
+
+void VirtualTexture::CopyPage(const ComPtr<ID3D12GraphicsCommandList>& commandList,
+	const PendingPage& page, UINT index)
+{
+	// File rows are tightly packed; the upload buffer wants them at the aligned pitch.
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout = m_pageLayout;
+	layout.Offset += m_pageStride * index;
+	for (UINT row = 0; row < m_pageRows; ++row) {
+		memcpy(m_uploadData + layout.Offset + UINT64{ row } * layout.Footprint.RowPitch,
+			page.data.data() + row * m_pageRowBytes, static_cast<size_t>(m_pageRowBytes));
+	}
+
+	CD3DX12_TEXTURE_COPY_LOCATION destination{ m_atlas.Get(), 0 };
+	CD3DX12_TEXTURE_COPY_LOCATION source{ m_uploadBuffer.Get(), layout };
+	commandList->CopyTextureRegion(&destination,
+		page.slot % m_slotsPerRow * m_slotSize, page.slot / m_slotsPerRow * m_slotSize, 0, &source, nullptr);
+}
+
+void VirtualTexture::UploadPageTable(const ComPtr<ID3D12GraphicsCommandList>& commandList, uint32_t dirtyMips)
+{
+	for (UINT mip = 0; mip < m_header.mipCount; ++mip) {
+		if (!(dirtyMips & 1u << mip)) continue;
+
+		const auto& layout = m_pageTableLayouts[mip];
+		const auto entries = m_pageCache.GetPageTable(mip);
+		const UINT side = GetPagesPerSide(m_header.pagesPerSide, mip);
+		for (UINT y = 0; y < side; ++y) {
+			memcpy(m_uploadData + layout.Offset + UINT64{ y } * layout.Footprint.RowPitch,
+				entries.data() + size_t{ y } * side, side * sizeof(uint32_t));
+		}
+
+		CD3DX12_TEXTURE_COPY_LOCATION destination{ m_pageTable.Get(), mip };
+		CD3DX12_TEXTURE_COPY_LOCATION source{ m_uploadBuffer.Get(), layout };
+		commandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+	}
+}
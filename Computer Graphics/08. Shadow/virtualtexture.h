@@ -0,0 +1,81 @@
+#pragma once
+#include "stdafx.h"
+#include "texture.h"
+#include "../Common/ioqueue.h"
+#include "../Common/pagecache.h"
+
+// A .vt file baked by the exporter's vtbake command, sampled through a page table from a fixed
+// atlas of pages. The terrain's pixel shader writes the page each pixel wants into a feedback
+// buffer at a fraction of the window resolution; the next frame reads it back, reads the missing
+// pages from the file on an I/O thread and points the page table at the finest resident pages.
+// Update must run at the start of a frame while the GPU is idle, ResolveFeedback after the last
+// draw that samples the texture.
+class VirtualTexture : public Texture
+{
+public:
+	// Root constants of RootParameter::VirtualTextureConstants, in the order of virtualtexture.hlsl.
+	static constexpr UINT ConstantCount = 10;
+
+	VirtualTexture(const ComPtr<ID3D12Device>& device, const ComPtr<ID3D12GraphicsCommandList>& commandList,
+		const wstring& fileName, UINT feedbackWidth, UINT feedbackHeight);
+	~VirtualTexture();
+
+	void UpdateShaderVariable(const ComPtr<ID3D12GraphicsCommandList>& commandList) const override;
+
+	// Feeds last frame's feedback to the page cache, copies the pages that finished reading into the
+	// atlas, starts reading the next ones and clears the feedback buffer.
+	void Update(const ComPtr<ID3D12GraphicsCommandList>& commandList);
+	void ResolveFeedback(const ComPtr<ID3D12GraphicsCommandList>& commandList) const;
+
+	UINT64 GetVirtualBytes() const;
+	UINT64 GetPhysicalBytes() const;
+	const PageCache& GetPageCache() const { return m_pageCache; }
+
+private:
+	struct PendingPage
+	{
+		uint32_t			page;
+		uint32_t			slot;
+		vector<std::byte>	data;
+		future<void>		ready;
+	};
+
+	static VirtualTexturing::FileHeader ReadHeader(const wstring& fileName);
+
+	void CreateShaderVariable(const ComPtr<ID3D12Device>& device) override;
+	void CreateResources(const ComPtr<ID3D12Device>& device);
+
+	void StartReads(const vector<PageCache::Upload>& uploads);
+	void CopyPage(const ComPtr<ID3D12GraphicsCommandList>& commandList, const PendingPage& page, UINT index);
+	void UploadPageTable(const ComPtr<ID3D12GraphicsCommandList>& commandList, uint32_t dirtyMips);
+
+private:
+	VirtualTexturing::FileHeader				m_header;
+	PageCache									m_pageCache;
+	UINT										m_slotSize;
+	UINT										m_slotsPerRow;
+	UINT										m_feedbackWidth;
+	UINT										m_feedbackHeight;
+	UINT64										m_frame;
+
+	ComPtr<ID3D12Resource>						m_atlas;
+	ComPtr<ID3D12Resource>						m_pageTable;
+	ComPtr<ID3D12Resource>						m_feedback;
+	ComPtr<ID3D12Resource>						m_feedbackClear;
+	ComPtr<ID3D12Resource>						m_feedbackReadback;
+
+	// Page table mips first, then one page footprint per upload of the frame. Rewritten every
+	// Update, which is safe because the previous frame has finished by then.
+	ComPtr<ID3D12Resource>						m_uploadBuffer;
+	uint8_t*									m_uploadData;
+	vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>	m_pageTableLayouts;
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT			m_pageLayout;
+	UINT										m_pageRows;
+	UINT64										m_pageRowBytes;
+	UINT64										m_pageStride;
+	UINT64										m_atlasBytes;
+
+	vector<PendingPage>							m_pending;
+	unique_ptr<IoQueue>							m_ioQueue;
+	IoQueue::FileId								m_file;
+};
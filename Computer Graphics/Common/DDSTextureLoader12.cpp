@@ -18,6 +18,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <memory>
 #include <new>
 
@@ -1031,6 +1032,35 @@ namespace
     }
 
 
+    //--------------------------------------------------------------------------------------
+    inline bool IsPlanar(DXGI_FORMAT fmt) noexcept
+    {
+        switch (fmt)
+        {
+        case DXGI_FORMAT_NV12:
+        case DXGI_FORMAT_P010:
+        case DXGI_FORMAT_P016:
+        case DXGI_FORMAT_420_OPAQUE:
+        case DXGI_FORMAT_NV11:
+        case DXGI_FORMAT_P208:
+        case DXGI_FORMAT_V208:
+        case DXGI_FORMAT_V408:
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+
+    //--------------------------------------------------------------------------------------
+    inline bool IsCompressed(DXGI_FORMAT fmt) noexcept
+    {
+        return (fmt >= DXGI_FORMAT_BC1_TYPELESS && fmt <= DXGI_FORMAT_BC5_SNORM)
+            || (fmt >= DXGI_FORMAT_BC6H_TYPELESS && fmt <= DXGI_FORMAT_BC7_UNORM_SRGB);
+    }
+
+
     //--------------------------------------------------------------------------------------
     inline void AdjustPlaneResource(
         _In_ DXGI_FORMAT fmt,
@@ -1237,14 +1267,13 @@ namespace
     }
 
     //--------------------------------------------------------------------------------------
-    HRESULT CreateTextureFromDDS(_In_ ID3D12Device* d3dDevice,
+    HRESULT GetTextureDescFromDDS(_In_opt_ ID3D12Device* d3dDevice,
         _In_ const DDS_HEADER* header,
         _In_reads_bytes_(bitSize) const uint8_t* bitData,
         size_t bitSize,
         size_t maxsize,
-        D3D12_RESOURCE_FLAGS resFlags,
         DDS_LOADER_FLAGS loadFlags,
-        _Outptr_ ID3D12Resource** texture,
+        _Out_ D3D12_RESOURCE_DESC& desc,
         std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
         _Out_opt_ bool* outIsCubeMap) noexcept(false)
     {
@@ -1416,9 +1445,12 @@ namespace
             return HRESULT_E_NOT_SUPPORTED;
         }
 
-        UINT numberOfPlanes = D3D12GetFormatPlaneCount(d3dDevice, format);
+        // Without a device (header parsing in tools) only single-plane formats are known.
+        UINT numberOfPlanes = d3dDevice ? D3D12GetFormatPlaneCount(d3dDevice, format) : 1;
         if (!numberOfPlanes)
             return E_INVALIDARG;
+        if (!d3dDevice && (IsPlanar(format) || IsDepthStencil(format)))
+            return HRESULT_E_NOT_SUPPORTED;
 
         if ((numberOfPlanes > 1) && IsDepthStencil(format))
         {
@@ -1460,26 +1492,63 @@ namespace
                     CountMips(width, height));
             }
 
-            hr = CreateTextureResource(d3dDevice, resDim, twidth, theight, tdepth, reservedMips - skipMip, arraySize,
-                format, resFlags, loadFlags, texture);
+            desc = {};
+            desc.Width = static_cast<UINT>(twidth);
+            desc.Height = static_cast<UINT>(theight);
+            desc.MipLevels = static_cast<UINT16>(reservedMips - skipMip);
+            desc.DepthOrArraySize = (resDim == D3D12_RESOURCE_DIMENSION_TEXTURE3D) ? static_cast<UINT16>(tdepth) : static_cast<UINT16>(arraySize);
+            desc.Format = (loadFlags & DDS_LOADER_FORCE_SRGB) ? MakeSRGB(format) : format;
+            desc.SampleDesc.Count = 1;
+            desc.SampleDesc.Quality = 0;
+            desc.Dimension = resDim;
+        }
+        else
+        {
+            subresources.clear();
+        }
+
+        return hr;
+    }
 
-            if (FAILED(hr) && !maxsize && (mipCount > 1))
-            {
-                subresources.clear();
+    //--------------------------------------------------------------------------------------
+    HRESULT CreateTextureFromDDS(_In_ ID3D12Device* d3dDevice,
+        _In_ const DDS_HEADER* header,
+        _In_reads_bytes_(bitSize) const uint8_t* bitData,
+        size_t bitSize,
+        size_t maxsize,
+        D3D12_RESOURCE_FLAGS resFlags,
+        DDS_LOADER_FLAGS loadFlags,
+        _Outptr_ ID3D12Resource** texture,
+        std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+        _Out_opt_ bool* outIsCubeMap) noexcept(false)
+    {
+        D3D12_RESOURCE_DESC desc = {};
+        HRESULT hr = GetTextureDescFromDDS(d3dDevice, header, bitData, bitSize, maxsize,
+            loadFlags, desc, subresources, outIsCubeMap);
 
-                maxsize = static_cast<size_t>(
-                    (resDim == D3D12_RESOURCE_DIMENSION_TEXTURE3D)
+        if (SUCCEEDED(hr))
+        {
+            // The format already carries DDS_LOADER_FORCE_SRGB.
+            const auto createFlags = loadFlags & ~DDS_LOADER_FORCE_SRGB;
+            const bool is3D = desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+
+            hr = CreateTextureResource(d3dDevice, desc.Dimension, static_cast<size_t>(desc.Width), desc.Height,
+                is3D ? desc.DepthOrArraySize : 1u, desc.MipLevels, is3D ? 1u : desc.DepthOrArraySize,
+                desc.Format, resFlags, createFlags, texture);
+
+            if (FAILED(hr) && !maxsize && (header->mipMapCount > 1))
+            {
+                maxsize = static_cast<size_t>(is3D
                     ? D3D12_REQ_TEXTURE3D_U_V_OR_W_DIMENSION
                     : D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION);
 
-                hr = FillInitData(width, height, depth, mipCount, arraySize,
-                    numberOfPlanes, format,
-                    maxsize, bitSize, bitData,
-                    twidth, theight, tdepth, skipMip, subresources);
+                hr = GetTextureDescFromDDS(d3dDevice, header, bitData, bitSize, maxsize,
+                    loadFlags & ~DDS_LOADER_MIP_RESERVE, desc, subresources, outIsCubeMap);
                 if (SUCCEEDED(hr))
                 {
-                    hr = CreateTextureResource(d3dDevice, resDim, twidth, theight, tdepth, mipCount - skipMip, arraySize,
-                        format, resFlags, loadFlags, texture);
+                    hr = CreateTextureResource(d3dDevice, desc.Dimension, static_cast<size_t>(desc.Width), desc.Height,
+                        is3D ? desc.DepthOrArraySize : 1u, desc.MipLevels, is3D ? 1u : desc.DepthOrArraySize,
+                        desc.Format, resFlags, createFlags, texture);
                 }
             }
         }
@@ -1644,6 +1713,162 @@ HRESULT DirectX::LoadDDSTextureFromMemoryEx(
 }
 
 
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+HRESULT DirectX::LoadDDSTextureDataFromMemory(
+    ID3D12Device* d3dDevice,
+    const uint8_t* ddsData,
+    size_t ddsDataSize,
+    size_t maxsize,
+    DDS_LOADER_FLAGS loadFlags,
+    D3D12_RESOURCE_DESC* desc,
+    std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+    DDS_ALPHA_MODE* alphaMode,
+    bool* isCubeMap)
+{
+    if (alphaMode)
+    {
+        *alphaMode = DDS_ALPHA_MODE_UNKNOWN;
+    }
+    if (isCubeMap)
+    {
+        *isCubeMap = false;
+    }
+
+    if (!ddsData || !desc)
+    {
+        return E_INVALIDARG;
+    }
+
+    const DDS_HEADER* header = nullptr;
+    const uint8_t* bitData = nullptr;
+    size_t bitSize = 0;
+
+    HRESULT hr = LoadTextureDataFromMemory(ddsData,
+        ddsDataSize,
+        &header,
+        &bitData,
+        &bitSize
+    );
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    hr = GetTextureDescFromDDS(d3dDevice,
+        header, bitData, bitSize, maxsize,
+        loadFlags, *desc, subresources, isCubeMap);
+    if (SUCCEEDED(hr) && alphaMode)
+    {
+        *alphaMode = GetAlphaMode(header);
+    }
+
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+HRESULT DirectX::GetDDSUploadFootprints(
+    const D3D12_RESOURCE_DESC& desc,
+    UINT64 baseOffset,
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts,
+    std::vector<UINT>& numRows,
+    UINT64* totalBytes)
+{
+    layouts.clear();
+    numRows.clear();
+    if (!totalBytes)
+    {
+        return E_INVALIDARG;
+    }
+    *totalBytes = 0;
+
+    if (IsPlanar(desc.Format) || IsDepthStencil(desc.Format))
+    {
+        return HRESULT_E_NOT_SUPPORTED;
+    }
+
+    const bool volume = (desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D);
+    const size_t arraySize = volume ? 1u : desc.DepthOrArraySize;
+    const size_t mipCount = desc.MipLevels;
+    const UINT blockSize = IsCompressed(desc.Format) ? 4u : 1u;
+
+    UINT64 offset = baseOffset;
+    for (size_t j = 0; j < arraySize; ++j)
+    {
+        for (size_t i = 0; i < mipCount; ++i)
+        {
+            const size_t width = std::max<size_t>(1u, static_cast<size_t>(desc.Width >> i));
+            const size_t height = std::max<size_t>(1u, desc.Height >> i);
+            const size_t depth = volume ? std::max<size_t>(1u, desc.DepthOrArraySize >> i) : 1u;
+
+            size_t rowBytes = 0;
+            size_t rows = 0;
+            HRESULT hr = GetSurfaceInfo(width, height, desc.Format, nullptr, &rowBytes, &rows);
+            if (FAILED(hr))
+                return hr;
+
+            const UINT64 rowPitch = (uint64_t(rowBytes) + D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1)
+                & ~uint64_t(D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
+            if (rowPitch > UINT32_MAX)
+                return HRESULT_E_ARITHMETIC_OVERFLOW;
+
+            offset = (offset + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1)
+                & ~uint64_t(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+
+            D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout = {};
+            layout.Offset = offset;
+            layout.Footprint.Format = desc.Format;
+            layout.Footprint.Width = static_cast<UINT>((width + blockSize - 1) / blockSize * blockSize);
+            layout.Footprint.Height = static_cast<UINT>((height + blockSize - 1) / blockSize * blockSize);
+            layout.Footprint.Depth = static_cast<UINT>(depth);
+            layout.Footprint.RowPitch = static_cast<UINT>(rowPitch);
+            layouts.emplace_back(layout);
+            numRows.emplace_back(static_cast<UINT>(rows));
+
+            offset += rowPitch * rows * depth;
+        }
+    }
+
+    *totalBytes = offset - baseOffset;
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+void DirectX::WriteDDSSubresources(
+    uint8_t* uploadData,
+    const std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts,
+    const std::vector<UINT>& numRows,
+    const std::vector<D3D12_SUBRESOURCE_DATA>& subresources) noexcept
+{
+    assert(layouts.size() == subresources.size() && numRows.size() == subresources.size());
+
+    for (size_t i = 0; i < subresources.size(); ++i)
+    {
+        const D3D12_SUBRESOURCE_FOOTPRINT& footprint = layouts[i].Footprint;
+        const D3D12_SUBRESOURCE_DATA& src = subresources[i];
+        const size_t rowBytes = static_cast<size_t>(src.RowPitch);
+        assert(rowBytes <= footprint.RowPitch);
+
+        uint8_t* dest = uploadData + layouts[i].Offset;
+        auto source = static_cast<const uint8_t*>(src.pData);
+        const size_t destSlicePitch = size_t(footprint.RowPitch) * numRows[i];
+        for (UINT z = 0; z < footprint.Depth; ++z)
+        {
+            uint8_t* destSlice = dest + destSlicePitch * z;
+            const uint8_t* sourceSlice = source + size_t(src.SlicePitch) * z;
+            for (UINT y = 0; y < numRows[i]; ++y)
+            {
+                memcpy(destSlice + size_t(footprint.RowPitch) * y, sourceSlice + rowBytes * y, rowBytes);
+            }
+        }
+    }
+}
+
+
 //--------------------------------------------------------------------------------------
 _Use_decl_annotations_
 HRESULT DirectX::LoadDDSTextureFromFile(
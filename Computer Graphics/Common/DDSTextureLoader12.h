@@ -101,6 +101,39 @@ namespace DirectX
         _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr,
         _Out_opt_ bool* isCubeMap = nullptr);
 
+    // Parses a DDS in memory without creating a resource: fills the description the texture
+    // needs and subresources that point into ddsData, e.g. to back them with a reserved resource.
+    // d3dDevice may be null, in which case planar and depth-stencil formats are not supported.
+    HRESULT __cdecl LoadDDSTextureDataFromMemory(
+        _In_opt_ ID3D12Device* d3dDevice,
+        _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+        size_t ddsDataSize,
+        size_t maxsize,
+        DDS_LOADER_FLAGS loadFlags,
+        _Out_ D3D12_RESOURCE_DESC* desc,
+        std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+        _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr,
+        _Out_opt_ bool* isCubeMap = nullptr);
+
+    // Lays desc's subresources out in an upload buffer starting at baseOffset, the way
+    // CopyTextureRegion reads them (rows aligned to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT, each
+    // subresource to D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT). Matches GetCopyableFootprints for
+    // the single-plane formats a DDS holds, but needs no device.
+    HRESULT __cdecl GetDDSUploadFootprints(
+        const D3D12_RESOURCE_DESC& desc,
+        UINT64 baseOffset,
+        std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts,
+        std::vector<UINT>& numRows,
+        _Out_ UINT64* totalBytes);
+
+    // Copies subresources (e.g. from LoadDDSTextureDataFromMemory over a mapped file) row by row
+    // into mapped upload memory laid out by GetDDSUploadFootprints.
+    void __cdecl WriteDDSSubresources(
+        _Out_ uint8_t* uploadData,
+        const std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts,
+        const std::vector<UINT>& numRows,
+        const std::vector<D3D12_SUBRESOURCE_DATA>& subresources) noexcept;
+
     HRESULT __cdecl LoadDDSTextureFromFileEx(
         _In_ ID3D12Device* d3dDevice,
         _In_z_ const wchar_t* szFileName,
@@ -0,0 +1,299 @@
+#include "assetpack.h"
+#include "ioqueue.h"
+#include "lz.h"
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace
+{
+	constexpr char Magic[4]{ 'A', 'P', 'A', 'K' };
+
+	// Loose files at least this large are mapped instead of read, so a loader parses the file in
+	// place and its rows are copied once, straight into GPU upload memory. Below it a read is cheaper.
+	constexpr uintmax_t MapThreshold = 64 * 1024;
+}
+
+AssetPack::AssetPack(const std::filesystem::path& path) : m_path{ path }, m_file{ path }
+{
+	const auto data = m_file.GetData();
+	AssetPackHeader header{};
+	if (data.size() < sizeof(header)) throw std::runtime_error{ "asset pack: truncated " + path.string() };
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version) {
+		throw std::runtime_error{ "asset pack: bad header " + path.string() };
+	}
+	if (header.tableOffset % alignof(AssetPackEntry) != 0 ||
+		header.tableOffset + uint64_t{ header.entryCount } * sizeof(AssetPackEntry) > header.nameOffset ||
+		header.nameOffset > data.size()) {
+		throw std::runtime_error{ "asset pack: bad table " + path.string() };
+	}
+
+	m_entries = { reinterpret_cast<const AssetPackEntry*>(data.data() + header.tableOffset), header.entryCount };
+	m_names = { reinterpret_cast<const char*>(data.data() + header.nameOffset), data.size() - header.nameOffset };
+	for (const auto& entry : m_entries) {
+		if (entry.offset + entry.storedSize > header.tableOffset || entry.nameOffset >= m_names.size()) {
+			throw std::runtime_error{ "asset pack: bad entry " + path.string() };
+		}
+	}
+}
+
+std::string AssetPack::NormalizePath(std::string_view path)
+{
+	std::string normalized;
+	normalized.reserve(path.size());
+	for (char c : path) {
+		if (c == '\\') c = '/';
+		else if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+		if (c == '/' && (normalized.empty() || normalized.back() == '/')) continue;
+		normalized += c;
+	}
+	while (normalized.starts_with("./")) normalized.erase(0, 2);
+	return normalized;
+}
+
+uint64_t AssetPack::HashPath(std::string_view normalizedPath)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : normalizedPath) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+const AssetPackEntry* AssetPack::Find(std::string_view path) const
+{
+	const std::string normalized = NormalizePath(path);
+	const uint64_t hash = HashPath(normalized);
+	auto it = std::ranges::lower_bound(m_entries, hash, {}, &AssetPackEntry::hash);
+	for (; it != m_entries.end() && it->hash == hash; ++it) {
+		if (GetName(*it) == normalized) return &*it;
+	}
+	return nullptr;
+}
+
+AssetData AssetPack::Load(const AssetPackEntry& entry) const
+{
+	const auto stored = m_file.GetData().subspan(entry.offset, entry.storedSize);
+	if (!(entry.flags & AssetPackEntry::Compressed)) return AssetData{ stored, weak_from_this().lock() };
+
+	std::vector<std::byte> data(entry.size);
+	if (!Lz::Decompress(stored, data)) {
+		throw std::runtime_error{ "asset pack: corrupt entry " + std::string{ GetName(entry) } };
+	}
+	return AssetData{ std::move(data) };
+}
+
+AssetData AssetPack::Load(std::string_view path) const
+{
+	const AssetPackEntry* entry = Find(path);
+	if (!entry) throw std::runtime_error{ "asset pack: missing " + std::string{ path } };
+	return Load(*entry);
+}
+
+void AssetPack::Prefetch(const AssetPackEntry& entry) const
+{
+	m_file.Prefetch(entry.offset, entry.storedSize);
+}
+
+std::string_view AssetPack::GetName(const AssetPackEntry& entry) const
+{
+	const char* name = m_names.data() + entry.nameOffset;
+	return { name, strnlen(name, m_names.size() - entry.nameOffset) };
+}
+
+AssetPackWriter::AssetPackWriter(const std::filesystem::path& path, uint32_t alignment) :
+	m_out{ path, std::ios::binary | std::ios::trunc }, m_alignment{ std::max(alignment, 16u) }, m_offset{ 0 }
+{
+	if (!m_out) throw std::runtime_error{ "cannot write " + path.string() };
+	if ((m_alignment & (m_alignment - 1)) != 0) throw std::invalid_argument{ "asset pack: alignment must be a power of two" };
+
+	const AssetPackHeader header{};
+	m_out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	m_offset = sizeof(header);
+}
+
+void AssetPackWriter::Add(std::string_view name, std::span<const std::byte> data, bool compress)
+{
+	AssetPackEntry entry{};
+	const std::string normalized = AssetPack::NormalizePath(name);
+	entry.hash = AssetPack::HashPath(normalized);
+	entry.size = data.size();
+	entry.nameOffset = static_cast<uint32_t>(m_names.size());
+	m_names.append(normalized).push_back('\0');
+
+	std::vector<std::byte> compressed;
+	if (compress && !data.empty()) {
+		compressed = Lz::Compress(data);
+		if (compressed.size() <= data.size() - data.size() / 8) {
+			entry.flags |= AssetPackEntry::Compressed;
+			data = compressed;
+		}
+	}
+
+	Pad(m_alignment);
+	entry.offset = m_offset;
+	entry.storedSize = data.size();
+	m_out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+	m_offset += data.size();
+	m_entries.push_back(entry);
+}
+
+void AssetPackWriter::Finish()
+{
+	std::ranges::sort(m_entries, {}, &AssetPackEntry::hash);
+
+	AssetPackHeader header{};
+	std::memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = AssetPack::Version;
+	header.entryCount = static_cast<uint32_t>(m_entries.size());
+	header.alignment = m_alignment;
+
+	Pad(alignof(AssetPackEntry));
+	header.tableOffset = m_offset;
+	m_out.write(reinterpret_cast<const char*>(m_entries.data()), static_cast<std::streamsize>(m_entries.size() * sizeof(AssetPackEntry)));
+	m_offset += m_entries.size() * sizeof(AssetPackEntry);
+
+	header.nameOffset = m_offset;
+	m_out.write(m_names.data(), static_cast<std::streamsize>(m_names.size()));
+	m_offset += m_names.size();
+
+	m_out.seekp(0);
+	m_out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	m_out.close();
+	if (!m_out) throw std::runtime_error{ "asset pack: write failed" };
+}
+
+void AssetPackWriter::Pad(uint64_t alignment)
+{
+	static constexpr char zeros[4096]{};
+	const uint64_t padding = (alignment - m_offset % alignment) % alignment;
+	for (uint64_t left = padding; left > 0; ) {
+		const uint64_t chunk = std::min<uint64_t>(left, sizeof(zeros));
+		m_out.write(zeros, static_cast<std::streamsize>(chunk));
+		left -= chunk;
+	}
+	m_offset += padding;
+}
+
+namespace
+{
+	struct PrefetchedAsset
+	{
+		std::vector<std::byte>	data;
+		std::future<void>		done;
+	};
+
+	std::mutex g_mountMutex;
+	std::shared_ptr<const AssetPack> g_pack;
+	std::string g_root;
+	std::unordered_map<std::string, PrefetchedAsset> g_prefetched;
+
+	// Must be called with g_mountMutex held.
+	const AssetPackEntry* FindMounted(const std::string& normalized)
+	{
+		if (!g_pack || !normalized.starts_with(g_root)) return nullptr;
+		return g_pack->Find(std::string_view{ normalized }.substr(g_root.size()));
+	}
+}
+
+void Assets::Mount(std::shared_ptr<const AssetPack> pack, const std::filesystem::path& root)
+{
+	std::lock_guard lock{ g_mountMutex };
+	g_pack = std::move(pack);
+	g_root = AssetPack::NormalizePath(root.generic_string());
+	if (!g_root.empty() && g_root.back() != '/') g_root += '/';
+}
+
+void Assets::Unmount()
+{
+	std::lock_guard lock{ g_mountMutex };
+	g_pack.reset();
+	g_root.clear();
+}
+
+void Assets::Prefetch(IoQueue& queue, std::span<const std::filesystem::path> paths, int priority)
+{
+	std::lock_guard lock{ g_mountMutex };
+	for (const auto& path : paths) {
+		const std::string normalized = GetKey(path);
+		if (g_prefetched.contains(normalized)) continue;
+
+		IoQueue::Request request;
+		request.priority = priority;
+		PrefetchedAsset asset;
+		if (const AssetPackEntry* entry = FindMounted(normalized)) {
+			if (!(entry->flags & AssetPackEntry::Compressed)) {
+				g_pack->Prefetch(*entry);
+				continue;
+			}
+			request.file = queue.Open(g_pack->GetPath());
+			request.offset = entry->offset;
+			request.size = entry->storedSize;
+			request.compressed = true;
+			asset.data.resize(entry->size);
+		}
+		else {
+			request.file = queue.Open(path);
+			request.size = queue.GetFileSize(request.file);
+			asset.data.resize(request.size);
+		}
+		request.destination = asset.data;
+		asset.done = queue.Enqueue(request);
+		g_prefetched.emplace(normalized, std::move(asset));
+	}
+}
+
+AssetData Assets::Load(const std::filesystem::path& path)
+{
+	const std::string normalized = GetKey(path);
+	std::shared_ptr<const AssetPack> pack;
+	const AssetPackEntry* entry = nullptr;
+	PrefetchedAsset prefetched;
+	{
+		std::lock_guard lock{ g_mountMutex };
+		if (auto it = g_prefetched.find(normalized); it != g_prefetched.end()) {
+			prefetched = std::move(it->second);
+			g_prefetched.erase(it);
+		}
+		else {
+			entry = FindMounted(normalized);
+			pack = g_pack;
+		}
+	}
+
+	if (prefetched.done.valid()) {
+		prefetched.done.get();
+		return AssetData{ std::move(prefetched.data) };
+	}
+
+	// The view holds the pack, so it stays valid after the pack is unmounted.
+	if (entry) return pack->Load(*entry);
+
+	const uintmax_t size = std::filesystem::file_size(path);
+	if (size >= MapThreshold) return AssetData{ MappedFile{ path } };
+
+	std::ifstream in(path, std::ios::binary);
+	if (!in) throw std::runtime_error{ "cannot open " + path.string() };
+	std::vector<std::byte> data(static_cast<size_t>(size));
+	in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+	return AssetData{ std::move(data) };
+}
+
+bool Assets::Exists(const std::filesystem::path& path)
+{
+	{
+		std::lock_guard lock{ g_mountMutex };
+		if (FindMounted(GetKey(path))) return true;
+	}
+	return std::filesystem::exists(path);
+}
+
+std::string Assets::GetKey(const std::filesystem::path& path)
+{
+	return AssetPack::NormalizePath(path.generic_string());
+}
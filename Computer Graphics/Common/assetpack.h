@@ -0,0 +1,144 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mappedfile.h"
+
+class IoQueue;
+
+// Pack layout: header | entry data (each aligned) | entry table sorted by path hash | name table.
+struct AssetPackHeader
+{
+	char		magic[4];
+	uint32_t	version;
+	uint32_t	entryCount;
+	uint32_t	alignment;
+	uint64_t	tableOffset;
+	uint64_t	nameOffset;
+};
+
+struct AssetPackEntry
+{
+	static constexpr uint32_t Compressed = 0x1;
+
+	uint64_t	hash;
+	uint64_t	offset;
+	uint64_t	storedSize;
+	uint64_t	size;
+	uint32_t	flags;
+	uint32_t	nameOffset;
+};
+
+// Bytes of one asset: a view into a mapped pack, a mapping of its own loose file or an owned buffer.
+// A view holds its pack when the pack is shared, so the mapping outlives an Unmount.
+class AssetData
+{
+public:
+	AssetData() = default;
+	explicit AssetData(std::span<const std::byte> view, std::shared_ptr<const void> owner = nullptr) :
+		m_owner{ std::move(owner) }, m_view{ view } {}
+	explicit AssetData(std::vector<std::byte> storage) : m_storage{ std::move(storage) }, m_view{ m_storage } {}
+	explicit AssetData(MappedFile file) : m_file{ std::make_unique<MappedFile>(std::move(file)) }, m_view{ m_file->GetData() } {}
+
+	AssetData(AssetData&& other) noexcept { *this = std::move(other); }
+	AssetData& operator=(AssetData&& other) noexcept
+	{
+		const bool owned = !other.m_storage.empty();
+		m_storage = std::move(other.m_storage);
+		m_file = std::move(other.m_file);
+		m_owner = std::move(other.m_owner);
+		m_view = owned ? std::span<const std::byte>{ m_storage } : other.m_view;
+		other.m_view = {};
+		return *this;
+	}
+
+	std::span<const std::byte> GetData() const { return m_view; }
+	size_t GetSize() const { return m_view.size(); }
+	bool IsView() const { return m_storage.empty() && !m_view.empty(); }
+
+private:
+	std::vector<std::byte>		m_storage;
+	std::unique_ptr<MappedFile>	m_file;
+	std::shared_ptr<const void>	m_owner;
+	std::span<const std::byte>	m_view;
+};
+
+class AssetPack : public std::enable_shared_from_this<AssetPack>
+{
+public:
+	static constexpr uint32_t Version = 1;
+
+	explicit AssetPack(const std::filesystem::path& path);
+
+	// Lower-case, forward slashes, no leading "./".
+	static std::string NormalizePath(std::string_view path);
+	// 64-bit FNV-1a of a normalized path.
+	static uint64_t HashPath(std::string_view normalizedPath);
+
+	const AssetPackEntry* Find(std::string_view path) const;
+	AssetData Load(const AssetPackEntry& entry) const;
+	AssetData Load(std::string_view path) const;
+	void Prefetch(const AssetPackEntry& entry) const;
+
+	std::span<const AssetPackEntry> GetEntries() const { return m_entries; }
+	std::string_view GetName(const AssetPackEntry& entry) const;
+	const MappedFile& GetFile() const { return m_file; }
+	const std::filesystem::path& GetPath() const { return m_path; }
+
+private:
+	std::filesystem::path				m_path;
+	MappedFile							m_file;
+	std::span<const AssetPackEntry>		m_entries;
+	std::span<const char>				m_names;
+};
+
+class AssetPackWriter
+{
+public:
+	explicit AssetPackWriter(const std::filesystem::path& path, uint32_t alignment = 64);
+
+	// Entries that do not shrink by at least an eighth are stored uncompressed.
+	void Add(std::string_view name, std::span<const std::byte> data, bool compress);
+	void Finish();
+
+	uint64_t GetWrittenBytes() const { return m_offset; }
+
+private:
+	void Pad(uint64_t alignment);
+
+private:
+	std::ofstream					m_out;
+	uint32_t						m_alignment;
+	uint64_t						m_offset;
+	std::vector<AssetPackEntry>		m_entries;
+	std::string						m_names;
+};
+
+// Process-wide pack lookup so loaders keep taking file names.
+namespace Assets
+{
+	// Paths under `root` (e.g. "../Resources") are served from `pack`.
+	void Mount(std::shared_ptr<const AssetPack> pack, const std::filesystem::path& root);
+	void Unmount();
+
+	// Starts reading `paths` on `queue` so later Load calls only wait for the data. Compressed pack
+	// entries and loose files are read (and decompressed) by the queue; uncompressed pack entries
+	// are already zero-copy views and only get an OS prefetch hint.
+	void Prefetch(IoQueue& queue, std::span<const std::filesystem::path> paths, int priority = 0);
+
+	// Returns prefetched data, the pack view when the path is packed, otherwise maps (large) or
+	// reads (small) the file from disk.
+	AssetData Load(const std::filesystem::path& path);
+
+	// True when the path is packed or on disk.
+	bool Exists(const std::filesystem::path& path);
+
+	// Normalized path that identifies an asset in caches and registries.
+	std::string GetKey(const std::filesystem::path& path);
+}
@@ -0,0 +1,196 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template <typename T>
+struct AssetHandle
+{
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+
+	bool IsValid() const { return index != UINT32_MAX; }
+	bool operator==(const AssetHandle&) const = default;
+};
+
+// Owns assets by key (a normalized path or a name) and hands out typed handles. Each Acquire adds
+// a reference, and the asset is unloaded when Release drops the last one. Slots are allocated up
+// front and a slot's asset and generation are atomic, so Get takes no lock: it never races a
+// reallocation, and a Release on another thread makes it throw or return the asset as it was
+// before the unload, which the returned reference keeps alive.
+template <typename T>
+class AssetRegistry
+{
+public:
+	explicit AssetRegistry(size_t capacity = 1024) : m_slots(capacity), m_usedSlots{ 0 } {}
+	AssetRegistry(const AssetRegistry&) = delete;
+	AssetRegistry& operator=(const AssetRegistry&) = delete;
+
+	// The first caller for a key runs load(), which returns something convertible to shared_ptr<T>.
+	// Concurrent callers for the same key wait for that load instead of repeating it.
+	template <typename Load>
+	AssetHandle<T> Acquire(std::string_view key, Load&& load)
+	{
+		std::unique_lock lock{ m_mutex };
+		for (auto it = m_lookup.find(std::string{ key }); it != m_lookup.end(); it = m_lookup.find(std::string{ key })) {
+			Slot& slot = m_slots[it->second];
+			if (!slot.loading) {
+				++slot.references;
+				return { it->second, slot.generation.load(std::memory_order_relaxed) };
+			}
+			m_loaded.wait(lock);
+		}
+
+		const uint32_t index = AllocateSlot();
+		m_slots[index].key = key;
+		m_slots[index].loading = true;
+		m_slots[index].references = 1;
+		m_lookup.emplace(key, index);
+		lock.unlock();
+
+		std::shared_ptr<T> asset;
+		try {
+			asset = load();
+		}
+		catch (...) {
+			lock.lock();
+			FreeSlot(index);
+			m_loaded.notify_all();
+			throw;
+		}
+
+		lock.lock();
+		m_slots[index].asset.store(std::move(asset), std::memory_order_release);
+		m_slots[index].loading = false;
+		m_loaded.notify_all();
+		return { index, m_slots[index].generation.load(std::memory_order_relaxed) };
+	}
+
+	// Returns an invalid handle when the key is not loaded. Does not add a reference.
+	AssetHandle<T> Find(std::string_view key) const
+	{
+		std::lock_guard lock{ m_mutex };
+		auto it = m_lookup.find(std::string{ key });
+		if (it == m_lookup.end() || m_slots[it->second].loading) return {};
+		return { it->second, m_slots[it->second].generation.load(std::memory_order_relaxed) };
+	}
+
+	void AddRef(AssetHandle<T> handle)
+	{
+		std::lock_guard lock{ m_mutex };
+		++CheckedSlot(handle).references;
+	}
+
+	void Release(AssetHandle<T> handle)
+	{
+		std::shared_ptr<T> unloaded;
+		{
+			std::lock_guard lock{ m_mutex };
+			Slot& slot = CheckedSlot(handle);
+			if (--slot.references > 0) return;
+			unloaded = slot.asset.exchange(nullptr, std::memory_order_acq_rel);
+			FreeSlot(handle.index);
+		}
+	}
+
+	// Throws std::out_of_range for handles whose asset has been unloaded. The asset is read before
+	// the generation and an unload clears it before bumping the generation, so an asset that passes
+	// the check was loaded for this handle.
+	std::shared_ptr<T> Get(AssetHandle<T> handle) const
+	{
+		if (handle.index >= m_slots.size()) throw std::out_of_range{ "asset registry: invalid handle" };
+		const Slot& slot = m_slots[handle.index];
+		std::shared_ptr<T> asset = slot.asset.load(std::memory_order_acquire);
+		if (slot.generation.load(std::memory_order_acquire) != handle.generation || !asset) {
+			throw std::out_of_range{ "asset registry: stale handle" };
+		}
+		return asset;
+	}
+
+	uint32_t GetReferenceCount(AssetHandle<T> handle) const
+	{
+		std::lock_guard lock{ m_mutex };
+		return CheckedSlot(handle).references;
+	}
+
+	size_t GetLoadedCount() const
+	{
+		std::lock_guard lock{ m_mutex };
+		return m_lookup.size();
+	}
+
+	template <typename Func>
+	void ForEach(Func&& func) const
+	{
+		std::lock_guard lock{ m_mutex };
+		for (size_t i = 0; i < m_usedSlots; ++i) {
+			if (const auto asset = m_slots[i].asset.load(std::memory_order_relaxed)) func(asset);
+		}
+	}
+
+private:
+	// Get reads asset and generation without the mutex; everything else is guarded by it.
+	struct Slot
+	{
+		std::atomic<std::shared_ptr<T>>	asset;
+		std::atomic<uint32_t>			generation = 0;
+		std::string						key;
+		uint32_t						references = 0;
+		bool							loading = false;
+	};
+
+	// Must be called with m_mutex held.
+	uint32_t AllocateSlot()
+	{
+		if (!m_freeSlots.empty()) {
+			const uint32_t index = m_freeSlots.back();
+			m_freeSlots.pop_back();
+			return index;
+		}
+		if (m_usedSlots == m_slots.size()) throw std::length_error{ "asset registry: out of slots" };
+		return static_cast<uint32_t>(m_usedSlots++);
+	}
+
+	// Must be called with m_mutex held.
+	void FreeSlot(uint32_t index)
+	{
+		Slot& slot = m_slots[index];
+		m_lookup.erase(slot.key);
+		slot.asset.store(nullptr, std::memory_order_release);
+		slot.key.clear();
+		slot.references = 0;
+		slot.loading = false;
+		slot.generation.fetch_add(1, std::memory_order_release);
+		m_freeSlots.push_back(index);
+	}
+
+	// Must be called with m_mutex held.
+	Slot& CheckedSlot(AssetHandle<T> handle)
+	{
+		return const_cast<Slot&>(std::as_const(*this).CheckedSlot(handle));
+	}
+
+	const Slot& CheckedSlot(AssetHandle<T> handle) const
+	{
+		if (handle.index >= m_slots.size()) throw std::out_of_range{ "asset registry: invalid handle" };
+		const Slot& slot = m_slots[handle.index];
+		if (slot.generation.load(std::memory_order_relaxed) != handle.generation || !slot.asset.load(std::memory_order_relaxed)) throw std::out_of_range{ "asset registry: stale handle" };
+		return slot;
+	}
+
+private:
+	mutable std::mutex						m_mutex;
+	std::condition_variable					m_loaded;
+	std::vector<Slot>						m_slots;
+	size_t									m_usedSlots;
+	std::vector<uint32_t>					m_freeSlots;
+	std::unordered_map<std::string, uint32_t>	m_lookup;
+};
@@ -0,0 +1,92 @@
+#include "dxil.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+	class Fnv1a
+	{
+	public:
+		void Add(const void* data, size_t size)
+		{
+			for (const auto* byte = static_cast<const uint8_t*>(data); size-- > 0; ++byte) {
+				m_hash ^= *byte;
+				m_hash *= 1099511628211ull;
+			}
+		}
+		uint64_t Get() const { return m_hash; }
+
+	private:
+		uint64_t m_hash = 14695981039346656037ull;
+	};
+
+	uint32_t ReadUint32(std::span<const std::byte> data, size_t offset)
+	{
+		uint32_t value = 0;
+		std::memcpy(&value, data.data() + offset, sizeof(value));
+		return value;
+	}
+
+	constexpr uint32_t FourCc(const char (&text)[5])
+	{
+		return static_cast<uint32_t>(text[0]) | static_cast<uint32_t>(text[1]) << 8 |
+			static_cast<uint32_t>(text[2]) << 16 | static_cast<uint32_t>(text[3]) << 24;
+	}
+}
+
+std::string Dxil::GetBlobName(const std::string& fileName, const Defines& defines, const std::string& entryPoint)
+{
+	std::string name = std::filesystem::path{ fileName }.stem().string() + '.' + entryPoint;
+	for (const auto& [define, value] : defines) name += '.' + define + '=' + value;
+	return name + ".dxil";
+}
+
+uint64_t Dxil::HashSources(const std::filesystem::path& directory)
+{
+	std::vector<std::filesystem::path> files;
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator{ directory, error }) {
+		if (entry.is_regular_file() && entry.path().extension() == ".hlsl") files.push_back(entry.path());
+	}
+	std::sort(files.begin(), files.end());
+
+	Fnv1a hash;
+	for (const auto& file : files) {
+		const std::string name = file.filename().string();
+		hash.Add(name.c_str(), name.size() + 1);
+		std::ifstream in{ file, std::ios::binary };
+		const std::string text{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+		const uint64_t size = text.size();
+		hash.Add(&size, sizeof(size));
+		hash.Add(text.data(), text.size());
+	}
+	return hash.Get();
+}
+
+Dxil::ContainerInfo Dxil::InspectContainer(std::span<const std::byte> blob)
+{
+	// DXBC header: magic, 16-byte digest, version, total size, part count, then the part offsets.
+	ContainerInfo info;
+	constexpr size_t HeaderSize = 32;
+	if (blob.size() < HeaderSize || ReadUint32(blob, 0) != FourCc("DXBC")) return info;
+	if (ReadUint32(blob, 24) != blob.size()) return info;
+
+	info.partCount = ReadUint32(blob, 28);
+	if (info.partCount > (blob.size() - HeaderSize) / sizeof(uint32_t)) return info;
+	bool dxil = false;
+	for (uint32_t part = 0; part < info.partCount; ++part) {
+		const size_t offset = ReadUint32(blob, HeaderSize + part * sizeof(uint32_t));
+		if (offset + 8 > blob.size()) return info;
+		const uint32_t size = ReadUint32(blob, offset + 4);
+		if (size > blob.size() - offset - 8) return info;
+		if (ReadUint32(blob, offset) == FourCc("DXIL")) {
+			dxil = true;
+			info.dxilBytes = size;
+		}
+	}
+	info.valid = dxil;
+	info.hashed = std::any_of(blob.begin() + 4, blob.begin() + 20, [](std::byte b) { return b != std::byte{ 0 }; });
+	return info;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The Shader Model 6 set Exporter dxc builds with DXC: one DXIL container per manifest program,
+// named by GetBlobName, and a SourcesFile holding HashSources of the directory it was built from.
+// The game takes the set only while that hash still matches, so editing a shader falls back to
+// FXC instead of loading stale DXIL.
+namespace Dxil
+{
+	using Defines = std::vector<std::pair<std::string, std::string>>;
+
+	inline constexpr const char* SourcesFile = "sources";
+
+	// `<file stem>.<entry point>[.<name>=<value>...].dxil`, defines in the given order.
+	std::string GetBlobName(const std::string& fileName, const Defines& defines, const std::string& entryPoint);
+
+	// FNV-1a over the names and contents of every .hlsl file in `directory`, in name order.
+	uint64_t HashSources(const std::filesystem::path& directory);
+
+	struct ContainerInfo
+	{
+		bool		valid = false;		// DXBC header intact, sizes consistent and a DXIL part present.
+		bool		hashed = false;		// The validator's digest is set; D3D12 refuses unhashed DXIL.
+		uint32_t	partCount = 0;
+		uint32_t	dxilBytes = 0;
+	};
+
+	ContainerInfo InspectContainer(std::span<const std::byte> blob);
+}
@@ -0,0 +1,196 @@
+#include "heightfield.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define HEIGHTFIELD_USE_SSE2
+#endif
+
+namespace
+{
+	// Spreads the low 16 bits of `value` to the even bits.
+	uint32_t SpreadBits(uint32_t value)
+	{
+		value &= 0xFFFF;
+		value = (value | value << 8) & 0x00FF00FF;
+		value = (value | value << 4) & 0x0F0F0F0F;
+		value = (value | value << 2) & 0x33333333;
+		value = (value | value << 1) & 0x55555555;
+		return value;
+	}
+
+	// The same products in the same order as the domain shader's BernsteinBasis, lane-wise with SSE;
+	// none may be reordered or fused.
+#ifdef HEIGHTFIELD_USE_SSE2
+	void BernsteinBasis(__m128 t, __m128* basis)
+	{
+		const __m128 invT = _mm_sub_ps(_mm_set1_ps(1.f), t);
+		const __m128 four = _mm_set1_ps(4.f);
+		basis[0] = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(invT, invT), invT), invT);
+		basis[1] = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(four, t), invT), invT), invT);
+		basis[2] = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(6.f), t), t), invT), invT);
+		basis[3] = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(four, t), t), t), invT);
+		basis[4] = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), t);
+	}
+#else
+	void BernsteinBasis(float t, float* basis)
+	{
+		const float invT = 1.f - t;
+		basis[0] = invT * invT * invT * invT;
+		basis[1] = 4.f * t * invT * invT * invT;
+		basis[2] = 6.f * t * t * invT * invT;
+		basis[3] = 4.f * t * t * t * invT;
+		basis[4] = t * t * t * t;
+	}
+#endif
+
+	// Where control point (row, column) of a patch is stored: the first four rows column by column,
+	// then the last row, so four consecutive floats are always four control points of one patch and
+	// one column of the first four rows fills a register. Rows count from the patch's high z, as the
+	// hull shader reads them (TerrainPatches::WritePatchIndices).
+	constexpr int GetControlPoint(int row, int column)
+	{
+		return row < Heightfield::PatchLength ? column * Heightfield::PatchLength + row :
+			Heightfield::PatchLength * (Heightfield::PatchLength + 1) + column;
+	}
+
+	// Stands in for the patch of a point outside the grid: every term is +0, like GetHeight's result.
+	alignas(16) constexpr float ZeroPatch[32]{};
+}
+
+Heightfield::Heightfield(std::vector<float> heights, int length) :
+	m_heights{ std::move(heights) }, m_length{ length }, m_patchCount{ std::max((length - 1) / PatchLength, 0) }
+{
+	// Morton order needs a power-of-two square; the unused tail of the last rows is never touched.
+	const size_t side = std::bit_ceil(static_cast<uint32_t>(std::max(m_patchCount, 1)));
+	m_patches.resize(side * side * PatchStride);
+	for (int pz = 0; pz < m_patchCount; ++pz) {
+		for (int px = 0; px < m_patchCount; ++px) {
+			float* patch = m_patches.data() + static_cast<size_t>(GetMortonIndex(px, pz)) * PatchStride;
+			for (int row = 0; row <= PatchLength; ++row) {
+				for (int column = 0; column <= PatchLength; ++column) {
+					patch[GetControlPoint(row, column)] = GetSample(px * PatchLength + column, (pz + 1) * PatchLength - row);
+				}
+			}
+		}
+	}
+}
+
+// Ahead of GetHeight and GetHeights so both can inline it.
+inline const float* Heightfield::FindPatch(float x, float z, float& u, float& v) const
+{
+	const float half = static_cast<float>(m_length / 2);
+	if (!(std::abs(x) <= half && std::abs(z) <= half) || m_patchCount == 0) return nullptr;
+
+	// The far edge belongs to the last patch, at u = 1 or v = 0: v runs from the patch's high z, as
+	// the domain location does.
+	const float fx = x + half;
+	const float fz = z + half;
+	const int px = std::min(static_cast<int>(static_cast<uint32_t>(fx) / PatchLength), m_patchCount - 1);
+	const int pz = std::min(static_cast<int>(static_cast<uint32_t>(fz) / PatchLength), m_patchCount - 1);
+	u = (fx - px * PatchLength) / static_cast<float>(PatchLength);
+	v = ((pz + 1) * PatchLength - fz) / static_cast<float>(PatchLength);
+	return m_patches.data() + static_cast<size_t>(SpreadBits(px) | SpreadBits(pz) << 1) * PatchStride;
+}
+
+float Heightfield::GetHeight(float x, float z) const
+{
+	float u, v;
+	const float* patch = FindPatch(x, z, u, v);
+	if (!patch) return 0.f;
+
+	// The domain shader's CubicBezierSum: each row's LineBezierSum from 0 in column order, then the
+	// rows' weighted sums from 0 in row order.
+	const float* last = patch + GetControlPoint(PatchLength, 0);
+#ifdef HEIGHTFIELD_USE_SSE2
+	// Both bases at once, u's in lane 0 and v's in lane 1; then the first four rows' line sums at
+	// once, one row per lane.
+	__m128 basis[5];
+	BernsteinBasis(_mm_setr_ps(u, v, 0.f, 0.f), basis);
+	__m128 lines = _mm_setzero_ps();
+	float lastLine = 0.f;
+	for (int column = 0; column <= PatchLength; ++column) {
+		const __m128 basisU = _mm_shuffle_ps(basis[column], basis[column], 0);
+		lines = _mm_add_ps(lines, _mm_mul_ps(basisU, _mm_load_ps(patch + GetControlPoint(0, column))));
+		lastLine += _mm_cvtss_f32(basis[column]) * last[column];
+	}
+	const __m128 basisV = _mm_movehl_ps(_mm_unpacklo_ps(basis[2], basis[3]), _mm_unpacklo_ps(basis[0], basis[1]));
+	alignas(16) float weighted[4];
+	_mm_store_ps(weighted, _mm_mul_ps(basisV, lines));
+	return 0.f + weighted[0] + weighted[1] + weighted[2] + weighted[3] +
+		_mm_cvtss_f32(_mm_shuffle_ps(basis[4], basis[4], 1)) * lastLine;
+#else
+	float basisU[5], basisV[5];
+	BernsteinBasis(u, basisU);
+	BernsteinBasis(v, basisV);
+	const float lastLine = 0.f + basisU[0] * last[0] + basisU[1] * last[1] + basisU[2] * last[2] +
+		basisU[3] * last[3] + basisU[4] * last[4];
+	float sum = 0.f;
+	for (int row = 0; row < PatchLength; ++row) {
+		sum += basisV[row] * (0.f + basisU[0] * patch[GetControlPoint(row, 0)] + basisU[1] * patch[GetControlPoint(row, 1)] +
+			basisU[2] * patch[GetControlPoint(row, 2)] + basisU[3] * patch[GetControlPoint(row, 3)] +
+			basisU[4] * patch[GetControlPoint(row, 4)]);
+	}
+	return sum + basisV[4] * lastLine;
+#endif
+}
+
+void Heightfield::GetHeights(std::span<const DirectX::XMFLOAT2> points, std::span<float> heights) const
+{
+	size_t i = 0;
+#ifdef HEIGHTFIELD_USE_SSE2
+	// Four points per pass, one per lane. Transposing four floats of each lane's patch gives one
+	// control point of all four patches per register; the sums are GetHeight's, lane-wise.
+	for (; i + 4 <= points.size(); i += 4) {
+		const float* patches[4];
+		alignas(16) float u[4], v[4];
+		for (int lane = 0; lane < 4; ++lane) {
+			patches[lane] = FindPatch(points[i + lane].x, points[i + lane].y, u[lane], v[lane]);
+			if (!patches[lane]) {
+				patches[lane] = ZeroPatch;
+				u[lane] = v[lane] = 0.f;
+			}
+		}
+		const auto load = [&](int offset, __m128* columns) {
+			columns[0] = _mm_loadu_ps(patches[0] + offset);
+			columns[1] = _mm_loadu_ps(patches[1] + offset);
+			columns[2] = _mm_loadu_ps(patches[2] + offset);
+			columns[3] = _mm_loadu_ps(patches[3] + offset);
+			_MM_TRANSPOSE4_PS(columns[0], columns[1], columns[2], columns[3]);
+		};
+
+		__m128 basisU[5], basisV[5];
+		BernsteinBasis(_mm_load_ps(u), basisU);
+		BernsteinBasis(_mm_load_ps(v), basisV);
+
+		// Column by column, the first four rows' line sums; then the last row's.
+		__m128 lines[5]{ _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+		for (int column = 0; column <= PatchLength; ++column) {
+			__m128 rows[4];
+			load(GetControlPoint(0, column), rows);
+			for (int row = 0; row < PatchLength; ++row) lines[row] = _mm_add_ps(lines[row], _mm_mul_ps(basisU[column], rows[row]));
+		}
+		__m128 lastRow[5];
+		load(GetControlPoint(PatchLength, 0), lastRow);
+		lastRow[4] = _mm_set_ps(patches[3][GetControlPoint(4, 4)], patches[2][GetControlPoint(4, 4)],
+			patches[1][GetControlPoint(4, 4)], patches[0][GetControlPoint(4, 4)]);
+		for (int column = 0; column <= PatchLength; ++column) {
+			lines[PatchLength] = _mm_add_ps(lines[PatchLength], _mm_mul_ps(basisU[column], lastRow[column]));
+		}
+
+		__m128 sum = _mm_setzero_ps();
+		for (int row = 0; row <= PatchLength; ++row) sum = _mm_add_ps(sum, _mm_mul_ps(basisV[row], lines[row]));
+		_mm_storeu_ps(heights.data() + i, sum);
+	}
+#endif
+	for (; i < points.size(); ++i) {
+		heights[i] = GetHeight(points[i].x, points[i].y);
+	}
+}
+
+uint32_t Heightfield::GetMortonIndex(uint32_t x, uint32_t z)
+{
+	return SpreadBits(x) | SpreadBits(z) << 1;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <DirectXMath.h>
+
+// Heights of a square grid centred on the origin, evaluated like the terrain's domain shader: every
+// 4x4 cells form a patch whose surface is the quartic Bézier over its 5x5 grid points. Besides the
+// row-major grid, each patch keeps its 25 control points together (padded to 32 floats) and the
+// patches are laid out in Morton order, so one query reads one block and nearby queries read nearby
+// blocks.
+class Heightfield
+{
+public:
+	static constexpr int PatchLength = 4;
+
+	// `heights` holds `length` rows of `length` samples; (length - 1) should be a multiple of
+	// PatchLength, any remainder lies outside every patch.
+	Heightfield(std::vector<float> heights, int length);
+
+	int GetLength() const { return m_length; }
+	int GetPatchCount() const { return m_patchCount; }
+	float GetSample(int x, int z) const { return m_heights[static_cast<size_t>(z) * m_length + x]; }
+	// The grid, row by row.
+	std::span<const float> GetSamples() const { return m_heights; }
+
+	// 0 outside the grid. The domain shader's sums in its order, so the result is bit-identical to
+	// the drawn surface's height at (x, z).
+	float GetHeight(float x, float z) const;
+
+	// GetHeight for every point, four at a time with SSE where available; the results are
+	// bit-identical to GetHeight's. `heights` must be at least as long as `points`.
+	void GetHeights(std::span<const DirectX::XMFLOAT2> points, std::span<float> heights) const;
+
+	// Interleaves the bits of x (even) and z (odd), the order patches are stored in.
+	static uint32_t GetMortonIndex(uint32_t x, uint32_t z);
+
+private:
+	static constexpr int PatchStride = 32;
+
+	// The patch holding (x, z) and the position within it, or null outside the grid.
+	const float* FindPatch(float x, float z, float& u, float& v) const;
+
+private:
+	std::vector<float>	m_heights;
+	std::vector<float>	m_patches;
+	int					m_length;
+	int					m_patchCount;		// Per side.
+};
@@ -0,0 +1,393 @@
+#include "heightpyramid.h"
+#include "terrainpackage.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+
+using namespace DirectX;
+
+namespace
+{
+	// Widens every bound by more than GetHeight's rounding, so no ray skips a node it grazes.
+	constexpr float BoundsMargin = 1e-3f;
+}
+
+HeightPyramid::HeightPyramid(const Heightfield& heightfield) :
+	m_heightfield{ &heightfield }, m_half{ static_cast<float>(heightfield.GetLength() / 2) }
+{
+	constexpr int side = Heightfield::PatchLength;
+	const int patchCount = heightfield.GetPatchCount();
+	if (patchCount == 0) return;
+
+	// Row k of quarter q takes the control points of a quartic to those of its piece over
+	// [q / 4, (q + 1) / 4]: its blossom at k copies of the piece's end and 4 - k of its start.
+	float split[side][side + 1][side + 1];
+	for (int quarter = 0; quarter < side; ++quarter) {
+		for (int k = 0; k <= side; ++k) {
+			for (int j = 0; j <= side; ++j) {
+				float points[side + 1]{};
+				points[j] = 1.f;
+				for (int round = 0; round < side; ++round) {
+					const float t = static_cast<float>(round < k ? quarter + 1 : quarter) / side;
+					for (int i = 0; i < side - round; ++i) points[i] = (1.f - t) * points[i] + t * points[i + 1];
+				}
+				split[quarter][k][j] = points[0];
+			}
+		}
+	}
+
+	Level cells{ {}, patchCount * side };
+	cells.bounds.resize(static_cast<size_t>(cells.side) * cells.side);
+	m_errors.resize(cells.bounds.size());
+	for (int pz = 0; pz < patchCount; ++pz) {
+		for (int px = 0; px < patchCount; ++px) {
+			float patch[side + 1][side + 1];
+			for (int row = 0; row <= side; ++row) {
+				for (int column = 0; column <= side; ++column) {
+					patch[row][column] = heightfield.GetSample(px * side + column, pz * side + row);
+				}
+			}
+
+			// Rows split first, then columns: the cell's own 5x5 control points, whose hull holds it.
+			for (int cz = 0; cz < side; ++cz) {
+				float rows[side + 1][side + 1]{};
+				for (int k = 0; k <= side; ++k) {
+					for (int row = 0; row <= side; ++row) {
+						for (int column = 0; column <= side; ++column) rows[k][column] += split[cz][k][row] * patch[row][column];
+					}
+				}
+				for (int cx = 0; cx < side; ++cx) {
+					// The bilinear through the cell's samples has the control points it takes at theirs,
+					// so the largest difference between the two sets bounds how far the surface strays.
+					const float* low = patch[cz] + cx;
+					const float* high = patch[cz + 1] + cx;
+					float minY = std::numeric_limits<float>::max(), maxY = std::numeric_limits<float>::lowest(), error = 0.f;
+					for (int k = 0; k <= side; ++k) {
+						for (int l = 0; l <= side; ++l) {
+							float point = 0.f;
+							for (int column = 0; column <= side; ++column) point += rows[k][column] * split[cx][l][column];
+							minY = std::min(minY, point);
+							maxY = std::max(maxY, point);
+
+							const float x = static_cast<float>(l) / side, z = static_cast<float>(k) / side;
+							const float nearRow = low[0] + (low[1] - low[0]) * x, farRow = high[0] + (high[1] - high[0]) * x;
+							error = std::max(error, std::abs(point - (nearRow + (farRow - nearRow) * z)));
+						}
+					}
+					const size_t cell = static_cast<size_t>(pz * side + cz) * cells.side + px * side + cx;
+					cells.bounds[cell] = Bounds{ minY - BoundsMargin, maxY + BoundsMargin };
+					m_errors[cell] = error + BoundsMargin;
+				}
+			}
+		}
+	}
+	m_levels.push_back(std::move(cells));
+
+	while (m_levels.back().side > 1) {
+		const Level& below = m_levels.back();
+		Level level{ {}, (below.side + 1) / 2 };
+		level.bounds.resize(static_cast<size_t>(level.side) * level.side);
+		for (int z = 0; z < level.side; ++z) {
+			for (int x = 0; x < level.side; ++x) {
+				Bounds bounds{ std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+				for (int cz = 2 * z; cz < std::min(2 * z + 2, below.side); ++cz) {
+					for (int cx = 2 * x; cx < std::min(2 * x + 2, below.side); ++cx) {
+						const Bounds& child = below.bounds[static_cast<size_t>(cz) * below.side + cx];
+						bounds.minY = std::min(bounds.minY, child.minY);
+						bounds.maxY = std::max(bounds.maxY, child.maxY);
+					}
+				}
+				level.bounds[static_cast<size_t>(z) * level.side + x] = bounds;
+			}
+		}
+		m_levels.push_back(std::move(level));
+	}
+}
+
+HeightPyramid::HeightPyramid(const Heightfield& heightfield, std::span<const std::byte> cooked) :
+	m_heightfield{ &heightfield }, m_half{ static_cast<float>(heightfield.GetLength() / 2) }
+{
+	TerrainPackage::Reader reader{ cooked };
+	m_levels.resize(reader.Read<uint32_t>());
+	for (Level& level : m_levels) {
+		level.side = reader.Read<int>();
+		level.bounds = reader.ReadVector<Bounds>();
+		if (level.bounds.size() != static_cast<size_t>(level.side) * level.side) {
+			throw std::runtime_error{ "terrain package: bad pyramid level" };
+		}
+	}
+	m_errors = reader.ReadVector<float>();
+	if (!m_levels.empty() && (m_levels[0].side != heightfield.GetPatchCount() * Heightfield::PatchLength ||
+		m_errors.size() != m_levels[0].bounds.size())) {
+		throw std::runtime_error{ "terrain package: the pyramid does not fit the heightfield" };
+	}
+}
+
+std::vector<std::byte> HeightPyramid::Cook() const
+{
+	TerrainPackage::Writer writer;
+	writer.Write(static_cast<uint32_t>(m_levels.size()));
+	for (const Level& level : m_levels) {
+		writer.Write(level.side);
+		writer.Write(level.bounds);
+	}
+	writer.Write(m_errors);
+	return std::move(writer.GetBytes());
+}
+
+float HeightPyramid::Intersect(const Ray& ray) const
+{
+	return Walk<true>(ray);
+}
+
+float HeightPyramid::IntersectCells(const Ray& ray) const
+{
+	return Walk<false>(ray);
+}
+
+template <bool Skip>
+float HeightPyramid::Walk(const Ray& ray) const
+{
+	if (m_levels.empty()) return Miss;
+
+	// In grid space, where cell (x, z) spans [x, x + 1] x [z, z + 1].
+	const int cells = m_levels[0].side;
+	const float ox = ray.origin.x + m_half, oy = ray.origin.y, oz = ray.origin.z + m_half;
+	const float dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+
+	float t = 0.f, end = ray.length;
+	const auto clip = [&](float origin, float direction) {
+		if (direction == 0.f) return origin >= 0.f && origin <= static_cast<float>(cells);
+		const float t0 = -origin / direction, t1 = (static_cast<float>(cells) - origin) / direction;
+		t = std::max(t, std::min(t0, t1));
+		end = std::min(end, std::max(t0, t1));
+		return true;
+	};
+	if (!clip(ox, dx) || !clip(oz, dz) || !(t <= end)) return Miss;
+
+	// Until the walk passes its first node, the ray may start below the surface.
+	bool above = false;
+	const float run = std::sqrt(dx * dx + dz * dz);
+	const float invX = dx != 0.f ? 1.f / dx : 0.f, invY = dy != 0.f ? 1.f / dy : 0.f, invZ = dz != 0.f ? 1.f / dz : 0.f;
+	if (Skip) {
+		// Nothing above the whole surface's top needs walking.
+		const float maxY = m_levels.back().bounds[0].maxY;
+		if (dy < 0.f && oy + t * dy > maxY) {
+			t = (maxY - oy) * invY;
+			above = true;
+		}
+		else if (dy > 0.f) {
+			end = std::min(end, (maxY - oy) * invY);
+		}
+		else if (dy == 0.f && oy > maxY) {
+			return Miss;
+		}
+		if (!(t <= end)) return Miss;
+	}
+	// The cells the ray starts and ends in.
+	const int ix = std::clamp(static_cast<int>(std::floor(ox + t * dx)), 0, cells - 1);
+	const int iz = std::clamp(static_cast<int>(std::floor(oz + t * dz)), 0, cells - 1);
+	const int endX = std::clamp(static_cast<int>(std::floor(ox + end * dx)), 0, cells - 1);
+	const int endZ = std::clamp(static_cast<int>(std::floor(oz + end * dz)), 0, cells - 1);
+	// The walk never leaves the smallest node holding both.
+	const int top = Skip ? std::min(GetLevelCount() - 1, static_cast<int>(std::bit_width(static_cast<uint32_t>((ix ^ endX) | (iz ^ endZ))))) : 0;
+	int level = top;
+	if (Skip) {
+		// Every node holding the start with its top above the start would be descended through anyway,
+		// so the walk starts in the largest it might skip.
+		const float y = oy + t * dy;
+		int inside = 0;
+		while (inside <= top && y > GetBounds(inside, ix >> inside, iz >> inside).maxY) ++inside;
+		level = std::clamp(inside - 1, 0, top);
+	}
+
+	// The node the ray is in at t. Stepping moves it by one along an axis, so only entering a child
+	// needs the ray's position; a node's exits follow from its corner.
+	int nx = ix >> level, nz = iz >> level;
+	const int stepX = dx > 0.f ? 1 : -1, stepZ = dz > 0.f ? 1 : -1;
+	const int farX = dx > 0.f ? 1 : 0, farZ = dz > 0.f ? 1 : 0;
+	while (true) {
+		const float exitX = dx != 0.f ? (static_cast<float>((nx + farX) << level) - ox) * invX : Miss;
+		const float exitZ = dz != 0.f ? (static_cast<float>((nz + farZ) << level) - oz) * invZ : Miss;
+		const float exit = std::max(std::min(std::min(exitX, exitZ), end), t);
+
+		// Passing above the node's top skips it whole; otherwise look closer.
+		const Level& nodes = m_levels[level];
+		const Bounds& bounds = nodes.bounds[static_cast<size_t>(nz) * nodes.side + nx];
+		const bool skipped = Skip && std::min(oy + t * dy, oy + exit * dy) > bounds.maxY;
+		if (!skipped) {
+			if (level > 0) {
+				--level;
+				const int side = m_levels[level].side;
+				nx = std::min(2 * nx + (ox + t * dx >= static_cast<float>((2 * nx + 1) << level) ? 1 : 0), side - 1);
+				nz = std::min(2 * nz + (oz + t * dz >= static_cast<float>((2 * nz + 1) << level) ? 1 : 0), side - 1);
+				continue;
+			}
+			// A descending ray can only cross between the cell's top and bottom, and has crossed by the
+			// bottom; a rising one can only cross below the top.
+			float t0 = t, t1 = exit;
+			if (dy < 0.f) {
+				t0 = std::max(t0, (bounds.maxY - oy) * invY);
+				t1 = std::min(t1, (bounds.minY - oy) * invY);
+			}
+			else if (dy > 0.f) {
+				t1 = std::min(t1, (bounds.maxY - oy) * invY);
+			}
+			if (t0 <= t1) {
+				const float hit = IntersectCell(ray, nx, nz, t0, t1, run, above || t0 > t);
+				if (hit != Miss) return hit;
+			}
+			else if (oy + t * dy < bounds.minY) {
+				return t;
+			}
+		}
+		if (exit >= end) return Miss;
+		above = true;
+
+		// Into the next node. Its parent is worth trying only if the step left the old parent, and
+		// only if the ray cleared the old node: one it had to look into means it runs low here.
+		t = exit;
+		bool leftParent;
+		if (exitX <= exitZ) {
+			nx += stepX;
+			leftParent = (nx >> 1) != ((nx - stepX) >> 1);
+		}
+		else {
+			nz += stepZ;
+			leftParent = (nz >> 1) != ((nz - stepZ) >> 1);
+		}
+		if (nx < 0 || nz < 0 || nx >= nodes.side || nz >= nodes.side) return Miss;
+		if (leftParent && skipped && level < top) {
+			++level;
+			nx >>= 1;
+			nz >>= 1;
+		}
+	}
+}
+
+void HeightPyramid::Intersect(std::span<const Ray> rays, std::span<float> distances, size_t workerCount) const
+{
+	Parallel::ForRange(0, rays.size(), [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i) distances[i] = Intersect(rays[i]);
+		}, workerCount);
+}
+
+bool HeightPyramid::IsVisible(const XMFLOAT3& from, const XMFLOAT3& to) const
+{
+	return Intersect(Ray{ from, XMFLOAT3{ to.x - from.x, to.y - from.y, to.z - from.z }, 1.f }) == Miss;
+}
+
+float HeightPyramid::IntersectCell(const Ray& ray, int x, int z, float t0, float t1, float run, bool above) const
+{
+	// Along the ray from t0, the height above the bilinear through the cell's samples is
+	// a + b * s + c * s^2, and the height above the surface is within the cell's error of that.
+	const Heightfield& heightfield = *m_heightfield;
+	const float h00 = heightfield.GetSample(x, z), h10 = heightfield.GetSample(x + 1, z);
+	const float h01 = heightfield.GetSample(x, z + 1), h11 = heightfield.GetSample(x + 1, z + 1);
+	const float slopeX = h10 - h00, slopeZ = h01 - h00, twist = h11 - h10 - h01 + h00;
+	const float x0 = ray.origin.x + m_half + t0 * ray.direction.x - static_cast<float>(x);
+	const float z0 = ray.origin.z + m_half + t0 * ray.direction.z - static_cast<float>(z);
+	const float a = ray.origin.y + t0 * ray.direction.y - (h00 + slopeX * x0 + slopeZ * z0 + twist * x0 * z0);
+	const float b = ray.direction.y - (slopeX * ray.direction.x + slopeZ * ray.direction.z +
+		twist * (x0 * ray.direction.z + z0 * ray.direction.x));
+	const float c = -twist * ray.direction.x * ray.direction.z;
+	const float error = m_errors[static_cast<size_t>(z) * m_levels[0].side + x];
+
+	// The first s in [0, t1 - t0] at which a + b * s + c * s^2 <= level, or Miss.
+	const float length = t1 - t0;
+	const auto reach = [&](float level) {
+		const float rest = a - level;
+		if (rest <= 0.f) return 0.f;
+		float s = Miss;
+		if (c == 0.f) {
+			if (b < 0.f) s = -rest / b;
+		}
+		else {
+			const float discriminant = b * b - 4.f * c * rest;
+			if (discriminant >= 0.f) {
+				// Both roots have the sign of -b / c when c > 0, the smaller one is the first; when c < 0
+				// they straddle 0 and the larger is. Either way it is q / c or rest / q below.
+				const float q = -0.5f * (b + std::copysign(std::sqrt(discriminant), b));
+				const float r0 = q / c, r1 = q != 0.f ? rest / q : Miss;
+				s = c > 0.f ? std::min(r0, r1) : std::max(r0, r1);
+				if (s < 0.f) s = Miss;
+			}
+		}
+		return s <= length ? s : Miss;
+	};
+	// Before the ray comes within the error, it is above the surface; once it is an error below, it is
+	// below. The margins cover rounding in the roots.
+	const float enter = reach(error + BoundsMargin);
+	if (enter == Miss) return Miss;
+	const float start = std::max(t0 + enter - length * BoundsMargin, t0);
+	const float below = reach(-error - BoundsMargin);
+	const float stop = below == Miss ? t1 : std::min(t0 + below + length * BoundsMargin, t1);
+	const float hit = Search(ray, start, stop, run, above || start > t0);
+	return hit != Miss || stop >= t1 ? hit : Search(ray, stop, t1, run, true);
+}
+
+float HeightPyramid::Search(const Ray& ray, float t0, float t1, float run, bool above) const
+{
+	// Height of the ray above the surface at t.
+	const auto heightAbove = [&](float t) {
+		return ray.origin.y + t * ray.direction.y -
+			m_heightfield->GetHeight(ray.origin.x + t * ray.direction.x, ray.origin.z + t * ray.direction.z);
+	};
+	// The start is evaluated only where the ray may begin below the surface, or for the refinement.
+	float lowAbove = Miss;
+	if (!above) {
+		lowAbove = heightAbove(t0);
+		if (lowAbove <= 0.f) return t0;
+	}
+
+	// CellSteps samples per cell crossed, at least one; three or more in one batched query.
+	const int stepCount = std::clamp(static_cast<int>(std::ceil((t1 - t0) * run * CellSteps)), 1, CellSteps);
+	float steps[CellSteps], heights[CellSteps];
+	for (int step = 0; step < stepCount; ++step) steps[step] = t0 + (t1 - t0) * static_cast<float>(step + 1) / stepCount;
+	const bool batched = stepCount > 2;
+	if (batched) {
+		XMFLOAT2 points[CellSteps];
+		for (int step = 0; step < stepCount; ++step) {
+			points[step] = XMFLOAT2{ ray.origin.x + steps[step] * ray.direction.x, ray.origin.z + steps[step] * ray.direction.z };
+		}
+		m_heightfield->GetHeights(std::span{ points, static_cast<size_t>(stepCount) },
+			std::span{ heights, static_cast<size_t>(stepCount) });
+	}
+
+	float low = t0;
+	for (int step = 0; step < stepCount; ++step) {
+		float high = steps[step];
+		float highAbove = batched ? ray.origin.y + high * ray.direction.y - heights[step] : heightAbove(high);
+		if (highAbove > 0.f) {
+			low = high;
+			lowAbove = highAbove;
+			continue;
+		}
+		if (lowAbove == Miss) {
+			lowAbove = heightAbove(low);
+			if (lowAbove <= 0.f) return low;
+		}
+
+		// Illinois false position: halving the end that stays put keeps both ends converging.
+		for (int i = 0, kept = 0; i < RefineSteps && highAbove < -SurfaceTolerance; ++i) {
+			const float t = std::clamp(high - highAbove * (high - low) / (highAbove - lowAbove), low, high);
+			const float tAbove = heightAbove(t);
+			if (tAbove <= 0.f) {
+				high = t;
+				highAbove = tAbove;
+				if (kept < 0) lowAbove *= 0.5f;
+				kept = -1;
+			}
+			else {
+				if (tAbove <= SurfaceTolerance) return t;
+				low = t;
+				lowAbove = tAbove;
+				if (kept > 0) highAbove *= 0.5f;
+				kept = 1;
+			}
+		}
+		return high;
+	}
+	return Miss;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+#include <DirectXMath.h>
+#include "heightfield.h"
+#include "parallel.h"
+
+// Ray queries against a Heightfield's surface. Level 0 bounds the surface over every grid cell,
+// from the control points the Bézier patches subdivide into over that cell, so the bounds hold
+// the surface itself and not only the samples. Each level above bounds 2x2 nodes of the one below.
+// A ray starts in the smallest node holding the part of it within the surface's bounds, walks the
+// pyramid like a grid, stepping over whole nodes it passes above and descending only where it dips
+// below a node's top, then finds the surface inside the cells it reaches. There the surface is
+// within each cell's error of the bilinear through the cell's samples, a quadratic along the ray,
+// so the ray is only sampled where it comes within that error of the quadratic.
+class HeightPyramid
+{
+public:
+	static constexpr float Miss = std::numeric_limits<float>::infinity();
+
+	// The segment from `origin` to origin + length * direction, in the heightfield's space.
+	struct Ray
+	{
+		DirectX::XMFLOAT3	origin;
+		DirectX::XMFLOAT3	direction;
+		float				length;
+	};
+
+	struct Bounds
+	{
+		float	minY;
+		float	maxY;
+	};
+
+	// The heightfield must outlive the pyramid.
+	explicit HeightPyramid(const Heightfield& heightfield);
+	// The levels Cook wrote for the same heightfield.
+	HeightPyramid(const Heightfield& heightfield, std::span<const std::byte> cooked);
+
+	// Every level's bounds, for a terrain package.
+	std::vector<std::byte> Cook() const;
+
+	// The smallest t in [0, ray.length] at which the ray meets the surface, or Miss. A ray that
+	// starts below the surface meets it at 0. Only the part of a cell between its bounds is searched,
+	// sampled at CellSteps points per cell the ray moves across, and the first crossing is refined
+	// until the ray is within SurfaceTolerance of the surface.
+	float Intersect(const Ray& ray) const;
+
+	// The same walk through every cell the ray crosses, none skipped; for checking and timing Intersect.
+	float IntersectCells(const Ray& ray) const;
+
+	// Intersect for every ray, split over `workerCount` threads. `distances` must be at least as
+	// long as `rays`.
+	void Intersect(std::span<const Ray> rays, std::span<float> distances,
+		size_t workerCount = Parallel::GetWorkerCount()) const;
+
+	// Whether the segment between two points clears the surface.
+	bool IsVisible(const DirectX::XMFLOAT3& from, const DirectX::XMFLOAT3& to) const;
+
+	// Level 0 has one node per cell; the last level is a single node over the whole grid.
+	int GetLevelCount() const { return static_cast<int>(m_levels.size()); }
+	int GetSide(int level) const { return m_levels[level].side; }
+	const Bounds& GetBounds(int level, int x, int z) const
+	{
+		return m_levels[level].bounds[static_cast<size_t>(z) * m_levels[level].side + x];
+	}
+
+private:
+	static constexpr int CellSteps = 4;
+	static constexpr int RefineSteps = 16;
+	static constexpr float SurfaceTolerance = 1e-4f;
+
+	struct Level
+	{
+		std::vector<Bounds>	bounds;
+		int					side;
+	};
+
+	// Intersect with `Skip`, IntersectCells without.
+	template <bool Skip>
+	float Walk(const Ray& ray) const;
+
+	// The ray's first crossing in cell (x, z), which it spans from t0 to t1, or Miss. `run` is how far
+	// the ray moves across the grid per unit of t, and `above` whether the walk knows it is above the
+	// surface at t0.
+	float IntersectCell(const Ray& ray, int x, int z, float t0, float t1, float run, bool above) const;
+
+	// The first crossing from t0 to t1 within one cell, by sampling and refining; `run` and `above`
+	// as for IntersectCell.
+	float Search(const Ray& ray, float t0, float t1, float run, bool above) const;
+
+private:
+	const Heightfield*	m_heightfield;
+	std::vector<Level>	m_levels;
+	std::vector<float>	m_errors;		// Per cell, how far the surface strays from the bilinear through its samples.
+	float				m_half;			// Heightfield::GetHeight's offset of the grid.
+};
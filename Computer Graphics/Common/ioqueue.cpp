@@ -0,0 +1,291 @@
+#include "ioqueue.h"
+#include "lz.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+double IoStatistics::GetLatencyPercentile(double fraction) const
+{
+	uint64_t total = 0;
+	for (uint64_t count : latencyHistogram) total += count;
+	if (total == 0) return 0.0;
+
+	const uint64_t target = static_cast<uint64_t>(fraction * static_cast<double>(total - 1)) + 1;
+	uint64_t seen = 0;
+	for (size_t i = 0; i < latencyHistogram.size(); ++i) {
+		seen += latencyHistogram[i];
+		if (seen >= target) return static_cast<double>(uint64_t{ 1 } << (i + 1));
+	}
+	return static_cast<double>(uint64_t{ 1 } << latencyHistogram.size());
+}
+
+struct IoQueue::File
+{
+	std::filesystem::path	path;
+	uint64_t				size = 0;
+#ifdef _WIN32
+	HANDLE					handle = INVALID_HANDLE_VALUE;
+	~File() { if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle); }
+#else
+	int						handle = -1;
+	~File() { if (handle >= 0) close(handle); }
+#endif
+};
+
+IoQueue::IoQueue(size_t ioThreads, size_t decodeThreads) :
+	m_sequence{ 0 }, m_stopIo{ false }, m_stopDecode{ false }, m_statisticsStart{ Clock::now() }
+{
+	if (decodeThreads == 0) decodeThreads = std::max<size_t>(1, std::thread::hardware_concurrency() - 1);
+	for (size_t i = 0; i < std::max<size_t>(1, ioThreads); ++i) m_ioThreads.emplace_back(&IoQueue::IoWorker, this);
+	for (size_t i = 0; i < decodeThreads; ++i) m_decodeThreads.emplace_back(&IoQueue::DecodeWorker, this);
+}
+
+IoQueue::~IoQueue()
+{
+	{
+		std::lock_guard lock{ m_mutex };
+		m_stopIo = true;
+	}
+	m_ioCondition.notify_all();
+	for (auto& thread : m_ioThreads) thread.join();
+
+	{
+		std::lock_guard lock{ m_mutex };
+		m_stopDecode = true;
+	}
+	m_decodeCondition.notify_all();
+	for (auto& thread : m_decodeThreads) thread.join();
+}
+
+IoQueue::FileId IoQueue::Open(const std::filesystem::path& path)
+{
+	std::lock_guard lock{ m_mutex };
+	for (FileId id = 0; id < m_files.size(); ++id) {
+		if (m_files[id]->path == path) return id;
+	}
+
+	auto file = std::make_unique<File>();
+	file->path = path;
+#ifdef _WIN32
+	file->handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file->handle == INVALID_HANDLE_VALUE) throw std::runtime_error{ "cannot open " + path.string() };
+	LARGE_INTEGER size{};
+	GetFileSizeEx(file->handle, &size);
+	file->size = static_cast<uint64_t>(size.QuadPart);
+#else
+	file->handle = open(path.c_str(), O_RDONLY);
+	if (file->handle < 0) throw std::runtime_error{ "cannot open " + path.string() };
+	struct stat status{};
+	fstat(file->handle, &status);
+	file->size = static_cast<uint64_t>(status.st_size);
+#endif
+	m_files.push_back(std::move(file));
+	return static_cast<FileId>(m_files.size() - 1);
+}
+
+uint64_t IoQueue::GetFileSize(FileId file) const
+{
+	std::lock_guard lock{ m_mutex };
+	return m_files.at(file)->size;
+}
+
+std::future<void> IoQueue::Enqueue(const Request& request)
+{
+	if (!request.compressed && request.size != request.destination.size()) {
+		throw std::invalid_argument{ "io queue: destination size does not match the read size" };
+	}
+
+	Pending pending{ request, {}, Clock::now() };
+	auto future = pending.promise.get_future();
+	{
+		std::lock_guard lock{ m_mutex };
+		if (request.file >= m_files.size()) throw std::invalid_argument{ "io queue: unknown file" };
+		m_pending.emplace(PendingKey{ -request.priority, request.file, request.offset, m_sequence++ }, std::move(pending));
+		m_statistics.queueDepth = m_pending.size();
+		m_statistics.maxQueueDepth = std::max(m_statistics.maxQueueDepth, m_statistics.queueDepth);
+	}
+	m_ioCondition.notify_one();
+	return future;
+}
+
+void IoQueue::WaitIdle()
+{
+	std::unique_lock lock{ m_mutex };
+	m_idleCondition.wait(lock, [this] { return m_pending.empty() && m_statistics.inFlight == 0; });
+}
+
+IoStatistics IoQueue::GetStatistics() const
+{
+	std::lock_guard lock{ m_mutex };
+	IoStatistics statistics = m_statistics;
+	statistics.elapsedSeconds = std::chrono::duration<double>(Clock::now() - m_statisticsStart).count();
+	return statistics;
+}
+
+void IoQueue::ResetStatistics()
+{
+	std::lock_guard lock{ m_mutex };
+	const size_t inFlight = m_statistics.inFlight;
+	m_statistics = IoStatistics{};
+	m_statistics.queueDepth = m_statistics.maxQueueDepth = m_pending.size();
+	m_statistics.inFlight = inFlight;
+	m_statisticsStart = Clock::now();
+}
+
+void IoQueue::IoWorker()
+{
+	while (true) {
+		std::vector<Pending> batch;
+		uint64_t first = 0, last = 0;
+		FileId file = 0;
+		{
+			std::unique_lock lock{ m_mutex };
+			m_ioCondition.wait(lock, [this] { return m_stopIo || !m_pending.empty(); });
+			if (m_pending.empty()) return;
+
+			// Take the most urgent request, then every following request of the same priority and
+			// file that lies within MaxGapBytes of the batch, as long as the batch stays small.
+			auto it = m_pending.begin();
+			const int priority = std::get<0>(it->first);
+			file = std::get<1>(it->first);
+			first = it->second.request.offset;
+			last = first + it->second.request.size;
+			batch.push_back(std::move(it->second));
+			it = m_pending.erase(it);
+			while (it != m_pending.end() && std::get<0>(it->first) == priority && std::get<1>(it->first) == file) {
+				const Request& next = it->second.request;
+				const uint64_t end = std::max(last, next.offset + next.size);
+				if (next.offset > last + MaxGapBytes || end - first > MaxBatchBytes) break;
+				last = end;
+				batch.push_back(std::move(it->second));
+				it = m_pending.erase(it);
+			}
+
+			m_statistics.batches += 1;
+			m_statistics.coalescedRequests += batch.size() - 1;
+			m_statistics.queueDepth = m_pending.size();
+			m_statistics.inFlight += batch.size();
+		}
+
+		auto staging = std::make_shared<std::vector<std::byte>>();
+		std::exception_ptr error;
+		try {
+			// A lone uncompressed request is read straight into its destination.
+			if (batch.size() == 1 && !batch[0].request.compressed) {
+				ReadAt(file, first, batch[0].request.destination);
+			}
+			else {
+				staging->resize(last - first);
+				ReadAt(file, first, *staging);
+			}
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+
+		{
+			std::lock_guard lock{ m_mutex };
+			if (!error) m_statistics.bytesRead += last - first;
+			for (auto& pending : batch) {
+				const uint64_t offset = pending.request.offset - first;
+				m_decodeJobs.push_back({ staging->empty() ? nullptr : staging, offset, error, std::move(pending) });
+			}
+		}
+		m_decodeCondition.notify_all();
+	}
+}
+
+void IoQueue::DecodeWorker()
+{
+	while (true) {
+		DecodeJob job;
+		{
+			std::unique_lock lock{ m_mutex };
+			m_decodeCondition.wait(lock, [this] { return m_stopDecode || !m_decodeJobs.empty(); });
+			if (m_decodeJobs.empty()) return;
+			job = std::move(m_decodeJobs.front());
+			m_decodeJobs.pop_front();
+		}
+
+		std::exception_ptr error = job.error;
+		const Request& request = job.pending.request;
+		if (!error && job.staging) {
+			const auto source = std::span<const std::byte>{ *job.staging }.subspan(job.stagingOffset, request.size);
+			if (request.compressed) {
+				if (!Lz::Decompress(source, request.destination)) {
+					error = std::make_exception_ptr(std::runtime_error{ "io queue: corrupt compressed data" });
+				}
+			}
+			else if (!source.empty()) {
+				std::memcpy(request.destination.data(), source.data(), source.size());
+			}
+		}
+		Complete(job.pending, error);
+	}
+}
+
+void IoQueue::ReadAt(FileId fileId, uint64_t offset, std::span<std::byte> destination)
+{
+	const File* file;
+	{
+		std::lock_guard lock{ m_mutex };
+		file = m_files[fileId].get();
+	}
+
+	size_t done = 0;
+	while (done < destination.size()) {
+		const size_t chunk = std::min<size_t>(destination.size() - done, size_t{ 1 } << 30);
+#ifdef _WIN32
+		OVERLAPPED overlapped{};
+		const uint64_t position = offset + done;
+		overlapped.Offset = static_cast<DWORD>(position);
+		overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+		DWORD read = 0;
+		if (!ReadFile(file->handle, destination.data() + done, static_cast<DWORD>(chunk), &read, &overlapped) || read == 0) {
+			throw std::runtime_error{ "io queue: read failed on " + file->path.string() };
+		}
+#else
+		const ssize_t read = pread(file->handle, destination.data() + done, chunk, static_cast<off_t>(offset + done));
+		if (read <= 0) throw std::runtime_error{ "io queue: read failed on " + file->path.string() };
+#endif
+		done += static_cast<size_t>(read);
+	}
+}
+
+void IoQueue::Complete(Pending& pending, std::exception_ptr error)
+{
+	const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - pending.enqueued).count();
+	const size_t bucket = std::min<size_t>(std::bit_width(static_cast<uint64_t>(std::max<int64_t>(latency, 1))) - 1,
+		IoStatistics::HistogramBuckets - 1);
+
+	// Statistics first, so a caller woken by the future sees its own request counted.
+	bool idle;
+	{
+		std::lock_guard lock{ m_mutex };
+		m_statistics.requests += 1;
+		if (!error) m_statistics.bytesDelivered += pending.request.destination.size();
+		m_statistics.latencyHistogram[bucket] += 1;
+		m_statistics.inFlight -= 1;
+		idle = m_pending.empty() && m_statistics.inFlight == 0;
+	}
+
+	if (error) pending.promise.set_exception(error);
+	else pending.promise.set_value();
+	if (idle) m_idleCondition.notify_all();
+}
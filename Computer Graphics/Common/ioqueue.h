@@ -0,0 +1,122 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+struct IoStatistics
+{
+	// Bucket i counts requests that completed in [2^i, 2^(i+1)) microseconds after Enqueue.
+	static constexpr size_t HistogramBuckets = 24;
+
+	uint64_t	requests = 0;
+	uint64_t	batches = 0;
+	uint64_t	coalescedRequests = 0;
+	uint64_t	bytesRead = 0;
+	uint64_t	bytesDelivered = 0;
+	size_t		queueDepth = 0;
+	size_t		maxQueueDepth = 0;
+	size_t		inFlight = 0;
+	double		elapsedSeconds = 0.0;
+	std::array<uint64_t, HistogramBuckets> latencyHistogram{};
+
+	double GetReadThroughput() const { return elapsedSeconds > 0.0 ? bytesRead / elapsedSeconds : 0.0; }
+	// Upper bound of the bucket that holds the given fraction (0..1) of completed requests.
+	double GetLatencyPercentile(double fraction) const;
+};
+
+// Asynchronous read queue: requests are ordered by priority, neighbouring reads of the same
+// file are coalesced into one batch, and batches are read by I/O threads (pread/ReadFile at an
+// offset) before a separate pool decompresses or copies each request into its destination.
+class IoQueue
+{
+public:
+	using FileId = uint32_t;
+
+	struct Request
+	{
+		FileId				file = 0;
+		uint64_t			offset = 0;
+		uint64_t			size = 0;				// bytes on disk
+		std::span<std::byte> destination;			// decompressed size, may be mapped upload memory
+		bool				compressed = false;		// Lz stream
+		int					priority = 0;			// higher is served first
+	};
+
+	static constexpr uint64_t MaxBatchBytes = 4 << 20;
+	static constexpr uint64_t MaxGapBytes = 64 << 10;
+
+	explicit IoQueue(size_t ioThreads = 2, size_t decodeThreads = 0);
+	~IoQueue();
+
+	IoQueue(const IoQueue&) = delete;
+	IoQueue& operator=(const IoQueue&) = delete;
+
+	// Opening the same path twice returns the same id.
+	FileId Open(const std::filesystem::path& path);
+	uint64_t GetFileSize(FileId file) const;
+
+	std::future<void> Enqueue(const Request& request);
+	void WaitIdle();
+
+	IoStatistics GetStatistics() const;
+	void ResetStatistics();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct File;
+
+	struct Pending
+	{
+		Request					request;
+		std::promise<void>		promise;
+		Clock::time_point		enqueued;
+	};
+
+	struct DecodeJob
+	{
+		std::shared_ptr<std::vector<std::byte>>	staging;		// null when read in place
+		uint64_t								stagingOffset;
+		std::exception_ptr						error;
+		Pending									pending;
+	};
+
+	// (-priority, file, offset, sequence): begin() is the next request to serve.
+	using PendingKey = std::tuple<int, FileId, uint64_t, uint64_t>;
+
+	void IoWorker();
+	void DecodeWorker();
+	void ReadAt(FileId file, uint64_t offset, std::span<std::byte> destination);
+	void Complete(Pending& pending, std::exception_ptr error);
+
+private:
+	mutable std::mutex						m_mutex;
+	std::condition_variable					m_ioCondition;
+	std::condition_variable					m_decodeCondition;
+	std::condition_variable					m_idleCondition;
+
+	std::deque<std::unique_ptr<File>>		m_files;
+	std::map<PendingKey, Pending>			m_pending;
+	std::deque<DecodeJob>					m_decodeJobs;
+	uint64_t								m_sequence;
+	bool									m_stopIo;
+	bool									m_stopDecode;
+
+	IoStatistics							m_statistics;
+	Clock::time_point						m_statisticsStart;
+
+	std::vector<std::thread>				m_ioThreads;
+	std::vector<std::thread>				m_decodeThreads;
+};
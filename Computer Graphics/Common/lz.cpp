@@ -0,0 +1,122 @@
+#include "lz.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	constexpr size_t MinMatch = 4;
+	constexpr size_t MaxOffset = 0xFFFF;
+	constexpr size_t HashBits = 16;
+	// The last bytes are always emitted as literals so the match finder never reads past the end.
+	constexpr size_t EndLiterals = 8;
+
+	uint32_t Read32(const std::byte* p)
+	{
+		uint32_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	uint32_t Hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HashBits);
+	}
+
+	void WriteLength(std::vector<std::byte>& out, size_t length)
+	{
+		for (; length >= 255; length -= 255) out.push_back(std::byte{ 255 });
+		out.push_back(static_cast<std::byte>(length));
+	}
+
+	void WriteSequence(std::vector<std::byte>& out, const std::byte* literals, size_t literalLength,
+		size_t offset, size_t matchLength)
+	{
+		const size_t matchCode = matchLength ? matchLength - MinMatch : 0;
+		const uint8_t token = static_cast<uint8_t>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15));
+		out.push_back(static_cast<std::byte>(token));
+		if (literalLength >= 15) WriteLength(out, literalLength - 15);
+		out.insert(out.end(), literals, literals + literalLength);
+		if (!matchLength) return;
+
+		out.push_back(static_cast<std::byte>(offset & 0xFF));
+		out.push_back(static_cast<std::byte>(offset >> 8));
+		if (matchCode >= 15) WriteLength(out, matchCode - 15);
+	}
+}
+
+std::vector<std::byte> Lz::Compress(std::span<const std::byte> source)
+{
+	std::vector<std::byte> out;
+	out.reserve(source.size() / 2 + 16);
+
+	const std::byte* const begin = source.data();
+	const size_t size = source.size();
+	std::vector<uint32_t> table(size_t{ 1 } << HashBits, UINT32_MAX);
+
+	size_t anchor = 0;
+	size_t position = 0;
+	while (size > EndLiterals + MinMatch && position < size - EndLiterals - MinMatch) {
+		const uint32_t sequence = Read32(begin + position);
+		uint32_t& slot = table[Hash(sequence)];
+		const size_t candidate = slot;
+		slot = static_cast<uint32_t>(position);
+
+		if (candidate == UINT32_MAX || position - candidate > MaxOffset || Read32(begin + candidate) != sequence) {
+			++position;
+			continue;
+		}
+
+		size_t length = MinMatch;
+		const size_t limit = size - EndLiterals;
+		while (position + length < limit && begin[candidate + length] == begin[position + length]) ++length;
+
+		WriteSequence(out, begin + anchor, position - anchor, position - candidate, length);
+		position += length;
+		anchor = position;
+	}
+	WriteSequence(out, begin + anchor, size - anchor, 0, 0);
+	return out;
+}
+
+bool Lz::Decompress(std::span<const std::byte> source, std::span<std::byte> destination)
+{
+	const std::byte* in = source.data();
+	const std::byte* const inEnd = in + source.size();
+	std::byte* const outBegin = destination.data();
+	std::byte* out = outBegin;
+	std::byte* const outEnd = out + destination.size();
+
+	auto readLength = [&](size_t length, bool& ok) {
+		if (length != 15) return length;
+		while (true) {
+			if (in >= inEnd) { ok = false; return length; }
+			const uint8_t extra = static_cast<uint8_t>(*in++);
+			length += extra;
+			if (extra != 255) return length;
+		}
+		};
+
+	while (in < inEnd) {
+		bool ok = true;
+		const uint8_t token = static_cast<uint8_t>(*in++);
+
+		const size_t literalLength = readLength(token >> 4, ok);
+		if (!ok || literalLength > static_cast<size_t>(inEnd - in) || literalLength > static_cast<size_t>(outEnd - out)) return false;
+		if (literalLength) std::memcpy(out, in, literalLength);
+		in += literalLength;
+		out += literalLength;
+		if (in == inEnd) break;
+
+		if (inEnd - in < 2) return false;
+		const size_t offset = static_cast<size_t>(in[0]) | (static_cast<size_t>(in[1]) << 8);
+		in += 2;
+		const size_t matchLength = readLength(token & 0xF, ok) + MinMatch;
+		if (!ok || offset == 0 || offset > static_cast<size_t>(out - outBegin) || matchLength > static_cast<size_t>(outEnd - out)) return false;
+
+		// Byte copy: overlapping matches (offset < length) repeat the pattern.
+		const std::byte* match = out - offset;
+		for (size_t i = 0; i < matchLength; ++i) out[i] = match[i];
+		out += matchLength;
+	}
+	return out == outEnd;
+}
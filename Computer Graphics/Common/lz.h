@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Byte-oriented LZ77 codec (LZ4-style sequences: token, literals, 16-bit offset, match length).
+// Fast to decode and good enough for mesh and heightmap data; not a general archiver.
+namespace Lz
+{
+	std::vector<std::byte> Compress(std::span<const std::byte> source);
+
+	// Decompresses into `destination`, whose size must be the original size.
+	// Returns false on malformed input instead of reading or writing out of bounds.
+	bool Decompress(std::span<const std::byte> source, std::span<std::byte> destination);
+}
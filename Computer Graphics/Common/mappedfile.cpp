@@ -0,0 +1,113 @@
+#include "mappedfile.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (file == INVALID_HANDLE_VALUE) throw std::runtime_error{ "cannot open " + path.string() };
+	m_file = file;
+	m_open = true;
+
+	LARGE_INTEGER size{};
+	GetFileSizeEx(file, &size);
+	m_size = static_cast<size_t>(size.QuadPart);
+	if (m_size == 0) return;
+
+	m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mapping) {
+		Close();
+		throw std::runtime_error{ "cannot map " + path.string() };
+	}
+	m_data = static_cast<const std::byte*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	const int file = open(path.c_str(), O_RDONLY);
+	if (file < 0) throw std::runtime_error{ "cannot open " + path.string() };
+	m_open = true;
+
+	struct stat status{};
+	fstat(file, &status);
+	m_size = static_cast<size_t>(status.st_size);
+	if (m_size != 0) {
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, file, 0);
+		m_data = data == MAP_FAILED ? nullptr : static_cast<const std::byte*>(data);
+	}
+	close(file);
+#endif
+	if (m_size != 0 && !m_data) {
+		Close();
+		throw std::runtime_error{ "cannot map " + path.string() };
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this == &other) return *this;
+	Close();
+	m_data = std::exchange(other.m_data, nullptr);
+	m_size = std::exchange(other.m_size, 0);
+	m_open = std::exchange(other.m_open, false);
+#ifdef _WIN32
+	m_file = std::exchange(other.m_file, nullptr);
+	m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+	return *this;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const
+{
+	if (!m_data || offset >= m_size) return;
+	size = std::min(size, m_size - offset);
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range{ const_cast<std::byte*>(m_data + offset), size };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t first = offset / page * page;
+	madvise(const_cast<std::byte*>(m_data + first), size + (offset - first), MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(m_mapping);
+	if (m_file) CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_data) munmap(const_cast<std::byte*>(m_data), m_size);
+#endif
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+// Read-only memory mapping of a whole file (Win32 file mapping or POSIX mmap).
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::filesystem::path& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	bool IsOpen() const { return m_open; }
+	std::span<const std::byte> GetData() const { return { m_data, m_size }; }
+	size_t GetSize() const { return m_size; }
+
+	// Hints the OS to fetch [offset, offset + size) ahead of the first access.
+	void Prefetch(size_t offset, size_t size) const;
+
+private:
+	void Close();
+
+private:
+	const std::byte*	m_data = nullptr;
+	size_t				m_size = 0;
+	bool				m_open = false;
+#ifdef _WIN32
+	void*				m_file = nullptr;
+	void*				m_mapping = nullptr;
+#endif
+};
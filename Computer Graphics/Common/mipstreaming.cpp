@@ -0,0 +1,181 @@
+#include "mipstreaming.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+
+float MipStreaming::GetPixelsPerUnit(float distance, float fovY, float viewportHeight)
+{
+	distance = std::max(distance, 1e-3f);
+	return viewportHeight / (2.f * distance * std::tan(fovY * 0.5f));
+}
+
+uint32_t MipStreaming::GetRequiredMip(float texelsPerUnit, float pixelsPerUnit, uint32_t mipCount)
+{
+	if (mipCount == 0) return 0;
+	const float texelsPerPixel = texelsPerUnit / std::max(pixelsPerUnit, 1e-6f);
+	if (!(texelsPerPixel > 1.f)) return 0;
+	const auto mip = static_cast<uint32_t>(std::min(std::floor(std::log2(texelsPerPixel)), 31.f));
+	return std::min(mip, mipCount - 1);
+}
+
+MipStreamer::MipStreamer(uint64_t residentBudget, uint64_t frameUploadBudget, uint32_t evictionDelay) :
+	m_residentBudget{ residentBudget }, m_frameUploadBudget{ frameUploadBudget }, m_evictionDelay{ evictionDelay },
+	m_residentBytes{ 0 }, m_frame{ 0 }
+{
+}
+
+MipStreamer::TextureId MipStreamer::Register(std::vector<uint64_t> mipBytes, uint32_t tailMip)
+{
+	if (mipBytes.empty() || tailMip >= mipBytes.size()) throw std::invalid_argument{ "mip streamer: bad mip tail" };
+
+	TextureId id;
+	if (!m_freeIds.empty()) {
+		id = m_freeIds.back();
+		m_freeIds.pop_back();
+	}
+	else {
+		id = static_cast<TextureId>(m_textures.size());
+		m_textures.emplace_back();
+	}
+
+	Texture& texture = m_textures[id];
+	texture.lastUsed.assign(mipBytes.size(), m_frame);
+	texture.mipBytes = std::move(mipBytes);
+	texture.tailMip = tailMip;
+	texture.residentMip = tailMip;
+	texture.requestedMip = tailMip;
+	texture.wantedMip = tailMip;
+	texture.registered = true;
+	for (uint32_t mip = tailMip; mip < texture.mipBytes.size(); ++mip) {
+		m_residentBytes += texture.mipBytes[mip];
+	}
+	return id;
+}
+
+void MipStreamer::Unregister(TextureId id)
+{
+	Texture& texture = m_textures.at(id);
+	if (!texture.registered) return;
+	for (uint32_t mip = texture.residentMip; mip < texture.mipBytes.size(); ++mip) {
+		m_residentBytes -= texture.mipBytes[mip];
+	}
+	texture = Texture{};
+	m_freeIds.push_back(id);
+}
+
+void MipStreamer::Request(TextureId id, uint32_t mip)
+{
+	Texture& texture = m_textures.at(id);
+	texture.requestedMip = std::min(texture.requestedMip, mip);
+}
+
+MipStreamer::Plan MipStreamer::Update()
+{
+	++m_frame;
+	Plan plan;
+
+	for (Texture& texture : m_textures) {
+		if (!texture.registered) continue;
+		texture.wantedMip = texture.requestedMip;
+		for (uint32_t mip = texture.wantedMip; mip < texture.tailMip; ++mip) {
+			texture.lastUsed[mip] = m_frame;
+		}
+		texture.requestedMip = texture.tailMip;
+	}
+
+	// Mips nobody has sampled for a while go even when there is room for them.
+	for (TextureId id = 0; id < m_textures.size(); ++id) {
+		const Texture& texture = m_textures[id];
+		while (texture.registered && texture.residentMip < texture.wantedMip &&
+			m_frame - texture.lastUsed[texture.residentMip] > m_evictionDelay) {
+			Evict(id, plan);
+		}
+	}
+
+	// (shortfall, -bytes of the next mip, id): the texture furthest from its target goes first,
+	// and among equals the cheaper upload.
+	using Candidate = std::tuple<uint32_t, int64_t, TextureId>;
+	std::priority_queue<Candidate> candidates;
+	auto push = [&](TextureId id) {
+		const Texture& texture = m_textures[id];
+		if (texture.residentMip <= texture.wantedMip) return;
+		const uint64_t bytes = texture.mipBytes[texture.residentMip - 1];
+		candidates.emplace(texture.residentMip - texture.wantedMip, -static_cast<int64_t>(bytes), id);
+		};
+	for (TextureId id = 0; id < m_textures.size(); ++id) {
+		if (m_textures[id].registered) push(id);
+	}
+
+	uint64_t frameBytes = 0;
+	while (!candidates.empty()) {
+		const TextureId id = std::get<2>(candidates.top());
+		candidates.pop();
+
+		Texture& texture = m_textures[id];
+		const uint32_t mip = texture.residentMip - 1;
+		const uint64_t bytes = texture.mipBytes[mip];
+
+		// One upload always goes through so a mip larger than the frame budget still arrives.
+		if (frameBytes > 0 && frameBytes + bytes > m_frameUploadBudget) continue;
+		if (m_residentBytes + bytes > m_residentBudget &&
+			!FreeBytes(m_residentBytes + bytes - m_residentBudget, id, plan)) continue;
+
+		plan.uploads.push_back({ id, mip });
+		texture.residentMip = mip;
+		texture.lastUsed[mip] = m_frame;
+		m_residentBytes += bytes;
+		frameBytes += bytes;
+		push(id);
+	}
+	return plan;
+}
+
+uint32_t MipStreamer::GetResidentMip(TextureId id) const
+{
+	return m_textures.at(id).residentMip;
+}
+
+uint32_t MipStreamer::GetWantedMip(TextureId id) const
+{
+	return m_textures.at(id).wantedMip;
+}
+
+bool MipStreamer::FreeBytes(uint64_t bytes, TextureId keep, Plan& plan)
+{
+	// Only mips finer than what their texture currently wants are given up for another texture.
+	std::vector<std::pair<uint64_t, TextureId>> victims;
+	uint64_t available = 0;
+	for (TextureId id = 0; id < m_textures.size(); ++id) {
+		const Texture& texture = m_textures[id];
+		if (id == keep || !texture.registered) continue;
+		for (uint32_t mip = texture.residentMip; mip < texture.wantedMip; ++mip) {
+			available += texture.mipBytes[mip];
+		}
+		if (texture.residentMip < texture.wantedMip) {
+			victims.emplace_back(texture.lastUsed[texture.residentMip], id);
+		}
+	}
+	if (available < bytes) return false;
+
+	std::ranges::sort(victims);
+	uint64_t freed = 0;
+	for (const auto& [lastUsed, id] : victims) {
+		const Texture& texture = m_textures[id];
+		while (freed < bytes && texture.residentMip < texture.wantedMip) {
+			freed += texture.mipBytes[texture.residentMip];
+			Evict(id, plan);
+		}
+		if (freed >= bytes) break;
+	}
+	return true;
+}
+
+void MipStreamer::Evict(TextureId id, Plan& plan)
+{
+	Texture& texture = m_textures[id];
+	plan.evictions.push_back({ id, texture.residentMip });
+	m_residentBytes -= texture.mipBytes[texture.residentMip];
+	++texture.residentMip;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace MipStreaming
+{
+	// Pixels spanned by one world unit at `distance` from a perspective camera.
+	float GetPixelsPerUnit(float distance, float fovY, float viewportHeight);
+
+	// Finest mip worth sampling when one world unit holds `texelsPerUnit` texels of mip 0 and spans
+	// `pixelsPerUnit` pixels: each coarser mip halves the texel density, and going below one texel
+	// per pixel only aliases.
+	uint32_t GetRequiredMip(float texelsPerUnit, float pixelsPerUnit, uint32_t mipCount);
+}
+
+// Decides which mips to stream in and which to evict, independent of the graphics API. Each texture
+// keeps a resident range [residentMip, mipCount); the mip tail from `tailMip` on never leaves.
+class MipStreamer
+{
+public:
+	using TextureId = uint32_t;
+
+	struct Upload
+	{
+		TextureId	texture;
+		uint32_t	mip;
+	};
+
+	struct Eviction
+	{
+		TextureId	texture;
+		uint32_t	mip;
+	};
+
+	struct Plan
+	{
+		std::vector<Upload>		uploads;
+		std::vector<Eviction>	evictions;
+	};
+
+	// `residentBudget` caps the bytes of all resident mips, `frameUploadBudget` the bytes streamed in
+	// per frame; mips go unused for `evictionDelay` frames before they are evicted without pressure.
+	MipStreamer(uint64_t residentBudget, uint64_t frameUploadBudget, uint32_t evictionDelay = 120);
+
+	// mipBytes[m] is the memory mip m occupies once resident. The texture starts with only its tail.
+	TextureId Register(std::vector<uint64_t> mipBytes, uint32_t tailMip);
+	void Unregister(TextureId texture);
+
+	// Marks `mip` and everything coarser as needed this frame; the finest request in a frame wins.
+	void Request(TextureId texture, uint32_t mip);
+
+	// Ends the frame. Uploads come one mip at a time, coarse to fine, with the largest shortfall
+	// first; under budget pressure the least recently used mips nobody needs are evicted first.
+	Plan Update();
+
+	uint32_t GetResidentMip(TextureId texture) const;
+	uint32_t GetWantedMip(TextureId texture) const;
+	uint64_t GetResidentBytes() const { return m_residentBytes; }
+	uint64_t GetFrame() const { return m_frame; }
+
+private:
+	struct Texture
+	{
+		std::vector<uint64_t>	mipBytes;
+		std::vector<uint64_t>	lastUsed;
+		uint32_t				tailMip = 0;
+		uint32_t				residentMip = 0;
+		uint32_t				requestedMip = 0;
+		uint32_t				wantedMip = 0;
+		bool					registered = false;
+	};
+
+	bool FreeBytes(uint64_t bytes, TextureId keep, Plan& plan);
+	void Evict(TextureId id, Plan& plan);
+
+private:
+	uint64_t				m_residentBudget;
+	uint64_t				m_frameUploadBudget;
+	uint32_t				m_evictionDelay;
+	uint64_t				m_residentBytes;
+	uint64_t				m_frame;
+	std::vector<Texture>	m_textures;
+	std::vector<TextureId>	m_freeIds;
+};
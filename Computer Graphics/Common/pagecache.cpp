@@ -0,0 +1,220 @@
+#include "pagecache.h"
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+using namespace VirtualTexturing;
+
+uint32_t VirtualTexturing::GetMipCount(uint32_t pagesPerSide)
+{
+	return static_cast<uint32_t>(std::bit_width(pagesPerSide));
+}
+
+uint64_t VirtualTexturing::GetPageIndex(uint32_t pagesPerSide, uint32_t id)
+{
+	const Page page = UnpackPage(id);
+	uint64_t index = 0;
+	for (uint32_t mip = 0; mip < page.mip; ++mip) {
+		const uint64_t side = GetPagesPerSide(pagesPerSide, mip);
+		index += side * side;
+	}
+	return index + uint64_t{ page.y } * GetPagesPerSide(pagesPerSide, page.mip) + page.x;
+}
+
+uint64_t VirtualTexturing::GetPageOffset(const FileHeader& header, uint32_t id)
+{
+	return sizeof(FileHeader) + GetPageIndex(header.pagesPerSide, id) * header.pageBytes;
+}
+
+PageCache::PageCache(uint32_t pagesPerSide, uint32_t slotCount, uint32_t frameUploadBudget) :
+	m_pagesPerSide{ pagesPerSide }, m_frameUploadBudget{ frameUploadBudget }, m_frame{ 0 },
+	m_residentCount{ 0 }, m_dirtyMips{ 0 }, m_mostRecent{ NoSlot }, m_leastRecent{ NoSlot }
+{
+	if (!std::has_single_bit(pagesPerSide) || VirtualTexturing::GetMipCount(pagesPerSide) > MaxMipCount) {
+		throw std::invalid_argument{ "page cache: pages per side must be a power of two up to 2^14" };
+	}
+	if (slotCount == 0 || slotCount > 0xFFFF) throw std::invalid_argument{ "page cache: bad slot count" };
+
+	m_slots.resize(slotCount);
+	m_freeSlots.reserve(slotCount);
+	for (uint32_t slot = slotCount; slot-- > 0;) m_freeSlots.push_back(slot);
+
+	const uint32_t mipCount = VirtualTexturing::GetMipCount(pagesPerSide);
+	m_pageSlots.assign(GetPageIndex(pagesPerSide, PackPage(mipCount, 0, 0)), NoSlot);
+	m_pageTable.resize(mipCount);
+	for (uint32_t mip = 0; mip < mipCount; ++mip) {
+		const uint32_t side = VirtualTexturing::GetPagesPerSide(pagesPerSide, mip);
+		m_pageTable[mip].assign(size_t{ side } * side, PackEntry(0, mipCount - 1));
+	}
+	m_dirtyMips = (1u << mipCount) - 1;
+}
+
+void PageCache::AddFeedback(std::span<const uint32_t> feedback)
+{
+	for (const uint32_t page : feedback) {
+		if (IsValid(page)) ++m_requests[page];
+	}
+}
+
+std::vector<PageCache::Upload> PageCache::Update()
+{
+	++m_frame;
+	++m_statistics.frames;
+
+	// Ancestors inherit the requests of their descendants, so a region fills in coarse to fine.
+	const uint32_t top = PackPage(GetMipCount() - 1, 0, 0);
+	std::unordered_map<uint32_t, uint32_t> wanted{ { top, 0 } };
+	for (const auto& [page, count] : m_requests) {
+		++m_statistics.requests;
+		if (IsResident(page)) ++m_statistics.hits;
+		for (uint32_t id = page;; id = GetParent(id)) {
+			wanted[id] += count;
+			if (id == top) break;
+		}
+	}
+	m_requests.clear();
+
+	std::vector<std::pair<uint32_t, uint32_t>> missing;
+	for (const auto& [page, count] : wanted) {
+		const uint32_t slot = GetSlot(page);
+		if (slot == NoSlot) {
+			missing.emplace_back(page, count);
+			continue;
+		}
+		m_slots[slot].lastUsed = m_frame;
+		Touch(slot);
+	}
+	std::sort(missing.begin(), missing.end(), [](const auto& a, const auto& b) {
+		return std::make_tuple(UnpackPage(b.first).mip, b.second, a.first) <
+			std::make_tuple(UnpackPage(a.first).mip, a.second, b.first);
+		});
+
+	std::vector<Upload> uploads;
+	for (const auto& [page, count] : missing) {
+		if (uploads.size() >= m_frameUploadBudget) break;
+		const uint32_t slot = AcquireSlot();
+		if (slot == NoSlot) break;
+
+		Slot& entry = m_slots[slot];
+		entry.page = page;
+		entry.loading = true;
+		entry.lastUsed = m_frame;
+		Touch(slot);
+		GetSlot(page) = slot;
+		uploads.push_back({ page, slot });
+		++m_statistics.uploads;
+	}
+	return uploads;
+}
+
+void PageCache::CompleteUpload(uint32_t page)
+{
+	if (!IsValid(page)) return;
+	const uint32_t slot = GetSlot(page);
+	if (slot == NoSlot || !m_slots[slot].loading) return;
+
+	m_slots[slot].loading = false;
+	++m_residentCount;
+	RefreshPageTable(page);
+}
+
+bool PageCache::IsResident(uint32_t page) const
+{
+	if (!IsValid(page)) return false;
+	const uint32_t slot = GetSlot(page);
+	return slot != NoSlot && !m_slots[slot].loading;
+}
+
+uint32_t PageCache::TakeDirtyMips()
+{
+	return std::exchange(m_dirtyMips, 0);
+}
+
+bool PageCache::IsValid(uint32_t id) const
+{
+	const Page page = UnpackPage(id);
+	if (page.mip >= GetMipCount()) return false;
+	const uint32_t side = VirtualTexturing::GetPagesPerSide(m_pagesPerSide, page.mip);
+	return page.x < side && page.y < side;
+}
+
+uint32_t& PageCache::GetSlot(uint32_t page)
+{
+	return m_pageSlots[GetPageIndex(m_pagesPerSide, page)];
+}
+
+uint32_t PageCache::GetSlot(uint32_t page) const
+{
+	return m_pageSlots[GetPageIndex(m_pagesPerSide, page)];
+}
+
+void PageCache::Touch(uint32_t slot)
+{
+	Unlink(slot);
+	Slot& entry = m_slots[slot];
+	entry.next = m_mostRecent;
+	if (m_mostRecent != NoSlot) m_slots[m_mostRecent].previous = slot;
+	m_mostRecent = slot;
+	if (m_leastRecent == NoSlot) m_leastRecent = slot;
+}
+
+void PageCache::Unlink(uint32_t slot)
+{
+	Slot& entry = m_slots[slot];
+	if (entry.previous != NoSlot) m_slots[entry.previous].next = entry.next;
+	else if (m_mostRecent == slot) m_mostRecent = entry.next;
+	if (entry.next != NoSlot) m_slots[entry.next].previous = entry.previous;
+	else if (m_leastRecent == slot) m_leastRecent = entry.previous;
+	entry.previous = entry.next = NoSlot;
+}
+
+uint32_t PageCache::AcquireSlot()
+{
+	if (!m_freeSlots.empty()) {
+		const uint32_t slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+		return slot;
+	}
+
+	// Walk from the least recently used; everything past a page used this frame is in use too.
+	const uint32_t topMip = GetMipCount() - 1;
+	for (uint32_t slot = m_leastRecent; slot != NoSlot; slot = m_slots[slot].previous) {
+		Slot& entry = m_slots[slot];
+		if (entry.lastUsed == m_frame) break;
+		if (entry.loading || UnpackPage(entry.page).mip == topMip) continue;
+
+		const uint32_t page = entry.page;
+		GetSlot(page) = NoSlot;
+		Unlink(slot);
+		entry = Slot{};
+		--m_residentCount;
+		++m_statistics.evictions;
+		RefreshPageTable(page);
+		return slot;
+	}
+	return NoSlot;
+}
+
+void PageCache::RefreshPageTable(uint32_t id)
+{
+	// Top-down over the page's footprint, so every parent entry is final before its children read it.
+	const Page page = UnpackPage(id);
+	const uint32_t topMip = GetMipCount() - 1;
+	for (uint32_t mip = page.mip + 1; mip-- > 0;) {
+		const uint32_t span = 1u << (page.mip - mip);
+		const uint32_t side = VirtualTexturing::GetPagesPerSide(m_pagesPerSide, mip);
+		for (uint32_t y = page.y * span; y < (page.y + 1) * span; ++y) {
+			for (uint32_t x = page.x * span; x < (page.x + 1) * span; ++x) {
+				const uint32_t slot = GetSlot(PackPage(mip, x, y));
+				uint32_t entry;
+				if (slot != NoSlot && !m_slots[slot].loading) entry = PackEntry(slot, mip);
+				else if (mip == topMip) entry = PackEntry(0, topMip);
+				else entry = m_pageTable[mip + 1][size_t{ y / 2 } * (side / 2) + x / 2];
+				m_pageTable[mip][size_t{ y } * side + x] = entry;
+			}
+		}
+	}
+	m_dirtyMips |= (2u << page.mip) - 1;
+}
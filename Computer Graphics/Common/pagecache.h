@@ -0,0 +1,142 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// Layout shared by the exporter's page baker and the runtime. A virtual texture is a square
+// power-of-two mip chain cut into square pages down to a single page; each page is stored with a
+// border of neighbouring texels so bilinear filtering never reads across pages in the cache.
+namespace VirtualTexturing
+{
+	// Page ids (also what the shader writes as feedback): mip in the top 4 bits, then 14 bits each of
+	// y and x.
+	constexpr uint32_t NoPage = 0xFFFFFFFF;
+	constexpr uint32_t MaxMipCount = 15;
+
+	struct Page
+	{
+		uint32_t	mip;
+		uint32_t	x;
+		uint32_t	y;
+	};
+
+	constexpr uint32_t PackPage(uint32_t mip, uint32_t x, uint32_t y) { return mip << 28 | y << 14 | x; }
+	constexpr Page UnpackPage(uint32_t id) { return { id >> 28, id & 0x3FFF, id >> 14 & 0x3FFF }; }
+	constexpr uint32_t GetParent(uint32_t id) { const Page page = UnpackPage(id); return PackPage(page.mip + 1, page.x / 2, page.y / 2); }
+
+	// Page table texels: the physical slot in the low 16 bits, the mip of the page in it above.
+	constexpr uint32_t PackEntry(uint32_t slot, uint32_t mip) { return mip << 16 | slot; }
+
+	constexpr uint32_t FileMagic = 0x58455456; // "VTEX"
+
+	// Pages follow the header mip by mip from mip 0, row by row, `pageBytes` each.
+	struct FileHeader
+	{
+		uint32_t	magic = FileMagic;
+		uint32_t	version = 1;
+		uint32_t	format = 0;			// DXGI_FORMAT of the page texels.
+		uint32_t	pageSize = 0;		// Texels per side without the border.
+		uint32_t	border = 0;
+		uint32_t	pagesPerSide = 0;	// At mip 0.
+		uint32_t	mipCount = 0;
+		uint32_t	pageBytes = 0;
+	};
+
+	inline uint32_t GetPagesPerSide(uint32_t pagesPerSide, uint32_t mip) { return pagesPerSide >> mip; }
+	uint32_t GetMipCount(uint32_t pagesPerSide);
+	// Index of the page among all pages of the chain, in file order.
+	uint64_t GetPageIndex(uint32_t pagesPerSide, uint32_t id);
+	uint64_t GetPageOffset(const FileHeader& header, uint32_t id);
+}
+
+// Decides which virtual texture pages occupy a fixed set of physical slots, independent of the
+// graphics API. Feedback names the pages the last frame sampled; Update turns it into uploads and
+// evicts the least recently used pages to make room. Uploads complete asynchronously, and only
+// completed pages appear in the page table, which points every page at its finest resident
+// ancestor. The single page of the coarsest mip is always wanted and never evicted, so every
+// lookup has a fallback once it has arrived.
+class PageCache
+{
+public:
+	struct Upload
+	{
+		uint32_t	page;
+		uint32_t	slot;
+	};
+
+	struct Statistics
+	{
+		uint64_t	frames = 0;
+		uint64_t	requests = 0;		// Distinct pages in the feedback.
+		uint64_t	hits = 0;			// Requested pages that were resident.
+		uint64_t	uploads = 0;
+		uint64_t	evictions = 0;
+	};
+
+	// `pagesPerSide` at mip 0 must be a power of two no larger than 2^14; at most
+	// `frameUploadBudget` uploads start per Update.
+	PageCache(uint32_t pagesPerSide, uint32_t slotCount, uint32_t frameUploadBudget);
+
+	// Packed page ids; NoPage entries and ids outside the chain are skipped.
+	void AddFeedback(std::span<const uint32_t> feedback);
+
+	// Ends the frame. Requested pages bring their ancestors along; coarse mips go first, then the
+	// pages most of the feedback asked for. Pages used this frame or still loading are never evicted,
+	// so when they fill the cache the remaining requests wait for a later frame.
+	std::vector<Upload> Update();
+
+	// The page's texels are in its slot from now on.
+	void CompleteUpload(uint32_t page);
+
+	bool IsResident(uint32_t page) const;
+	uint32_t GetMipCount() const { return static_cast<uint32_t>(m_pageTable.size()); }
+	uint32_t GetPagesPerSide() const { return m_pagesPerSide; }
+	uint32_t GetSlotCount() const { return static_cast<uint32_t>(m_slots.size()); }
+	uint32_t GetResidentCount() const { return m_residentCount; }
+
+	// Row-major PackEntry texels of one mip, pagesPerSide >> mip wide.
+	std::span<const uint32_t> GetPageTable(uint32_t mip) const { return m_pageTable[mip]; }
+	// Bit m is set when mip m of the page table changed since the last call.
+	uint32_t TakeDirtyMips();
+
+	const Statistics& GetStatistics() const { return m_statistics; }
+
+private:
+	static constexpr uint32_t NoSlot = 0xFFFFFFFF;
+
+	struct Slot
+	{
+		uint32_t	page = VirtualTexturing::NoPage;
+		uint32_t	previous = NoSlot;		// Towards the most recently used.
+		uint32_t	next = NoSlot;
+		uint64_t	lastUsed = 0;
+		bool		loading = false;
+	};
+
+	bool IsValid(uint32_t page) const;
+	uint32_t& GetSlot(uint32_t page);
+	uint32_t GetSlot(uint32_t page) const;
+
+	void Touch(uint32_t slot);
+	void Unlink(uint32_t slot);
+	uint32_t AcquireSlot();
+	void RefreshPageTable(uint32_t page);
+
+private:
+	uint32_t								m_pagesPerSide;
+	uint32_t								m_frameUploadBudget;
+	uint64_t								m_frame;
+	uint32_t								m_residentCount;
+	uint32_t								m_dirtyMips;
+
+	std::vector<Slot>						m_slots;
+	std::vector<uint32_t>					m_freeSlots;
+	uint32_t								m_mostRecent;
+	uint32_t								m_leastRecent;
+
+	std::vector<uint32_t>					m_pageSlots;	// By GetPageIndex.
+	std::vector<std::vector<uint32_t>>		m_pageTable;
+	std::unordered_map<uint32_t, uint32_t>	m_requests;		// Page to feedback count.
+	Statistics								m_statistics;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel
+{
+	inline size_t GetWorkerCount()
+	{
+		return std::max<size_t>(1, std::thread::hardware_concurrency());
+	}
+
+	// Splits [begin, end) into one contiguous range per worker and calls func(first, last) on each.
+	// The first exception thrown by a worker is rethrown on the calling thread after all workers join.
+	template <typename Func>
+	void ForRange(size_t begin, size_t end, Func&& func, size_t workerCount = GetWorkerCount())
+	{
+		if (begin >= end) return;
+		const size_t count = end - begin;
+		workerCount = std::min(workerCount, count);
+		if (workerCount <= 1) {
+			func(begin, end);
+			return;
+		}
+
+		std::exception_ptr error;
+		std::mutex errorMutex;
+		auto run = [&](size_t first, size_t last) {
+			try {
+				func(first, last);
+			}
+			catch (...) {
+				std::lock_guard lock{ errorMutex };
+				if (!error) error = std::current_exception();
+			}
+			};
+
+		const size_t step = (count + workerCount - 1) / workerCount;
+		std::vector<std::thread> workers;
+		workers.reserve(workerCount - 1);
+		for (size_t first = begin + step; first < end; first += step) {
+			workers.emplace_back(run, first, std::min(first + step, end));
+		}
+		run(begin, std::min(begin + step, end));
+		for (auto& worker : workers) worker.join();
+		if (error) std::rethrow_exception(error);
+	}
+
+	template <typename Func>
+	void For(size_t begin, size_t end, Func&& func, size_t workerCount = GetWorkerCount())
+	{
+		ForRange(begin, end, [&func](size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i) func(i);
+			}, workerCount);
+	}
+}
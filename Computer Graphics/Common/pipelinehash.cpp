@@ -0,0 +1,133 @@
+#include "pipelinehash.h"
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
+
+namespace
+{
+	// FNV-1a over the fields one by one; whole structs would also hash their uninitialized padding.
+	class Hasher
+	{
+	public:
+		explicit Hasher(uint64_t seed) : m_hash{ 14695981039346656037ull ^ seed } {}
+
+		void AddBytes(const void* data, size_t size)
+		{
+			for (const auto* byte = static_cast<const uint8_t*>(data); size-- > 0; ++byte) {
+				m_hash ^= *byte;
+				m_hash *= 1099511628211ull;
+			}
+		}
+		template <typename T> requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+		void Add(T value) { AddBytes(&value, sizeof(value)); }
+		void Add(const char* text) { if (text) AddBytes(text, std::strlen(text)); Add(uint8_t{ 0 }); }
+		void Add(const D3D12_SHADER_BYTECODE& shader) { Add(shader.BytecodeLength); AddBytes(shader.pShaderBytecode, shader.BytecodeLength); }
+
+		uint64_t Get() const { return m_hash; }
+
+	private:
+		uint64_t m_hash;
+	};
+}
+
+uint64_t PipelineHash::HashBytes(const void* data, size_t size)
+{
+	Hasher hasher{ 0 };
+	hasher.AddBytes(data, size);
+	return hasher.Get();
+}
+
+uint64_t PipelineHash::Hash(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t seed)
+{
+	Hasher hasher{ seed };
+	for (const auto& shader : { desc.VS, desc.PS, desc.DS, desc.HS, desc.GS }) {
+		hasher.Add(shader);
+	}
+
+	const auto& streamOutput = desc.StreamOutput;
+	hasher.Add(streamOutput.NumEntries);
+	for (uint32_t i = 0; i < streamOutput.NumEntries; ++i) {
+		const auto& entry = streamOutput.pSODeclaration[i];
+		hasher.Add(entry.Stream);
+		hasher.Add(entry.SemanticName);
+		hasher.Add(entry.SemanticIndex);
+		hasher.Add(entry.StartComponent);
+		hasher.Add(entry.ComponentCount);
+		hasher.Add(entry.OutputSlot);
+	}
+	hasher.Add(streamOutput.NumStrides);
+	for (uint32_t i = 0; i < streamOutput.NumStrides; ++i) {
+		hasher.Add(streamOutput.pBufferStrides[i]);
+	}
+	hasher.Add(streamOutput.RasterizedStream);
+
+	const auto& blend = desc.BlendState;
+	hasher.Add(blend.AlphaToCoverageEnable);
+	hasher.Add(blend.IndependentBlendEnable);
+	for (const auto& target : blend.RenderTarget) {
+		hasher.Add(target.BlendEnable);
+		hasher.Add(target.LogicOpEnable);
+		hasher.Add(target.SrcBlend);
+		hasher.Add(target.DestBlend);
+		hasher.Add(target.BlendOp);
+		hasher.Add(target.SrcBlendAlpha);
+		hasher.Add(target.DestBlendAlpha);
+		hasher.Add(target.BlendOpAlpha);
+		hasher.Add(target.LogicOp);
+		hasher.Add(target.RenderTargetWriteMask);
+	}
+	hasher.Add(desc.SampleMask);
+
+	const auto& rasterizer = desc.RasterizerState;
+	hasher.Add(rasterizer.FillMode);
+	hasher.Add(rasterizer.CullMode);
+	hasher.Add(rasterizer.FrontCounterClockwise);
+	hasher.Add(rasterizer.DepthBias);
+	hasher.Add(rasterizer.DepthBiasClamp);
+	hasher.Add(rasterizer.SlopeScaledDepthBias);
+	hasher.Add(rasterizer.DepthClipEnable);
+	hasher.Add(rasterizer.MultisampleEnable);
+	hasher.Add(rasterizer.AntialiasedLineEnable);
+	hasher.Add(rasterizer.ForcedSampleCount);
+	hasher.Add(rasterizer.ConservativeRaster);
+
+	const auto& depthStencil = desc.DepthStencilState;
+	hasher.Add(depthStencil.DepthEnable);
+	hasher.Add(depthStencil.DepthWriteMask);
+	hasher.Add(depthStencil.DepthFunc);
+	hasher.Add(depthStencil.StencilEnable);
+	hasher.Add(depthStencil.StencilReadMask);
+	hasher.Add(depthStencil.StencilWriteMask);
+	for (const auto& face : { depthStencil.FrontFace, depthStencil.BackFace }) {
+		hasher.Add(face.StencilFailOp);
+		hasher.Add(face.StencilDepthFailOp);
+		hasher.Add(face.StencilPassOp);
+		hasher.Add(face.StencilFunc);
+	}
+
+	const auto& inputLayout = desc.InputLayout;
+	hasher.Add(inputLayout.NumElements);
+	for (uint32_t i = 0; i < inputLayout.NumElements; ++i) {
+		const auto& element = inputLayout.pInputElementDescs[i];
+		hasher.Add(element.SemanticName);
+		hasher.Add(element.SemanticIndex);
+		hasher.Add(element.Format);
+		hasher.Add(element.InputSlot);
+		hasher.Add(element.AlignedByteOffset);
+		hasher.Add(element.InputSlotClass);
+		hasher.Add(element.InstanceDataStepRate);
+	}
+
+	hasher.Add(desc.IBStripCutValue);
+	hasher.Add(desc.PrimitiveTopologyType);
+	hasher.Add(desc.NumRenderTargets);
+	for (uint32_t i = 0; i < desc.NumRenderTargets; ++i) {
+		hasher.Add(desc.RTVFormats[i]);
+	}
+	hasher.Add(desc.DSVFormat);
+	hasher.Add(desc.SampleDesc.Count);
+	hasher.Add(desc.SampleDesc.Quality);
+	hasher.Add(desc.NodeMask);
+	hasher.Add(desc.Flags);
+	return hasher.Get();
+}
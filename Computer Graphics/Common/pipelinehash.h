@@ -0,0 +1,17 @@
+#pragma once
+#include <windows.h>
+#include <d3d12.h>
+#include <cstddef>
+#include <cstdint>
+
+// The key PipelineCache files graphics pipelines under. It covers the contents of everything a
+// description points to, field by field, so copies of a description hash alike wherever their
+// arrays and strings live and whatever their padding holds. The root signature and any cached
+// blob are left out; callers seed the hash with the serialized root signature instead.
+namespace PipelineHash
+{
+	// FNV-1a of `size` bytes.
+	uint64_t HashBytes(const void* data, size_t size);
+
+	uint64_t Hash(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t seed);
+}
@@ -0,0 +1,224 @@
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include "shadercache.h"
+#include "dxil.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#pragma comment(lib, "d3dcompiler.lib")
+#endif
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	class Fnv1a
+	{
+	public:
+		void Add(const void* data, size_t size)
+		{
+			for (const auto* byte = static_cast<const uint8_t*>(data); size-- > 0; ++byte) {
+				m_hash ^= *byte;
+				m_hash *= 1099511628211ull;
+			}
+		}
+		void Add(const std::string& text) { Add(text.data(), text.size() + 1); }
+		uint64_t Get() const { return m_hash; }
+
+	private:
+		uint64_t m_hash = 14695981039346656037ull;
+	};
+
+	std::string GetMessages(ID3DBlob* errors)
+	{
+		if (!errors) return {};
+		return { static_cast<const char*>(errors->GetBufferPointer()), errors->GetBufferSize() };
+	}
+}
+
+// Serves #include directives from the cache's source map; the text stays alive as long as the cache.
+class ShaderCache::Include : public ID3DInclude
+{
+public:
+	explicit Include(ShaderCache& cache) : m_cache{ cache } {}
+
+	HRESULT STDMETHODCALLTYPE Open(D3D_INCLUDE_TYPE, LPCSTR fileName, LPCVOID, LPCVOID* data, UINT* bytes) override
+	{
+		try {
+			const auto source = m_cache.ReadSource(fileName);
+			*data = source->data();
+			*bytes = static_cast<UINT>(source->size());
+			return S_OK;
+		}
+		catch (const std::exception&) {
+			return E_FAIL;
+		}
+	}
+
+	HRESULT STDMETHODCALLTYPE Close(LPCVOID) override { return S_OK; }
+
+private:
+	ShaderCache& m_cache;
+};
+
+ShaderCache::ShaderCache(const std::filesystem::path& sourceDirectory, const std::filesystem::path& cacheDirectory,
+	UINT flags) :
+	m_sourceDirectory{ sourceDirectory }, m_cacheDirectory{ cacheDirectory }, m_flags{ flags },
+	m_include{ std::make_unique<Include>(*this) }
+{
+	std::error_code error;
+	std::filesystem::create_directories(m_cacheDirectory, error);
+}
+
+ShaderCache::~ShaderCache() = default;
+
+ComPtr<ID3DBlob> ShaderCache::Compile(const std::string& fileName, const D3D_SHADER_MACRO* defines,
+	const std::string& entryPoint, const std::string& target)
+{
+	if (!m_dxilDirectory.empty()) return LoadDxil(fileName, defines, entryPoint);
+
+	const auto text = Preprocess(fileName, defines);
+
+	Fnv1a hash;
+	hash.Add(*text);
+	hash.Add(entryPoint);
+	hash.Add(target);
+	const uint32_t version = D3D_COMPILER_VERSION;
+	hash.Add(&m_flags, sizeof(m_flags));
+	hash.Add(&version, sizeof(version));
+	char name[24];
+	std::snprintf(name, sizeof(name), "%016llx.cso", static_cast<unsigned long long>(hash.Get()));
+	const std::filesystem::path path = m_cacheDirectory / name;
+
+	ComPtr<ID3DBlob> blob;
+	if (std::ifstream in{ path, std::ios::binary | std::ios::ate }) {
+		const auto size = static_cast<SIZE_T>(in.tellg());
+		if (size > 0 && SUCCEEDED(D3DCreateBlob(size, &blob))) {
+			in.seekg(0);
+			if (in.read(static_cast<char*>(blob->GetBufferPointer()), static_cast<std::streamsize>(size))) {
+				std::lock_guard lock{ m_mutex };
+				++m_statistics.hits;
+				return blob;
+			}
+		}
+	}
+
+	// The text is fully preprocessed, so neither defines nor an include handler are needed; its
+	// #line directives keep the compiler's messages pointing at the original files.
+	const auto start = std::chrono::steady_clock::now();
+	ComPtr<ID3DBlob> errors;
+	if (FAILED(D3DCompile(text->data(), text->size(), fileName.c_str(), nullptr, nullptr,
+		entryPoint.c_str(), target.c_str(), m_flags, 0, &blob, &errors))) {
+		throw std::runtime_error{ "shader cache: " + fileName + " " + entryPoint + ": " + GetMessages(errors.Get()) };
+	}
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	// Written under a temporary name first, so a concurrent reader never sees half a blob.
+	std::filesystem::path temporary = path;
+	temporary += ".tmp";
+	{
+		std::ofstream out{ temporary, std::ios::binary | std::ios::trunc };
+		out.write(static_cast<const char*>(blob->GetBufferPointer()), static_cast<std::streamsize>(blob->GetBufferSize()));
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error) std::filesystem::remove(temporary, error);
+
+	std::lock_guard lock{ m_mutex };
+	++m_statistics.misses;
+	m_statistics.compileSeconds += elapsed.count();
+	return blob;
+}
+
+bool ShaderCache::UseDxil(const std::filesystem::path& directory)
+{
+	std::ifstream in{ directory / Dxil::SourcesFile };
+	uint64_t hash = 0;
+	if (!(in >> std::hex >> hash) || hash != Dxil::HashSources(m_sourceDirectory)) return false;
+	m_dxilDirectory = directory;
+	return true;
+}
+
+ShaderCache::Statistics ShaderCache::GetStatistics() const
+{
+	std::lock_guard lock{ m_mutex };
+	return m_statistics;
+}
+
+std::shared_ptr<const std::string> ShaderCache::ReadSource(const std::string& fileName)
+{
+	{
+		std::lock_guard lock{ m_mutex };
+		if (const auto it = m_sources.find(fileName); it != m_sources.end()) return it->second;
+	}
+
+	std::ifstream in{ m_sourceDirectory / fileName, std::ios::binary };
+	if (!in) throw std::runtime_error{ "shader cache: cannot open " + (m_sourceDirectory / fileName).string() };
+	auto source = std::make_shared<const std::string>(std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{});
+
+	std::lock_guard lock{ m_mutex };
+	const auto [it, inserted] = m_sources.emplace(fileName, std::move(source));
+	if (inserted) ++m_statistics.filesRead;
+	return it->second;
+}
+
+std::shared_ptr<const std::string> ShaderCache::Preprocess(const std::string& fileName, const D3D_SHADER_MACRO* defines)
+{
+	std::string key = fileName;
+	for (const D3D_SHADER_MACRO* define = defines; define && define->Name; ++define) {
+		key += '\0';
+		key += define->Name;
+		key += '=';
+		if (define->Definition) key += define->Definition;
+	}
+	{
+		std::lock_guard lock{ m_mutex };
+		if (const auto it = m_preprocessed.find(key); it != m_preprocessed.end()) return it->second;
+	}
+
+	const auto source = ReadSource(fileName);
+	ComPtr<ID3DBlob> text, errors;
+	if (FAILED(D3DPreprocess(source->data(), source->size(), fileName.c_str(), defines, m_include.get(),
+		&text, &errors))) {
+		throw std::runtime_error{ "shader cache: " + fileName + ": " + GetMessages(errors.Get()) };
+	}
+	auto preprocessed = std::make_shared<const std::string>(
+		static_cast<const char*>(text->GetBufferPointer()), text->GetBufferSize());
+
+	std::lock_guard lock{ m_mutex };
+	const auto [it, inserted] = m_preprocessed.emplace(std::move(key), std::move(preprocessed));
+	if (inserted) ++m_statistics.preprocessed;
+	return it->second;
+}
+
+ComPtr<ID3DBlob> ShaderCache::LoadDxil(const std::string& fileName, const D3D_SHADER_MACRO* defines,
+	const std::string& entryPoint)
+{
+	Dxil::Defines names;
+	for (const D3D_SHADER_MACRO* define = defines; define && define->Name; ++define) {
+		names.emplace_back(define->Name, define->Definition ? define->Definition : "1");
+	}
+	const std::filesystem::path path = m_dxilDirectory / Dxil::GetBlobName(fileName, names, entryPoint);
+
+	ComPtr<ID3DBlob> blob;
+	std::ifstream in{ path, std::ios::binary | std::ios::ate };
+	if (!in) throw std::runtime_error{ "shader cache: " + path.string() + " is not in the DXIL set; rerun Exporter dxc" };
+	const auto size = static_cast<SIZE_T>(in.tellg());
+	in.seekg(0);
+	if (FAILED(D3DCreateBlob(size, &blob)) ||
+		!in.read(static_cast<char*>(blob->GetBufferPointer()), static_cast<std::streamsize>(size))) {
+		throw std::runtime_error{ "shader cache: cannot read " + path.string() };
+	}
+
+	std::lock_guard lock{ m_mutex };
+	++m_statistics.hits;
+	return blob;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <windows.h>
+#include <d3dcompiler.h>
+#include <wrl/client.h>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Compiles HLSL through a directory of cached bytecode. A blob is keyed by a hash of the
+// preprocessed source, which already holds every included file and the effect of the defines,
+// together with the entry point, target, flags and compiler version, so editing an included
+// header misses as it should. Source files are read once through a shared include handler and a
+// file is preprocessed once per set of defines, however many entry points it has.
+//
+// The exporter's shaders command fills the cache offline; at run time a miss compiles and writes
+// the blob, so the next run is warm either way. With UseDxil the cache serves a Shader Model 6 set
+// built by the exporter's dxc command instead.
+class ShaderCache
+{
+public:
+	struct Statistics
+	{
+		uint32_t	hits = 0;
+		uint32_t	misses = 0;
+		uint32_t	filesRead = 0;
+		uint32_t	preprocessed = 0;
+		double		compileSeconds = 0.0;		// In D3DCompile, summed over threads.
+	};
+
+	// File names, including those in #include directives, are relative to `sourceDirectory`, so the
+	// preprocessed text and with it the key do not depend on where the caller runs.
+	ShaderCache(const std::filesystem::path& sourceDirectory, const std::filesystem::path& cacheDirectory, UINT flags);
+	~ShaderCache();
+
+	ShaderCache(const ShaderCache&) = delete;
+	ShaderCache& operator=(const ShaderCache&) = delete;
+
+	// Thread-safe. Throws std::runtime_error with the compiler's messages when compilation fails.
+	Microsoft::WRL::ComPtr<ID3DBlob> Compile(const std::string& fileName, const D3D_SHADER_MACRO* defines,
+		const std::string& entryPoint, const std::string& target);
+
+	// Serves every Compile from the DXIL set in `directory` if it was built from the current sources,
+	// and returns whether it was; not thread-safe. A program missing from the set then throws, since
+	// a pipeline cannot mix DXIL with FXC bytecode.
+	bool UseDxil(const std::filesystem::path& directory);
+	bool UsesDxil() const { return !m_dxilDirectory.empty(); }
+
+	Statistics GetStatistics() const;
+	const std::filesystem::path& GetCacheDirectory() const { return m_cacheDirectory; }
+
+private:
+	class Include;
+
+	std::shared_ptr<const std::string> ReadSource(const std::string& fileName);
+	std::shared_ptr<const std::string> Preprocess(const std::string& fileName, const D3D_SHADER_MACRO* defines);
+	Microsoft::WRL::ComPtr<ID3DBlob> LoadDxil(const std::string& fileName, const D3D_SHADER_MACRO* defines,
+		const std::string& entryPoint);
+
+private:
+	std::filesystem::path											m_sourceDirectory;
+	std::filesystem::path											m_cacheDirectory;
+	std::filesystem::path											m_dxilDirectory;
+	UINT															m_flags;
+	std::unique_ptr<Include>										m_include;
+
+	mutable std::mutex												m_mutex;
+	std::unordered_map<std::string, std::shared_ptr<const std::string>>	m_sources;
+	std::unordered_map<std::string, std::shared_ptr<const std::string>>	m_preprocessed;	// By file and defines.
+	Statistics														m_statistics;
+};
@@ -0,0 +1,77 @@
+#include "taskgraph.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+TaskGraph::TaskId TaskGraph::Add(std::string name, std::function<void()> work, std::vector<TaskId> dependencies)
+{
+	const TaskId id = m_tasks.size();
+	for (TaskId dependency : dependencies) {
+		if (dependency >= id) throw std::invalid_argument{ "task graph: dependency on a later task" };
+		m_tasks[dependency].dependents.push_back(id);
+	}
+	m_tasks.push_back({ std::move(name), std::move(work), {}, dependencies.size() });
+	return id;
+}
+
+void TaskGraph::Run(size_t workerCount)
+{
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<TaskId> ready;
+	std::vector<size_t> remaining(m_tasks.size());
+	size_t finished = 0;
+	size_t running = 0;
+	std::exception_ptr error;
+
+	for (TaskId id = 0; id < m_tasks.size(); ++id) {
+		remaining[id] = m_tasks[id].dependencyCount;
+		if (remaining[id] == 0) ready.push_back(id);
+	}
+
+	auto worker = [&] {
+		std::unique_lock lock{ mutex };
+		while (true) {
+			condition.wait(lock, [&] { return !ready.empty() || finished == m_tasks.size() || (error && running == 0); });
+			if (ready.empty()) return;
+
+			const TaskId id = ready.front();
+			ready.pop_front();
+			++running;
+			lock.unlock();
+
+			const auto start = std::chrono::steady_clock::now();
+			std::exception_ptr taskError;
+			try {
+				m_tasks[id].work();
+			}
+			catch (...) {
+				taskError = std::current_exception();
+			}
+			m_tasks[id].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			lock.lock();
+			--running;
+			++finished;
+			if (taskError && !error) error = taskError;
+			if (error) ready.clear();
+			else {
+				for (TaskId dependent : m_tasks[id].dependents) {
+					if (--remaining[dependent] == 0) ready.push_back(dependent);
+				}
+			}
+			condition.notify_all();
+		}
+		};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < std::min(workerCount, m_tasks.size()); ++i) threads.emplace_back(worker);
+	worker();
+	for (auto& thread : threads) thread.join();
+
+	if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "parallel.h"
+
+// Runs tasks on a pool of threads as soon as all of their dependencies have finished.
+class TaskGraph
+{
+public:
+	using TaskId = size_t;
+
+	TaskId Add(std::string name, std::function<void()> work, std::vector<TaskId> dependencies = {});
+
+	// Blocks until every task has run. Once a task throws, no new tasks start and the first
+	// exception is rethrown here. With one worker, tasks run on the calling thread in the order added.
+	void Run(size_t workerCount = Parallel::GetWorkerCount());
+
+	size_t GetTaskCount() const { return m_tasks.size(); }
+	const std::string& GetName(TaskId task) const { return m_tasks[task].name; }
+	double GetSeconds(TaskId task) const { return m_tasks[task].seconds; }
+
+private:
+	struct Task
+	{
+		std::string				name;
+		std::function<void()>	work;
+		std::vector<TaskId>		dependents;
+		size_t					dependencyCount = 0;
+		double					seconds = 0.0;
+	};
+
+	std::vector<Task> m_tasks;
+};
@@ -0,0 +1,218 @@
+#include "terrainnormals.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NORMALS_USE_SSE2
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	int16_t ToSnorm16(float value)
+	{
+		return static_cast<int16_t>(std::lround(std::clamp(value, -1.f, 1.f) * 32767.f));
+	}
+
+	// The quartic Bernstein basis and its derivative, from the cubic one.
+	void BernsteinBasis(float t, float* basis, float* derivative)
+	{
+		const float invT = 1.f - t;
+		basis[0] = invT * invT * invT * invT;
+		basis[1] = 4.f * t * invT * invT * invT;
+		basis[2] = 6.f * t * t * invT * invT;
+		basis[3] = 4.f * t * t * t * invT;
+		basis[4] = t * t * t * t;
+
+		const float cubic[4]{ invT * invT * invT, 3.f * t * invT * invT, 3.f * t * t * invT, t * t * t };
+		for (int i = 0; i <= 4; ++i) derivative[i] = 4.f * ((i > 0 ? cubic[i - 1] : 0.f) - (i < 4 ? cubic[i] : 0.f));
+	}
+
+	// The patch holding grid coordinate `position` along one axis, and where in it the position lies.
+	float GetPatchCoordinate(float position, int patchCount, int& patch)
+	{
+		constexpr int side = Heightfield::PatchLength;
+		patch = std::clamp(static_cast<int>(position) / side, 0, patchCount - 1);
+		return std::clamp((position - static_cast<float>(patch * side)) / side, 0.f, 1.f);
+	}
+
+	// The unit normal of a surface rising `slopeX` along x and `slopeZ` along z per unit.
+	XMFLOAT3 GetNormalFromSlopes(float slopeX, float slopeZ)
+	{
+		const float scale = 1.f / std::sqrt(slopeX * slopeX + 1.f + slopeZ * slopeZ);
+		return XMFLOAT3{ -slopeX * scale, scale, -slopeZ * scale };
+	}
+
+#ifdef NORMALS_USE_SSE2
+	// ToSnorm16 of four values: lround's halves away from zero, from the exact fraction past the
+	// truncated value.
+	__m128i ToSnorm16(__m128 values)
+	{
+		const __m128 scaled = _mm_mul_ps(_mm_min_ps(_mm_max_ps(values, _mm_set1_ps(-1.f)), _mm_set1_ps(1.f)), _mm_set1_ps(32767.f));
+		const __m128i truncated = _mm_cvttps_epi32(scaled);
+		const __m128 fraction = _mm_sub_ps(scaled, _mm_cvtepi32_ps(truncated));
+		// The masks are -1 in every lane that rounds away from the truncated value.
+		const __m128i up = _mm_castps_si128(_mm_cmpge_ps(fraction, _mm_set1_ps(0.5f)));
+		const __m128i down = _mm_castps_si128(_mm_cmple_ps(fraction, _mm_set1_ps(-0.5f)));
+		return _mm_add_epi32(_mm_sub_epi32(truncated, up), down);
+	}
+#endif
+}
+
+uint32_t TerrainNormals::Pack(const XMFLOAT3& normal)
+{
+	return static_cast<uint16_t>(ToSnorm16(normal.x)) | static_cast<uint32_t>(static_cast<uint16_t>(ToSnorm16(normal.z))) << 16;
+}
+
+XMFLOAT3 TerrainNormals::Unpack(uint32_t texel)
+{
+	const float x = std::max(static_cast<float>(static_cast<int16_t>(texel & 0xFFFF)) / 32767.f, -1.f);
+	const float z = std::max(static_cast<float>(static_cast<int16_t>(texel >> 16)) / 32767.f, -1.f);
+	return XMFLOAT3{ x, std::sqrt(std::max(1.f - x * x - z * z, 0.f)), z };
+}
+
+XMFLOAT3 TerrainNormals::GetNormal(const Heightfield& heightfield, float x, float z)
+{
+	constexpr int side = Heightfield::PatchLength;
+	const int patchCount = heightfield.GetPatchCount();
+	if (patchCount == 0) return XMFLOAT3{ 0.f, 1.f, 0.f };
+
+	int px, pz;
+	float basisU[5], basisV[5], derivativeU[5], derivativeV[5];
+	BernsteinBasis(GetPatchCoordinate(x, patchCount, px), basisU, derivativeU);
+	BernsteinBasis(GetPatchCoordinate(z, patchCount, pz), basisV, derivativeV);
+
+	// Slopes along u and v, down each column of the patch and then across as Bake sums them, over
+	// the patch's side to make them per unit.
+	float slopeX = 0.f, slopeZ = 0.f;
+	for (int column = 0; column <= side; ++column) {
+		float height = 0.f, heightDerivative = 0.f;
+		for (int row = 0; row <= side; ++row) {
+			const float sample = heightfield.GetSample(px * side + column, pz * side + row);
+			height += basisV[row] * sample;
+			heightDerivative += derivativeV[row] * sample;
+		}
+		slopeX += derivativeU[column] * height;
+		slopeZ += basisU[column] * heightDerivative;
+	}
+	return GetNormalFromSlopes(slopeX / side, slopeZ / side);
+}
+
+std::vector<uint32_t> TerrainNormals::Bake(const Heightfield& heightfield, int texelsPerCell, size_t workerCount)
+{
+	constexpr int side = Heightfield::PatchLength;
+	texelsPerCell = std::max(texelsPerCell, 1);
+	const int length = heightfield.GetLength();
+	const int patchCount = heightfield.GetPatchCount();
+	const int texels = std::max(GetSide(heightfield, texelsPerCell), 0);
+	std::vector<uint32_t> normals(static_cast<size_t>(texels) * texels);
+	if (patchCount == 0) {
+		std::fill(normals.begin(), normals.end(), Pack(XMFLOAT3{ 0.f, 1.f, 0.f }));
+		return normals;
+	}
+
+	// Every texel column's first grid column and u basis, a row of texel columns per basis function.
+	const float step = 1.f / static_cast<float>(texelsPerCell);
+	std::vector<int> firstColumns(texels);
+	std::vector<float> basisU(static_cast<size_t>(side + 1) * texels), derivativeU(basisU.size());
+	for (int x = 0; x < texels; ++x) {
+		int px;
+		float basis[side + 1], derivative[side + 1];
+		BernsteinBasis(GetPatchCoordinate(static_cast<float>(x) * step, patchCount, px), basis, derivative);
+		firstColumns[x] = px * side;
+		for (int i = 0; i <= side; ++i) {
+			basisU[static_cast<size_t>(i) * texels + x] = basis[i];
+			derivativeU[static_cast<size_t>(i) * texels + x] = derivative[i];
+		}
+	}
+
+	const float* samples = heightfield.GetSamples().data();
+	Parallel::ForRange(0, static_cast<size_t>(texels), [&](size_t first, size_t last) {
+		std::vector<float> heights(length), heightDerivatives(length);
+		for (size_t row = first; row < last; ++row) {
+			int pz;
+			float basisV[side + 1], derivativeV[side + 1];
+			BernsteinBasis(GetPatchCoordinate(static_cast<float>(row) * step, patchCount, pz), basisV, derivativeV);
+
+			// Every grid column summed down the patch rows under the texel row, four per pass.
+			const float* patchRows = samples + static_cast<size_t>(pz) * side * length;
+			int column = 0;
+#ifdef NORMALS_USE_SSE2
+			for (; column + 4 <= length; column += 4) {
+				__m128 height = _mm_setzero_ps(), heightDerivative = _mm_setzero_ps();
+				for (int i = 0; i <= side; ++i) {
+					const __m128 sample = _mm_loadu_ps(patchRows + static_cast<size_t>(i) * length + column);
+					height = _mm_add_ps(height, _mm_mul_ps(_mm_set1_ps(basisV[i]), sample));
+					heightDerivative = _mm_add_ps(heightDerivative, _mm_mul_ps(_mm_set1_ps(derivativeV[i]), sample));
+				}
+				_mm_storeu_ps(heights.data() + column, height);
+				_mm_storeu_ps(heightDerivatives.data() + column, heightDerivative);
+			}
+#endif
+			for (; column < length; ++column) {
+				float height = 0.f, heightDerivative = 0.f;
+				for (int i = 0; i <= side; ++i) {
+					const float sample = patchRows[static_cast<size_t>(i) * length + column];
+					height += basisV[i] * sample;
+					heightDerivative += derivativeV[i] * sample;
+				}
+				heights[column] = height;
+				heightDerivatives[column] = heightDerivative;
+			}
+
+			// Then across the patch, four texels per pass.
+			uint32_t* out = normals.data() + row * texels;
+			int x = 0;
+#ifdef NORMALS_USE_SSE2
+			const __m128 one = _mm_set1_ps(1.f), patchSide = _mm_set1_ps(static_cast<float>(side));
+			const __m128 signMask = _mm_set1_ps(-0.f);
+			for (; x + 4 <= texels; x += 4) {
+				const int* columns = firstColumns.data() + x;
+				__m128 slopeX = _mm_setzero_ps(), slopeZ = _mm_setzero_ps();
+				for (int i = 0; i <= side; ++i) {
+					const __m128 height = _mm_setr_ps(heights[columns[0] + i], heights[columns[1] + i],
+						heights[columns[2] + i], heights[columns[3] + i]);
+					const __m128 heightDerivative = _mm_setr_ps(heightDerivatives[columns[0] + i], heightDerivatives[columns[1] + i],
+						heightDerivatives[columns[2] + i], heightDerivatives[columns[3] + i]);
+					slopeX = _mm_add_ps(slopeX, _mm_mul_ps(_mm_loadu_ps(derivativeU.data() + static_cast<size_t>(i) * texels + x), height));
+					slopeZ = _mm_add_ps(slopeZ, _mm_mul_ps(_mm_loadu_ps(basisU.data() + static_cast<size_t>(i) * texels + x), heightDerivative));
+				}
+				slopeX = _mm_div_ps(slopeX, patchSide);
+				slopeZ = _mm_div_ps(slopeZ, patchSide);
+				const __m128 scale = _mm_div_ps(one, _mm_sqrt_ps(
+					_mm_add_ps(_mm_add_ps(_mm_mul_ps(slopeX, slopeX), one), _mm_mul_ps(slopeZ, slopeZ))));
+				const __m128i normalX = ToSnorm16(_mm_mul_ps(_mm_xor_ps(slopeX, signMask), scale));
+				const __m128i normalZ = ToSnorm16(_mm_mul_ps(_mm_xor_ps(slopeZ, signMask), scale));
+				// x in the low half of every texel, z in the high.
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x),
+					_mm_unpacklo_epi16(_mm_packs_epi32(normalX, normalX), _mm_packs_epi32(normalZ, normalZ)));
+			}
+#endif
+			for (; x < texels; ++x) {
+				const int first = firstColumns[x];
+				float slopeX = 0.f, slopeZ = 0.f;
+				for (int i = 0; i <= side; ++i) {
+					slopeX += derivativeU[static_cast<size_t>(i) * texels + x] * heights[first + i];
+					slopeZ += basisU[static_cast<size_t>(i) * texels + x] * heightDerivatives[first + i];
+				}
+				out[x] = Pack(GetNormalFromSlopes(slopeX / side, slopeZ / side));
+			}
+		}
+		}, workerCount);
+	return normals;
+}
+
+std::vector<uint32_t> TerrainNormals::BakeReference(const Heightfield& heightfield, int texelsPerCell)
+{
+	texelsPerCell = std::max(texelsPerCell, 1);
+	const int side = std::max(GetSide(heightfield, texelsPerCell), 0);
+	std::vector<uint32_t> texels(static_cast<size_t>(side) * side);
+	const float step = 1.f / static_cast<float>(texelsPerCell);
+	for (int z = 0; z < side; ++z) {
+		uint32_t* out = texels.data() + static_cast<size_t>(z) * side;
+		for (int x = 0; x < side; ++x) *out++ = Pack(GetNormal(heightfield, static_cast<float>(x) * step, static_cast<float>(z) * step));
+	}
+	return texels;
+}
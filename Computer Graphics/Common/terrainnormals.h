@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "heightfield.h"
+#include "parallel.h"
+
+// Normals of a Heightfield's Bézier surface baked into a texture. Texel (x, z) holds the normal at
+// grid position (x, z) / texelsPerCell, so with linear filtering a point of the grid reads its
+// normal at (position * texelsPerCell + 0.5) / side. Texels pack as R16G16_SNORM, the normal's x
+// and z; its y, always up over a heightfield, is sqrt(1 - x² - z²).
+namespace TerrainNormals
+{
+	inline int GetSide(const Heightfield& heightfield, int texelsPerCell)
+	{
+		return (heightfield.GetLength() - 1) * texelsPerCell + 1;
+	}
+
+	uint32_t Pack(const DirectX::XMFLOAT3& normal);
+	DirectX::XMFLOAT3 Unpack(uint32_t texel);
+
+	// The unit normal where the surface meets grid position (x, z), from the partial derivatives of
+	// the patch it lies in; points outside every patch take the nearest patch's edge.
+	DirectX::XMFLOAT3 GetNormal(const Heightfield& heightfield, float x, float z);
+
+	// GetSide x GetSide texels, row by row from low z. Each texel row first sums the patch rows it
+	// lies in down every grid column, then finishes four texels per pass from those sums, with SSE
+	// where available; rows are split over `workerCount` threads. The texels are identical to
+	// BakeReference's.
+	std::vector<uint32_t> Bake(const Heightfield& heightfield, int texelsPerCell,
+		size_t workerCount = Parallel::GetWorkerCount());
+	// The same one GetNormal at a time on one thread, for checking Bake.
+	std::vector<uint32_t> BakeReference(const Heightfield& heightfield, int texelsPerCell);
+}
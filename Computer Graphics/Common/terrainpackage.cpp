@@ -0,0 +1,93 @@
+#include "terrainpackage.h"
+#include "heightpyramid.h"
+#include "terrainnormals.h"
+#include "terrainpatches.h"
+#include "terrainquadtree.h"
+#include "terraintessellation.h"
+#include <algorithm>
+#include <iterator>
+#include <string>
+
+using namespace TerrainPackage;
+
+std::vector<std::byte> TerrainPackage::Cook(const Heightfield& heightfield, int normalTexelsPerCell, int lodSamplesPerCell,
+	size_t workerCount)
+{
+	const int length = heightfield.GetLength();
+	const TerrainQuadtree quadtree{ heightfield };
+	const auto& patchOrder = quadtree.GetPatchOrder();
+
+	std::vector<GridVertex> vertices(static_cast<size_t>(length) * length);
+	TerrainPatches::WriteGrid<GridVertex>(heightfield, vertices, workerCount);
+	std::vector<uint32_t> indices(patchOrder.size() * TerrainPatches::PatchVertices);
+	TerrainPatches::WritePatchIndices(length, patchOrder, indices, workerCount);
+	const std::vector<std::byte> cookedQuadtree = quadtree.Cook();
+	const std::vector<std::byte> cookedTessellation = TerrainTessellation{ heightfield, patchOrder, workerCount }.Cook();
+	const std::vector<std::byte> cookedPyramid = HeightPyramid{ heightfield }.Cook();
+	const std::vector<uint32_t> normals = TerrainNormals::Bake(heightfield, normalTexelsPerCell, workerCount);
+	const std::vector<float> lodHeights = TerrainPatches::GetLodHeights(heightfield, lodSamplesPerCell, workerCount);
+
+	const std::span<const std::byte> sections[]{
+		std::as_bytes(heightfield.GetSamples()), std::as_bytes(std::span{ vertices }), std::as_bytes(std::span{ indices }),
+		cookedQuadtree, cookedTessellation, cookedPyramid, std::as_bytes(std::span{ normals }), std::as_bytes(std::span{ lodHeights }) };
+	static_assert(std::size(sections) == static_cast<size_t>(Section::Count));
+
+	FileHeader header;
+	header.length = static_cast<uint32_t>(length);
+	header.normalTexelsPerCell = static_cast<uint32_t>(std::max(normalTexelsPerCell, 1));
+	header.lodSamplesPerCell = static_cast<uint32_t>(lodSamplesPerCell);
+	uint64_t offset = sizeof(FileHeader);
+	for (size_t i = 0; i < std::size(sections); ++i) {
+		offset = (offset + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+		header.sections[i] = SectionEntry{ offset, sections[i].size() };
+		offset += sections[i].size();
+	}
+
+	std::vector<std::byte> file(offset);
+	std::memcpy(file.data(), &header, sizeof(header));
+	for (size_t i = 0; i < std::size(sections); ++i) {
+		if (!sections[i].empty()) std::memcpy(file.data() + header.sections[i].offset, sections[i].data(), sections[i].size());
+	}
+	return file;
+}
+
+Contents TerrainPackage::Read(std::span<const std::byte> file)
+{
+	Contents contents;
+	FileHeader& header = contents.header;
+	if (file.size() < sizeof(header)) throw std::runtime_error{ "terrain package: truncated header" };
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != FileMagic || header.version != Version || header.sectionCount != static_cast<uint32_t>(Section::Count)) {
+		throw std::runtime_error{ "terrain package: not a cooked terrain this code reads" };
+	}
+	if (header.length < 5 || header.length > 65536 || header.normalTexelsPerCell == 0) {
+		throw std::runtime_error{ "terrain package: bad grid size" };
+	}
+
+	const auto section = [&](Section name, size_t elementSize, uint64_t count) {
+		const SectionEntry& entry = header.sections[static_cast<size_t>(name)];
+		if (entry.offset % SectionAlignment != 0 || entry.offset > file.size() || entry.size > file.size() - entry.offset ||
+			(elementSize && entry.size != count * elementSize)) {
+			throw std::runtime_error{ "terrain package: bad section " + std::to_string(static_cast<uint32_t>(name)) };
+		}
+		return file.subspan(static_cast<size_t>(entry.offset), static_cast<size_t>(entry.size));
+	};
+	const auto view = [&]<typename E>(std::span<const E>& elements, Section name, uint64_t count) {
+		const auto bytes = section(name, sizeof(E), count);
+		elements = { reinterpret_cast<const E*>(bytes.data()), static_cast<size_t>(count) };
+	};
+
+	const uint64_t length = header.length;
+	const uint64_t patchCount = (length - 1) / Heightfield::PatchLength;
+	const uint64_t normalSide = (length - 1) * header.normalTexelsPerCell + 1;
+	const uint64_t lodSide = (length - 1) * header.lodSamplesPerCell + 1;
+	view(contents.heights, Section::Heights, length * length);
+	view(contents.vertices, Section::Vertices, length * length);
+	view(contents.indices, Section::Indices, patchCount * patchCount * TerrainPatches::PatchVertices);
+	contents.quadtree = section(Section::Quadtree, 0, 0);
+	contents.tessellation = section(Section::Tessellation, 0, 0);
+	contents.pyramid = section(Section::Pyramid, 0, 0);
+	view(contents.normals, Section::Normals, normalSide * normalSide);
+	view(contents.lodHeights, Section::LodHeights, lodSide * lodSide);
+	return contents;
+}
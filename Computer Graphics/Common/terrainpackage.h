@@ -0,0 +1,150 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include <DirectXMath.h>
+#include "heightfield.h"
+#include "parallel.h"
+
+// A cooked terrain: everything the terrain mesh builds from a height map at load time, laid out
+// to be mapped and uploaded as is. The header's table locates every section, each aligned to
+// SectionAlignment; classes that keep more than plain arrays cook themselves into a section of
+// their own with Writer and restore from it with Reader.
+namespace TerrainPackage
+{
+	constexpr uint32_t FileMagic = 0x4B4F4F43; // "COOK"
+	constexpr uint32_t Version = 3;
+	constexpr uint64_t SectionAlignment = 64;
+
+	enum class Section : uint32_t
+	{
+		Heights,			// length x length floats, row by row.
+		Vertices,			// length x length GridVertex, TerrainPatches::WriteGrid's order.
+		Indices,			// 25 uint32_t per patch, TerrainPatches::WritePatchIndices'.
+		Quadtree,			// TerrainQuadtree::Cook.
+		Tessellation,		// TerrainTessellation::Cook.
+		Pyramid,			// HeightPyramid::Cook.
+		Normals,			// TerrainNormals::Bake at normalTexelsPerCell, one uint32_t per texel.
+		LodHeights,			// TerrainPatches::GetLodHeights at lodSamplesPerCell.
+		Count
+	};
+
+	struct SectionEntry
+	{
+		uint64_t	offset;
+		uint64_t	size;
+	};
+
+	struct FileHeader
+	{
+		uint32_t		magic = FileMagic;
+		uint32_t		version = Version;
+		uint32_t		length = 0;
+		uint32_t		normalTexelsPerCell = 0;
+		uint32_t		lodSamplesPerCell = 0;
+		uint32_t		sectionCount = static_cast<uint32_t>(Section::Count);
+		SectionEntry	sections[static_cast<size_t>(Section::Count)];
+	};
+
+	// The vertex of the shared control-point grid, as the game's TerrainVertex lays it out.
+	struct GridVertex
+	{
+		GridVertex() = default;
+		GridVertex(const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT2& uv0) : position{ position }, uv0{ uv0 } {}
+
+		DirectX::XMFLOAT3	position;
+		DirectX::XMFLOAT2	uv0;
+	};
+
+	// Appends counted arrays of trivially copyable elements.
+	class Writer
+	{
+	public:
+		template <typename E>
+		void Write(std::span<const E> elements)
+		{
+			Write(static_cast<uint64_t>(elements.size()));
+			const auto* bytes = reinterpret_cast<const std::byte*>(elements.data());
+			m_bytes.insert(m_bytes.end(), bytes, bytes + elements.size_bytes());
+		}
+		template <typename E>
+		void Write(const std::vector<E>& elements) { Write(std::span<const E>{ elements }); }
+		template <typename E>
+		void Write(const E& element)
+		{
+			const auto* bytes = reinterpret_cast<const std::byte*>(&element);
+			m_bytes.insert(m_bytes.end(), bytes, bytes + sizeof(E));
+		}
+
+		std::vector<std::byte>& GetBytes() { return m_bytes; }
+
+	private:
+		std::vector<std::byte>	m_bytes;
+	};
+
+	// Reads what Writer wrote, in the same order; throws on a truncated section.
+	class Reader
+	{
+	public:
+		explicit Reader(std::span<const std::byte> bytes) : m_bytes{ bytes } {}
+
+		template <typename E>
+		E Read()
+		{
+			E element;
+			std::memcpy(&element, Take(sizeof(E)).data(), sizeof(E));
+			return element;
+		}
+		template <typename E>
+		std::vector<E> ReadVector()
+		{
+			const uint64_t count = Read<uint64_t>();
+			if (count > m_bytes.size() / sizeof(E)) throw std::runtime_error{ "terrain package: truncated section" };
+			std::vector<E> elements(static_cast<size_t>(count));
+			std::memcpy(elements.data(), Take(elements.size() * sizeof(E)).data(), elements.size() * sizeof(E));
+			return elements;
+		}
+
+	private:
+		std::span<const std::byte> Take(size_t size)
+		{
+			if (size > m_bytes.size()) throw std::runtime_error{ "terrain package: truncated section" };
+			const auto taken = m_bytes.first(size);
+			m_bytes = m_bytes.subspan(size);
+			return taken;
+		}
+
+	private:
+		std::span<const std::byte>	m_bytes;
+	};
+
+	// The sections of a package in memory; views into the file.
+	struct Contents
+	{
+		FileHeader							header;
+		std::span<const float>				heights;
+		std::span<const GridVertex>			vertices;
+		std::span<const uint32_t>			indices;
+		std::span<const std::byte>			quadtree;
+		std::span<const std::byte>			tessellation;
+		std::span<const std::byte>			pyramid;
+		std::span<const uint32_t>			normals;
+		std::span<const float>				lodHeights;
+	};
+
+	inline bool IsPackage(std::span<const std::byte> file)
+	{
+		return file.size() >= sizeof(uint32_t) && std::memcmp(file.data(), &FileMagic, sizeof(uint32_t)) == 0;
+	}
+
+	// Cooks every section for the heightfield, building on `workerCount` threads.
+	std::vector<std::byte> Cook(const Heightfield& heightfield, int normalTexelsPerCell, int lodSamplesPerCell,
+		size_t workerCount = Parallel::GetWorkerCount());
+
+	// Throws unless `file` is a whole package this code reads. `file` must stay mapped while the
+	// contents are used.
+	Contents Read(std::span<const std::byte> file);
+}
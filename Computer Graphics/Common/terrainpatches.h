@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <DirectXMath.h>
+#include "heightfield.h"
+#include "parallel.h"
+
+namespace TerrainPatches
+{
+	constexpr int PatchVertices = (Heightfield::PatchLength + 1) * (Heightfield::PatchLength + 1);
+
+	// Writes the control points of patch i of `patchOrder` to vertices[i * PatchVertices] onwards:
+	// rows from the patch's high z down, each from low x up, as the hull shader reads them. A point
+	// is Vertex{ position centred like Heightfield::GetHeight, uv over the whole grid, uv over the
+	// patch }. Patches are split over `workerCount` threads; `vertices` must already hold every patch.
+	template <typename Vertex>
+	void WriteControlPoints(const Heightfield& heightfield, std::span<const DirectX::XMUINT2> patchOrder,
+		std::span<Vertex> vertices, size_t workerCount = Parallel::GetWorkerCount())
+	{
+		constexpr int side = Heightfield::PatchLength;
+		const int length = heightfield.GetLength();
+		const int half = length / 2;
+		const float last = static_cast<float>(length - 1);
+		Parallel::For(0, patchOrder.size(), [&](size_t patch) {
+			const int x0 = static_cast<int>(patchOrder[patch].x) * side;
+			const int z0 = static_cast<int>(patchOrder[patch].y) * side;
+			Vertex* out = vertices.data() + patch * PatchVertices;
+			for (int row = 0; row <= side; ++row) {
+				const int z = z0 + side - row;
+				for (int column = 0; column <= side; ++column) {
+					const int x = x0 + column;
+					*out++ = Vertex{ DirectX::XMFLOAT3{ static_cast<float>(x - half), heightfield.GetSample(x, z), static_cast<float>(z - half) },
+						DirectX::XMFLOAT2{ static_cast<float>(x) / last, 1.f - static_cast<float>(z) / last },
+						DirectX::XMFLOAT2{ static_cast<float>(column) / side, static_cast<float>(row) / side } };
+				}
+			}
+			}, workerCount);
+	}
+
+	// The grid's samples as control points every patch shares, row by row from low z: Vertex{
+	// position centred like Heightfield::GetHeight, uv over the whole grid }. Rows are split over
+	// `workerCount` threads; `vertices` must hold length x length points.
+	template <typename Vertex>
+	void WriteGrid(const Heightfield& heightfield, std::span<Vertex> vertices, size_t workerCount = Parallel::GetWorkerCount())
+	{
+		const int length = heightfield.GetLength();
+		const int half = length / 2;
+		const float last = static_cast<float>(length - 1);
+		Parallel::For(0, static_cast<size_t>(length), [&](size_t row) {
+			const int z = static_cast<int>(row);
+			Vertex* out = vertices.data() + row * length;
+			for (int x = 0; x < length; ++x) {
+				*out++ = Vertex{ DirectX::XMFLOAT3{ static_cast<float>(x - half), heightfield.GetSample(x, z), static_cast<float>(z - half) },
+					DirectX::XMFLOAT2{ static_cast<float>(x) / last, 1.f - static_cast<float>(z) / last } };
+			}
+			}, workerCount);
+	}
+
+	// The indices into WriteGrid's vertices of the control points WriteControlPoints writes, in the
+	// same order: patch i's at indices[i * PatchVertices] onwards.
+	inline void WritePatchIndices(int length, std::span<const DirectX::XMUINT2> patchOrder, std::span<uint32_t> indices,
+		size_t workerCount = Parallel::GetWorkerCount())
+	{
+		constexpr uint32_t side = Heightfield::PatchLength;
+		Parallel::For(0, patchOrder.size(), [&](size_t patch) {
+			const uint32_t x0 = patchOrder[patch].x * side;
+			const uint32_t z0 = patchOrder[patch].y * side;
+			uint32_t* out = indices.data() + patch * PatchVertices;
+			for (uint32_t row = 0; row <= side; ++row) {
+				const uint32_t first = (z0 + side - row) * static_cast<uint32_t>(length) + x0;
+				for (uint32_t column = 0; column <= side; ++column) *out++ = first + column;
+			}
+			}, workerCount);
+	}
+
+	// The surface every 1 / samplesPerCell units, (length - 1) * samplesPerCell + 1 rows of as many
+	// from the grid's low corner, as the CDLOD path displaces its grids. Rows are split over
+	// `workerCount` threads.
+	inline std::vector<float> GetLodHeights(const Heightfield& heightfield, int samplesPerCell,
+		size_t workerCount = Parallel::GetWorkerCount())
+	{
+		const int side = std::max((heightfield.GetLength() - 1) * samplesPerCell + 1, 0);
+		const float spacing = 1.f / static_cast<float>(samplesPerCell);
+		const float low = -static_cast<float>(heightfield.GetLength() / 2);
+		std::vector<float> heights(static_cast<size_t>(side) * side);
+		Parallel::ForRange(0, static_cast<size_t>(side), [&](size_t first, size_t last) {
+			std::vector<DirectX::XMFLOAT2> points(side);
+			for (size_t row = first; row < last; ++row) {
+				for (int x = 0; x < side; ++x) points[x] = DirectX::XMFLOAT2{ low + x * spacing, low + static_cast<int>(row) * spacing };
+				heightfield.GetHeights(points, std::span<float>{ heights.data() + row * side, static_cast<size_t>(side) });
+			}
+			}, workerCount);
+		return heights;
+	}
+}
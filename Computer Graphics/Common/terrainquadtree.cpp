@@ -0,0 +1,310 @@
+#include "terrainquadtree.h"
+#include "terrainpackage.h"
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define QUADTREE_USE_SSE2
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	// Signed distance of the corner farthest along the plane's normal (`nearest` false) or of the
+	// one nearest; both products are summed in the same order as in the SSE test.
+	float GetCornerDistance(const XMFLOAT4& plane, bool nearest, float minX, float maxX, float minY, float maxY,
+		float minZ, float maxZ)
+	{
+		const float x = (plane.x >= 0.f) != nearest ? maxX : minX;
+		const float y = (plane.y >= 0.f) != nearest ? maxY : minY;
+		const float z = (plane.z >= 0.f) != nearest ? maxZ : minZ;
+		return plane.x * x + plane.y * y + plane.z * z + plane.w;
+	}
+
+	// Whether the box is wholly outside one plane; `crossing` is set when it is not wholly inside all.
+	bool IsOutside(const XMFLOAT4 (&planes)[6], float minX, float maxX, float minY, float maxY,
+		float minZ, float maxZ, bool& crossing)
+	{
+		crossing = false;
+		bool outside = false;
+		for (const XMFLOAT4& plane : planes) {
+			outside |= GetCornerDistance(plane, false, minX, maxX, minY, maxY, minZ, maxZ) < 0.f;
+			crossing |= GetCornerDistance(plane, true, minX, maxX, minY, maxY, minZ, maxZ) < 0.f;
+		}
+		return outside;
+	}
+
+	// Distance from `eye` to the nearest point of the box, 0 inside it.
+	float GetDistance(const XMFLOAT3& eye, float minX, float maxX, float minY, float maxY, float minZ, float maxZ)
+	{
+		const float dx = std::max({ minX - eye.x, 0.f, eye.x - maxX });
+		const float dy = std::max({ minY - eye.y, 0.f, eye.y - maxY });
+		const float dz = std::max({ minZ - eye.z, 0.f, eye.z - maxZ });
+		return std::sqrt(dx * dx + dy * dy + dz * dz);
+	}
+}
+
+TerrainQuadtree::TerrainQuadtree(const Heightfield& heightfield) :
+	m_half{ static_cast<float>(heightfield.GetLength() / 2) }
+{
+	const int patchCount = heightfield.GetPatchCount();
+	const uint32_t side = std::bit_ceil(static_cast<uint32_t>(std::max(patchCount, 1)));
+	m_levels.resize(std::countr_zero(side) + 1);
+
+	const auto resize = [](Level& level, size_t nodes) {
+		nodes = std::max<size_t>(nodes, 4);
+		level.minY.assign(nodes, FLT_MAX);
+		level.maxY.assign(nodes, -FLT_MAX);
+		level.first.assign(nodes, 0);
+		level.count.assign(nodes, 0);
+	};
+
+	Level& patches = m_levels.front();
+	resize(patches, static_cast<size_t>(side) * side);
+	std::vector<XMUINT2> coordinates(patches.count.size());
+	for (int pz = 0; pz < patchCount; ++pz) {
+		for (int px = 0; px < patchCount; ++px) {
+			const uint32_t node = Heightfield::GetMortonIndex(px, pz);
+			float low = FLT_MAX, high = -FLT_MAX;
+			for (int z = pz * Heightfield::PatchLength; z <= (pz + 1) * Heightfield::PatchLength; ++z) {
+				for (int x = px * Heightfield::PatchLength; x <= (px + 1) * Heightfield::PatchLength; ++x) {
+					low = std::min(low, heightfield.GetSample(x, z));
+					high = std::max(high, heightfield.GetSample(x, z));
+				}
+			}
+			patches.minY[node] = low;
+			patches.maxY[node] = high;
+			patches.count[node] = 1;
+			coordinates[node] = XMUINT2{ static_cast<uint32_t>(px), static_cast<uint32_t>(pz) };
+		}
+	}
+	for (uint32_t node = 0; node < patches.count.size(); ++node) {
+		if (!patches.count[node]) continue;
+		patches.first[node] = static_cast<uint32_t>(m_patchOrder.size());
+		m_patchOrder.push_back(coordinates[node]);
+	}
+
+	for (size_t level = 1; level < m_levels.size(); ++level) {
+		const Level& children = m_levels[level - 1];
+		Level& nodes = m_levels[level];
+		const uint32_t levelSide = side >> level;
+		resize(nodes, static_cast<size_t>(levelSide) * levelSide);
+		for (size_t node = 0; node < static_cast<size_t>(levelSide) * levelSide; ++node) {
+			for (size_t child = node * 4; child < node * 4 + 4; ++child) {
+				if (!children.count[child]) continue;
+				if (!nodes.count[node]) nodes.first[node] = children.first[child];
+				nodes.count[node] += children.count[child];
+				nodes.minY[node] = std::min(nodes.minY[node], children.minY[child]);
+				nodes.maxY[node] = std::max(nodes.maxY[node], children.maxY[child]);
+			}
+		}
+	}
+}
+
+TerrainQuadtree::TerrainQuadtree(std::span<const std::byte> cooked)
+{
+	TerrainPackage::Reader reader{ cooked };
+	m_half = reader.Read<float>();
+	m_levels.resize(reader.Read<uint32_t>());
+	for (Level& level : m_levels) {
+		level.minY = reader.ReadVector<float>();
+		level.maxY = reader.ReadVector<float>();
+		level.first = reader.ReadVector<uint32_t>();
+		level.count = reader.ReadVector<uint32_t>();
+		if (level.minY.size() < 4 || level.maxY.size() != level.minY.size() || level.first.size() != level.minY.size() ||
+			level.count.size() != level.minY.size()) {
+			throw std::runtime_error{ "terrain package: bad quadtree level" };
+		}
+	}
+	if (m_levels.empty()) throw std::runtime_error{ "terrain package: empty quadtree" };
+	m_patchOrder = reader.ReadVector<XMUINT2>();
+}
+
+std::vector<std::byte> TerrainQuadtree::Cook() const
+{
+	TerrainPackage::Writer writer;
+	writer.Write(m_half);
+	writer.Write(static_cast<uint32_t>(m_levels.size()));
+	for (const Level& level : m_levels) {
+		writer.Write(level.minY);
+		writer.Write(level.maxY);
+		writer.Write(level.first);
+		writer.Write(level.count);
+	}
+	writer.Write(m_patchOrder);
+	return std::move(writer.GetBytes());
+}
+
+uint32_t TerrainQuadtree::Cull(FXMMATRIX objectToClip, std::vector<Range>& ranges) const
+{
+	Planes planes;
+	GetPlanes(objectToClip, planes);
+	ranges.clear();
+
+	// The root's four children, or the only patch padded to four.
+	uint32_t patches = 0;
+	CullGroup(planes, std::max(static_cast<int>(m_levels.size()) - 2, 0), 0, 0, 0, ranges, patches);
+	return patches;
+}
+
+uint32_t TerrainQuadtree::CullPatches(FXMMATRIX objectToClip, std::vector<Range>& ranges) const
+{
+	Planes planes;
+	GetPlanes(objectToClip, planes);
+	ranges.clear();
+
+	const Level& level = m_levels.front();
+	const float size = static_cast<float>(Heightfield::PatchLength);
+	uint32_t patches = 0;
+	for (uint32_t patch = 0; patch < m_patchOrder.size(); ++patch) {
+		const XMUINT2 coordinate = m_patchOrder[patch];
+		const uint32_t node = Heightfield::GetMortonIndex(coordinate.x, coordinate.y);
+		const float minX = static_cast<float>(coordinate.x) * size - m_half;
+		const float minZ = static_cast<float>(coordinate.y) * size - m_half;
+		bool crossing;
+		if (IsOutside(planes, minX, minX + size, level.minY[node], level.maxY[node], minZ, minZ + size, crossing)) continue;
+		Append(ranges, patch, 1);
+		++patches;
+	}
+	return patches;
+}
+
+void TerrainQuadtree::SelectLods(const XMFLOAT3& eye, float firstRange, FXMMATRIX objectToClip,
+	std::vector<LodNode>& nodes) const
+{
+	LodQuery query{ {}, eye, firstRange };
+	GetPlanes(objectToClip, query.planes);
+	nodes.clear();
+
+	// The root takes whatever lies beyond every level's range.
+	const int top = static_cast<int>(m_levels.size()) - 1;
+	if (m_levels[top].count[0]) SelectLod(query, top, 0, 0, 0, true, false, nodes);
+}
+
+void TerrainQuadtree::GetPlanes(FXMMATRIX objectToClip, Planes& planes)
+{
+	// Rows of the transpose are the columns: inside is 0 <= z <= w and -w <= x, y <= w.
+	const XMMATRIX columns = XMMatrixTranspose(objectToClip);
+	XMStoreFloat4(&planes[0], XMVectorAdd(columns.r[3], columns.r[0]));
+	XMStoreFloat4(&planes[1], XMVectorSubtract(columns.r[3], columns.r[0]));
+	XMStoreFloat4(&planes[2], XMVectorAdd(columns.r[3], columns.r[1]));
+	XMStoreFloat4(&planes[3], XMVectorSubtract(columns.r[3], columns.r[1]));
+	XMStoreFloat4(&planes[4], columns.r[2]);
+	XMStoreFloat4(&planes[5], XMVectorSubtract(columns.r[3], columns.r[2]));
+}
+
+void TerrainQuadtree::Append(std::vector<Range>& ranges, uint32_t first, uint32_t count)
+{
+	if (!ranges.empty() && ranges.back().first + ranges.back().count == first) ranges.back().count += count;
+	else ranges.push_back({ first, count });
+}
+
+void TerrainQuadtree::CullGroup(const Planes& planes, int level, uint32_t base, uint32_t x, uint32_t z,
+	std::vector<Range>& ranges, uint32_t& patches) const
+{
+	const Level& nodes = m_levels[level];
+	const float size = static_cast<float>(Heightfield::PatchLength << level);
+	alignas(16) float minX[4], maxX[4], minZ[4], maxZ[4];
+	for (uint32_t lane = 0; lane < 4; ++lane) {
+		minX[lane] = static_cast<float>(x * 2 + (lane & 1)) * size - m_half;
+		minZ[lane] = static_cast<float>(z * 2 + (lane >> 1)) * size - m_half;
+		maxX[lane] = minX[lane] + size;
+		maxZ[lane] = minZ[lane] + size;
+	}
+
+	int outsideMask = 0, crossingMask = 0;
+#ifdef QUADTREE_USE_SSE2
+	const __m128 boxMinX = _mm_load_ps(minX), boxMaxX = _mm_load_ps(maxX);
+	const __m128 boxMinY = _mm_loadu_ps(nodes.minY.data() + base), boxMaxY = _mm_loadu_ps(nodes.maxY.data() + base);
+	const __m128 boxMinZ = _mm_load_ps(minZ), boxMaxZ = _mm_load_ps(maxZ);
+	const __m128 zero = _mm_setzero_ps();
+	__m128 outside = zero, crossing = zero;
+	for (const XMFLOAT4& plane : planes) {
+		const __m128 a = _mm_set1_ps(plane.x), b = _mm_set1_ps(plane.y), c = _mm_set1_ps(plane.z), d = _mm_set1_ps(plane.w);
+		const bool px = plane.x >= 0.f, py = plane.y >= 0.f, pz = plane.z >= 0.f;
+		const __m128 farthest = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, px ? boxMaxX : boxMinX),
+			_mm_mul_ps(b, py ? boxMaxY : boxMinY)), _mm_mul_ps(c, pz ? boxMaxZ : boxMinZ)), d);
+		const __m128 nearest = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, px ? boxMinX : boxMaxX),
+			_mm_mul_ps(b, py ? boxMinY : boxMaxY)), _mm_mul_ps(c, pz ? boxMinZ : boxMaxZ)), d);
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(farthest, zero));
+		crossing = _mm_or_ps(crossing, _mm_cmplt_ps(nearest, zero));
+	}
+	outsideMask = _mm_movemask_ps(outside);
+	crossingMask = _mm_movemask_ps(crossing);
+#else
+	for (uint32_t lane = 0; lane < 4; ++lane) {
+		bool crossing;
+		if (IsOutside(planes, minX[lane], maxX[lane], nodes.minY[base + lane], nodes.maxY[base + lane],
+			minZ[lane], maxZ[lane], crossing)) outsideMask |= 1 << lane;
+		if (crossing) crossingMask |= 1 << lane;
+	}
+#endif
+
+	// Lanes in order, depth first, so the ranges come out ascending.
+	for (uint32_t lane = 0; lane < 4; ++lane) {
+		const uint32_t node = base + lane;
+		if (!nodes.count[node] || outsideMask & 1 << lane) continue;
+		if (level == 0 || !(crossingMask & 1 << lane)) {
+			Append(ranges, nodes.first[node], nodes.count[node]);
+			patches += nodes.count[node];
+		}
+		else {
+			CullGroup(planes, level - 1, node * 4, x * 2 + (lane & 1), z * 2 + (lane >> 1), ranges, patches);
+		}
+	}
+}
+
+bool TerrainQuadtree::SelectLod(const LodQuery& query, int level, uint32_t node, uint32_t x, uint32_t z,
+	bool forced, bool inside, std::vector<LodNode>& nodes) const
+{
+	const Level& nodesOfLevel = m_levels[level];
+	const float size = static_cast<float>(Heightfield::PatchLength << level);
+	const float minX = static_cast<float>(x) * size - m_half;
+	const float minZ = static_cast<float>(z) * size - m_half;
+	const float distance = GetDistance(query.eye, minX, minX + size, nodesOfLevel.minY[node], nodesOfLevel.maxY[node],
+		minZ, minZ + size);
+	if (!forced && distance > GetLodRange(query.firstRange, level)) return false;
+	if (!inside) {
+		bool crossing;
+		if (IsOutside(query.planes, minX, minX + size, nodesOfLevel.minY[node], nodesOfLevel.maxY[node],
+			minZ, minZ + size, crossing)) return true;
+		inside = !crossing;
+	}
+
+	const float morphEnd = GetLodRange(query.firstRange, level);
+	const float previous = level > 0 ? GetLodRange(query.firstRange, level - 1) : 0.f;
+	const float morphStart = previous + (morphEnd - previous) * MorphStart;
+	// A node reaching into the padding is never drawn whole; its real children are.
+	const auto isWhole = [](const Level& nodes, uint32_t node, int level) { return nodes.count[node] == 1u << 2 * level; };
+	if (level == 0 || (isWhole(nodesOfLevel, node, level) && distance > previous)) {
+		nodes.push_back({ minX, minZ, size, morphStart, morphEnd, static_cast<uint32_t>(level), WholeNode });
+		return true;
+	}
+
+	const Level& children = m_levels[level - 1];
+	const float childSize = size * 0.5f;
+	for (uint32_t lane = 0; lane < 4; ++lane) {
+		const uint32_t child = node * 4 + lane;
+		if (!children.count[child]) continue;
+		const uint32_t childX = x * 2 + (lane & 1), childZ = z * 2 + (lane >> 1);
+		if (SelectLod(query, level - 1, child, childX, childZ, false, inside, nodes)) continue;
+
+		// Beyond the child's range: its quarter of this grid, unless it reaches into the padding.
+		if (!isWhole(children, child, level - 1)) {
+			SelectLod(query, level - 1, child, childX, childZ, true, inside, nodes);
+			continue;
+		}
+		const float childMinX = minX + static_cast<float>(lane & 1) * childSize;
+		const float childMinZ = minZ + static_cast<float>(lane >> 1) * childSize;
+		bool crossing;
+		if (!inside && IsOutside(query.planes, childMinX, childMinX + childSize, children.minY[child], children.maxY[child],
+			childMinZ, childMinZ + childSize, crossing)) continue;
+		nodes.push_back({ minX, minZ, size, morphStart, morphEnd, static_cast<uint32_t>(level), lane });
+	}
+	return true;
+}
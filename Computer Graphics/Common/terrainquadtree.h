@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <DirectXMath.h>
+#include "heightfield.h"
+
+// Frustum culling for the patches of a Heightfield. Every quadtree node bounds the control points
+// below it, and with them the Bézier surfaces. The levels are kept in Morton order from the
+// patches up, so the four children of node i are nodes 4i to 4i + 3 of the level below and one
+// SSE pass tests all four against a plane. The mesh stores its patches in GetPatchOrder's order,
+// which is Morton order without the padding, so every node is one run of the vertex buffer.
+// SelectLods walks the same nodes for continuous distance-dependent LOD (CDLOD) instead.
+class TerrainQuadtree
+{
+public:
+	// Patches, counted in GetPatchOrder's order.
+	struct Range
+	{
+		uint32_t	first;
+		uint32_t	count;
+	};
+
+	// A square drawn with one CDLOD grid at `level`: the node's whole grid, or only the quarter
+	// over child `quadrant` (x in bit 0, z in bit 1) when that child is not drawn finer.
+	struct LodNode
+	{
+		float		x;				// Low corner of the node, in the heightfield's space.
+		float		z;
+		float		size;			// Of the whole node; PatchLength << level.
+		float		morphStart;		// Eye distances over which the grid morphs into the next level's.
+		float		morphEnd;
+		uint32_t	level;
+		uint32_t	quadrant;		// WholeNode, or 0 to 3.
+	};
+	static constexpr uint32_t WholeNode = 4;
+
+	// Where morphing starts, as a fraction of the way from the previous level's range to the level's.
+	static constexpr float MorphStart = 0.7f;
+
+	explicit TerrainQuadtree(const Heightfield& heightfield);
+	// The tree Cook wrote, as it was.
+	explicit TerrainQuadtree(std::span<const std::byte> cooked);
+
+	// Every node and the patch order, for a terrain package.
+	std::vector<std::byte> Cook() const;
+
+	// The patch (x, z) at every place of the mesh, counting patches from the grid's low corner.
+	const std::vector<DirectX::XMUINT2>& GetPatchOrder() const { return m_patchOrder; }
+
+	// Replaces `ranges` with the patches whose bounds are at least partly inside the frustum of
+	// `objectToClip`, which maps the heightfield's space (centred like Heightfield::GetHeight) to
+	// D3D clip space. Ranges ascend and adjacent ones are merged. Returns the patch count.
+	uint32_t Cull(DirectX::FXMMATRIX objectToClip, std::vector<Range>& ranges) const;
+
+	// The same test patch by patch, without the tree; for checking and timing Cull.
+	uint32_t CullPatches(DirectX::FXMMATRIX objectToClip, std::vector<Range>& ranges) const;
+
+	// Replaces `nodes` with the CDLOD selection for an eye at `eye` (the heightfield's space): level
+	// L is used up to GetLodRange(firstRange, L) from the eye, and nodes wholly outside the frustum
+	// of `objectToClip` are dropped. Neighbouring nodes differ by at most one level as long as the
+	// ranges are wide against the nodes; Exporter lodbench checks the seams.
+	void SelectLods(const DirectX::XMFLOAT3& eye, float firstRange, DirectX::FXMMATRIX objectToClip,
+		std::vector<LodNode>& nodes) const;
+
+	int GetLevelCount() const { return static_cast<int>(m_levels.size()); }
+	static float GetLodRange(float firstRange, int level) { return firstRange * static_cast<float>(1u << level); }
+
+private:
+	using Planes = DirectX::XMFLOAT4[6];
+
+	struct LodQuery
+	{
+		Planes				planes;
+		DirectX::XMFLOAT3	eye;
+		float				firstRange;
+	};
+
+	// Nodes of one level in Morton order, at least four so the top can be loaded as a group.
+	struct Level
+	{
+		std::vector<float>		minY;
+		std::vector<float>		maxY;
+		std::vector<uint32_t>	first;
+		std::vector<uint32_t>	count;			// 0 for nodes wholly in the padding.
+	};
+
+	static void GetPlanes(DirectX::FXMMATRIX objectToClip, Planes& planes);
+	static void Append(std::vector<Range>& ranges, uint32_t first, uint32_t count);
+
+	// Tests nodes `base` to `base + 3` of `level`, whose parent is node (x, z) of the level above.
+	void CullGroup(const Planes& planes, int level, uint32_t base, uint32_t x, uint32_t z,
+		std::vector<Range>& ranges, uint32_t& patches) const;
+
+	// Selects node `node` of `level` at (x, z). Returns false, leaving the node to its parent's grid,
+	// when the node is beyond the level's range and not `forced`; `inside` skips the frustum test.
+	bool SelectLod(const LodQuery& query, int level, uint32_t node, uint32_t x, uint32_t z, bool forced,
+		bool inside, std::vector<LodNode>& nodes) const;
+
+private:
+	std::vector<Level>					m_levels;		// Patches first.
+	std::vector<DirectX::XMUINT2>		m_patchOrder;
+	float								m_half;			// Heightfield::GetHeight's offset of the grid.
+};
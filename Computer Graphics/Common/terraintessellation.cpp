@@ -0,0 +1,241 @@
+#include "terraintessellation.h"
+#include "terrainpackage.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TESSELLATION_USE_SSE2
+#endif
+
+using namespace DirectX;
+
+TerrainTessellation::TerrainTessellation(const Heightfield& heightfield, std::span<const XMUINT2> patchOrder,
+	size_t workerCount) :
+	m_densities{ ComputeDensities(heightfield, workerCount) }, m_length{ heightfield.GetLength() }
+{
+	const float half = static_cast<float>(m_length / 2);
+	constexpr int side = Heightfield::PatchLength;
+
+	// Built from the edge's own grid points, walked the same way from either side, so both
+	// patches sharing an edge store the same floats for it.
+	const auto setBounds = [&](size_t patch, int bound, float minX, float maxX, float minY, float maxY, float minZ,
+		float maxZ, float curvature, float cap) {
+		PatchBlock& block = m_blocks[patch / 4];
+		const size_t lane = patch % 4;
+		block.minX[bound][lane] = minX;
+		block.maxX[bound][lane] = maxX;
+		block.minY[bound][lane] = minY;
+		block.maxY[bound][lane] = maxY;
+		block.minZ[bound][lane] = minZ;
+		block.maxZ[bound][lane] = maxZ;
+		block.curvature[bound][lane] = curvature;
+		block.cap[bound][lane] = cap;
+	};
+	const auto setEdge = [&](size_t patch, int edge, int x0, int z0, int dx, int dz) {
+		float heights[side + 1];
+		int density = 0;
+		for (int k = 0; k <= side; ++k) {
+			heights[k] = heightfield.GetSample(x0 + k * dx, z0 + k * dz);
+			density = std::max(density, GetDensity(x0 + k * dx, z0 + k * dz));
+		}
+		float curvature = 0.f;
+		for (int k = 0; k + 2 <= side; ++k) {
+			curvature = std::max(curvature, std::abs(heights[k] - 2.f * heights[k + 1] + heights[k + 2]));
+		}
+		// |B''| <= 4 * 3 * the largest second difference, over the 8 of the chord error bound.
+		setBounds(patch, edge, static_cast<float>(x0) - half, static_cast<float>(x0 + side * dx) - half,
+			*std::min_element(heights, heights + side + 1), *std::max_element(heights, heights + side + 1),
+			static_cast<float>(z0) - half, static_cast<float>(z0 + side * dz) - half, 1.5f * curvature, GetMaxFactor(density));
+	};
+
+	// Every patch writes only its own lanes.
+	m_blocks.resize((patchOrder.size() + 3) / 4, PatchBlock{});
+	Parallel::For(0, patchOrder.size(), [&](size_t patch) {
+		const int x0 = static_cast<int>(patchOrder[patch].x) * side;
+		const int z0 = static_cast<int>(patchOrder[patch].y) * side;
+		setEdge(patch, 0, x0, z0, 0, 1);
+		setEdge(patch, 1, x0, z0 + side, 1, 0);
+		setEdge(patch, 2, x0 + side, z0, 0, 1);
+		setEdge(patch, 3, x0, z0, 1, 0);
+
+		float minY = m_blocks[patch / 4].minY[0][patch % 4], maxY = m_blocks[patch / 4].maxY[0][patch % 4];
+		float uu = 0.f, uv = 0.f, vv = 0.f;
+		int density = 0;
+		const auto point = [&](int x, int z) { return heightfield.GetSample(x0 + x, z0 + z); };
+		for (int z = 0; z <= side; ++z) {
+			for (int x = 0; x <= side; ++x) {
+				minY = std::min(minY, point(x, z));
+				maxY = std::max(maxY, point(x, z));
+				density = std::max(density, GetDensity(x0 + x, z0 + z));
+				if (x + 2 <= side) uu = std::max(uu, std::abs(point(x, z) - 2.f * point(x + 1, z) + point(x + 2, z)));
+				if (z + 2 <= side) vv = std::max(vv, std::abs(point(x, z) - 2.f * point(x, z + 1) + point(x, z + 2)));
+				if (x < side && z < side) uv = std::max(uv, std::abs(point(x, z) - point(x + 1, z) - point(x, z + 1) + point(x + 1, z + 1)));
+			}
+		}
+		// About (|Suu| + 2|Suv| + |Svv|) / 8 for the two triangles of each tessellated quad.
+		setBounds(patch, 4, static_cast<float>(x0) - half, static_cast<float>(x0 + side) - half, minY, maxY,
+			static_cast<float>(z0) - half, static_cast<float>(z0 + side) - half, 1.5f * uu + 4.f * uv + 1.5f * vv,
+			GetMaxFactor(density));
+		}, workerCount);
+}
+
+TerrainTessellation::TerrainTessellation(std::span<const std::byte> cooked)
+{
+	TerrainPackage::Reader reader{ cooked };
+	m_length = reader.Read<int>();
+	m_blocks = reader.ReadVector<PatchBlock>();
+}
+
+std::vector<std::byte> TerrainTessellation::Cook() const
+{
+	TerrainPackage::Writer writer;
+	writer.Write(m_length);
+	writer.Write(m_blocks);
+	return std::move(writer.GetBytes());
+}
+
+std::vector<int> TerrainTessellation::ComputeDensities(const Heightfield& heightfield, size_t workerCount)
+{
+	const int length = heightfield.GetLength();
+	const float* samples = heightfield.GetSamples().data();
+	std::vector<int> densities(static_cast<size_t>(length) * length);
+
+	// A neighbour clamped to the grid is the point itself or another of its neighbours, so clamping
+	// leaves every maximum as it was. Truncating the largest step gives the largest truncated step.
+	Parallel::ForRange(0, static_cast<size_t>(length), [&](size_t first, size_t last) {
+		for (int z = static_cast<int>(first); z < static_cast<int>(last); ++z) {
+			const float* rows[3]{ samples + static_cast<size_t>(std::max(z - 1, 0)) * length,
+				samples + static_cast<size_t>(z) * length, samples + static_cast<size_t>(std::min(z + 1, length - 1)) * length };
+			int* row = densities.data() + static_cast<size_t>(z) * length;
+			const auto point = [&](int x) {
+				const int columns[3]{ std::max(x - 1, 0), x, std::min(x + 1, length - 1) };
+				float step = 0.f;
+				for (const float* line : rows) {
+					for (int column : columns) step = std::max(step, std::abs(rows[1][x] - line[column]));
+				}
+				row[x] = static_cast<int>(step);
+			};
+
+			int x = 0;
+#ifdef TESSELLATION_USE_SSE2
+			// Four points whose neighbours all lie inside the row per pass.
+			if (length > 2) point(x++);
+			const __m128 signMask = _mm_set1_ps(-0.f);
+			for (; x + 4 < length; x += 4) {
+				const __m128 center = _mm_loadu_ps(rows[1] + x);
+				__m128 step = _mm_setzero_ps();
+				for (const float* line : rows) {
+					for (int dx = -1; dx <= 1; ++dx) {
+						step = _mm_max_ps(step, _mm_andnot_ps(signMask, _mm_sub_ps(center, _mm_loadu_ps(line + x + dx))));
+					}
+				}
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), _mm_cvttps_epi32(step));
+			}
+#endif
+			for (; x < length; ++x) point(x);
+		}
+		}, workerCount);
+	return densities;
+}
+
+std::vector<int> TerrainTessellation::ComputeDensitiesReference(const Heightfield& heightfield)
+{
+	const int length = heightfield.GetLength();
+	std::vector<int> densities(static_cast<size_t>(length) * length);
+	for (int z = 0; z < length; ++z) {
+		for (int x = 0; x < length; ++x) {
+			int density = 0;
+			for (int tz = std::max(z - 1, 0); tz <= std::min(z + 1, length - 1); ++tz) {
+				for (int tx = std::max(x - 1, 0); tx <= std::min(x + 1, length - 1); ++tx) {
+					density = std::max(density, static_cast<int>(std::abs(heightfield.GetSample(x, z) - heightfield.GetSample(tx, tz))));
+				}
+			}
+			densities[static_cast<size_t>(z) * length + x] = density;
+		}
+	}
+	return densities;
+}
+
+void TerrainTessellation::Compute(const XMFLOAT3& eye, float pixelsPerUnit, float pixelError,
+	std::span<const TerrainQuadtree::Range> ranges, PatchFactors* factors) const
+{
+#ifdef TESSELLATION_USE_SSE2
+	const float scale = pixelsPerUnit / pixelError;
+	const __m128 eyeX = _mm_set1_ps(eye.x), eyeY = _mm_set1_ps(eye.y), eyeZ = _mm_set1_ps(eye.z);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+	const __m128 minDistance = _mm_set1_ps(MinDistance), scales = _mm_set1_ps(scale);
+	for (const auto& range : ranges) {
+		const uint32_t last = range.first + range.count;
+		for (uint32_t first = range.first / 4 * 4; first < last; first += 4) {
+			const PatchBlock& block = m_blocks[first / 4];
+			__m128 bounds[BoundsPerPatch];
+			for (int bound = 0; bound < BoundsPerPatch; ++bound) {
+				const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(block.minX[bound]), eyeX), zero),
+					_mm_sub_ps(eyeX, _mm_load_ps(block.maxX[bound])));
+				const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(block.minY[bound]), eyeY), zero),
+					_mm_sub_ps(eyeY, _mm_load_ps(block.maxY[bound])));
+				const __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(block.minZ[bound]), eyeZ), zero),
+					_mm_sub_ps(eyeZ, _mm_load_ps(block.maxZ[bound])));
+				const __m128 distance = _mm_max_ps(_mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+					_mm_mul_ps(dz, dz))), minDistance);
+				const __m128 factor = _mm_sqrt_ps(_mm_div_ps(_mm_mul_ps(_mm_load_ps(block.curvature[bound]), scales), distance));
+				bounds[bound] = _mm_min_ps(_mm_max_ps(factor, one), _mm_load_ps(block.cap[bound]));
+			}
+
+			// Lane i of each edge becomes patch i's edges; only the range's patches are written.
+			_MM_TRANSPOSE4_PS(bounds[0], bounds[1], bounds[2], bounds[3]);
+			alignas(16) float inside[4];
+			_mm_store_ps(inside, bounds[4]);
+			for (uint32_t lane = 0; lane < 4; ++lane) {
+				const uint32_t patch = first + lane;
+				if (patch < range.first || patch >= last) continue;
+				_mm_storeu_ps(factors[patch].edges, bounds[lane]);
+				factors[patch].inside[0] = factors[patch].inside[1] = inside[lane];
+			}
+		}
+	}
+#else
+	ComputeReference(eye, pixelsPerUnit, pixelError, ranges, factors);
+#endif
+}
+
+void TerrainTessellation::ComputeReference(const XMFLOAT3& eye, float pixelsPerUnit, float pixelError,
+	std::span<const TerrainQuadtree::Range> ranges, PatchFactors* factors) const
+{
+	const float scale = pixelsPerUnit / pixelError;
+	for (const auto& range : ranges) {
+		for (uint32_t patch = range.first; patch < range.first + range.count; ++patch) {
+			const PatchBlock& block = m_blocks[patch / 4];
+			const uint32_t lane = patch % 4;
+			float values[BoundsPerPatch];
+			for (int bound = 0; bound < BoundsPerPatch; ++bound) {
+				values[bound] = GetFactor(eye, scale, block.minX[bound][lane], block.maxX[bound][lane],
+					block.minY[bound][lane], block.maxY[bound][lane], block.minZ[bound][lane], block.maxZ[bound][lane],
+					block.curvature[bound][lane], block.cap[bound][lane]);
+			}
+			std::copy(values, values + 4, factors[patch].edges);
+			factors[patch].inside[0] = factors[patch].inside[1] = values[4];
+		}
+	}
+}
+
+float TerrainTessellation::GetMaxFactor(int density)
+{
+	if (density == 0) return 1.f;
+	if (density <= 2) return 3.f;
+	if (density <= 5) return 10.f;
+	return MaxFactor;
+}
+
+// The same operations in the same order as Compute's lanes.
+float TerrainTessellation::GetFactor(const XMFLOAT3& eye, float scale, float minX, float maxX, float minY,
+	float maxY, float minZ, float maxZ, float curvature, float cap)
+{
+	const float dx = std::max(std::max(minX - eye.x, 0.f), eye.x - maxX);
+	const float dy = std::max(std::max(minY - eye.y, 0.f), eye.y - maxY);
+	const float dz = std::max(std::max(minZ - eye.z, 0.f), eye.z - maxZ);
+	const float distance = std::max(std::sqrt(dx * dx + dy * dy + dz * dz), MinDistance);
+	const float factor = std::sqrt(curvature * scale / distance);
+	return std::min(std::max(factor, 1.f), cap);
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <DirectXMath.h>
+#include "heightfield.h"
+#include "parallel.h"
+#include "terrainquadtree.h"
+
+// Tessellation factors for the patches of a Heightfield, from the screen-space error of the
+// tessellated surface. Tessellating a Bézier curve into segments 1/n long leaves it at most
+// max|B''| / 8n² away from its chords, and max|B''| is bounded by the second differences of the
+// control points, so every edge and patch interior keeps one such bound. Each frame a factor is
+// the n that projects that error to at most the allowed pixels from the nearest point of the
+// edge's or patch's bounds. An edge's factor depends only on the edge, so the two patches sharing
+// it always agree and the tessellation has no cracks.
+class TerrainTessellation
+{
+public:
+	static constexpr float MaxFactor = 64.f;
+
+	// The hull shader's factors, in SV_TessFactor order: the u = 0, v = 0, u = 1 and v = 1 edges.
+	// Control point row 0 lies at the patch's high z and column 0 at its low x, as the mesh builds them.
+	struct PatchFactors
+	{
+		float	edges[4];
+		float	inside[2];
+	};
+
+	// Patch i of the factors is patchOrder[i], as TerrainQuadtree::GetPatchOrder lays the mesh out.
+	// The densities and the patches' bounds are built on `workerCount` threads.
+	TerrainTessellation(const Heightfield& heightfield, std::span<const DirectX::XMUINT2> patchOrder,
+		size_t workerCount = Parallel::GetWorkerCount());
+	// The patches' bounds Cook wrote. Only Compute and ComputeReference work on such a
+	// tessellation; it keeps no densities.
+	explicit TerrainTessellation(std::span<const std::byte> cooked);
+
+	// The patches' bounds, for a terrain package.
+	std::vector<std::byte> Cook() const;
+
+	// Writes the factors of the patches in `ranges` for an eye at `eye` (the heightfield's space).
+	// `pixelsPerUnit` is the projected size of one unit at distance 1 and `pixelError` the largest
+	// error allowed, in pixels. Four patches per pass with SSE where available, one per lane; the
+	// results are bit-identical to ComputeReference's.
+	void Compute(const DirectX::XMFLOAT3& eye, float pixelsPerUnit, float pixelError,
+		std::span<const TerrainQuadtree::Range> ranges, PatchFactors* factors) const;
+
+	// The same one factor at a time, for checking Compute.
+	void ComputeReference(const DirectX::XMFLOAT3& eye, float pixelsPerUnit, float pixelError,
+		std::span<const TerrainQuadtree::Range> ranges, PatchFactors* factors) const;
+
+	// The largest step to any of the 8 neighbours of grid point (x, z), in whole units.
+	int GetDensity(int x, int z) const { return m_densities[static_cast<size_t>(z) * m_length + x]; }
+	const std::vector<int>& GetDensities() const { return m_densities; }
+
+	// Every grid point's density, row by row: four points per pass with SSE where available and
+	// rows split over `workerCount` threads. The results are identical to ComputeDensitiesReference's.
+	static std::vector<int> ComputeDensities(const Heightfield& heightfield, size_t workerCount = Parallel::GetWorkerCount());
+	// The same one point and one neighbour at a time, for checking ComputeDensities.
+	static std::vector<int> ComputeDensitiesReference(const Heightfield& heightfield);
+
+	// The factor cap for a patch or edge whose densest control point has `density`.
+	static float GetMaxFactor(int density);
+
+private:
+	static constexpr float MinDistance = 0.01f;
+	// A patch's four edges in PatchFactors order, then its interior.
+	static constexpr int BoundsPerPatch = 5;
+
+	// Bounds, error coefficient and factor cap of every edge and the interior of four consecutive
+	// patches, one patch per lane; lanes past the last patch are never written out.
+	struct alignas(16) PatchBlock
+	{
+		float	minX[BoundsPerPatch][4], maxX[BoundsPerPatch][4];
+		float	minY[BoundsPerPatch][4], maxY[BoundsPerPatch][4];
+		float	minZ[BoundsPerPatch][4], maxZ[BoundsPerPatch][4];
+		float	curvature[BoundsPerPatch][4];
+		float	cap[BoundsPerPatch][4];
+	};
+
+	static float GetFactor(const DirectX::XMFLOAT3& eye, float scale, float minX, float maxX, float minY, float maxY,
+		float minZ, float maxZ, float curvature, float cap);
+
+private:
+	std::vector<int>			m_densities;
+	std::vector<PatchBlock>		m_blocks;
+	int							m_length;
+};
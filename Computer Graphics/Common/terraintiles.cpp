@@ -0,0 +1,475 @@
+#include "terraintiles.h"
+#include "lz.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+using namespace TerrainTiling;
+
+uint32_t TerrainTiling::GetSampleBytes(SampleFormat format)
+{
+	return format == SampleFormat::Unorm16 ? 2 : 1;
+}
+
+uint64_t TerrainTiling::GetTileBytes(const FileHeader& header)
+{
+	const uint64_t side = GetTileSide(header);
+	return side * side * GetSampleBytes(static_cast<SampleFormat>(header.format));
+}
+
+uint64_t TerrainTiling::GetOverviewOffset(const FileHeader& header)
+{
+	return sizeof(FileHeader) + uint64_t{ header.tilesPerSide } * header.tilesPerSide * sizeof(TileEntry);
+}
+
+uint64_t TerrainTiling::GetOverviewBytes(const FileHeader& header)
+{
+	const uint64_t side = GetOverviewSide(header);
+	return side * side * GetSampleBytes(static_cast<SampleFormat>(header.format));
+}
+
+void TerrainTiling::Validate(const FileHeader& header)
+{
+	if (header.magic != FileMagic || header.version != 1) throw std::runtime_error{ "terrain tiles: not a tiled height map" };
+	if (header.format > static_cast<uint32_t>(SampleFormat::Unorm16)) throw std::runtime_error{ "terrain tiles: unknown sample format" };
+	if (header.tileCells == 0 || header.tileCells % Heightfield::PatchLength != 0 || header.tileCells > 4096 ||
+		header.overviewStep == 0 || header.tileCells % header.overviewStep != 0) {
+		throw std::runtime_error{ "terrain tiles: bad tile size" };
+	}
+	if (header.length == 0 || header.tilesPerSide == 0 || header.tilesPerSide > 4096 ||
+		uint64_t{ header.tilesPerSide } * header.tileCells + 1 < header.length) {
+		throw std::runtime_error{ "terrain tiles: the tiles do not cover the grid" };
+	}
+}
+
+void TerrainTiling::DecodeSamples(const FileHeader& header, std::span<const std::byte> samples, std::span<float> heights)
+{
+	if (static_cast<SampleFormat>(header.format) == SampleFormat::Unorm16) {
+		for (size_t i = 0; i < heights.size(); ++i) {
+			const uint16_t sample = static_cast<uint16_t>(std::to_integer<uint16_t>(samples[2 * i]) |
+				std::to_integer<uint16_t>(samples[2 * i + 1]) << 8);
+			heights[i] = header.heightOffset + static_cast<float>(sample) * header.heightScale;
+		}
+		return;
+	}
+	for (size_t i = 0; i < heights.size(); ++i) {
+		heights[i] = header.heightOffset + static_cast<float>(std::to_integer<uint8_t>(samples[i])) * header.heightScale;
+	}
+}
+
+namespace
+{
+	// Applies `combine` to every sample of a tile and the one it is coded against, in an order
+	// that visits each reference before it changes when decoding and after when encoding.
+	template <typename Sample, typename Combine>
+	void CodeDeltas(const FileHeader& header, std::span<std::byte> tile, bool decode, Combine combine)
+	{
+		const size_t side = GetTileSide(header);
+		const auto get = [&](size_t i) { Sample sample; std::memcpy(&sample, tile.data() + i * sizeof(Sample), sizeof(Sample)); return sample; };
+		const auto set = [&](size_t i, Sample sample) { std::memcpy(tile.data() + i * sizeof(Sample), &sample, sizeof(Sample)); };
+		for (size_t k = 1; k < side * side; ++k) {
+			const size_t i = decode ? k : side * side - k;
+			const size_t reference = i % side == 0 ? i - side : i - 1;
+			set(i, combine(get(i), get(reference)));
+		}
+	}
+}
+
+void TerrainTiling::DecodeDeltas(const FileHeader& header, std::span<std::byte> tile)
+{
+	// Little-endian samples, as every target this builds for stores them.
+	if (static_cast<SampleFormat>(header.format) == SampleFormat::Unorm16) {
+		CodeDeltas<uint16_t>(header, tile, true, [](uint16_t delta, uint16_t reference) { return static_cast<uint16_t>(delta + reference); });
+	}
+	else {
+		CodeDeltas<uint8_t>(header, tile, true, [](uint8_t delta, uint8_t reference) { return static_cast<uint8_t>(delta + reference); });
+	}
+}
+
+void TerrainTiling::EncodeDeltas(const FileHeader& header, std::span<std::byte> tile)
+{
+	if (static_cast<SampleFormat>(header.format) == SampleFormat::Unorm16) {
+		CodeDeltas<uint16_t>(header, tile, false, [](uint16_t sample, uint16_t reference) { return static_cast<uint16_t>(sample - reference); });
+	}
+	else {
+		CodeDeltas<uint8_t>(header, tile, false, [](uint8_t sample, uint8_t reference) { return static_cast<uint8_t>(sample - reference); });
+	}
+}
+
+std::vector<float> TerrainTiling::ReadHeights(std::span<const std::byte> file, FileHeader& header)
+{
+	if (file.size() < sizeof(FileHeader)) throw std::runtime_error{ "terrain tiles: file too small" };
+	std::memcpy(&header, file.data(), sizeof(FileHeader));
+	Validate(header);
+	if (file.size() < GetOverviewOffset(header)) throw std::runtime_error{ "terrain tiles: file too small" };
+
+	const uint32_t side = GetTileSide(header);
+	const size_t length = header.length;
+	std::vector<float> heights(length * length);
+	std::vector<std::byte> samples(GetTileBytes(header));
+	std::vector<float> tile(static_cast<size_t>(side) * side);
+	for (uint32_t tz = 0; tz < header.tilesPerSide; ++tz) {
+		for (uint32_t tx = 0; tx < header.tilesPerSide; ++tx) {
+			TileEntry entry;
+			std::memcpy(&entry, file.data() + sizeof(FileHeader) + (size_t{ tz } * header.tilesPerSide + tx) * sizeof(TileEntry), sizeof(TileEntry));
+			if (entry.offset > file.size() || entry.size > file.size() - entry.offset) throw std::runtime_error{ "terrain tiles: tile past the end of the file" };
+
+			const auto stored = file.subspan(static_cast<size_t>(entry.offset), entry.size);
+			if (entry.compressed) {
+				if (!Lz::Decompress(stored, samples)) throw std::runtime_error{ "terrain tiles: corrupt tile" };
+			}
+			else if (stored.size() == samples.size()) {
+				std::copy(stored.begin(), stored.end(), samples.begin());
+			}
+			else {
+				throw std::runtime_error{ "terrain tiles: bad tile size" };
+			}
+			DecodeDeltas(header, samples);
+			DecodeSamples(header, samples, tile);
+
+			for (uint32_t z = 0; z < side && tz * header.tileCells + z < length; ++z) {
+				for (uint32_t x = 0; x < side && tx * header.tileCells + x < length; ++x) {
+					heights[(tz * header.tileCells + z) * length + tx * header.tileCells + x] = tile[size_t{ z } * side + x];
+				}
+			}
+		}
+	}
+	return heights;
+}
+
+TerrainTileCache::TerrainTileCache(uint32_t tilesPerSide, uint32_t slotCount, uint32_t frameLoadBudget) :
+	m_tilesPerSide{ tilesPerSide }, m_frameLoadBudget{ frameLoadBudget }, m_frame{ 0 }, m_residentCount{ 0 },
+	m_loadingCount{ 0 }, m_lastX{ 0.f }, m_lastZ{ 0.f }, m_mostRecent{ NoSlot }, m_leastRecent{ NoSlot }
+{
+	if (tilesPerSide == 0 || tilesPerSide > 4096) throw std::invalid_argument{ "tile cache: bad tiles per side" };
+	if (slotCount == 0) throw std::invalid_argument{ "tile cache: bad slot count" };
+
+	m_slots.resize(slotCount);
+	m_freeSlots.reserve(slotCount);
+	for (uint32_t slot = slotCount; slot-- > 0;) m_freeSlots.push_back(slot);
+	m_tileSlots.assign(size_t{ tilesPerSide } * tilesPerSide, NoSlot);
+}
+
+std::vector<TerrainTileCache::Load> TerrainTileCache::Update(float x, float z, float radius)
+{
+	++m_frame;
+	++m_statistics.frames;
+
+	// Where the eye is heading at its current speed; a jump farther than the radius is a teleport
+	// and says nothing about where it goes next.
+	std::vector<std::pair<float, uint32_t>> wanted;
+	Want(x, z, radius, x, z, wanted);
+	const float dx = x - m_lastX, dz = z - m_lastZ;
+	if (m_frame > 1 && dx * dx + dz * dz <= radius * radius) {
+		Want(x + dx * LookAheadFrames, z + dz * LookAheadFrames, radius, x, z, wanted);
+	}
+	m_lastX = x;
+	m_lastZ = z;
+
+	// Nearest first, each tile once.
+	std::sort(wanted.begin(), wanted.end(), [](const auto& a, const auto& b) {
+		return std::make_pair(a.second, a.first) < std::make_pair(b.second, b.first); });
+	wanted.erase(std::unique(wanted.begin(), wanted.end(), [](const auto& a, const auto& b) {
+		return a.second == b.second; }), wanted.end());
+	std::sort(wanted.begin(), wanted.end());
+
+	// The nearest end up most recently used.
+	std::vector<uint32_t> missing;
+	for (auto it = wanted.rbegin(); it != wanted.rend(); ++it) {
+		++m_statistics.requests;
+		const uint32_t slot = m_tileSlots[it->second];
+		if (slot == NoSlot) {
+			missing.push_back(it->second);
+			continue;
+		}
+		if (!m_slots[slot].loading) ++m_statistics.hits;
+		m_slots[slot].lastUsed = m_frame;
+		Touch(slot);
+	}
+
+	std::vector<Load> loads;
+	for (auto it = missing.rbegin(); it != missing.rend(); ++it) {
+		if (loads.size() >= m_frameLoadBudget) break;
+		const uint32_t slot = AcquireSlot();
+		if (slot == NoSlot) break;
+
+		Slot& entry = m_slots[slot];
+		entry.tile = *it;
+		entry.loading = true;
+		entry.lastUsed = m_frame;
+		Touch(slot);
+		m_tileSlots[*it] = slot;
+		++m_loadingCount;
+		loads.push_back({ *it, slot });
+		++m_statistics.loads;
+	}
+	return loads;
+}
+
+void TerrainTileCache::CompleteLoad(uint32_t tile)
+{
+	if (tile >= m_tileSlots.size()) return;
+	const uint32_t slot = m_tileSlots[tile];
+	if (slot == NoSlot || !m_slots[slot].loading) return;
+
+	m_slots[slot].loading = false;
+	--m_loadingCount;
+	++m_residentCount;
+}
+
+bool TerrainTileCache::IsResident(uint32_t tile) const
+{
+	return GetResidentSlot(tile) != NoSlot;
+}
+
+uint32_t TerrainTileCache::GetResidentSlot(uint32_t tile) const
+{
+	if (tile >= m_tileSlots.size()) return NoSlot;
+	const uint32_t slot = m_tileSlots[tile];
+	return slot != NoSlot && !m_slots[slot].loading ? slot : NoSlot;
+}
+
+uint32_t TerrainTileCache::GetSlotTile(uint32_t slot) const
+{
+	if (slot >= m_slots.size() || m_slots[slot].loading) return NoSlot;
+	return m_slots[slot].tile;
+}
+
+void TerrainTileCache::Want(float x, float z, float radius, float eyeX, float eyeZ,
+	std::vector<std::pair<float, uint32_t>>& wanted) const
+{
+	const auto first = [&](float value) { return static_cast<int>(std::clamp(std::floor(value - radius), 0.f, static_cast<float>(m_tilesPerSide - 1))); };
+	const auto last = [&](float value) { return static_cast<int>(std::clamp(std::floor(value + radius), 0.f, static_cast<float>(m_tilesPerSide - 1))); };
+	// Squared distance from a point to tile (tx, tz).
+	const auto distance = [](float px, float pz, int tx, int tz) {
+		const float dx = std::max(std::max(static_cast<float>(tx) - px, 0.f), px - static_cast<float>(tx + 1));
+		const float dz = std::max(std::max(static_cast<float>(tz) - pz, 0.f), pz - static_cast<float>(tz + 1));
+		return dx * dx + dz * dz;
+	};
+	for (int tz = first(z); tz <= last(z); ++tz) {
+		for (int tx = first(x); tx <= last(x); ++tx) {
+			if (distance(x, z, tx, tz) > radius * radius) continue;
+			wanted.emplace_back(distance(eyeX, eyeZ, tx, tz), static_cast<uint32_t>(tz) * m_tilesPerSide + tx);
+		}
+	}
+}
+
+void TerrainTileCache::Touch(uint32_t slot)
+{
+	Unlink(slot);
+	Slot& entry = m_slots[slot];
+	entry.next = m_mostRecent;
+	if (m_mostRecent != NoSlot) m_slots[m_mostRecent].previous = slot;
+	m_mostRecent = slot;
+	if (m_leastRecent == NoSlot) m_leastRecent = slot;
+}
+
+void TerrainTileCache::Unlink(uint32_t slot)
+{
+	Slot& entry = m_slots[slot];
+	if (entry.previous != NoSlot) m_slots[entry.previous].next = entry.next;
+	else if (m_mostRecent == slot) m_mostRecent = entry.next;
+	if (entry.next != NoSlot) m_slots[entry.next].previous = entry.previous;
+	else if (m_leastRecent == slot) m_leastRecent = entry.previous;
+	entry.previous = entry.next = NoSlot;
+}
+
+uint32_t TerrainTileCache::AcquireSlot()
+{
+	if (!m_freeSlots.empty()) {
+		const uint32_t slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+		return slot;
+	}
+
+	// Walk from the least recently used; everything past a tile wanted this frame is wanted too.
+	for (uint32_t slot = m_leastRecent; slot != NoSlot; slot = m_slots[slot].previous) {
+		Slot& entry = m_slots[slot];
+		if (entry.lastUsed == m_frame) break;
+		if (entry.loading) continue;
+
+		m_tileSlots[entry.tile] = NoSlot;
+		Unlink(slot);
+		entry = Slot{};
+		--m_residentCount;
+		++m_statistics.evictions;
+		return slot;
+	}
+	return NoSlot;
+}
+
+TerrainTileStream::TerrainTileStream(IoQueue& queue, const std::filesystem::path& path, uint32_t slotCount, uint32_t frameLoadBudget) :
+	m_queue{ queue }, m_file{ queue.Open(path) }, m_header{ ReadHeader(queue, m_file) },
+	m_cache{ m_header.tilesPerSide, slotCount, frameLoadBudget }, m_half{ static_cast<float>(m_header.length / 2) },
+	m_bytesRead{ 0 }, m_bytesLoaded{ 0 }
+{
+	const uint64_t tableBytes = GetOverviewOffset(m_header) - sizeof(FileHeader);
+	if (m_queue.GetFileSize(m_file) < GetOverviewOffset(m_header) + GetOverviewBytes(m_header)) {
+		throw std::runtime_error{ "terrain tiles: file too small" };
+	}
+
+	std::vector<std::byte> data(tableBytes + GetOverviewBytes(m_header));
+	IoQueue::Request request;
+	request.file = m_file;
+	request.offset = sizeof(FileHeader);
+	request.size = data.size();
+	request.destination = data;
+	m_queue.Enqueue(request).get();
+
+	m_tiles.resize(size_t{ m_header.tilesPerSide } * m_header.tilesPerSide);
+	std::memcpy(m_tiles.data(), data.data(), tableBytes);
+	const uint64_t tileBytes = GetTileBytes(m_header);
+	for (const TileEntry& entry : m_tiles) {
+		if (entry.offset > m_queue.GetFileSize(m_file) || entry.size > m_queue.GetFileSize(m_file) - entry.offset ||
+			(!entry.compressed && entry.size != tileBytes)) {
+			throw std::runtime_error{ "terrain tiles: bad tile entry" };
+		}
+	}
+
+	const size_t overviewSide = GetOverviewSide(m_header);
+	m_overview.resize(overviewSide * overviewSide);
+	DecodeSamples(m_header, std::span{ data }.subspan(tableBytes), m_overview);
+	m_slots.resize(slotCount);
+}
+
+TerrainTileStream::~TerrainTileStream()
+{
+	// The reads write into the pending tiles' buffers.
+	for (auto& pending : m_pending) pending.ready.wait();
+}
+
+void TerrainTileStream::Update(float x, float z, float radius)
+{
+	for (size_t i = 0; i < m_pending.size();) {
+		if (m_pending[i].ready.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready) {
+			++i;
+			continue;
+		}
+		PendingTile pending = std::move(m_pending[i]);
+		m_pending.erase(m_pending.begin() + i);
+		Complete(pending);
+	}
+
+	const float scale = 1.f / static_cast<float>(m_header.tileCells);
+	const auto loads = m_cache.Update((x + m_half) * scale, (z + m_half) * scale, radius * scale);
+	for (size_t i = 0; i < loads.size(); ++i) {
+		const TileEntry& entry = m_tiles[loads[i].tile];
+		PendingTile pending{ loads[i].tile, loads[i].slot, std::vector<std::byte>(GetTileBytes(m_header)), {} };
+
+		// The cache hands the loads out nearest first.
+		IoQueue::Request request;
+		request.file = m_file;
+		request.offset = entry.offset;
+		request.size = entry.size;
+		request.destination = pending.samples;
+		request.compressed = entry.compressed != 0;
+		request.priority = static_cast<int>(loads.size() - i);
+		pending.ready = m_queue.Enqueue(request);
+		m_bytesRead += entry.size;
+		m_pending.push_back(std::move(pending));
+	}
+}
+
+void TerrainTileStream::WaitIdle()
+{
+	while (!m_pending.empty()) {
+		PendingTile pending = std::move(m_pending.back());
+		m_pending.pop_back();
+		pending.ready.wait();
+		Complete(pending);
+	}
+}
+
+void TerrainTileStream::Preload(float x, float z, float radius)
+{
+	// Each Update starts at most the frame's budget of loads; none started means all that fit are in.
+	for (uint64_t loads = m_cache.GetStatistics().loads;;) {
+		Update(x, z, radius);
+		WaitIdle();
+		if (m_cache.GetStatistics().loads == loads) break;
+		loads = m_cache.GetStatistics().loads;
+	}
+}
+
+float TerrainTileStream::GetHeight(float x, float z) const
+{
+	if (-m_half > x || m_half < x || -m_half > z || m_half < z) return 0.f;
+
+	// Grid position; subtracting whole tiles from it is exact, so the tile's patch sees the same
+	// u and v the whole grid's would.
+	const float fx = x + m_half, fz = z + m_half;
+	const uint32_t tile = FindTile(fx, fz);
+	const uint32_t slot = m_cache.GetResidentSlot(tile);
+	if (slot != TerrainTileCache::NoSlot) {
+		const float tileHalf = static_cast<float>(m_header.tileCells / 2);
+		const float originX = static_cast<float>(tile % m_header.tilesPerSide * m_header.tileCells);
+		const float originZ = static_cast<float>(tile / m_header.tilesPerSide * m_header.tileCells);
+		return m_slots[slot]->GetHeight(fx - originX - tileHalf, fz - originZ - tileHalf);
+	}
+	return GetOverviewHeight(fx, fz);
+}
+
+float TerrainTileStream::GetSample(uint32_t x, uint32_t z) const
+{
+	const float fx = static_cast<float>(x), fz = static_cast<float>(z);
+	const uint32_t tile = FindTile(fx, fz);
+	const uint32_t slot = m_cache.GetResidentSlot(tile);
+	if (slot == TerrainTileCache::NoSlot) return GetOverviewHeight(fx, fz);
+	return m_slots[slot]->GetSample(static_cast<int>(x - tile % m_header.tilesPerSide * m_header.tileCells),
+		static_cast<int>(z - tile / m_header.tilesPerSide * m_header.tileCells));
+}
+
+bool TerrainTileStream::IsResident(float x, float z) const
+{
+	if (-m_half > x || m_half < x || -m_half > z || m_half < z) return false;
+	return m_cache.IsResident(FindTile(x + m_half, z + m_half));
+}
+
+FileHeader TerrainTileStream::ReadHeader(IoQueue& queue, IoQueue::FileId file)
+{
+	if (queue.GetFileSize(file) < sizeof(FileHeader)) throw std::runtime_error{ "terrain tiles: file too small" };
+
+	FileHeader header;
+	IoQueue::Request request;
+	request.file = file;
+	request.size = sizeof(FileHeader);
+	request.destination = std::as_writable_bytes(std::span{ &header, 1 });
+	queue.Enqueue(request).get();
+	Validate(header);
+	return header;
+}
+
+uint32_t TerrainTileStream::FindTile(float fx, float fz) const
+{
+	// The far edge belongs to the last tile.
+	const uint32_t last = m_header.tilesPerSide - 1;
+	const uint32_t tx = std::min(static_cast<uint32_t>(fx) / m_header.tileCells, last);
+	const uint32_t tz = std::min(static_cast<uint32_t>(fz) / m_header.tileCells, last);
+	return tz * m_header.tilesPerSide + tx;
+}
+
+float TerrainTileStream::GetOverviewHeight(float fx, float fz) const
+{
+	const int side = static_cast<int>(GetOverviewSide(m_header));
+	const float ox = fx / static_cast<float>(m_header.overviewStep), oz = fz / static_cast<float>(m_header.overviewStep);
+	const int ix = std::min(static_cast<int>(ox), side - 2), iz = std::min(static_cast<int>(oz), side - 2);
+	const float u = ox - static_cast<float>(ix), v = oz - static_cast<float>(iz);
+	const float* row = m_overview.data() + static_cast<size_t>(iz) * side + ix;
+	return (1.f - v) * ((1.f - u) * row[0] + u * row[1]) + v * ((1.f - u) * row[side] + u * row[side + 1]);
+}
+
+void TerrainTileStream::Complete(PendingTile& pending)
+{
+	pending.ready.get();
+
+	const int side = static_cast<int>(GetTileSide(m_header));
+	std::vector<float> heights(static_cast<size_t>(side) * side);
+	DecodeDeltas(m_header, pending.samples);
+	DecodeSamples(m_header, pending.samples, heights);
+	m_slots[pending.slot] = std::make_unique<Heightfield>(std::move(heights), side);
+	m_cache.CompleteLoad(pending.tile);
+	m_bytesLoaded += pending.samples.size();
+}
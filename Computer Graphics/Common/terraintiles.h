@@ -0,0 +1,225 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+#include "heightfield.h"
+#include "ioqueue.h"
+
+// Layout shared by the exporter's tiler and the runtime. A tiled height map cuts the grid of a
+// Heightfield into square tiles of `tileCells` cells. Neighbouring tiles both store the samples of
+// their shared edge and tiles start on patch boundaries, so a tile evaluates the surface over it
+// on its own, exactly as the whole grid would, and tiles meet without seams. A tile stores each
+// sample as its difference from the one before it in the row, and the first of a row as its
+// difference from the first of the row above, wrapping around; smooth ground then repeats a few
+// small values and each tile is Lz-compressed when that is smaller. An overview holding every
+// `overviewStep`-th sample of the grid, as plain samples, stands in for tiles that are not loaded.
+namespace TerrainTiling
+{
+	constexpr uint32_t FileMagic = 0x454C4954; // "TILE"
+
+	enum class SampleFormat : uint32_t
+	{
+		Unorm8,
+		Unorm16,
+	};
+
+	// The tile table follows the header, tile by tile row by row, then the overview, then the tiles.
+	struct FileHeader
+	{
+		uint32_t	magic = FileMagic;
+		uint32_t	version = 1;
+		uint32_t	format = 0;			// SampleFormat.
+		uint32_t	length = 0;			// Samples per side of the grid; tiles past it repeat its last sample.
+		uint32_t	tileCells = 0;		// A multiple of Heightfield::PatchLength and of overviewStep.
+		uint32_t	tilesPerSide = 0;
+		uint32_t	overviewStep = 0;
+		float		heightOffset = 0.f;	// Sample s is the height heightOffset + s * heightScale.
+		float		heightScale = 1.f;
+	};
+
+	struct TileEntry
+	{
+		uint64_t	offset;
+		uint32_t	size;				// Bytes in the file.
+		uint32_t	compressed;			// An Lz stream of GetTileBytes bytes.
+	};
+
+	uint32_t GetSampleBytes(SampleFormat format);
+	// Samples per side of a tile and of the overview.
+	inline uint32_t GetTileSide(const FileHeader& header) { return header.tileCells + 1; }
+	inline uint32_t GetOverviewSide(const FileHeader& header) { return header.tilesPerSide * header.tileCells / header.overviewStep + 1; }
+	uint64_t GetTileBytes(const FileHeader& header);
+	uint64_t GetOverviewOffset(const FileHeader& header);
+	uint64_t GetOverviewBytes(const FileHeader& header);
+
+	// Throws unless the header describes a tiled height map this code reads.
+	void Validate(const FileHeader& header);
+
+	// Converts samples in the header's format to heights, one per entry of `heights`.
+	void DecodeSamples(const FileHeader& header, std::span<const std::byte> samples, std::span<float> heights);
+	// The samples of a tile from their differences, and back, in place.
+	void DecodeDeltas(const FileHeader& header, std::span<std::byte> tile);
+	void EncodeDeltas(const FileHeader& header, std::span<std::byte> tile);
+
+	// Every height of a whole tiled file in memory, `length` rows of `length`; for maps small
+	// enough to keep whole.
+	std::vector<float> ReadHeights(std::span<const std::byte> file, FileHeader& header);
+}
+
+// Decides which tiles of a tiled height map occupy a fixed set of slots, independent of how they
+// are read. Every frame wants the tiles within a radius of the eye and, at its current speed, of
+// where it will be LookAheadFrames later; Update starts loading the missing ones nearest first and
+// evicts the least recently wanted tiles to make room. Loads complete asynchronously; wanted and
+// loading tiles are never evicted, so when they fill the slots the farthest wait for a later frame.
+class TerrainTileCache
+{
+public:
+	static constexpr uint32_t NoSlot = 0xFFFFFFFF;
+	static constexpr float LookAheadFrames = 30.f;
+
+	struct Load
+	{
+		uint32_t	tile;				// z * tilesPerSide + x.
+		uint32_t	slot;
+	};
+
+	struct Statistics
+	{
+		uint64_t	frames = 0;
+		uint64_t	requests = 0;		// Wanted tiles, summed over frames.
+		uint64_t	hits = 0;			// Wanted tiles that were resident.
+		uint64_t	loads = 0;
+		uint64_t	evictions = 0;
+	};
+
+	// At most `frameLoadBudget` loads start per Update.
+	TerrainTileCache(uint32_t tilesPerSide, uint32_t slotCount, uint32_t frameLoadBudget);
+
+	// Ends the frame for an eye at (x, z), in tiles from the grid's low corner, wanting the tiles
+	// that come within `radius` tiles of it.
+	std::vector<Load> Update(float x, float z, float radius);
+
+	// The tile's samples are in its slot from now on.
+	void CompleteLoad(uint32_t tile);
+
+	bool IsResident(uint32_t tile) const;
+	// The slot of a resident tile, otherwise NoSlot.
+	uint32_t GetResidentSlot(uint32_t tile) const;
+	// The tile resident in `slot`, otherwise NoSlot.
+	uint32_t GetSlotTile(uint32_t slot) const;
+
+	uint32_t GetTilesPerSide() const { return m_tilesPerSide; }
+	uint32_t GetSlotCount() const { return static_cast<uint32_t>(m_slots.size()); }
+	uint32_t GetResidentCount() const { return m_residentCount; }
+	uint32_t GetLoadingCount() const { return m_loadingCount; }
+	const Statistics& GetStatistics() const { return m_statistics; }
+
+private:
+	struct Slot
+	{
+		uint32_t	tile = NoSlot;
+		uint32_t	previous = NoSlot;		// Towards the most recently used.
+		uint32_t	next = NoSlot;
+		uint64_t	lastUsed = 0;
+		bool		loading = false;
+	};
+
+	void Want(float x, float z, float radius, float eyeX, float eyeZ, std::vector<std::pair<float, uint32_t>>& wanted) const;
+	void Touch(uint32_t slot);
+	void Unlink(uint32_t slot);
+	uint32_t AcquireSlot();
+
+private:
+	uint32_t				m_tilesPerSide;
+	uint32_t				m_frameLoadBudget;
+	uint64_t				m_frame;
+	uint32_t				m_residentCount;
+	uint32_t				m_loadingCount;
+	float					m_lastX;
+	float					m_lastZ;
+
+	std::vector<Slot>		m_slots;
+	std::vector<uint32_t>	m_freeSlots;
+	uint32_t				m_mostRecent;
+	uint32_t				m_leastRecent;
+
+	std::vector<uint32_t>	m_tileSlots;	// By tile.
+	Statistics				m_statistics;
+};
+
+// Streams the tiles of a tiled height map file around an eye through an IoQueue, which reads and
+// decompresses them off the calling thread, and answers height queries from whatever is resident:
+// the surface of the tile under a point once it has arrived, the overview's bilinear heights
+// until then. Coordinates are Heightfield::GetHeight's, centred on the grid.
+class TerrainTileStream
+{
+public:
+	// The header, tile table and overview are read before the constructor returns; the queue must
+	// outlive the stream.
+	TerrainTileStream(IoQueue& queue, const std::filesystem::path& path, uint32_t slotCount, uint32_t frameLoadBudget);
+	~TerrainTileStream();
+
+	TerrainTileStream(const TerrainTileStream&) = delete;
+	TerrainTileStream& operator=(const TerrainTileStream&) = delete;
+
+	// Takes the tiles that finished reading, then starts reading the missing ones within `radius`
+	// units of (x, z). Rethrows the error of a failed read.
+	void Update(float x, float z, float radius);
+	// Waits for every read in flight and takes its tile.
+	void WaitIdle();
+	// Updates and waits until every tile within `radius` units of (x, z) that fits the slots is
+	// resident, for a start that should not see the overview.
+	void Preload(float x, float z, float radius);
+
+	// 0 outside the grid.
+	float GetHeight(float x, float z) const;
+	// Grid sample (x, z), counted from the grid's low corner, from the tile holding it when that
+	// is resident, otherwise the overview's bilinear height there.
+	float GetSample(uint32_t x, uint32_t z) const;
+	bool IsResident(float x, float z) const;
+	// The overview's bilinear height at grid position (fx, fz), counted from the grid's low corner.
+	float GetOverviewHeight(float fx, float fz) const;
+	// The samples of the tile resident in `slot` (see TerrainTileCache::GetSlotTile), centred on
+	// the tile; replaced when Update or WaitIdle takes another tile into the slot.
+	const Heightfield& GetSlot(uint32_t slot) const { return *m_slots[slot]; }
+
+	const TerrainTiling::FileHeader& GetHeader() const { return m_header; }
+	const TerrainTileCache& GetCache() const { return m_cache; }
+	// Bytes read from the file for tiles so far, and what they decompressed to.
+	uint64_t GetBytesRead() const { return m_bytesRead; }
+	uint64_t GetBytesLoaded() const { return m_bytesLoaded; }
+
+private:
+	struct PendingTile
+	{
+		uint32_t				tile;
+		uint32_t				slot;
+		std::vector<std::byte>	samples;
+		std::future<void>		ready;
+	};
+
+	static TerrainTiling::FileHeader ReadHeader(IoQueue& queue, IoQueue::FileId file);
+
+	// The tile holding grid position (fx, fz), which must lie on the grid.
+	uint32_t FindTile(float fx, float fz) const;
+	void Complete(PendingTile& pending);
+
+private:
+	IoQueue&									m_queue;
+	IoQueue::FileId								m_file;
+	TerrainTiling::FileHeader					m_header;
+	TerrainTileCache							m_cache;
+	std::vector<TerrainTiling::TileEntry>		m_tiles;
+	std::vector<float>							m_overview;
+	float										m_half;
+
+	std::vector<std::unique_ptr<Heightfield>>	m_slots;
+	std::vector<PendingTile>					m_pending;
+	uint64_t									m_bytesRead;
+	uint64_t									m_bytesLoaded;
+};
@@ -0,0 +1,1003 @@
+#include "bc.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <DirectXPackedVector.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BC_USE_SSE2
+#endif
+
+using namespace std;
+
+namespace
+{
+	constexpr int Weights4[16]{ 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+	constexpr float MaxHalf = 0x7BFF;	// Bits of the largest finite half; BC6H_UF16 works on half bits.
+
+	// One block in channel-major order, so SSE loads the same channel of four pixels at once.
+	struct alignas(16) Block
+	{
+		float channel[4][16];
+	};
+
+	Block LoadBlock(const uint8_t rgba[64])
+	{
+		Block block{};
+		for (int i = 0; i < 16; ++i) {
+			for (int c = 0; c < 4; ++c) block.channel[c][i] = rgba[i * 4 + c];
+		}
+		return block;
+	}
+
+	int GetPowerIterations(BcQuality quality)
+	{
+		return quality == BcQuality::Fast ? 0 : quality == BcQuality::Normal ? 4 : 8;
+	}
+
+	int GetRefineIterations(BcQuality quality)
+	{
+		return quality == BcQuality::Fast ? 0 : quality == BcQuality::Normal ? 1 : 3;
+	}
+
+	// Picks the nearest palette entry for each pixel over the first `channels` channels and returns
+	// the summed squared error of the pixels in `mask`. This is where encoding spends its time, so it
+	// runs on four pixels at once.
+	float FindIndices(const Block& block, const float palette[][4], int paletteSize, int channels, uint8_t indices[16],
+		uint16_t mask = 0xFFFF)
+	{
+#ifdef BC_USE_SSE2
+		__m128 total = _mm_setzero_ps();
+		for (int group = 0; group < 16; group += 4) {
+			__m128 pixel[4];
+			for (int c = 0; c < channels; ++c) pixel[c] = _mm_load_ps(&block.channel[c][group]);
+
+			__m128 best = _mm_set1_ps(FLT_MAX);
+			__m128i bestIndex = _mm_setzero_si128();
+			for (int k = 0; k < paletteSize; ++k) {
+				__m128 error = _mm_setzero_ps();
+				for (int c = 0; c < channels; ++c) {
+					const __m128 difference = _mm_sub_ps(pixel[c], _mm_set1_ps(palette[k][c]));
+					error = _mm_add_ps(error, _mm_mul_ps(difference, difference));
+				}
+				const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, best));
+				best = _mm_min_ps(error, best);
+				bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)), _mm_andnot_si128(closer, bestIndex));
+			}
+			const __m128i bit = _mm_set_epi32(8, 4, 2, 1);
+			const __m128i selected = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask >> group), bit), bit);
+			total = _mm_add_ps(total, _mm_and_ps(best, _mm_castsi128_ps(selected)));
+
+			alignas(16) int32_t lanes[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(lanes), bestIndex);
+			for (int i = 0; i < 4; ++i) indices[group + i] = static_cast<uint8_t>(lanes[i]);
+		}
+		alignas(16) float sums[4];
+		_mm_store_ps(sums, total);
+		return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+		float total = 0.0f;
+		for (int i = 0; i < 16; ++i) {
+			float best = FLT_MAX;
+			for (int k = 0; k < paletteSize; ++k) {
+				float error = 0.0f;
+				for (int c = 0; c < channels; ++c) {
+					const float difference = block.channel[c][i] - palette[k][c];
+					error += difference * difference;
+				}
+				if (error < best) {
+					best = error;
+					indices[i] = static_cast<uint8_t>(k);
+				}
+			}
+			if ((mask >> i) & 1) total += best;
+		}
+		return total;
+#endif
+	}
+
+	// Endpoints at the extent of the pixels in `mask` along the principal axis, which power
+	// iterations on the channel covariance refine from the bounding box diagonal.
+	void FitEndpoints(const Block& block, int channels, int iterations, float endpoints[2][4], uint16_t mask = 0xFFFF)
+	{
+		float mean[4]{}, low[4], high[4];
+		const int count = popcount(mask);
+		for (int c = 0; c < channels; ++c) {
+			low[c] = FLT_MAX;
+			high[c] = -FLT_MAX;
+			for (int i = 0; i < 16; ++i) {
+				if (!((mask >> i) & 1)) continue;
+				mean[c] += block.channel[c][i];
+				low[c] = min(low[c], block.channel[c][i]);
+				high[c] = max(high[c], block.channel[c][i]);
+			}
+			mean[c] /= static_cast<float>(max(count, 1));
+		}
+
+		float covariance[4][4]{};
+		for (int i = 0; i < 16; ++i) {
+			if (!((mask >> i) & 1)) continue;
+			for (int a = 0; a < channels; ++a) {
+				for (int b = 0; b < channels; ++b) {
+					covariance[a][b] += (block.channel[a][i] - mean[a]) * (block.channel[b][i] - mean[b]);
+				}
+			}
+		}
+
+		// The diagonal runs from low to high in every channel; flip the channels that correlate
+		// negatively with the dominant one so the box axis points along the data.
+		float axis[4]{};
+		int dominant = 0;
+		for (int c = 0; c < channels; ++c) {
+			axis[c] = high[c] - low[c];
+			if (covariance[c][c] > covariance[dominant][dominant]) dominant = c;
+		}
+		for (int c = 0; c < channels; ++c) {
+			if (covariance[dominant][c] < 0.0f) axis[c] = -axis[c];
+		}
+
+		for (int iteration = 0; iteration < iterations; ++iteration) {
+			float next[4]{}, largest = 0.0f;
+			for (int a = 0; a < channels; ++a) {
+				for (int b = 0; b < channels; ++b) next[a] += covariance[a][b] * axis[b];
+				largest = max(largest, fabs(next[a]));
+			}
+			if (largest == 0.0f) break;
+			for (int c = 0; c < channels; ++c) axis[c] = next[c] / largest;
+		}
+
+		float length = 0.0f;
+		for (int c = 0; c < channels; ++c) length += axis[c] * axis[c];
+		float first = 0.0f, last = 0.0f;
+		if (length > 1e-8f) {
+			first = FLT_MAX;
+			last = -FLT_MAX;
+			for (int i = 0; i < 16; ++i) {
+				if (!((mask >> i) & 1)) continue;
+				float t = 0.0f;
+				for (int c = 0; c < channels; ++c) t += (block.channel[c][i] - mean[c]) * axis[c];
+				first = min(first, t);
+				last = max(last, t);
+			}
+			first /= length;
+			last /= length;
+		}
+		for (int c = 0; c < channels; ++c) {
+			endpoints[0][c] = mean[c] + first * axis[c];
+			endpoints[1][c] = mean[c] + last * axis[c];
+		}
+	}
+
+	// Least-squares endpoints for fixed indices, where weights[i] places pixel i between the endpoints.
+	bool RefineEndpoints(const Block& block, int channels, const float weights[16], float limit, float endpoints[2][4],
+		uint16_t mask = 0xFFFF)
+	{
+		float a = 0.0f, b = 0.0f, c = 0.0f, first[4]{}, second[4]{};
+		for (int i = 0; i < 16; ++i) {
+			if (!((mask >> i) & 1)) continue;
+			const float w = weights[i], v = 1.0f - w;
+			a += v * v;
+			b += v * w;
+			c += w * w;
+			for (int k = 0; k < channels; ++k) {
+				first[k] += v * block.channel[k][i];
+				second[k] += w * block.channel[k][i];
+			}
+		}
+		const float determinant = a * c - b * b;
+		if (fabs(determinant) < 1e-6f) return false;
+		for (int k = 0; k < channels; ++k) {
+			endpoints[0][k] = clamp((c * first[k] - b * second[k]) / determinant, 0.0f, limit);
+			endpoints[1][k] = clamp((a * second[k] - b * first[k]) / determinant, 0.0f, limit);
+		}
+		return true;
+	}
+
+	// Blocks are little-endian bit streams starting at bit 0 of byte 0.
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(uint8_t* data, size_t size) : m_data{ data }, m_position{ 0 } { memset(data, 0, size); }
+
+		void Write(uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; ++i, ++m_position) {
+				if ((value >> i) & 1) m_data[m_position >> 3] |= static_cast<uint8_t>(1 << (m_position & 7));
+			}
+		}
+
+	private:
+		uint8_t*	m_data;
+		size_t		m_position;
+	};
+
+	class BitReader
+	{
+	public:
+		explicit BitReader(const uint8_t* data) : m_data{ data }, m_position{ 0 } {}
+
+		uint32_t Read(int bits)
+		{
+			uint32_t value = 0;
+			for (int i = 0; i < bits; ++i, ++m_position) {
+				value |= static_cast<uint32_t>((m_data[m_position >> 3] >> (m_position & 7)) & 1) << i;
+			}
+			return value;
+		}
+
+	private:
+		const uint8_t*	m_data;
+		size_t			m_position;
+	};
+
+	// BC1 color ---------------------------------------------------------------------------------
+
+	uint16_t Pack565(const float color[4])
+	{
+		const auto quantize = [](float value, int maximum) {
+			return static_cast<uint16_t>(clamp(static_cast<int>(lround(value * maximum / 255.0f)), 0, maximum));
+			};
+		return static_cast<uint16_t>(quantize(color[0], 31) << 11 | quantize(color[1], 63) << 5 | quantize(color[2], 31));
+	}
+
+	void Unpack565(uint16_t packed, int color[3])
+	{
+		const int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = r << 3 | r >> 2;
+		color[1] = g << 2 | g >> 4;
+		color[2] = b << 3 | b >> 2;
+	}
+
+	// BC2 and BC3 always interpolate four colors; BC1 only when c0 > c1, otherwise the fourth is transparent.
+	void GetColorPalette(uint16_t c0, uint16_t c1, bool fourColors, float palette[4][4])
+	{
+		int p0[3], p1[3];
+		Unpack565(c0, p0);
+		Unpack565(c1, p1);
+		for (int c = 0; c < 3; ++c) {
+			palette[0][c] = static_cast<float>(p0[c]);
+			palette[1][c] = static_cast<float>(p1[c]);
+			if (fourColors || c0 > c1) {
+				palette[2][c] = static_cast<float>((2 * p0[c] + p1[c]) / 3);
+				palette[3][c] = static_cast<float>((p0[c] + 2 * p1[c]) / 3);
+			}
+			else {
+				palette[2][c] = static_cast<float>((p0[c] + p1[c]) / 2);
+				palette[3][c] = 0.0f;
+			}
+		}
+		palette[0][3] = palette[1][3] = palette[2][3] = 255.0f;
+		palette[3][3] = (fourColors || c0 > c1) ? 255.0f : 0.0f;
+	}
+
+	void EncodeColor(const Block& block, BcQuality quality, uint8_t out[8])
+	{
+		static constexpr float weights[4]{ 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+		float endpoints[2][4]{};
+		FitEndpoints(block, 3, GetPowerIterations(quality), endpoints);
+
+		uint16_t best0 = 0, best1 = 0;
+		uint8_t bestIndices[16]{};
+		float bestError = FLT_MAX;
+		for (int pass = 0; pass <= GetRefineIterations(quality); ++pass) {
+			// c0 > c1 keeps BC1 in its four-color mode.
+			uint16_t c0 = Pack565(endpoints[0]), c1 = Pack565(endpoints[1]);
+			if (c0 < c1) swap(c0, c1);
+
+			float palette[4][4];
+			GetColorPalette(c0, c1, true, palette);
+			uint8_t indices[16];
+			const float error = FindIndices(block, palette, 4, 3, indices);
+			if (error < bestError) {
+				bestError = error;
+				best0 = c0;
+				best1 = c1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+			if (c0 == c1) break;
+
+			float pixelWeights[16];
+			for (int i = 0; i < 16; ++i) pixelWeights[i] = weights[indices[i]];
+			if (!RefineEndpoints(block, 3, pixelWeights, 255.0f, endpoints)) break;
+		}
+
+		BitWriter writer{ out, 8 };
+		writer.Write(best0, 16);
+		writer.Write(best1, 16);
+		for (int i = 0; i < 16; ++i) writer.Write(bestIndices[i], 2);
+	}
+
+	void DecodeColor(const uint8_t block[8], bool fourColors, uint8_t rgba[64])
+	{
+		BitReader reader{ block };
+		const auto c0 = static_cast<uint16_t>(reader.Read(16));
+		const auto c1 = static_cast<uint16_t>(reader.Read(16));
+		float palette[4][4];
+		GetColorPalette(c0, c1, fourColors, palette);
+		for (int i = 0; i < 16; ++i) {
+			const uint32_t index = reader.Read(2);
+			for (int c = 0; c < 4; ++c) rgba[i * 4 + c] = static_cast<uint8_t>(palette[index][c]);
+		}
+	}
+
+	// BC4 channel (also BC3 alpha and both BC5 channels) ----------------------------------------
+
+	// e0 > e1 interpolates six values between them, otherwise four plus exact 0 and 255.
+	void GetChannelPalette(int e0, int e1, float palette[8][4])
+	{
+		palette[0][0] = static_cast<float>(e0);
+		palette[1][0] = static_cast<float>(e1);
+		if (e0 > e1) {
+			for (int i = 2; i < 8; ++i) palette[i][0] = ((8 - i) * e0 + (i - 1) * e1) / 7.0f;
+		}
+		else {
+			for (int i = 2; i < 6; ++i) palette[i][0] = ((6 - i) * e0 + (i - 1) * e1) / 5.0f;
+			palette[6][0] = 0.0f;
+			palette[7][0] = 255.0f;
+		}
+	}
+
+	void EncodeChannel(const Block& source, int channel, BcQuality quality, uint8_t out[8])
+	{
+		Block block{};
+		memcpy(block.channel[0], source.channel[channel], sizeof(block.channel[0]));
+
+		int low = 255, high = 0, innerLow = 255, innerHigh = 0;
+		for (int i = 0; i < 16; ++i) {
+			const int value = static_cast<int>(block.channel[0][i]);
+			low = min(low, value);
+			high = max(high, value);
+			if (value != 0 && value != 255) {
+				innerLow = min(innerLow, value);
+				innerHigh = max(innerHigh, value);
+			}
+		}
+
+		int best0 = high, best1 = low;
+		uint8_t bestIndices[16]{};
+		float bestError = FLT_MAX;
+		const auto tryEndpoints = [&](int e0, int e1) {
+			float palette[8][4];
+			GetChannelPalette(e0, e1, palette);
+			uint8_t indices[16];
+			const float error = FindIndices(block, palette, 8, 1, indices);
+			if (error < bestError) {
+				bestError = error;
+				best0 = e0;
+				best1 = e1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+			};
+
+		tryEndpoints(high, low);
+		if (quality != BcQuality::Fast && innerLow <= innerHigh && (low == 0 || high == 255)) {
+			tryEndpoints(innerLow, innerHigh);
+		}
+		if (quality == BcQuality::High && high - low > 2) {
+			// Pulling the endpoints in spends the interpolated values where most pixels are.
+			for (int inset0 = 0; inset0 < 4; ++inset0) {
+				for (int inset1 = 0; inset1 < 4; ++inset1) {
+					if (high - inset0 > low + inset1) tryEndpoints(high - inset0, low + inset1);
+				}
+			}
+		}
+
+		BitWriter writer{ out, 8 };
+		writer.Write(static_cast<uint32_t>(best0), 8);
+		writer.Write(static_cast<uint32_t>(best1), 8);
+		for (int i = 0; i < 16; ++i) writer.Write(bestIndices[i], 3);
+	}
+
+	void DecodeChannel(const uint8_t block[8], uint8_t rgba[64], int channel)
+	{
+		BitReader reader{ block };
+		const int e0 = static_cast<int>(reader.Read(8));
+		const int e1 = static_cast<int>(reader.Read(8));
+		float palette[8][4];
+		GetChannelPalette(e0, e1, palette);
+		for (int i = 0; i < 16; ++i) {
+			rgba[i * 4 + channel] = static_cast<uint8_t>(lround(palette[reader.Read(3)][0]));
+		}
+	}
+
+	// BC7 ---------------------------------------------------------------------------------------
+
+	constexpr int Weights2[4]{ 0, 21, 43, 64 };
+	constexpr int Weights3[8]{ 0, 9, 18, 27, 37, 46, 55, 64 };
+
+	// Bit i is set where pixel i belongs to the second subset of a two-subset partition.
+	constexpr uint16_t Partitions2[64]{
+		0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80, 0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+		0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE, 0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+		0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A, 0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+		0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C, 0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22,
+	};
+
+	// The second subset's anchor pixel, whose index is stored with one bit less like pixel 0's.
+	constexpr uint8_t Anchors2[64]{
+		15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+		15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+		15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+		6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+	};
+
+	enum class PBits
+	{
+		None,
+		Shared,			// One per subset.
+		PerEndpoint,
+	};
+
+	struct BC7Mode
+	{
+		int		subsets;
+		int		partitionBits;
+		int		rotationBits;
+		int		indexModeBits;
+		int		colorBits;
+		int		alphaBits;		// 0 for opaque modes, whose alpha is 255.
+		PBits	pbits;
+		int		indexBits;
+		int		alphaIndexBits;	// Nonzero when alpha has indices of its own.
+	};
+
+	// The three-subset modes 0 and 2 and mode 7 are neither written nor read.
+	constexpr BC7Mode BC7Modes[8]{
+		{ 3, 4, 0, 0, 4, 0, PBits::PerEndpoint, 3, 0 },
+		{ 2, 6, 0, 0, 6, 0, PBits::Shared, 3, 0 },
+		{ 3, 6, 0, 0, 5, 0, PBits::None, 2, 0 },
+		{ 2, 6, 0, 0, 7, 0, PBits::PerEndpoint, 2, 0 },
+		{ 1, 0, 2, 1, 5, 6, PBits::None, 2, 3 },
+		{ 1, 0, 2, 0, 7, 8, PBits::None, 2, 2 },
+		{ 1, 0, 0, 0, 7, 7, PBits::PerEndpoint, 4, 0 },
+		{ 2, 6, 0, 0, 5, 5, PBits::PerEndpoint, 2, 0 },
+	};
+
+	// Channel values without their p-bit, which is 0 in modes without one.
+	struct BC7Endpoint
+	{
+		int		value[4];
+		int		pbit;
+	};
+
+	struct BC7Block
+	{
+		int				mode = 6;
+		int				partition = 0;
+		int				rotation = 0;		// Swaps alpha with red, green or blue after decoding.
+		int				indexMode = 0;		// Mode 4: color takes the 3-bit indices and alpha the 2-bit ones.
+		BC7Endpoint		endpoints[4]{};		// Two per subset; modes 4 and 5 keep alpha in value[3].
+		uint8_t			indices[16]{};
+		uint8_t			alphaIndices[16]{};
+		float			error = FLT_MAX;
+	};
+
+	const int* GetBC7Weights(int indexBits)
+	{
+		return indexBits == 2 ? Weights2 : indexBits == 3 ? Weights3 : Weights4;
+	}
+
+	uint16_t GetSubsetMask(int subsets, int partition, int subset)
+	{
+		if (subsets == 1) return 0xFFFF;
+		return static_cast<uint16_t>(subset == 1 ? Partitions2[partition] : ~Partitions2[partition]);
+	}
+
+	bool IsAnchor(int subsets, int partition, int pixel)
+	{
+		return pixel == 0 || (subsets == 2 && pixel == Anchors2[partition]);
+	}
+
+	// Widens `bits` bits (with the p-bit as the lowest) to 8 by repeating the top bits.
+	int ExpandBC7(int value, int bits)
+	{
+		return value << (8 - bits) | value >> (2 * bits - 8);
+	}
+
+	int GetBC7Value(int value, int bits, int pbit, bool hasPBit)
+	{
+		return hasPBit ? ExpandBC7(value << 1 | pbit, bits + 1) : ExpandBC7(value, bits);
+	}
+
+	// The `bits`-bit value that expands closest to `target` with the given p-bit.
+	int QuantizeBC7(float target, int bits, int pbit, bool hasPBit)
+	{
+		const int maximum = (1 << bits) - 1;
+		const int guess = clamp(static_cast<int>(lround(target * maximum / 255.0f)), 0, maximum);
+		int best = guess;
+		for (int candidate = max(guess - 1, 0); candidate <= min(guess + 1, maximum); ++candidate) {
+			if (fabs(GetBC7Value(candidate, bits, pbit, hasPBit) - target) < fabs(GetBC7Value(best, bits, pbit, hasPBit) - target)) {
+				best = candidate;
+			}
+		}
+		return best;
+	}
+
+	float QuantizeBC7(const float endpoint[4], int channels, const int bits[4], int pbit, bool hasPBit, BC7Endpoint& quantized)
+	{
+		quantized.pbit = pbit;
+		float error = 0.0f;
+		for (int c = 0; c < channels; ++c) {
+			quantized.value[c] = QuantizeBC7(endpoint[c], bits[c], pbit, hasPBit);
+			const float difference = endpoint[c] - static_cast<float>(GetBC7Value(quantized.value[c], bits[c], pbit, hasPBit));
+			error += difference * difference;
+		}
+		return error;
+	}
+
+	void GetBC7Palette(const BC7Endpoint& e0, const BC7Endpoint& e1, int channels, const int bits[4], bool hasPBit,
+		int indexBits, float palette[16][4])
+	{
+		const int* weights = GetBC7Weights(indexBits);
+		for (int c = 0; c < channels; ++c) {
+			const int v0 = GetBC7Value(e0.value[c], bits[c], e0.pbit, hasPBit);
+			const int v1 = GetBC7Value(e1.value[c], bits[c], e1.pbit, hasPBit);
+			for (int i = 0; i < 1 << indexBits; ++i) {
+				palette[i][c] = static_cast<float>(((64 - weights[i]) * v0 + weights[i] * v1 + 32) >> 6);
+			}
+		}
+	}
+
+	// Fits one subset's endpoints to the first `channels` channels of the pixels in `mask` and picks
+	// their indices, which are written for every pixel. Returns the squared error of the subset.
+	float FitBC7Subset(const Block& block, int channels, const int bits[4], PBits pbits, int indexBits, uint16_t mask,
+		BcQuality quality, BC7Endpoint endpoints[2], uint8_t indices[16])
+	{
+		float fitted[2][4]{};
+		FitEndpoints(block, channels, GetPowerIterations(quality), fitted, mask);
+
+		const bool hasPBit = pbits != PBits::None;
+		const int* weights = GetBC7Weights(indexBits);
+		float bestError = FLT_MAX;
+		for (int pass = 0; pass <= GetRefineIterations(quality); ++pass) {
+			// High tries every p-bit choice, the others take the one that quantizes the endpoints best.
+			int choices[4][2]{};
+			int choiceCount = 1;
+			if (pbits != PBits::None && quality == BcQuality::High) {
+				choiceCount = pbits == PBits::Shared ? 2 : 4;
+				for (int choice = 0; choice < choiceCount; ++choice) {
+					choices[choice][0] = choice & 1;
+					choices[choice][1] = pbits == PBits::Shared ? choice : choice >> 1;
+				}
+			}
+			else if (pbits != PBits::None) {
+				BC7Endpoint scratch;
+				float errors[2][2];
+				for (int e = 0; e < 2; ++e) {
+					for (int pbit = 0; pbit < 2; ++pbit) errors[e][pbit] = QuantizeBC7(fitted[e], channels, bits, pbit, true, scratch);
+				}
+				if (pbits == PBits::Shared) {
+					choices[0][0] = choices[0][1] = errors[0][1] + errors[1][1] < errors[0][0] + errors[1][0] ? 1 : 0;
+				}
+				else {
+					choices[0][0] = errors[0][1] < errors[0][0] ? 1 : 0;
+					choices[0][1] = errors[1][1] < errors[1][0] ? 1 : 0;
+				}
+			}
+
+			for (int choice = 0; choice < choiceCount; ++choice) {
+				BC7Endpoint e0{}, e1{};
+				QuantizeBC7(fitted[0], channels, bits, choices[choice][0], hasPBit, e0);
+				QuantizeBC7(fitted[1], channels, bits, choices[choice][1], hasPBit, e1);
+
+				float palette[16][4];
+				GetBC7Palette(e0, e1, channels, bits, hasPBit, indexBits, palette);
+				uint8_t candidate[16];
+				const float error = FindIndices(block, palette, 1 << indexBits, channels, candidate, mask);
+				if (error < bestError) {
+					bestError = error;
+					endpoints[0] = e0;
+					endpoints[1] = e1;
+					memcpy(indices, candidate, sizeof(candidate));
+				}
+			}
+
+			float pixelWeights[16];
+			for (int i = 0; i < 16; ++i) pixelWeights[i] = weights[indices[i]] / 64.0f;
+			if (!RefineEndpoints(block, channels, pixelWeights, 255.0f, fitted, mask)) break;
+		}
+		return bestError;
+	}
+
+	// Modes 1, 3 and 6: every subset's color and alpha share one set of indices.
+	BC7Block EncodeBC7Subsets(const Block& pixels, int mode, int partition, BcQuality quality)
+	{
+		const BC7Mode& format = BC7Modes[mode];
+		const int channels = format.alphaBits > 0 ? 4 : 3;
+		const int bits[4]{ format.colorBits, format.colorBits, format.colorBits, format.alphaBits };
+
+		BC7Block result;
+		result.mode = mode;
+		result.partition = partition;
+		result.error = 0.0f;
+		for (int subset = 0; subset < format.subsets; ++subset) {
+			const uint16_t mask = GetSubsetMask(format.subsets, partition, subset);
+			uint8_t indices[16];
+			result.error += FitBC7Subset(pixels, channels, bits, format.pbits, format.indexBits, mask, quality,
+				result.endpoints + subset * 2, indices);
+			for (int i = 0; i < 16; ++i) {
+				if ((mask >> i) & 1) result.indices[i] = indices[i];
+			}
+		}
+		if (channels == 3) {
+			for (int i = 0; i < 16; ++i) {
+				const float difference = pixels.channel[3][i] - 255.0f;
+				result.error += difference * difference;
+			}
+		}
+		return result;
+	}
+
+	// Modes 4 and 5: color and alpha, after swapping alpha into the rotated channel, have endpoints
+	// and indices of their own.
+	BC7Block EncodeBC7SeparateAlpha(const Block& source, int mode, int rotation, int indexMode, BcQuality quality)
+	{
+		const BC7Mode& format = BC7Modes[mode];
+		Block color = source;
+		if (rotation > 0) swap(color.channel[3], color.channel[rotation - 1]);
+		Block alpha{};
+		memcpy(alpha.channel[0], color.channel[3], sizeof(alpha.channel[0]));
+
+		BC7Block result;
+		result.mode = mode;
+		result.rotation = rotation;
+		result.indexMode = indexMode;
+		const int colorBits[4]{ format.colorBits, format.colorBits, format.colorBits, 0 }, alphaBits[4]{ format.alphaBits };
+		const int colorIndexBits = indexMode ? format.alphaIndexBits : format.indexBits;
+		const int alphaIndexBits = indexMode ? format.indexBits : format.alphaIndexBits;
+
+		BC7Endpoint colorEndpoints[2], alphaEndpoints[2];
+		result.error = FitBC7Subset(color, 3, colorBits, PBits::None, colorIndexBits, 0xFFFF, quality, colorEndpoints, result.indices);
+		result.error += FitBC7Subset(alpha, 1, alphaBits, PBits::None, alphaIndexBits, 0xFFFF, quality, alphaEndpoints, result.alphaIndices);
+		for (int e = 0; e < 2; ++e) {
+			result.endpoints[e] = colorEndpoints[e];
+			result.endpoints[e].value[3] = alphaEndpoints[e].value[0];
+		}
+		return result;
+	}
+
+	// Partitions ranked by how well unquantized lines through each subset fit the color.
+	vector<int> RankPartitions(const Block& pixels, int count)
+	{
+		vector<pair<float, int>> scores;
+		for (int partition = 0; partition < 64; ++partition) {
+			float error = 0.0f;
+			for (int subset = 0; subset < 2; ++subset) {
+				const uint16_t mask = GetSubsetMask(2, partition, subset);
+				float endpoints[2][4]{};
+				FitEndpoints(pixels, 3, 1, endpoints, mask);
+				float palette[8][4];
+				for (int i = 0; i < 8; ++i) {
+					for (int c = 0; c < 3; ++c) palette[i][c] = endpoints[0][c] + (endpoints[1][c] - endpoints[0][c]) * Weights3[i] / 64.0f;
+				}
+				uint8_t indices[16];
+				error += FindIndices(pixels, palette, 8, 3, indices, mask);
+			}
+			scores.emplace_back(error, partition);
+		}
+		partial_sort(scores.begin(), scores.begin() + count, scores.end());
+
+		vector<int> partitions;
+		for (int i = 0; i < count; ++i) partitions.push_back(scores[i].second);
+		return partitions;
+	}
+
+	// BC6H mode 11 ------------------------------------------------------------------------------
+
+	int UnquantizeBC6H(int value)
+	{
+		if (value == 0) return 0;
+		if (value == 1023) return 0xFFFF;
+		return ((value << 16) + 0x8000) >> 10;
+	}
+
+	int FinishBC6H(int unquantized)
+	{
+		return (unquantized * 31) >> 6;
+	}
+
+	// Picks the 10-bit endpoint whose unquantized, finished value lands closest to the half bits.
+	int QuantizeBC6H(float half)
+	{
+		const int low = clamp(static_cast<int>(half * 64.0f / 31.0f) >> 6, 0, 1023);
+		int best = low;
+		for (int candidate = max(low - 1, 0); candidate <= min(low + 1, 1023); ++candidate) {
+			if (fabs(FinishBC6H(UnquantizeBC6H(candidate)) - half) < fabs(FinishBC6H(UnquantizeBC6H(best)) - half)) {
+				best = candidate;
+			}
+		}
+		return best;
+	}
+
+	void GetBC6HPalette(const int q0[3], const int q1[3], float palette[16][4])
+	{
+		for (int c = 0; c < 3; ++c) {
+			const int e0 = UnquantizeBC6H(q0[c]), e1 = UnquantizeBC6H(q1[c]);
+			for (int i = 0; i < 16; ++i) {
+				palette[i][c] = static_cast<float>(FinishBC6H(((64 - Weights4[i]) * e0 + Weights4[i] * e1 + 32) >> 6));
+			}
+		}
+	}
+
+	// Each subset's anchor index is stored with one bit less, so its top bit must be clear; swapping
+	// the endpoints and mirroring the subset's indices keeps the colors unchanged.
+	template <typename Endpoint>
+	void FixAnchor(Endpoint& e0, Endpoint& e1, uint8_t indices[16], int indexBits = 4, uint16_t mask = 0xFFFF, int anchor = 0)
+	{
+		const int highest = (1 << indexBits) - 1;
+		if (indices[anchor] <= highest >> 1) return;
+		swap(e0, e1);
+		for (int i = 0; i < 16; ++i) {
+			if ((mask >> i) & 1) indices[i] = static_cast<uint8_t>(highest - indices[i]);
+		}
+	}
+
+	void WriteBC7(BC7Block encoded, uint8_t block[16])
+	{
+		const BC7Mode& format = BC7Modes[encoded.mode];
+		if (format.alphaIndexBits > 0) {
+			// Color and alpha are mirrored apart; the p-bit-less modes 4 and 5 swap only the values.
+			const int colorIndexBits = encoded.indexMode ? format.alphaIndexBits : format.indexBits;
+			const int alphaIndexBits = encoded.indexMode ? format.indexBits : format.alphaIndexBits;
+			int colors[2][3], alphas[2]{ encoded.endpoints[0].value[3], encoded.endpoints[1].value[3] };
+			for (int e = 0; e < 2; ++e) memcpy(colors[e], encoded.endpoints[e].value, sizeof(colors[e]));
+			FixAnchor(colors[0], colors[1], encoded.indices, colorIndexBits);
+			FixAnchor(alphas[0], alphas[1], encoded.alphaIndices, alphaIndexBits);
+			for (int e = 0; e < 2; ++e) {
+				memcpy(encoded.endpoints[e].value, colors[e], sizeof(colors[e]));
+				encoded.endpoints[e].value[3] = alphas[e];
+			}
+			if (encoded.indexMode) swap(encoded.indices, encoded.alphaIndices);
+		}
+		else {
+			for (int subset = 0; subset < format.subsets; ++subset) {
+				const int anchor = subset == 0 ? 0 : Anchors2[encoded.partition];
+				FixAnchor(encoded.endpoints[subset * 2], encoded.endpoints[subset * 2 + 1], encoded.indices, format.indexBits,
+					GetSubsetMask(format.subsets, encoded.partition, subset), anchor);
+			}
+		}
+
+		const int endpointCount = format.subsets * 2;
+		BitWriter writer{ block, 16 };
+		writer.Write(1u << encoded.mode, encoded.mode + 1);
+		writer.Write(static_cast<uint32_t>(encoded.partition), format.partitionBits);
+		writer.Write(static_cast<uint32_t>(encoded.rotation), format.rotationBits);
+		writer.Write(static_cast<uint32_t>(encoded.indexMode), format.indexModeBits);
+		for (int c = 0; c < 3; ++c) {
+			for (int e = 0; e < endpointCount; ++e) writer.Write(static_cast<uint32_t>(encoded.endpoints[e].value[c]), format.colorBits);
+		}
+		for (int e = 0; e < endpointCount && format.alphaBits > 0; ++e) {
+			writer.Write(static_cast<uint32_t>(encoded.endpoints[e].value[3]), format.alphaBits);
+		}
+		if (format.pbits == PBits::PerEndpoint) {
+			for (int e = 0; e < endpointCount; ++e) writer.Write(static_cast<uint32_t>(encoded.endpoints[e].pbit), 1);
+		}
+		else if (format.pbits == PBits::Shared) {
+			for (int subset = 0; subset < format.subsets; ++subset) writer.Write(static_cast<uint32_t>(encoded.endpoints[subset * 2].pbit), 1);
+		}
+		for (int i = 0; i < 16; ++i) {
+			writer.Write(encoded.indices[i], format.indexBits - IsAnchor(format.subsets, encoded.partition, i));
+		}
+		for (int i = 0; i < 16 && format.alphaIndexBits > 0; ++i) {
+			writer.Write(encoded.alphaIndices[i], format.alphaIndexBits - (i == 0));
+		}
+	}
+}
+
+void BC::EncodeBC1(const uint8_t rgba[64], uint8_t block[8], BcQuality quality)
+{
+	EncodeColor(LoadBlock(rgba), quality, block);
+}
+
+void BC::EncodeBC3(const uint8_t rgba[64], uint8_t block[16], BcQuality quality)
+{
+	const Block pixels = LoadBlock(rgba);
+	EncodeChannel(pixels, 3, quality, block);
+	EncodeColor(pixels, quality, block + 8);
+}
+
+void BC::EncodeBC4(const uint8_t rgba[64], uint8_t block[8], BcQuality quality)
+{
+	EncodeChannel(LoadBlock(rgba), 0, quality, block);
+}
+
+void BC::EncodeBC5(const uint8_t rgba[64], uint8_t block[16], BcQuality quality)
+{
+	const Block pixels = LoadBlock(rgba);
+	EncodeChannel(pixels, 0, quality, block);
+	EncodeChannel(pixels, 1, quality, block + 8);
+}
+
+void BC::EncodeBC7(const uint8_t rgba[64], uint8_t block[16], BcQuality quality)
+{
+	const Block pixels = LoadBlock(rgba);
+	BC7Block best = EncodeBC7Subsets(pixels, 6, 0, quality);
+	if (quality == BcQuality::High) {
+		const auto consider = [&](const BC7Block& candidate) { if (candidate.error < best.error) best = candidate; };
+		for (int rotation = 0; rotation < 4; ++rotation) {
+			consider(EncodeBC7SeparateAlpha(pixels, 4, rotation, 0, quality));
+			consider(EncodeBC7SeparateAlpha(pixels, 4, rotation, 1, quality));
+			consider(EncodeBC7SeparateAlpha(pixels, 5, rotation, 0, quality));
+		}
+
+		// The partitioned modes are opaque, so blocks whose alpha alone costs more are left out.
+		float alphaError = 0.0f;
+		for (int i = 0; i < 16; ++i) alphaError += (pixels.channel[3][i] - 255.0f) * (pixels.channel[3][i] - 255.0f);
+		if (alphaError < best.error) {
+			for (const int partition : RankPartitions(pixels, 4)) {
+				consider(EncodeBC7Subsets(pixels, 1, partition, quality));
+				consider(EncodeBC7Subsets(pixels, 3, partition, quality));
+			}
+		}
+	}
+	WriteBC7(best, block);
+}
+
+void BC::EncodeBC6H(const float rgb[48], uint8_t block[16], BcQuality quality)
+{
+	// Fit in half-bit space, which is close to logarithmic and is what the hardware interpolates.
+	Block pixels{};
+	for (int i = 0; i < 16; ++i) {
+		for (int c = 0; c < 3; ++c) {
+			const float value = rgb[i * 3 + c];
+			pixels.channel[c][i] = value > 0.0f ? DirectX::PackedVector::XMConvertFloatToHalf(min(value, 65504.0f)) : 0.0f;
+		}
+	}
+
+	float endpoints[2][4]{};
+	FitEndpoints(pixels, 3, GetPowerIterations(quality), endpoints);
+
+	using Endpoint = array<int, 3>;
+	Endpoint best0{}, best1{};
+	uint8_t bestIndices[16]{};
+	float bestError = FLT_MAX;
+	for (int pass = 0; pass <= GetRefineIterations(quality); ++pass) {
+		Endpoint q0{}, q1{};
+		for (int c = 0; c < 3; ++c) {
+			q0[c] = QuantizeBC6H(endpoints[0][c]);
+			q1[c] = QuantizeBC6H(endpoints[1][c]);
+		}
+
+		float palette[16][4];
+		GetBC6HPalette(q0.data(), q1.data(), palette);
+		uint8_t indices[16];
+		const float error = FindIndices(pixels, palette, 16, 3, indices);
+		if (error < bestError) {
+			bestError = error;
+			best0 = q0;
+			best1 = q1;
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+
+		float weights[16];
+		for (int i = 0; i < 16; ++i) weights[i] = Weights4[indices[i]] / 64.0f;
+		if (!RefineEndpoints(pixels, 3, weights, MaxHalf, endpoints)) break;
+	}
+	FixAnchor(best0, best1, bestIndices);
+
+	BitWriter writer{ block, 16 };
+	writer.Write(0x03, 5);
+	for (int c = 0; c < 3; ++c) writer.Write(static_cast<uint32_t>(best0[c]), 10);
+	for (int c = 0; c < 3; ++c) writer.Write(static_cast<uint32_t>(best1[c]), 10);
+	writer.Write(bestIndices[0], 3);
+	for (int i = 1; i < 16; ++i) writer.Write(bestIndices[i], 4);
+}
+
+void BC::DecodeBC1(const uint8_t block[8], uint8_t rgba[64])
+{
+	DecodeColor(block, false, rgba);
+}
+
+void BC::DecodeBC3(const uint8_t block[16], uint8_t rgba[64])
+{
+	DecodeColor(block + 8, true, rgba);
+	DecodeChannel(block, rgba, 3);
+}
+
+void BC::DecodeBC4(const uint8_t block[8], uint8_t rgba[64])
+{
+	for (int i = 0; i < 16; ++i) {
+		rgba[i * 4 + 1] = rgba[i * 4 + 2] = 0;
+		rgba[i * 4 + 3] = 255;
+	}
+	DecodeChannel(block, rgba, 0);
+}
+
+void BC::DecodeBC5(const uint8_t block[16], uint8_t rgba[64])
+{
+	for (int i = 0; i < 16; ++i) {
+		rgba[i * 4 + 2] = 0;
+		rgba[i * 4 + 3] = 255;
+	}
+	DecodeChannel(block, rgba, 0);
+	DecodeChannel(block + 8, rgba, 1);
+}
+
+bool BC::DecodeBC7(const uint8_t block[16], uint8_t rgba[64])
+{
+	BitReader reader{ block };
+	int mode = 0;
+	while (mode < 8 && reader.Read(1) == 0) ++mode;
+	if (mode != 1 && mode != 3 && mode != 4 && mode != 5 && mode != 6) return false;
+
+	const BC7Mode& format = BC7Modes[mode];
+	const int partition = static_cast<int>(reader.Read(format.partitionBits));
+	const int rotation = static_cast<int>(reader.Read(format.rotationBits));
+	const int indexMode = static_cast<int>(reader.Read(format.indexModeBits));
+	const int endpointCount = format.subsets * 2;
+	BC7Endpoint endpoints[4]{};
+	for (int c = 0; c < 3; ++c) {
+		for (int e = 0; e < endpointCount; ++e) endpoints[e].value[c] = static_cast<int>(reader.Read(format.colorBits));
+	}
+	for (int e = 0; e < endpointCount && format.alphaBits > 0; ++e) {
+		endpoints[e].value[3] = static_cast<int>(reader.Read(format.alphaBits));
+	}
+	if (format.pbits == PBits::PerEndpoint) {
+		for (int e = 0; e < endpointCount; ++e) endpoints[e].pbit = static_cast<int>(reader.Read(1));
+	}
+	else if (format.pbits == PBits::Shared) {
+		for (int subset = 0; subset < format.subsets; ++subset) {
+			endpoints[subset * 2].pbit = endpoints[subset * 2 + 1].pbit = static_cast<int>(reader.Read(1));
+		}
+	}
+
+	uint8_t indices[16], alphaIndices[16];
+	for (int i = 0; i < 16; ++i) {
+		indices[i] = static_cast<uint8_t>(reader.Read(format.indexBits - IsAnchor(format.subsets, partition, i)));
+	}
+	for (int i = 0; i < 16; ++i) {
+		alphaIndices[i] = format.alphaIndexBits > 0 ? static_cast<uint8_t>(reader.Read(format.alphaIndexBits - (i == 0))) : indices[i];
+	}
+	int colorIndexBits = format.indexBits, alphaIndexBits = format.alphaIndexBits > 0 ? format.alphaIndexBits : format.indexBits;
+	if (indexMode) {
+		swap(indices, alphaIndices);
+		swap(colorIndexBits, alphaIndexBits);
+	}
+
+	const bool hasPBit = format.pbits != PBits::None;
+	const int bits[4]{ format.colorBits, format.colorBits, format.colorBits, format.alphaBits };
+	for (int subset = 0; subset < format.subsets; ++subset) {
+		const BC7Endpoint& e0 = endpoints[subset * 2];
+		const BC7Endpoint& e1 = endpoints[subset * 2 + 1];
+		float colors[16][4], alphas[16][4];
+		GetBC7Palette(e0, e1, 3, bits, hasPBit, colorIndexBits, colors);
+		if (format.alphaBits > 0) {
+			BC7Endpoint a0{ { e0.value[3] }, e0.pbit }, a1{ { e1.value[3] }, e1.pbit };
+			GetBC7Palette(a0, a1, 1, bits + 3, hasPBit, alphaIndexBits, alphas);
+		}
+		const uint16_t mask = GetSubsetMask(format.subsets, partition, subset);
+		for (int i = 0; i < 16; ++i) {
+			if (!((mask >> i) & 1)) continue;
+			for (int c = 0; c < 3; ++c) rgba[i * 4 + c] = static_cast<uint8_t>(colors[indices[i]][c]);
+			rgba[i * 4 + 3] = format.alphaBits > 0 ? static_cast<uint8_t>(alphas[alphaIndices[i]][0]) : 255;
+			if (rotation > 0) swap(rgba[i * 4 + 3], rgba[i * 4 + rotation - 1]);
+		}
+	}
+	return true;
+}
+
+bool BC::DecodeBC6H(const uint8_t block[16], float rgb[48])
+{
+	BitReader reader{ block };
+	if (reader.Read(5) != 0x03) return false;
+
+	int q0[3], q1[3];
+	for (int c = 0; c < 3; ++c) q0[c] = static_cast<int>(reader.Read(10));
+	for (int c = 0; c < 3; ++c) q1[c] = static_cast<int>(reader.Read(10));
+	float palette[16][4];
+	GetBC6HPalette(q0, q1, palette);
+	for (int i = 0; i < 16; ++i) {
+		const uint32_t index = reader.Read(i == 0 ? 3 : 4);
+		for (int c = 0; c < 3; ++c) {
+			rgb[i * 3 + c] = DirectX::PackedVector::XMConvertHalfToFloat(static_cast<DirectX::PackedVector::HALF>(palette[index][c]));
+		}
+	}
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+
+// Fast fits endpoints to the block's bounding box axis, Normal and High run power iterations for
+// the principal axis and then refine the endpoints by least squares (once, or three times with a
+// wider p-bit and endpoint search).
+enum class BcQuality
+{
+	Fast,
+	Normal,
+	High,
+};
+
+// Encoders and decoders for one 4x4 block. LDR blocks are 16 RGBA8 pixels in row order, HDR blocks
+// 16 RGB float pixels. BC4 reads red and BC5 red and green; their decoders write zero to the other
+// color channels and 255 to alpha.
+namespace BC
+{
+	// Opaque four-color blocks; alpha is ignored (use BC3 or BC7 when it matters).
+	void EncodeBC1(const uint8_t rgba[64], uint8_t block[8], BcQuality quality);
+	void EncodeBC3(const uint8_t rgba[64], uint8_t block[16], BcQuality quality);
+	void EncodeBC4(const uint8_t rgba[64], uint8_t block[8], BcQuality quality);
+	void EncodeBC5(const uint8_t rgba[64], uint8_t block[16], BcQuality quality);
+
+	// Fast and Normal write mode 6: one subset, 7-bit RGBA endpoints with p-bits and 4-bit indices.
+	// High also tries modes 4 and 5 (alpha with indices of its own, in every rotation) and, on the
+	// best ranked partitions, the two-subset RGB modes 1 and 3, and keeps the closest.
+	void EncodeBC7(const uint8_t rgba[64], uint8_t block[16], BcQuality quality);
+
+	// Writes BC6H_UF16 mode 11: one region, 10-bit endpoints and 4-bit indices. Negative values clamp to zero.
+	void EncodeBC6H(const float rgb[48], uint8_t block[16], BcQuality quality);
+
+	void DecodeBC1(const uint8_t block[8], uint8_t rgba[64]);
+	void DecodeBC3(const uint8_t block[16], uint8_t rgba[64]);
+	void DecodeBC4(const uint8_t block[8], uint8_t rgba[64]);
+	void DecodeBC5(const uint8_t block[16], uint8_t rgba[64]);
+
+	// Only decode the modes the encoders write (BC7 modes 1, 3, 4, 5 and 6) and return false for any other.
+	bool DecodeBC7(const uint8_t block[16], uint8_t rgba[64]);
+	bool DecodeBC6H(const uint8_t block[16], float rgb[48]);
+}
@@ -0,0 +1,301 @@
+#include "compressor.h"
+#include "../Common/parallel.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <DirectXPackedVector.h>
+
+using namespace std;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	using Clock = chrono::steady_clock;
+	using Pixel = array<float, 4>;
+
+	struct Surface
+	{
+		size_t		sourceOffset;
+		size_t		outputOffset;
+		size_t		firstBlock;
+		uint32_t	width;
+		uint32_t	height;
+		uint32_t	blocksWide;
+	};
+
+	// Unorm sources come back in [0, 1], float sources unchanged.
+	Pixel LoadPixel(const std::byte* surface, DdsFormat format, uint32_t width, uint32_t x, uint32_t y)
+	{
+		const size_t index = size_t{ y } * width + x;
+		const auto* bytes = reinterpret_cast<const uint8_t*>(surface) + index * Dds::GetElementSize(format);
+		switch (format)
+		{
+		case DdsFormat::R32G32B32A32Float: {
+			Pixel pixel;
+			memcpy(pixel.data(), bytes, sizeof(pixel));
+			return pixel;
+		}
+		case DdsFormat::R16G16B16A16Float: {
+			HALF half[4];
+			memcpy(half, bytes, sizeof(half));
+			return { XMConvertHalfToFloat(half[0]), XMConvertHalfToFloat(half[1]), XMConvertHalfToFloat(half[2]), XMConvertHalfToFloat(half[3]) };
+		}
+		case DdsFormat::R8G8B8A8Unorm:
+		case DdsFormat::R8G8B8A8UnormSrgb:
+			return { bytes[0] / 255.0f, bytes[1] / 255.0f, bytes[2] / 255.0f, bytes[3] / 255.0f };
+		case DdsFormat::B8G8R8A8Unorm:
+		case DdsFormat::B8G8R8A8UnormSrgb:
+			return { bytes[2] / 255.0f, bytes[1] / 255.0f, bytes[0] / 255.0f, bytes[3] / 255.0f };
+		case DdsFormat::B8G8R8X8Unorm:
+			return { bytes[2] / 255.0f, bytes[1] / 255.0f, bytes[0] / 255.0f, 1.0f };
+		default:
+			throw invalid_argument{ "compress: unsupported source format " + to_string(static_cast<uint32_t>(format)) };
+		}
+	}
+
+	float SrgbToLinear(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	DdsFormat ToSrgb(DdsFormat format)
+	{
+		switch (format)
+		{
+		case DdsFormat::BC1Unorm: return DdsFormat::BC1UnormSrgb;
+		case DdsFormat::BC3Unorm: return DdsFormat::BC3UnormSrgb;
+		case DdsFormat::BC7Unorm: return DdsFormat::BC7UnormSrgb;
+		default: return format;
+		}
+	}
+
+	const char* GetFormatName(DdsFormat format)
+	{
+		switch (format)
+		{
+		case DdsFormat::BC1Unorm: return "bc1";
+		case DdsFormat::BC3Unorm: return "bc3";
+		case DdsFormat::BC4Unorm: return "bc4";
+		case DdsFormat::BC5Unorm: return "bc5";
+		case DdsFormat::BC6HUf16: return "bc6h";
+		case DdsFormat::BC7Unorm: return "bc7";
+		default: return "?";
+		}
+	}
+
+	// Channels the format stores, which are the ones PSNR compares.
+	int GetChannelCount(DdsFormat format)
+	{
+		switch (format)
+		{
+		case DdsFormat::BC4Unorm: return 1;
+		case DdsFormat::BC5Unorm: return 2;
+		case DdsFormat::BC1Unorm:
+		case DdsFormat::BC6HUf16: return 3;
+		default: return 4;
+		}
+	}
+
+	void ToRgba8(const Pixel pixels[16], uint8_t rgba[64])
+	{
+		for (int i = 0; i < 16; ++i) {
+			for (int c = 0; c < 4; ++c) rgba[i * 4 + c] = static_cast<uint8_t>(lround(clamp(pixels[i][c], 0.0f, 1.0f) * 255.0f));
+		}
+	}
+
+	void EncodeBlock(DdsFormat format, const Pixel pixels[16], uint8_t* block, BcQuality quality)
+	{
+		if (format == DdsFormat::BC6HUf16) {
+			float rgb[48];
+			for (int i = 0; i < 16; ++i) {
+				for (int c = 0; c < 3; ++c) rgb[i * 3 + c] = pixels[i][c];
+			}
+			BC::EncodeBC6H(rgb, block, quality);
+			return;
+		}
+
+		uint8_t rgba[64];
+		ToRgba8(pixels, rgba);
+		switch (format)
+		{
+		case DdsFormat::BC1Unorm: BC::EncodeBC1(rgba, block, quality); break;
+		case DdsFormat::BC3Unorm: BC::EncodeBC3(rgba, block, quality); break;
+		case DdsFormat::BC4Unorm: BC::EncodeBC4(rgba, block, quality); break;
+		case DdsFormat::BC5Unorm: BC::EncodeBC5(rgba, block, quality); break;
+		case DdsFormat::BC7Unorm: BC::EncodeBC7(rgba, block, quality); break;
+		default: throw invalid_argument{ "compress: unsupported target format" };
+		}
+	}
+
+	// Squared error summed over the stored channels of the pixels inside the surface, on the
+	// 0-255 scale for LDR formats and in linear values for BC6H.
+	double GetBlockError(DdsFormat format, const Pixel pixels[16], const uint8_t* block, uint32_t columns, uint32_t rows)
+	{
+		Pixel decoded[16]{};
+		Pixel expected[16];
+		if (format == DdsFormat::BC6HUf16) {
+			float rgb[48];
+			if (!BC::DecodeBC6H(block, rgb)) throw runtime_error{ "compress: unexpected BC6H mode" };
+			for (int i = 0; i < 16; ++i) {
+				for (int c = 0; c < 3; ++c) {
+					decoded[i][c] = rgb[i * 3 + c];
+					expected[i][c] = clamp(pixels[i][c], 0.0f, 65504.0f);
+				}
+			}
+		}
+		else {
+			uint8_t source[64], rgba[64];
+			ToRgba8(pixels, source);
+			switch (format)
+			{
+			case DdsFormat::BC1Unorm: BC::DecodeBC1(block, rgba); break;
+			case DdsFormat::BC3Unorm: BC::DecodeBC3(block, rgba); break;
+			case DdsFormat::BC4Unorm: BC::DecodeBC4(block, rgba); break;
+			case DdsFormat::BC5Unorm: BC::DecodeBC5(block, rgba); break;
+			default:
+				if (!BC::DecodeBC7(block, rgba)) throw runtime_error{ "compress: unexpected BC7 mode" };
+				break;
+			}
+			for (int i = 0; i < 16; ++i) {
+				for (int c = 0; c < 4; ++c) {
+					decoded[i][c] = rgba[i * 4 + c];
+					expected[i][c] = source[i * 4 + c];
+				}
+			}
+		}
+
+		const int channels = GetChannelCount(format);
+		double error = 0.0;
+		for (uint32_t y = 0; y < rows; ++y) {
+			for (uint32_t x = 0; x < columns; ++x) {
+				for (int c = 0; c < channels; ++c) {
+					const double difference = double{ decoded[y * 4 + x][c] } - expected[y * 4 + x][c];
+					error += difference * difference;
+				}
+			}
+		}
+		return error;
+	}
+}
+
+DdsFormat Compressor::ParseFormat(string_view name)
+{
+	for (DdsFormat format : { DdsFormat::BC1Unorm, DdsFormat::BC3Unorm, DdsFormat::BC4Unorm,
+		DdsFormat::BC5Unorm, DdsFormat::BC6HUf16, DdsFormat::BC7Unorm }) {
+		if (name == GetFormatName(format)) return format;
+	}
+	throw invalid_argument{ "compress: unknown format " + string{ name } };
+}
+
+BcQuality Compressor::ParseQuality(string_view name)
+{
+	if (name == "fast") return BcQuality::Fast;
+	if (name == "normal") return BcQuality::Normal;
+	if (name == "high") return BcQuality::High;
+	throw invalid_argument{ "compress: unknown quality " + string{ name } };
+}
+
+void Compressor::Compress(const filesystem::path& input, const filesystem::path& output, DdsFormat format, BcQuality quality)
+{
+	const DdsImage source = Dds::Read(input);
+	if (Dds::IsBlockCompressed(source.format)) throw invalid_argument{ "compress: " + input.string() + " is already block compressed" };
+	const bool srgb = Dds::IsSrgb(source.format);
+	const bool linearize = srgb && format == DdsFormat::BC6HUf16;
+
+	DdsImage result;
+	result.format = srgb ? ToSrgb(format) : format;
+	result.width = source.width;
+	result.height = source.height;
+	result.mipCount = source.mipCount;
+	result.arraySize = source.arraySize;
+	result.cubeMap = source.cubeMap;
+
+	vector<Surface> surfaces;
+	size_t sourceOffset = 0, outputOffset = 0, blockCount = 0;
+	uint64_t pixelCount = 0;
+	for (uint32_t slice = 0; slice < source.arraySize; ++slice) {
+		for (uint32_t mip = 0; mip < source.mipCount; ++mip) {
+			Surface surface{};
+			surface.width = Dds::GetMipSize(source.width, mip);
+			surface.height = Dds::GetMipSize(source.height, mip);
+			surface.blocksWide = (surface.width + 3) / 4;
+			surface.sourceOffset = sourceOffset;
+			surface.outputOffset = outputOffset;
+			surface.firstBlock = blockCount;
+			surfaces.push_back(surface);
+
+			sourceOffset += Dds::GetSurfaceSize(source.format, surface.width, surface.height);
+			outputOffset += Dds::GetSurfaceSize(result.format, surface.width, surface.height);
+			blockCount += size_t{ surface.blocksWide } * ((surface.height + 3) / 4);
+			pixelCount += uint64_t{ surface.width } * surface.height;
+		}
+	}
+	result.data.resize(outputOffset);
+	const size_t blockSize = Dds::GetElementSize(result.format);
+
+	// Blocks past the surface edge repeat the last row and column.
+	const auto forEachBlock = [&](auto&& func) {
+		Parallel::For(0, blockCount, [&](size_t index) {
+			const auto surface = prev(upper_bound(surfaces.begin(), surfaces.end(), index,
+				[](size_t value, const Surface& s) { return value < s.firstBlock; }));
+			const size_t local = index - surface->firstBlock;
+			const uint32_t bx = static_cast<uint32_t>(local % surface->blocksWide) * 4;
+			const uint32_t by = static_cast<uint32_t>(local / surface->blocksWide) * 4;
+
+			Pixel pixels[16];
+			for (uint32_t y = 0; y < 4; ++y) {
+				for (uint32_t x = 0; x < 4; ++x) {
+					Pixel& pixel = pixels[y * 4 + x] = LoadPixel(source.data.data() + surface->sourceOffset, source.format,
+						surface->width, min(bx + x, surface->width - 1), min(by + y, surface->height - 1));
+					if (linearize) {
+						for (int c = 0; c < 3; ++c) pixel[c] = SrgbToLinear(pixel[c]);
+					}
+				}
+			}
+			auto* block = reinterpret_cast<uint8_t*>(result.data.data() + surface->outputOffset) + local * blockSize;
+			func(index, pixels, block, min(4u, surface->width - bx), min(4u, surface->height - by));
+			});
+		};
+
+	const auto start = Clock::now();
+	forEachBlock([&](size_t, const Pixel pixels[16], uint8_t* block, uint32_t, uint32_t) {
+		EncodeBlock(format, pixels, block, quality);
+		});
+	const double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+	vector<double> blockErrors(blockCount);
+	forEachBlock([&](size_t index, const Pixel pixels[16], uint8_t* block, uint32_t columns, uint32_t rows) {
+		blockErrors[index] = GetBlockError(format, pixels, block, columns, rows);
+		});
+	double error = 0.0;
+	for (double blockError : blockErrors) error += blockError;
+
+	double peak = 255.0;
+	if (format == DdsFormat::BC6HUf16) {
+		peak = 0.0;
+		for (const auto& surface : surfaces) {
+			for (uint32_t y = 0; y < surface.height; ++y) {
+				for (uint32_t x = 0; x < surface.width; ++x) {
+					const Pixel pixel = LoadPixel(source.data.data() + surface.sourceOffset, source.format, surface.width, x, y);
+					for (int c = 0; c < 3; ++c) peak = max<double>(peak, linearize ? SrgbToLinear(pixel[c]) : min(pixel[c], 65504.0f));
+				}
+			}
+		}
+	}
+	const double meanError = error / (static_cast<double>(pixelCount) * GetChannelCount(format));
+	const double psnr = meanError > 0.0 ? 10.0 * log10(peak * peak / meanError) : INFINITY;
+
+	Dds::Write(output, result);
+
+	const char* qualityName = quality == BcQuality::Fast ? "fast" : quality == BcQuality::Normal ? "normal" : "high";
+	cout << GetFormatName(format) << " (" << qualityName << "): " << surfaces.size() << " surfaces, "
+		<< pixelCount / 1e6 << " Mpixel in " << seconds * 1000.0 << " ms on " << Parallel::GetWorkerCount() << " workers, "
+		<< pixelCount / 1e6 / seconds << " Mpixel/s, " << source.data.size() << " -> " << result.data.size() << " bytes, PSNR "
+		<< psnr << " dB (" << output.string() << ")" << endl;
+}
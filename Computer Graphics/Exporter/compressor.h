@@ -0,0 +1,18 @@
+#pragma once
+#include <filesystem>
+#include <string_view>
+#include "bc.h"
+#include "dds.h"
+
+namespace Compressor
+{
+	// "bc1", "bc3", "bc4", "bc5", "bc6h" or "bc7"; sRGB sources keep sRGB for BC1, BC3 and BC7.
+	DdsFormat ParseFormat(std::string_view name);
+
+	// "fast", "normal" or "high".
+	BcQuality ParseQuality(std::string_view name);
+
+	// Encodes every mip and array slice (or cube face) of an uncompressed DDS, in parallel over rows of
+	// blocks, and prints encode throughput and the PSNR of the decoded result against the source.
+	void Compress(const std::filesystem::path& input, const std::filesystem::path& output, DdsFormat format, BcQuality quality);
+}
@@ -0,0 +1,311 @@
+#include "dds.h"
+#include "../Common/mappedfile.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+	constexpr uint32_t Magic = 0x20534444; // "DDS "
+
+	constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+	{
+		return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+	}
+
+	struct DdsPixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t rBitMask;
+		uint32_t gBitMask;
+		uint32_t bBitMask;
+		uint32_t aBitMask;
+	};
+
+	struct DdsHeader
+	{
+		uint32_t		size;
+		uint32_t		flags;
+		uint32_t		height;
+		uint32_t		width;
+		uint32_t		pitchOrLinearSize;
+		uint32_t		depth;
+		uint32_t		mipMapCount;
+		uint32_t		reserved1[11];
+		DdsPixelFormat	ddspf;
+		uint32_t		caps;
+		uint32_t		caps2;
+		uint32_t		caps3;
+		uint32_t		caps4;
+		uint32_t		reserved2;
+	};
+
+	struct DdsHeaderDxt10
+	{
+		uint32_t dxgiFormat;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+	static_assert(sizeof(DdsHeader) == 124 && sizeof(DdsHeaderDxt10) == 20);
+
+	constexpr uint32_t PixelFormatFourCC = 0x4;
+	constexpr uint32_t PixelFormatRgb = 0x40;
+	constexpr uint32_t PixelFormatAlpha = 0x1;
+	constexpr uint32_t HeaderFlags = 0x1 | 0x2 | 0x4 | 0x1000;	// CAPS | HEIGHT | WIDTH | PIXELFORMAT
+	constexpr uint32_t HeaderMipCount = 0x20000;
+	constexpr uint32_t HeaderLinearSize = 0x80000;
+	constexpr uint32_t HeaderPitch = 0x8;
+	constexpr uint32_t HeaderDepth = 0x800000;
+	constexpr uint32_t CapsTexture = 0x1000;
+	constexpr uint32_t CapsComplex = 0x8;
+	constexpr uint32_t CapsMipMap = 0x400000;
+	constexpr uint32_t Caps2CubeMap = 0x200;
+	constexpr uint32_t Caps2AllFaces = 0xFC00;
+	constexpr uint32_t Caps2Volume = 0x200000;
+	constexpr uint32_t DimensionTexture2D = 3;
+	constexpr uint32_t MiscTextureCube = 0x4;
+
+	DdsFormat GetLegacyFormat(const DdsPixelFormat& ddspf)
+	{
+		if (ddspf.flags & PixelFormatFourCC) {
+			switch (ddspf.fourCC)
+			{
+			case MakeFourCC('D', 'X', 'T', '1'): return DdsFormat::BC1Unorm;
+			case MakeFourCC('D', 'X', 'T', '4'):
+			case MakeFourCC('D', 'X', 'T', '5'): return DdsFormat::BC3Unorm;
+			case MakeFourCC('A', 'T', 'I', '1'):
+			case MakeFourCC('B', 'C', '4', 'U'): return DdsFormat::BC4Unorm;
+			case MakeFourCC('A', 'T', 'I', '2'):
+			case MakeFourCC('B', 'C', '5', 'U'): return DdsFormat::BC5Unorm;
+			case 113: return DdsFormat::R16G16B16A16Float;	// D3DFMT_A16B16G16R16F
+			case 116: return DdsFormat::R32G32B32A32Float;	// D3DFMT_A32B32G32R32F
+			default: return DdsFormat::Unknown;
+			}
+		}
+		if ((ddspf.flags & PixelFormatRgb) && ddspf.rgbBitCount == 32) {
+			if (ddspf.rBitMask == 0x000000FF && ddspf.gBitMask == 0x0000FF00 && ddspf.bBitMask == 0x00FF0000) {
+				return DdsFormat::R8G8B8A8Unorm;
+			}
+			if (ddspf.rBitMask == 0x00FF0000 && ddspf.gBitMask == 0x0000FF00 && ddspf.bBitMask == 0x000000FF) {
+				return (ddspf.flags & PixelFormatAlpha) && ddspf.aBitMask ? DdsFormat::B8G8R8A8Unorm : DdsFormat::B8G8R8X8Unorm;
+			}
+		}
+		return DdsFormat::Unknown;
+	}
+
+	size_t GetImageSize(const DdsImage& image)
+	{
+		size_t size = 0;
+		for (uint32_t mip = 0; mip < image.mipCount; ++mip) {
+			size += Dds::GetSurfaceSize(image.format, Dds::GetMipSize(image.width, mip), Dds::GetMipSize(image.height, mip));
+		}
+		return size * image.arraySize;
+	}
+}
+
+bool Dds::IsBlockCompressed(DdsFormat format)
+{
+	switch (format)
+	{
+	case DdsFormat::BC1Unorm:
+	case DdsFormat::BC1UnormSrgb:
+	case DdsFormat::BC3Unorm:
+	case DdsFormat::BC3UnormSrgb:
+	case DdsFormat::BC4Unorm:
+	case DdsFormat::BC5Unorm:
+	case DdsFormat::BC6HUf16:
+	case DdsFormat::BC7Unorm:
+	case DdsFormat::BC7UnormSrgb:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool Dds::IsSrgb(DdsFormat format)
+{
+	switch (format)
+	{
+	case DdsFormat::R8G8B8A8UnormSrgb:
+	case DdsFormat::B8G8R8A8UnormSrgb:
+	case DdsFormat::BC1UnormSrgb:
+	case DdsFormat::BC3UnormSrgb:
+	case DdsFormat::BC7UnormSrgb:
+		return true;
+	default:
+		return false;
+	}
+}
+
+size_t Dds::GetElementSize(DdsFormat format)
+{
+	switch (format)
+	{
+	case DdsFormat::R32G32B32A32Float: return 16;
+	case DdsFormat::R16G16B16A16Float: return 8;
+	case DdsFormat::R8G8B8A8Unorm:
+	case DdsFormat::R8G8B8A8UnormSrgb:
+	case DdsFormat::B8G8R8A8Unorm:
+	case DdsFormat::B8G8R8X8Unorm:
+	case DdsFormat::B8G8R8A8UnormSrgb: return 4;
+	case DdsFormat::BC1Unorm:
+	case DdsFormat::BC1UnormSrgb:
+	case DdsFormat::BC4Unorm: return 8;
+	case DdsFormat::BC3Unorm:
+	case DdsFormat::BC3UnormSrgb:
+	case DdsFormat::BC5Unorm:
+	case DdsFormat::BC6HUf16:
+	case DdsFormat::BC7Unorm:
+	case DdsFormat::BC7UnormSrgb: return 16;
+	default: return 0;
+	}
+}
+
+size_t Dds::GetSurfaceSize(DdsFormat format, uint32_t width, uint32_t height)
+{
+	if (IsBlockCompressed(format)) {
+		return size_t{ (width + 3) / 4 } * ((height + 3) / 4) * GetElementSize(format);
+	}
+	return size_t{ width } * height * GetElementSize(format);
+}
+
+size_t Dds::GetSubresourceOffset(const DdsImage& image, uint32_t slice, uint32_t mip)
+{
+	size_t sliceSize = 0, mipOffset = 0;
+	for (uint32_t i = 0; i < image.mipCount; ++i) {
+		if (i == mip) mipOffset = sliceSize;
+		sliceSize += GetSurfaceSize(image.format, GetMipSize(image.width, i), GetMipSize(image.height, i));
+	}
+	return sliceSize * slice + mipOffset;
+}
+
+DdsImage Dds::Read(const filesystem::path& path)
+{
+	const MappedFile file{ path };
+	const auto data = file.GetData();
+	uint32_t magic{};
+	DdsHeader header{};
+	if (data.size() < sizeof(magic) + sizeof(header)) throw runtime_error{ "dds: truncated " + path.string() };
+	memcpy(&magic, data.data(), sizeof(magic));
+	memcpy(&header, data.data() + sizeof(magic), sizeof(header));
+	if (magic != Magic || header.size != sizeof(header)) throw runtime_error{ "dds: bad header " + path.string() };
+	if ((header.caps2 & Caps2Volume) || ((header.flags & HeaderDepth) && header.depth > 1)) {
+		throw runtime_error{ "dds: volume textures are not supported " + path.string() };
+	}
+
+	DdsImage image;
+	image.width = header.width;
+	image.height = header.height;
+	image.mipCount = max<uint32_t>(1, header.mipMapCount);
+	size_t offset = sizeof(magic) + sizeof(header);
+
+	if ((header.ddspf.flags & PixelFormatFourCC) && header.ddspf.fourCC == MakeFourCC('D', 'X', '1', '0')) {
+		DdsHeaderDxt10 extension{};
+		if (data.size() < offset + sizeof(extension)) throw runtime_error{ "dds: truncated " + path.string() };
+		memcpy(&extension, data.data() + offset, sizeof(extension));
+		offset += sizeof(extension);
+		if (extension.resourceDimension != DimensionTexture2D || extension.arraySize == 0) {
+			throw runtime_error{ "dds: only 2D textures are supported " + path.string() };
+		}
+		image.format = static_cast<DdsFormat>(extension.dxgiFormat);
+		image.cubeMap = (extension.miscFlag & MiscTextureCube) != 0;
+		image.arraySize = extension.arraySize * (image.cubeMap ? 6 : 1);
+	}
+	else {
+		image.format = GetLegacyFormat(header.ddspf);
+		if (header.caps2 & Caps2CubeMap) {
+			if ((header.caps2 & Caps2AllFaces) != Caps2AllFaces) throw runtime_error{ "dds: partial cube map " + path.string() };
+			image.cubeMap = true;
+			image.arraySize = 6;
+		}
+	}
+	if (GetElementSize(image.format) == 0) throw runtime_error{ "dds: unsupported format " + path.string() };
+	if (image.width == 0 || image.height == 0 || image.mipCount > 32) throw runtime_error{ "dds: bad size " + path.string() };
+
+	const size_t size = GetImageSize(image);
+	if (data.size() - offset < size) throw runtime_error{ "dds: truncated " + path.string() };
+	image.data.assign(data.begin() + offset, data.begin() + offset + size);
+	return image;
+}
+
+void Dds::Write(const filesystem::path& path, const DdsImage& image)
+{
+	if (image.data.size() != GetImageSize(image)) throw invalid_argument{ "dds: image data does not match its size" };
+	if (image.cubeMap && image.arraySize % 6 != 0) throw invalid_argument{ "dds: cube map needs six faces per cube" };
+
+	DdsHeader header{};
+	header.size = sizeof(header);
+	header.flags = HeaderFlags | HeaderMipCount;
+	header.height = image.height;
+	header.width = image.width;
+	header.mipMapCount = image.mipCount;
+	header.ddspf.size = sizeof(header.ddspf);
+	header.ddspf.flags = PixelFormatFourCC;
+	header.ddspf.fourCC = MakeFourCC('D', 'X', '1', '0');
+	header.caps = CapsTexture | (image.mipCount > 1 ? CapsMipMap | CapsComplex : 0);
+	if (IsBlockCompressed(image.format)) {
+		header.flags |= HeaderLinearSize;
+		header.pitchOrLinearSize = static_cast<uint32_t>(GetSurfaceSize(image.format, image.width, image.height));
+	}
+	else {
+		header.flags |= HeaderPitch;
+		header.pitchOrLinearSize = static_cast<uint32_t>(size_t{ image.width } * GetElementSize(image.format));
+	}
+	if (image.cubeMap) {
+		header.caps |= CapsComplex;
+		header.caps2 = Caps2CubeMap | Caps2AllFaces;
+	}
+
+	DdsHeaderDxt10 extension{};
+	extension.dxgiFormat = static_cast<uint32_t>(image.format);
+	extension.resourceDimension = DimensionTexture2D;
+	extension.miscFlag = image.cubeMap ? MiscTextureCube : 0;
+	extension.arraySize = image.cubeMap ? image.arraySize / 6 : image.arraySize;
+
+	ofstream out(path, ios::binary);
+	if (!out) throw runtime_error{ "cannot create " + path.string() };
+	out.write(reinterpret_cast<const char*>(&Magic), sizeof(Magic));
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(&extension), sizeof(extension));
+	out.write(reinterpret_cast<const char*>(image.data.data()), static_cast<streamsize>(image.data.size()));
+	if (!out) throw runtime_error{ "cannot write " + path.string() };
+}
+
+DdsImage Dds::MakeArray(const vector<DdsImage>& images)
+{
+	if (images.empty()) throw invalid_argument{ "dds: no images to stack" };
+
+	DdsImage result;
+	result.format = images.front().format;
+	result.width = images.front().width;
+	result.height = images.front().height;
+	result.mipCount = images.front().mipCount;
+	result.arraySize = 0;
+	for (const auto& image : images) {
+		if (image.cubeMap) throw invalid_argument{ "dds: cube maps cannot be stacked" };
+		if (image.format != result.format || image.width != result.width || image.height != result.height) {
+			throw invalid_argument{ "dds: stacked textures need one format and size" };
+		}
+		result.mipCount = min(result.mipCount, image.mipCount);
+		result.arraySize += image.arraySize;
+	}
+
+	// Mips run from finest to coarsest in every slice, so dropping the coarse tail is a prefix copy.
+	const size_t sliceSize = GetSubresourceOffset(result, 1, 0);
+	result.data.reserve(sliceSize * result.arraySize);
+	for (const auto& image : images) {
+		for (uint32_t slice = 0; slice < image.arraySize; ++slice) {
+			const auto first = image.data.begin() + GetSubresourceOffset(image, slice, 0);
+			result.data.insert(result.data.end(), first, first + sliceSize);
+		}
+	}
+	return result;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// DXGI_FORMAT values the exporter reads or writes (the numbers match dxgiformat.h).
+enum class DdsFormat : uint32_t
+{
+	Unknown = 0,
+	R32G32B32A32Float = 2,
+	R16G16B16A16Float = 10,
+	R8G8B8A8Unorm = 28,
+	R8G8B8A8UnormSrgb = 29,
+	BC1Unorm = 71,
+	BC1UnormSrgb = 72,
+	BC3Unorm = 77,
+	BC3UnormSrgb = 78,
+	BC4Unorm = 80,
+	BC5Unorm = 83,
+	B8G8R8A8Unorm = 87,
+	B8G8R8X8Unorm = 88,
+	B8G8R8A8UnormSrgb = 91,
+	BC6HUf16 = 95,
+	BC7Unorm = 98,
+	BC7UnormSrgb = 99,
+};
+
+// A 2D texture, texture array or cube map. Surfaces are tightly packed in subresource order:
+// every mip of slice 0, then every mip of slice 1 and so on (cube faces are slices).
+struct DdsImage
+{
+	DdsFormat				format = DdsFormat::Unknown;
+	uint32_t				width = 0;
+	uint32_t				height = 0;
+	uint32_t				mipCount = 1;
+	uint32_t				arraySize = 1;
+	bool					cubeMap = false;
+	std::vector<std::byte>	data;
+};
+
+namespace Dds
+{
+	bool IsBlockCompressed(DdsFormat format);
+	bool IsSrgb(DdsFormat format);
+
+	// Bytes per 4x4 block for BC formats, per pixel otherwise. Zero for unsupported formats.
+	size_t GetElementSize(DdsFormat format);
+	size_t GetSurfaceSize(DdsFormat format, uint32_t width, uint32_t height);
+	size_t GetSubresourceOffset(const DdsImage& image, uint32_t slice, uint32_t mip);
+
+	inline uint32_t GetMipSize(uint32_t size, uint32_t mip) { return std::max<uint32_t>(1, size >> mip); }
+
+	// Reads legacy and DX10 headers; volume textures are rejected.
+	DdsImage Read(const std::filesystem::path& path);
+
+	// Always writes a DX10 header.
+	void Write(const std::filesystem::path& path, const DdsImage& image);
+
+	// Stacks the slices of same-format, same-size 2D textures (or arrays) into one texture array.
+	// Every slice keeps the mip count of the shortest chain, so the array shares one set of mips.
+	DdsImage MakeArray(const std::vector<DdsImage>& images);
+}
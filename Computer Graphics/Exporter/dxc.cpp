@@ -0,0 +1,328 @@
+#include "dxc.h"
+#include "shadermanifest.h"
+#include "../Common/dxil.h"
+#include "../Common/parallel.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	struct Statistics
+	{
+		uint32_t	instructions = 0;
+		uint32_t	intrinsics = 0;			// dx.op calls.
+		uint32_t	waveIntrinsics = 0;
+		uint32_t	halfInstructions = 0;	// With a half or i16 operand or result.
+	};
+
+	struct Result
+	{
+		string				name;
+		int					exitCode = 0;
+		vector<std::byte>	blob;
+		Statistics			statistics;
+	};
+
+	// Counts the instructions in the function bodies of a DXC disassembly, which is LLVM IR.
+	Statistics ReadDisassembly(istream& in)
+	{
+		Statistics statistics;
+		bool body = false;
+		for (string line; getline(in, line);) {
+			if (line.rfind("define ", 0) == 0) body = true;
+			else if (line.rfind('}', 0) == 0) body = false;
+			if (!body || line.rfind("  ", 0) != 0 || line.size() < 3 || line[2] == ';') continue;
+
+			++statistics.instructions;
+			if (const size_t call = line.find("@dx.op."); call != string::npos) {
+				++statistics.intrinsics;
+				if (line.compare(call + 7, 4, "wave") == 0) ++statistics.waveIntrinsics;
+			}
+			if (line.find(" half") != string::npos || line.find(" i16") != string::npos) ++statistics.halfInstructions;
+		}
+		return statistics;
+	}
+
+	vector<std::byte> ReadFile(const filesystem::path& path)
+	{
+		ifstream in(path, ios::binary);
+		if (!in) throw runtime_error{ "cannot open " + path.string() };
+		vector<std::byte> data(static_cast<size_t>(filesystem::file_size(path)));
+		in.read(reinterpret_cast<char*>(data.data()), static_cast<streamsize>(data.size()));
+		return data;
+	}
+
+	string Quote(const filesystem::path& path)
+	{
+		return '"' + path.string() + '"';
+	}
+
+	int Run(const string& command)
+	{
+#ifdef _WIN32
+		// cmd.exe drops the first and last quote of a command line that starts with one.
+		return system(('"' + command + '"').c_str());
+#else
+		return system(command.c_str());
+#endif
+	}
+
+	// ps_5_1 and 6_2 give ps_6_2.
+	string GetTarget(const string& target, const string& shaderModel)
+	{
+		return target.substr(0, target.find('_') + 1) + shaderModel;
+	}
+
+	bool Has16BitTypes(const string& shaderModel)
+	{
+		const int major = stoi(shaderModel);
+		const int minor = stoi(shaderModel.substr(shaderModel.find('_') + 1));
+		return major > 6 || (major == 6 && minor >= 2);
+	}
+
+	// A pixel shader's -Fc output in DXC's layout, cut down to a two-block function: 16 instructions,
+	// 5 dx.op calls, one of them a wave intrinsic, and 4 instructions on half values.
+	constexpr const char* CannedDisassembly = R"(;
+; Input signature:
+;
+; Name                 Index   Mask Register SysValue  Format   Used
+; -------------------- ----- ------ -------- -------- ------- ------
+; SV_Position              0   xyzw        0      POS   float
+; NORMAL                   0   xyz         1     NONE   float   xyz
+;
+; Output signature:
+;
+; Name                 Index   Mask Register SysValue  Format   Used
+; -------------------- ----- ------ -------- -------- ------- ------
+; SV_Target                0   xyzw        0   TARGET   float   xyzw
+;
+target datalayout = "e-m:e-p:32:32-i1:32-i16:16-i32:32-i64:64-f16:16-f32:32-f64:64-n8:16:32:64"
+target triple = "dxil-ms-dx"
+
+%dx.types.Handle = type { i8* }
+%dx.types.CBufRet.i32 = type { i32, i32, i32, i32 }
+%dx.types.fouri32 = type { i32, i32, i32, i32 }
+
+define void @main() {
+  %1 = call %dx.types.Handle @dx.op.createHandle(i32 57, i8 2, i32 0, i32 0, i1 false)  ; CreateHandle(resourceClass,rangeId,index,nonUniformIndex)
+  %2 = call float @dx.op.loadInput.f32(i32 4, i32 1, i32 0, i8 0, i32 undef)  ; LoadInput(inputSigId,rowIndex,colIndex,gsStreamID)
+  %3 = call %dx.types.CBufRet.i32 @dx.op.cbufferLoadLegacy.i32(i32 59, %dx.types.Handle %1, i32 0)  ; CBufferLoadLegacy(handle,regIndex)
+  %4 = extractvalue %dx.types.CBufRet.i32 %3, 2
+  %5 = icmp eq i32 %4, 0
+  br i1 %5, label %12, label %6
+
+; <label>:6                                       ; preds = %0
+  %7 = fcmp fast olt float %2, 1.000000e+00
+  %8 = call %dx.types.fouri32 @dx.op.waveActiveBallot(i32 116, i1 %7)  ; WaveActiveBallot(cond)
+  %9 = extractvalue %dx.types.fouri32 %8, 0
+  %10 = fptrunc float %2 to half
+  %11 = fmul fast half %10, 0xH3800
+  br label %12
+
+; <label>:12                                      ; preds = %6, %0
+  %13 = phi half [ %11, %6 ], [ 0xH0000, %0 ]
+  %14 = fpext half %13 to float
+  call void @dx.op.storeOutput.f32(i32 5, i32 0, i32 0, i8 0, float %14)  ; StoreOutput(outputSigId,rowIndex,colIndex,value)
+  ret void
+}
+
+; Function Attrs: nounwind readnone
+declare float @dx.op.loadInput.f32(i32, i32, i32, i8, i32) #0
+
+; Function Attrs: nounwind
+declare void @dx.op.storeOutput.f32(i32, i32, i32, i8, float) #1
+
+attributes #0 = { nounwind readnone }
+attributes #1 = { nounwind }
+
+!dx.version = !{!1}
+!1 = !{i32 1, i32 2}
+)";
+
+	void Append32(vector<std::byte>& data, uint32_t value)
+	{
+		for (int shift = 0; shift < 32; shift += 8) data.push_back(static_cast<std::byte>(value >> shift & 0xFF));
+	}
+
+	uint32_t Read32(const vector<std::byte>& data, size_t offset)
+	{
+		uint32_t value = 0;
+		for (int shift = 0; shift < 32; shift += 8) value |= to_integer<uint32_t>(data[offset + shift / 8]) << shift;
+		return value;
+	}
+
+	void Write32(vector<std::byte>& data, size_t offset, uint32_t value)
+	{
+		for (int shift = 0; shift < 32; shift += 8) data[offset + shift / 8] = static_cast<std::byte>(value >> shift & 0xFF);
+	}
+
+	uint32_t FourCc(const char (&text)[5])
+	{
+		return static_cast<uint32_t>(text[0]) | static_cast<uint32_t>(text[1]) << 8 |
+			static_cast<uint32_t>(text[2]) << 16 | static_cast<uint32_t>(text[3]) << 24;
+	}
+
+	// A DXBC container in the layout DXC writes: five parts, the fourth a 32-byte DXIL part holding
+	// a ps_6_2 program header, the bitcode header and the bitcode magic. Without DXIL there are four,
+	// and an unsigned one has a zero digest.
+	vector<std::byte> MakeContainer(bool withDxil, bool hashed)
+	{
+		vector<vector<std::byte>> parts;
+		const auto addPart = [&](uint32_t fourCc, const vector<uint32_t>& words) {
+			vector<std::byte> part;
+			Append32(part, fourCc);
+			Append32(part, static_cast<uint32_t>(words.size() * sizeof(uint32_t)));
+			for (uint32_t word : words) Append32(part, word);
+			parts.push_back(move(part));
+			};
+		addPart(FourCc("SFI0"), { 0, 0 });
+		addPart(FourCc("ISG1"), { 0, 8 });
+		addPart(FourCc("OSG1"), { 0, 8 });
+		if (withDxil) addPart(FourCc("DXIL"), { 0x62, 8, FourCc("DXIL"), 0x102, 16, 8, 0xDEC04342, 0 });
+		addPart(FourCc("HASH"), { 0, 0x01234567, 0x89ABCDEF, 0x01234567, 0x89ABCDEF });
+
+		vector<std::byte> container;
+		Append32(container, FourCc("DXBC"));
+		for (uint32_t word = 0; word < 4; ++word) Append32(container, hashed ? 0x9E3779B9 * (word + 1) : 0);
+		Append32(container, 1);
+		const size_t sizeOffset = container.size();
+		Append32(container, 0);
+		Append32(container, static_cast<uint32_t>(parts.size()));
+		size_t offset = container.size() + parts.size() * sizeof(uint32_t);
+		for (const auto& part : parts) {
+			Append32(container, static_cast<uint32_t>(offset));
+			offset += part.size();
+		}
+		for (const auto& part : parts) container.insert(container.end(), part.begin(), part.end());
+		Write32(container, sizeOffset, static_cast<uint32_t>(container.size()));
+		return container;
+	}
+}
+
+void Dxc::Build(const filesystem::path& manifest, const filesystem::path& outputDirectory,
+	const string& compiler, bool debug)
+{
+	const Shaders::Manifest list = Shaders::ReadManifest(manifest);
+	const filesystem::path output = !outputDirectory.empty() ? outputDirectory : list.dxilDirectory;
+	filesystem::create_directories(output);
+	// A half-built set must not pass for a current one.
+	error_code error;
+	filesystem::remove(output / Dxil::SourcesFile, error);
+
+	string options = " -nologo -HV 2021";
+	if (Has16BitTypes(list.shaderModel)) options += " -enable-16bit-types";
+	options += debug ? " -Zi -Qembed_debug -Od" : " -O3";
+
+	vector<Result> results(list.programs.size());
+	const auto start = chrono::steady_clock::now();
+	Parallel::For(0, list.programs.size(), [&](size_t index) {
+		const Shaders::Program& program = list.programs[index];
+		Dxil::Defines defines;
+		for (size_t i = 0; i < program.names.size(); ++i) defines.emplace_back(program.names[i], program.values[i]);
+
+		Result& result = results[index];
+		result.name = Dxil::GetBlobName(program.file, defines, program.entry);
+		const filesystem::path blob = output / result.name;
+		filesystem::path disassembly = blob, log = blob;
+		disassembly.replace_extension(".txt");
+		log.replace_extension(".log");
+
+		string command = Quote(compiler) + options + " -T " + GetTarget(program.target, list.shaderModel) +
+			" -E " + program.entry;
+		for (const auto& [name, value] : defines) command += " -D " + name + '=' + value;
+		command += " -Fo " + Quote(blob) + " -Fc " + Quote(disassembly) + ' ' + Quote(list.sourceDirectory / program.file) +
+			" 2> " + Quote(log);
+		result.exitCode = Run(command);
+		if (result.exitCode != 0) return;
+
+		result.blob = ReadFile(blob);
+		ifstream in{ disassembly };
+		result.statistics = ReadDisassembly(in);
+		filesystem::remove(log, error);
+		});
+	const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+	vector<string> failures;
+	Statistics total;
+	for (const Result& result : results) {
+		if (result.exitCode != 0) {
+			filesystem::path log = output / result.name;
+			log.replace_extension(".log");
+			ifstream in{ log };
+			failures.push_back(result.name + ": dxc exited with " + to_string(result.exitCode) + "\n" +
+				string{ istreambuf_iterator<char>{ in }, istreambuf_iterator<char>{} });
+			continue;
+		}
+		const Dxil::ContainerInfo info = Dxil::InspectContainer(result.blob);
+		if (!info.valid) failures.push_back(result.name + ": not a DXIL container");
+		else if (!info.hashed) failures.push_back(result.name + ": container is not hashed; use a DXC that signs DXIL");
+
+		const Statistics& statistics = result.statistics;
+		cout << result.name << ": " << result.blob.size() << " bytes, " << statistics.instructions << " instructions, "
+			<< statistics.intrinsics << " dx.op calls, " << statistics.waveIntrinsics << " wave, "
+			<< statistics.halfInstructions << " 16-bit" << endl;
+		total.instructions += statistics.instructions;
+		total.waveIntrinsics += statistics.waveIntrinsics;
+		total.halfInstructions += statistics.halfInstructions;
+	}
+	if (!failures.empty()) {
+		string message = "dxc: " + to_string(failures.size()) + " of " + to_string(results.size()) + " programs failed";
+		for (const string& failure : failures) message += "\n" + failure;
+		throw runtime_error{ message };
+	}
+
+	ofstream{ output / Dxil::SourcesFile } << hex << setw(16) << setfill('0') << Dxil::HashSources(list.sourceDirectory) << endl;
+	cout << results.size() << " programs in " << elapsed.count() << " ms, shader model " << list.shaderModel << ": "
+		<< total.instructions << " instructions, " << total.waveIntrinsics << " wave, " << total.halfInstructions
+		<< " 16-bit (" << output.string() << ")" << endl;
+}
+
+void Dxc::Check()
+{
+	const auto check = [](bool condition, const string& what) {
+		if (!condition) throw runtime_error{ "dxc check: " + what };
+		};
+
+	istringstream disassembly{ CannedDisassembly };
+	const Statistics statistics = ReadDisassembly(disassembly);
+	check(statistics.instructions == 16, "counted " + to_string(statistics.instructions) + " instructions, not 16");
+	check(statistics.intrinsics == 5, "counted " + to_string(statistics.intrinsics) + " dx.op calls, not 5");
+	check(statistics.waveIntrinsics == 1, "counted " + to_string(statistics.waveIntrinsics) + " wave intrinsics, not 1");
+	check(statistics.halfInstructions == 4, "counted " + to_string(statistics.halfInstructions) + " 16-bit instructions, not 4");
+
+	const vector<std::byte> container = MakeContainer(true, true);
+	const Dxil::ContainerInfo info = Dxil::InspectContainer(container);
+	check(info.valid && info.hashed, "a signed container was refused");
+	check(info.partCount == 5 && info.dxilBytes == 32, "the parts of a container were misread");
+	check(Dxil::InspectContainer(MakeContainer(true, false)).valid, "an unsigned container was not read");
+	check(!Dxil::InspectContainer(MakeContainer(true, false)).hashed, "an unsigned container passed as signed");
+	check(!Dxil::InspectContainer(MakeContainer(false, true)).valid, "a container without DXIL passed");
+
+	const auto refused = [&](const string& what, const auto& change) {
+		vector<std::byte> broken = container;
+		change(broken);
+		check(!Dxil::InspectContainer(broken).valid, "a container with " + what + " passed");
+		};
+	refused("another magic", [](auto& data) { Write32(data, 0, FourCc("DXBD")); });
+	refused("a wrong total size", [](auto& data) { data.push_back(std::byte{ 0 }); });
+	refused("a truncated header", [](auto& data) { data.resize(24); });
+	refused("too many parts", [](auto& data) { Write32(data, 28, 1000); });
+	constexpr size_t DxilOffset = 32 + 3 * sizeof(uint32_t);
+	refused("a part past the end", [](auto& data) { Write32(data, DxilOffset, static_cast<uint32_t>(data.size())); });
+	refused("an oversized part", [](auto& data) { Write32(data, Read32(data, DxilOffset) + 4, 1000); });
+
+	check(Dxil::GetBlobName("terrain.hlsl", { { "VIRTUAL_TEXTURE", "1" }, { "SPOT_LIGHTS", "32" } }, "PIXEL_MAIN") ==
+		"terrain.PIXEL_MAIN.VIRTUAL_TEXTURE=1.SPOT_LIGHTS=32.dxil", "blob names changed");
+	check(GetTarget("ps_5_1", "6_2") == "ps_6_2" && GetTarget("ds_5_1", "6_0") == "ds_6_0", "targets are not raised");
+	check(Has16BitTypes("6_2") && Has16BitTypes("7_0") && !Has16BitTypes("6_1"), "16-bit types are enabled for the wrong models");
+	cout << "dxc: disassembly counts, container checks, blob names and targets hold" << endl;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <filesystem>
+#include <string>
+
+namespace Dxc
+{
+	// Builds the Shader Model 6 set of a shader manifest (see Shaders::ReadManifest) with the DXC
+	// executable `compiler`, into the manifest's "dxil" directory unless `outputDirectory` is given.
+	// Every FXC target is raised to the manifest's "shaderModel", with 16-bit types from 6.2 on.
+	// Each blob gets its disassembly beside it, and a line of blob size, DXIL instructions, dx.op
+	// calls, wave intrinsics and 16-bit instructions is printed per program.
+	//
+	// Throws when a program fails to compile or its container is malformed or unhashed, and only
+	// a fully built set gets the sources file the game checks. Needs nothing but DXC, so it runs on
+	// Linux as well.
+	void Build(const std::filesystem::path& manifest, const std::filesystem::path& outputDirectory,
+		const std::string& compiler, bool debug);
+
+	// Checks Build's reading of DXC output without DXC: the instruction, dx.op, wave and 16-bit
+	// counts of a canned disassembly, InspectContainer on a canned container, signed and unsigned,
+	// and on broken copies of it, and the blob names and raised targets. Throws on the first failure.
+	void Check();
+}
@@ -0,0 +1,731 @@
+#include "importer.h"
+#include "json.h"
+#include "../Common/parallel.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	using Clock = chrono::steady_clock;
+
+	double SecondsSince(Clock::time_point start)
+	{
+		return chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	vector<char> ReadFile(const filesystem::path& path)
+	{
+		ifstream in(path, ios::binary);
+		if (!in) throw runtime_error{ "cannot open " + path.string() };
+		vector<char> data(static_cast<size_t>(filesystem::file_size(path)));
+		in.read(data.data(), static_cast<streamsize>(data.size()));
+		return data;
+	}
+
+	// OBJ and glTF are right-handed; the renderer is left-handed with clockwise front faces.
+	XMFLOAT3 ToLeftHanded(XMFLOAT3 v)
+	{
+		return XMFLOAT3{ v.x, v.y, -v.z };
+	}
+
+	void GenerateNormals(ImportSubMesh& submesh, const vector<bool>& missing, size_t firstVertex = 0)
+	{
+		vector<XMFLOAT3> sums(submesh.vertices.size() - firstVertex, XMFLOAT3{ 0.f, 0.f, 0.f });
+		for (size_t i = 0; i + 2 < submesh.indices.size(); i += 3) {
+			const uint32_t index[3]{ submesh.indices[i], submesh.indices[i + 1], submesh.indices[i + 2] };
+			if (index[0] < firstVertex || index[1] < firstVertex || index[2] < firstVertex) continue;
+
+			const XMVECTOR p0 = XMLoadFloat3(&submesh.vertices[index[0]].position);
+			const XMVECTOR p1 = XMLoadFloat3(&submesh.vertices[index[1]].position);
+			const XMVECTOR p2 = XMLoadFloat3(&submesh.vertices[index[2]].position);
+			const XMVECTOR faceNormal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+			for (uint32_t corner : index) {
+				XMFLOAT3& sum = sums[corner - firstVertex];
+				XMStoreFloat3(&sum, XMVectorAdd(XMLoadFloat3(&sum), faceNormal));
+			}
+		}
+		for (size_t i = firstVertex; i < submesh.vertices.size(); ++i) {
+			if (!missing[i - firstVertex]) continue;
+			XMStoreFloat3(&submesh.vertices[i].normal, XMVector3Normalize(XMLoadFloat3(&sums[i - firstVertex])));
+		}
+	}
+}
+
+// --------------------------------------------------------------------------------------
+// OBJ
+// --------------------------------------------------------------------------------------
+namespace
+{
+	constexpr int32_t MissingIndex = INT32_MIN;
+	// A rebased MissingIndex; every other negative index is out of range.
+	constexpr int64_t AbsentIndex = INT64_MIN;
+
+	enum ObjRelative : uint8_t
+	{
+		RelativePosition = 0x1,
+		RelativeUv = 0x2,
+		RelativeNormal = 0x4,
+	};
+
+	struct ObjCorner
+	{
+		int32_t position;
+		int32_t uv;
+		int32_t normal;
+		uint8_t relative;
+	};
+
+	struct ObjChunk
+	{
+		vector<XMFLOAT3>	positions;
+		vector<XMFLOAT2>	uvs;
+		vector<XMFLOAT3>	normals;
+		vector<ObjCorner>	corners;
+		vector<pair<size_t, string>> materialChanges;
+
+		size_t positionBase = 0;
+		size_t uvBase = 0;
+		size_t normalBase = 0;
+	};
+
+	bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	const char* SkipBlank(const char* p, const char* end)
+	{
+		while (p < end && IsBlank(*p)) ++p;
+		return p;
+	}
+
+	const char* ParseFloat(const char* p, const char* end, float& value)
+	{
+		p = SkipBlank(p, end);
+		if (p < end && *p == '+') ++p;
+		auto [next, error] = from_chars(p, end, value);
+		if (error != errc{}) value = 0.f;
+		return next;
+	}
+
+	const char* ParseIndex(const char* p, const char* end, int32_t& value)
+	{
+		if (p < end && *p == '+') ++p;
+		auto [next, error] = from_chars(p, end, value);
+		if (error != errc{}) value = MissingIndex;
+		return next;
+	}
+
+	// Absolute indices become 0-based global indices. Relative (negative) indices become
+	// chunk-local indices flagged in ObjCorner::relative and are rebased once chunk sizes are known.
+	int32_t ResolveLocal(int32_t index, size_t localCount, uint8_t flag, uint8_t& relative)
+	{
+		if (index == MissingIndex) return MissingIndex;
+		// OBJ counts from 1, so 0 names nothing and is rejected as out of range.
+		if (index >= 0) return index - 1;
+		relative |= flag;
+		return static_cast<int32_t>(localCount) + index;
+	}
+
+	void ParseObjChunk(const char* begin, const char* end, ObjChunk& chunk)
+	{
+		vector<ObjCorner> polygon;
+		for (const char* line = begin; line < end; ) {
+			const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+			if (!lineEnd) lineEnd = end;
+
+			const char* p = SkipBlank(line, lineEnd);
+			if (lineEnd - p >= 2 && p[0] == 'v' && IsBlank(p[1])) {
+				XMFLOAT3 position;
+				p = ParseFloat(p + 1, lineEnd, position.x);
+				p = ParseFloat(p, lineEnd, position.y);
+				p = ParseFloat(p, lineEnd, position.z);
+				chunk.positions.push_back(position);
+			}
+			else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && IsBlank(p[2])) {
+				XMFLOAT2 uv;
+				p = ParseFloat(p + 2, lineEnd, uv.x);
+				p = ParseFloat(p, lineEnd, uv.y);
+				chunk.uvs.push_back(uv);
+			}
+			else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && IsBlank(p[2])) {
+				XMFLOAT3 normal;
+				p = ParseFloat(p + 2, lineEnd, normal.x);
+				p = ParseFloat(p, lineEnd, normal.y);
+				p = ParseFloat(p, lineEnd, normal.z);
+				chunk.normals.push_back(normal);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'f' && IsBlank(p[1])) {
+				polygon.clear();
+				p = SkipBlank(p + 1, lineEnd);
+				while (p < lineEnd) {
+					int32_t position = MissingIndex, uv = MissingIndex, normal = MissingIndex;
+					p = ParseIndex(p, lineEnd, position);
+					if (p < lineEnd && *p == '/') {
+						++p;
+						if (p < lineEnd && *p != '/') p = ParseIndex(p, lineEnd, uv);
+						if (p < lineEnd && *p == '/') p = ParseIndex(p + 1, lineEnd, normal);
+					}
+					while (p < lineEnd && !IsBlank(*p)) ++p;
+					p = SkipBlank(p, lineEnd);
+
+					ObjCorner corner{};
+					corner.position = ResolveLocal(position, chunk.positions.size(), RelativePosition, corner.relative);
+					corner.uv = ResolveLocal(uv, chunk.uvs.size(), RelativeUv, corner.relative);
+					corner.normal = ResolveLocal(normal, chunk.normals.size(), RelativeNormal, corner.relative);
+					if (corner.position != MissingIndex) polygon.push_back(corner);
+				}
+				// Fan triangulation with reversed winding for the handedness flip.
+				for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+					chunk.corners.push_back(polygon[0]);
+					chunk.corners.push_back(polygon[i + 1]);
+					chunk.corners.push_back(polygon[i]);
+				}
+			}
+			else if (lineEnd - p > 7 && string_view{ p, 6 } == "usemtl" && IsBlank(p[6])) {
+				const char* name = SkipBlank(p + 6, lineEnd);
+				const char* nameEnd = lineEnd;
+				while (nameEnd > name && IsBlank(nameEnd[-1])) --nameEnd;
+				chunk.materialChanges.emplace_back(chunk.corners.size(), string{ name, nameEnd });
+			}
+			line = lineEnd + 1;
+		}
+	}
+
+	struct ObjVertexKey
+	{
+		int64_t position;
+		int64_t uv;
+		int64_t normal;
+
+		bool operator==(const ObjVertexKey&) const = default;
+	};
+
+	struct ObjVertexKeyHash
+	{
+		size_t operator()(const ObjVertexKey& key) const noexcept
+		{
+			uint64_t h = static_cast<uint64_t>(key.position) * 0x9E3779B97F4A7C15ull;
+			h ^= static_cast<uint64_t>(key.uv) + 0x7F4A7C159E3779B9ull + (h << 6) + (h >> 2);
+			h ^= static_cast<uint64_t>(key.normal) + 0x94D049BB133111EBull + (h << 6) + (h >> 2);
+			return static_cast<size_t>(h);
+		}
+	};
+
+	int64_t Rebase(int32_t index, bool relative, size_t base)
+	{
+		if (index == MissingIndex) return AbsentIndex;
+		return relative ? static_cast<int64_t>(base) + index : index;
+	}
+}
+
+ImportedMesh Importer::ImportObj(const string& fileName)
+{
+	ImportedMesh result;
+
+	auto start = Clock::now();
+	const vector<char> text = ReadFile(fileName);
+	result.statistics.inputBytes = text.size();
+	result.statistics.readSeconds = SecondsSince(start);
+
+	// Parse: split at line boundaries so every worker owns whole lines.
+	start = Clock::now();
+	const size_t chunkCount = min<size_t>(Parallel::GetWorkerCount() * 4, max<size_t>(1, text.size() >> 20));
+	vector<size_t> cuts{ 0 };
+	for (size_t i = 1; i < chunkCount; ++i) {
+		size_t cut = max(cuts.back(), text.size() * i / chunkCount);
+		while (cut < text.size() && text[cut] != '\n') ++cut;
+		cuts.push_back(min(cut + 1, text.size()));
+	}
+	cuts.push_back(text.size());
+
+	vector<ObjChunk> chunks(chunkCount);
+	Parallel::For(0, chunkCount, [&](size_t i) {
+		ParseObjChunk(text.data() + cuts[i], text.data() + cuts[i + 1], chunks[i]);
+		});
+
+	size_t positionCount = 0, uvCount = 0, normalCount = 0;
+	for (auto& chunk : chunks) {
+		chunk.positionBase = positionCount;
+		chunk.uvBase = uvCount;
+		chunk.normalBase = normalCount;
+		positionCount += chunk.positions.size();
+		uvCount += chunk.uvs.size();
+		normalCount += chunk.normals.size();
+	}
+
+	vector<XMFLOAT3> positions(positionCount), normals(normalCount);
+	vector<XMFLOAT2> uvs(uvCount);
+	Parallel::For(0, chunkCount, [&](size_t i) {
+		auto& chunk = chunks[i];
+		ranges::copy(chunk.positions, positions.begin() + chunk.positionBase);
+		ranges::copy(chunk.uvs, uvs.begin() + chunk.uvBase);
+		ranges::copy(chunk.normals, normals.begin() + chunk.normalBase);
+		vector<XMFLOAT3>{}.swap(chunk.positions);
+		vector<XMFLOAT2>{}.swap(chunk.uvs);
+		vector<XMFLOAT3>{}.swap(chunk.normals);
+		});
+
+	// Material ranges: a chunk inherits the material that was active where the previous one ended.
+	vector<string> materialNames;
+	unordered_map<string, uint32_t> materialIds;
+	auto getMaterialId = [&](const string& name) {
+		auto [it, inserted] = materialIds.try_emplace(name, static_cast<uint32_t>(materialNames.size()));
+		if (inserted) materialNames.push_back(name);
+		return it->second;
+		};
+	vector<vector<pair<size_t, uint32_t>>> chunkMaterials(chunkCount);
+	uint32_t currentMaterial = getMaterialId("");
+	for (size_t i = 0; i < chunkCount; ++i) {
+		chunkMaterials[i].emplace_back(0, currentMaterial);
+		for (const auto& [corner, name] : chunks[i].materialChanges) {
+			currentMaterial = getMaterialId(name);
+			chunkMaterials[i].emplace_back(corner, currentMaterial);
+		}
+	}
+	result.statistics.parseSeconds = SecondsSince(start);
+
+	// Build: deduplicate corners per (chunk, material), then stitch chunks together per material.
+	start = Clock::now();
+	const size_t materialCount = materialNames.size();
+	vector<vector<ImportSubMesh>> partial(chunkCount, vector<ImportSubMesh>(materialCount));
+	vector<vector<vector<bool>>> partialMissing(chunkCount, vector<vector<bool>>(materialCount));
+	Parallel::For(0, chunkCount, [&](size_t c) {
+		const ObjChunk& chunk = chunks[c];
+		vector<unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash>> lookup(materialCount);
+		const auto& segments = chunkMaterials[c];
+		for (size_t s = 0; s < segments.size(); ++s) {
+			const uint32_t material = segments[s].second;
+			const size_t last = s + 1 < segments.size() ? segments[s + 1].first : chunk.corners.size();
+			ImportSubMesh& submesh = partial[c][material];
+			vector<bool>& missing = partialMissing[c][material];
+
+			for (size_t i = segments[s].first; i < last; ++i) {
+				const ObjCorner& corner = chunk.corners[i];
+				const ObjVertexKey key{
+					Rebase(corner.position, corner.relative & RelativePosition, chunk.positionBase),
+					Rebase(corner.uv, corner.relative & RelativeUv, chunk.uvBase),
+					Rebase(corner.normal, corner.relative & RelativeNormal, chunk.normalBase) };
+				const auto outOfRange = [](int64_t index, size_t count) { return index < 0 || index >= static_cast<int64_t>(count); };
+				if (outOfRange(key.position, positionCount) || (key.uv != AbsentIndex && outOfRange(key.uv, uvCount)) ||
+					(key.normal != AbsentIndex && outOfRange(key.normal, normalCount))) {
+					throw runtime_error{ "obj: face index out of range in " + fileName };
+				}
+
+				auto [it, inserted] = lookup[material].try_emplace(key, static_cast<uint32_t>(submesh.vertices.size()));
+				if (inserted) {
+					ImportVertex vertex{};
+					vertex.position = ToLeftHanded(positions[key.position]);
+					if (key.uv >= 0) vertex.uv = XMFLOAT2{ uvs[key.uv].x, 1.f - uvs[key.uv].y };
+					if (key.normal >= 0) vertex.normal = ToLeftHanded(normals[key.normal]);
+					submesh.vertices.push_back(vertex);
+					missing.push_back(key.normal < 0);
+				}
+				submesh.indices.push_back(it->second);
+			}
+		}
+		});
+
+	Parallel::For(0, materialCount, [&](size_t m) {
+		ImportSubMesh submesh;
+		submesh.material = materialNames[m];
+		vector<bool> missing;
+		size_t vertexCount = 0, indexCount = 0;
+		for (size_t c = 0; c < chunkCount; ++c) {
+			vertexCount += partial[c][m].vertices.size();
+			indexCount += partial[c][m].indices.size();
+		}
+		submesh.vertices.reserve(vertexCount);
+		submesh.indices.reserve(indexCount);
+		missing.reserve(vertexCount);
+		for (size_t c = 0; c < chunkCount; ++c) {
+			ImportSubMesh& part = partial[c][m];
+			const uint32_t offset = static_cast<uint32_t>(submesh.vertices.size());
+			submesh.vertices.insert(submesh.vertices.end(), part.vertices.begin(), part.vertices.end());
+			for (uint32_t index : part.indices) submesh.indices.push_back(index + offset);
+			missing.insert(missing.end(), partialMissing[c][m].begin(), partialMissing[c][m].end());
+			part = ImportSubMesh{};
+		}
+		if (ranges::find(missing, true) != missing.end()) GenerateNormals(submesh, missing);
+		partial[0][m] = move(submesh);
+		});
+
+	for (size_t m = 0; m < materialCount; ++m) {
+		if (partial[0][m].indices.empty()) continue;
+		result.submeshes.push_back(move(partial[0][m]));
+	}
+	result.statistics.buildSeconds = SecondsSince(start);
+	return result;
+}
+
+// --------------------------------------------------------------------------------------
+// glTF 2.0 (.gltf with external or embedded buffers, .glb)
+// --------------------------------------------------------------------------------------
+namespace
+{
+	constexpr uint32_t GlbMagic = 0x46546C67;
+	constexpr uint32_t GlbChunkJson = 0x4E4F534A;
+	constexpr uint32_t GlbChunkBin = 0x004E4942;
+
+	enum GltfComponentType
+	{
+		GltfByte = 5120,
+		GltfUnsignedByte = 5121,
+		GltfShort = 5122,
+		GltfUnsignedShort = 5123,
+		GltfUnsignedInt = 5125,
+		GltfFloat = 5126,
+	};
+
+	vector<char> DecodeBase64(string_view text)
+	{
+		auto decode = [](char c) -> int {
+			if (c >= 'A' && c <= 'Z') return c - 'A';
+			if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+			if (c >= '0' && c <= '9') return c - '0' + 52;
+			if (c == '+' || c == '-') return 62;
+			if (c == '/' || c == '_') return 63;
+			return -1;
+			};
+
+		vector<char> out;
+		out.reserve(text.size() * 3 / 4);
+		uint32_t bits = 0;
+		int bitCount = 0;
+		for (char c : text) {
+			const int value = decode(c);
+			if (value < 0) continue;
+			bits = (bits << 6) | static_cast<uint32_t>(value);
+			bitCount += 6;
+			if (bitCount >= 8) {
+				bitCount -= 8;
+				out.push_back(static_cast<char>((bits >> bitCount) & 0xFF));
+			}
+		}
+		return out;
+	}
+
+	class GltfDocument
+	{
+	public:
+		GltfDocument(const filesystem::path& path, ImportStatistics& statistics)
+		{
+			auto start = Clock::now();
+			vector<char> file = ReadFile(path);
+			statistics.inputBytes = file.size();
+
+			string_view json{ file.data(), file.size() };
+			vector<char> glbBinary;
+			uint32_t magic = 0;
+			if (file.size() >= 12) memcpy(&magic, file.data(), sizeof(magic));
+			if (magic == GlbMagic) {
+				size_t offset = 12;
+				json = {};
+				while (offset + 8 <= file.size()) {
+					uint32_t length, type;
+					memcpy(&length, file.data() + offset, sizeof(length));
+					memcpy(&type, file.data() + offset + 4, sizeof(type));
+					offset += 8;
+					if (offset + length > file.size()) throw runtime_error{ "glb: truncated chunk" };
+					if (type == GlbChunkJson) json = { file.data() + offset, length };
+					else if (type == GlbChunkBin) glbBinary.assign(file.data() + offset, file.data() + offset + length);
+					offset += (length + 3) & ~3u;
+				}
+			}
+			m_json = JsonValue::Parse(json);
+
+			for (const auto& buffer : m_json["buffers"].IsArray() ? m_json["buffers"].GetArray() : JsonValue::Array{}) {
+				if (!buffer.Contains("uri")) {
+					m_buffers.push_back(move(glbBinary));
+					continue;
+				}
+				const string& uri = buffer["uri"].GetString();
+				if (uri.starts_with("data:")) {
+					m_buffers.push_back(DecodeBase64(string_view{ uri }.substr(uri.find(',') + 1)));
+				}
+				else {
+					const auto bufferPath = path.parent_path() / filesystem::u8path(uri);
+					statistics.inputBytes += filesystem::file_size(bufferPath);
+					m_buffers.push_back(ReadFile(bufferPath));
+				}
+			}
+			statistics.readSeconds = SecondsSince(start);
+		}
+
+		const JsonValue& Json() const { return m_json; }
+
+		// Reads any float or (normalized) integer accessor as `components` floats per element.
+		vector<float> ReadFloats(int accessorIndex, int components) const
+		{
+			const JsonValue& accessor = m_json["accessors"][accessorIndex];
+			const size_t count = static_cast<size_t>(accessor["count"].GetNumber());
+			const int componentType = static_cast<int>(accessor["componentType"].GetNumber());
+			const bool normalized = accessor["normalized"].IsNull() ? false : accessor["normalized"].GetBool();
+
+			vector<float> out(count * components, 0.f);
+			if (!accessor.Contains("bufferView")) return out;
+			const auto [data, stride] = Locate(accessor, components * ComponentSize(componentType));
+			for (size_t i = 0; i < count; ++i) {
+				const char* element = data + i * stride;
+				for (int c = 0; c < components; ++c) {
+					out[i * components + c] = ReadComponent(element, c, componentType, normalized);
+				}
+			}
+			return out;
+		}
+
+		vector<uint32_t> ReadIndices(int accessorIndex) const
+		{
+			const JsonValue& accessor = m_json["accessors"][accessorIndex];
+			const size_t count = static_cast<size_t>(accessor["count"].GetNumber());
+			const int componentType = static_cast<int>(accessor["componentType"].GetNumber());
+			const auto [data, stride] = Locate(accessor, ComponentSize(componentType));
+
+			vector<uint32_t> out(count);
+			for (size_t i = 0; i < count; ++i) {
+				const char* element = data + i * stride;
+				switch (componentType)
+				{
+				case GltfUnsignedByte: out[i] = static_cast<uint8_t>(*element); break;
+				case GltfUnsignedShort: { uint16_t v; memcpy(&v, element, sizeof(v)); out[i] = v; break; }
+				case GltfUnsignedInt: memcpy(&out[i], element, sizeof(uint32_t)); break;
+				default: throw runtime_error{ "gltf: unsupported index type" };
+				}
+			}
+			return out;
+		}
+
+	private:
+		static size_t ComponentSize(int componentType)
+		{
+			switch (componentType)
+			{
+			case GltfByte: case GltfUnsignedByte: return 1;
+			case GltfShort: case GltfUnsignedShort: return 2;
+			case GltfUnsignedInt: case GltfFloat: return 4;
+			default: throw runtime_error{ "gltf: unknown component type" };
+			}
+		}
+
+		static float ReadComponent(const char* element, int c, int componentType, bool normalized)
+		{
+			switch (componentType)
+			{
+			case GltfFloat: { float v; memcpy(&v, element + c * 4, sizeof(v)); return v; }
+			case GltfUnsignedByte: { const float v = static_cast<uint8_t>(element[c]); return normalized ? v / 255.f : v; }
+			case GltfByte: { const float v = static_cast<int8_t>(element[c]); return normalized ? max(v / 127.f, -1.f) : v; }
+			case GltfUnsignedShort: { uint16_t v; memcpy(&v, element + c * 2, sizeof(v)); return normalized ? v / 65535.f : v; }
+			case GltfShort: { int16_t v; memcpy(&v, element + c * 2, sizeof(v)); return normalized ? max(v / 32767.f, -1.f) : v; }
+			case GltfUnsignedInt: { uint32_t v; memcpy(&v, element + c * 4, sizeof(v)); return static_cast<float>(v); }
+			default: return 0.f;
+			}
+		}
+
+		pair<const char*, size_t> Locate(const JsonValue& accessor, size_t elementSize) const
+		{
+			if (accessor.Contains("sparse")) throw runtime_error{ "gltf: sparse accessors are not supported" };
+			const JsonValue& view = m_json["bufferViews"][static_cast<size_t>(accessor["bufferView"].GetNumber())];
+			const auto& buffer = m_buffers.at(static_cast<size_t>(view["buffer"].GetNumber()));
+			const size_t offset = static_cast<size_t>(view.GetNumber("byteOffset", 0) + accessor.GetNumber("byteOffset", 0));
+			const size_t stride = static_cast<size_t>(view.GetNumber("byteStride", static_cast<double>(elementSize)));
+			const size_t count = static_cast<size_t>(accessor["count"].GetNumber());
+			if (count && offset + (count - 1) * stride + elementSize > buffer.size()) {
+				throw runtime_error{ "gltf: accessor exceeds buffer" };
+			}
+			return { buffer.data() + offset, stride };
+		}
+
+	private:
+		JsonValue				m_json;
+		vector<vector<char>>	m_buffers;
+	};
+
+	struct GltfDrawItem
+	{
+		int			mesh;
+		int			primitive;
+		XMFLOAT4X4	world;
+	};
+
+	XMMATRIX GetLocalMatrix(const JsonValue& node)
+	{
+		if (node.Contains("matrix")) {
+			// Column-major column-vector matrix == row-major row-vector matrix.
+			XMFLOAT4X4 m;
+			for (size_t i = 0; i < 16; ++i) (&m._11)[i] = static_cast<float>(node["matrix"][i].GetNumber());
+			return XMLoadFloat4x4(&m);
+		}
+		XMFLOAT3 s{ 1.f, 1.f, 1.f }, t{ 0.f, 0.f, 0.f };
+		XMFLOAT4 r{ 0.f, 0.f, 0.f, 1.f };
+		if (node.Contains("scale")) s = XMFLOAT3{ (float)node["scale"][0].GetNumber(), (float)node["scale"][1].GetNumber(), (float)node["scale"][2].GetNumber() };
+		if (node.Contains("translation")) t = XMFLOAT3{ (float)node["translation"][0].GetNumber(), (float)node["translation"][1].GetNumber(), (float)node["translation"][2].GetNumber() };
+		if (node.Contains("rotation")) r = XMFLOAT4{ (float)node["rotation"][0].GetNumber(), (float)node["rotation"][1].GetNumber(), (float)node["rotation"][2].GetNumber(), (float)node["rotation"][3].GetNumber() };
+		return XMMatrixScaling(s.x, s.y, s.z) * XMMatrixRotationQuaternion(XMLoadFloat4(&r)) * XMMatrixTranslation(t.x, t.y, t.z);
+	}
+
+	void CollectDrawItems(const JsonValue& json, size_t nodeIndex, FXMMATRIX parent, vector<GltfDrawItem>& items, int depth = 0)
+	{
+		if (depth > 256) throw runtime_error{ "gltf: node hierarchy too deep" };
+		const JsonValue& node = json["nodes"][nodeIndex];
+		const XMMATRIX world = GetLocalMatrix(node) * parent;
+		if (node.Contains("mesh")) {
+			const int mesh = static_cast<int>(node["mesh"].GetNumber());
+			for (size_t p = 0; p < json["meshes"][mesh]["primitives"].Size(); ++p) {
+				GltfDrawItem item{ mesh, static_cast<int>(p), {} };
+				XMStoreFloat4x4(&item.world, world);
+				items.push_back(item);
+			}
+		}
+		if (node.Contains("children")) {
+			for (const auto& child : node["children"].GetArray()) {
+				CollectDrawItems(json, static_cast<size_t>(child.GetNumber()), world, items, depth + 1);
+			}
+		}
+	}
+}
+
+ImportedMesh Importer::ImportGltf(const string& fileName)
+{
+	ImportedMesh result;
+	const GltfDocument document{ filesystem::u8path(fileName), result.statistics };
+	const JsonValue& json = document.Json();
+
+	auto start = Clock::now();
+	vector<GltfDrawItem> items;
+	if (json["scenes"].Size() > 0) {
+		const JsonValue& scene = json["scenes"][static_cast<size_t>(json.GetNumber("scene", 0))];
+		if (scene.Contains("nodes")) {
+			for (const auto& root : scene["nodes"].GetArray()) {
+				CollectDrawItems(json, static_cast<size_t>(root.GetNumber()), XMMatrixIdentity(), items);
+			}
+		}
+	}
+	else {
+		for (size_t m = 0; m < json["meshes"].Size(); ++m) {
+			for (size_t p = 0; p < json["meshes"][m]["primitives"].Size(); ++p) {
+				GltfDrawItem item{ static_cast<int>(m), static_cast<int>(p), {} };
+				XMStoreFloat4x4(&item.world, XMMatrixIdentity());
+				items.push_back(item);
+			}
+		}
+	}
+
+	vector<ImportSubMesh> decoded(items.size());
+	vector<int> decodedMaterial(items.size(), -1);
+	Parallel::For(0, items.size(), [&](size_t i) {
+		const GltfDrawItem& item = items[i];
+		const JsonValue& primitive = json["meshes"][item.mesh]["primitives"][item.primitive];
+		if (primitive.GetInt("mode", 4) != 4) {
+			cerr << "gltf: skipping non-triangle primitive " << item.mesh << "/" << item.primitive << endl;
+			return;
+		}
+		const JsonValue& attributes = primitive["attributes"];
+		if (!attributes.Contains("POSITION")) return;
+
+		const vector<float> positions = document.ReadFloats(attributes.GetInt("POSITION", 0), 3);
+		const vector<float> normals = attributes.Contains("NORMAL") ?
+			document.ReadFloats(attributes.GetInt("NORMAL", 0), 3) : vector<float>{};
+		const vector<float> uvs = attributes.Contains("TEXCOORD_0") ?
+			document.ReadFloats(attributes.GetInt("TEXCOORD_0", 0), 2) : vector<float>{};
+		const size_t vertexCount = positions.size() / 3;
+		// Every attribute of a primitive must have POSITION's count.
+		if ((!normals.empty() && normals.size() != vertexCount * 3) || (!uvs.empty() && uvs.size() != vertexCount * 2)) {
+			throw runtime_error{ "gltf: attribute counts differ from POSITION's in " + fileName };
+		}
+
+		ImportSubMesh& submesh = decoded[i];
+		if (primitive.Contains("indices")) submesh.indices = document.ReadIndices(primitive.GetInt("indices", 0));
+		else {
+			submesh.indices.resize(vertexCount);
+			for (uint32_t v = 0; v < vertexCount; ++v) submesh.indices[v] = v;
+		}
+		submesh.indices.resize(submesh.indices.size() / 3 * 3);
+		for (uint32_t index : submesh.indices) {
+			if (index >= vertexCount) throw runtime_error{ "gltf: index out of range in " + fileName };
+		}
+
+		const XMMATRIX world = XMLoadFloat4x4(&item.world);
+		const XMMATRIX normalMatrix = XMMatrixTranspose(XMMatrixInverse(nullptr, world));
+		const bool mirrored = XMVectorGetX(XMVector3Dot(XMVector3Cross(world.r[0], world.r[1]), world.r[2])) < 0.f;
+
+		submesh.vertices.resize(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v) {
+			ImportVertex& vertex = submesh.vertices[v];
+			XMFLOAT3 position{ positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2] };
+			XMStoreFloat3(&position, XMVector3Transform(XMLoadFloat3(&position), world));
+			vertex.position = ToLeftHanded(position);
+			if (!normals.empty()) {
+				XMFLOAT3 normal{ normals[v * 3], normals[v * 3 + 1], normals[v * 3 + 2] };
+				XMStoreFloat3(&normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&normal), normalMatrix)));
+				vertex.normal = ToLeftHanded(normal);
+			}
+			if (!uvs.empty()) vertex.uv = XMFLOAT2{ uvs[v * 2], uvs[v * 2 + 1] };
+		}
+		// The z flip reverses winding once; a mirroring node transform reverses it again.
+		if (!mirrored) {
+			for (size_t t = 0; t < submesh.indices.size(); t += 3) swap(submesh.indices[t + 1], submesh.indices[t + 2]);
+		}
+		if (normals.empty()) GenerateNormals(submesh, vector<bool>(vertexCount, true));
+		decodedMaterial[i] = primitive.GetInt("material", -1);
+		});
+	result.statistics.parseSeconds = SecondsSince(start);
+
+	start = Clock::now();
+	map<int, ImportSubMesh> byMaterial;
+	for (size_t i = 0; i < items.size(); ++i) {
+		if (decoded[i].indices.empty()) continue;
+		ImportSubMesh& submesh = byMaterial[decodedMaterial[i]];
+		const uint32_t offset = static_cast<uint32_t>(submesh.vertices.size());
+		submesh.vertices.insert(submesh.vertices.end(), decoded[i].vertices.begin(), decoded[i].vertices.end());
+		for (uint32_t index : decoded[i].indices) submesh.indices.push_back(index + offset);
+		decoded[i] = ImportSubMesh{};
+	}
+	for (auto& [material, submesh] : byMaterial) {
+		if (material >= 0) {
+			const JsonValue& desc = json["materials"][static_cast<size_t>(material)];
+			submesh.material = desc.Contains("name") ? desc["name"].GetString() : "material" + to_string(material);
+		}
+		result.submeshes.push_back(move(submesh));
+	}
+	result.statistics.buildSeconds = SecondsSince(start);
+	return result;
+}
+
+ImportedMesh Importer::Import(const string& fileName)
+{
+	string extension = filesystem::u8path(fileName).extension().string();
+	ranges::transform(extension, extension.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+	if (extension == ".obj") return ImportObj(fileName);
+	if (extension == ".gltf" || extension == ".glb") return ImportGltf(fileName);
+	throw runtime_error{ "unsupported mesh format: " + fileName };
+}
+
+vector<string> Importer::WriteMesh(const ImportedMesh& mesh, const string& path)
+{
+	vector<string> fileNames;
+	for (size_t i = 0; const auto& submesh : mesh.submeshes) {
+		const string fileName = mesh.submeshes.size() == 1 ?
+			path + ".binary" : path + "_" + to_string(i) + ".binary";
+		++i;
+
+		ofstream out(fileName, ios::binary);
+		if (!out) throw runtime_error{ "cannot write " + fileName };
+		out << submesh.vertices.size();
+		out.write(reinterpret_cast<const char*>(submesh.vertices.data()), sizeof(ImportVertex) * submesh.vertices.size());
+		out << submesh.indices.size();
+		out.write(reinterpret_cast<const char*>(submesh.indices.data()), sizeof(uint32_t) * submesh.indices.size());
+		fileNames.push_back(fileName);
+	}
+	return fileNames;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <DirectXMath.h>
+
+// Matches TextureVertex in the renderer (POSITION, NORMAL, TEXCOORD).
+struct ImportVertex
+{
+	DirectX::XMFLOAT3 position;
+	DirectX::XMFLOAT3 normal;
+	DirectX::XMFLOAT2 uv;
+};
+
+struct ImportSubMesh
+{
+	std::string				material;
+	std::vector<ImportVertex>	vertices;
+	std::vector<uint32_t>		indices;
+};
+
+struct ImportStatistics
+{
+	uint64_t	inputBytes = 0;
+	double		readSeconds = 0.0;
+	double		parseSeconds = 0.0;
+	double		buildSeconds = 0.0;
+};
+
+struct ImportedMesh
+{
+	std::vector<ImportSubMesh>	submeshes;
+	ImportStatistics			statistics;
+};
+
+namespace Importer
+{
+	// Picks the OBJ or glTF path from the file extension (.obj, .gltf, .glb).
+	ImportedMesh Import(const std::string& fileName);
+
+	ImportedMesh ImportObj(const std::string& fileName);
+	ImportedMesh ImportGltf(const std::string& fileName);
+
+	// Writes one IndexMesh<TextureVertex> file per submesh: "<path>.binary" for a single
+	// submesh, "<path>_<index>.binary" otherwise. Returns the written file names.
+	std::vector<std::string> WriteMesh(const ImportedMesh& mesh, const std::string& path);
+}
@@ -0,0 +1,255 @@
+#include "json.h"
+#include <charconv>
+#include <stdexcept>
+
+using namespace std;
+
+class JsonParser
+{
+public:
+	JsonParser(string_view text) : m_text{ text }, m_position{ 0 } {}
+
+	JsonValue ParseDocument()
+	{
+		JsonValue value = ParseValue();
+		SkipWhitespace();
+		if (m_position != m_text.size()) Fail("trailing characters");
+		return value;
+	}
+
+private:
+	[[noreturn]] void Fail(const char* message) const
+	{
+		throw runtime_error{ "json: " + string{ message } + " at offset " + to_string(m_position) };
+	}
+
+	void SkipWhitespace()
+	{
+		while (m_position < m_text.size()) {
+			const char c = m_text[m_position];
+			if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
+			++m_position;
+		}
+	}
+
+	char Peek()
+	{
+		SkipWhitespace();
+		if (m_position >= m_text.size()) Fail("unexpected end");
+		return m_text[m_position];
+	}
+
+	void Expect(char c)
+	{
+		if (Peek() != c) Fail("unexpected character");
+		++m_position;
+	}
+
+	bool Consume(string_view word)
+	{
+		if (m_text.substr(m_position, word.size()) != word) return false;
+		m_position += word.size();
+		return true;
+	}
+
+	JsonValue ParseValue()
+	{
+		JsonValue value;
+		switch (Peek())
+		{
+		case '{': value.m_value = ParseObject(); break;
+		case '[': value.m_value = ParseArray(); break;
+		case '"': value.m_value = ParseString(); break;
+		case 't': if (!Consume("true")) Fail("bad literal"); value.m_value = true; break;
+		case 'f': if (!Consume("false")) Fail("bad literal"); value.m_value = false; break;
+		case 'n': if (!Consume("null")) Fail("bad literal"); break;
+		default: value.m_value = ParseNumber(); break;
+		}
+		return value;
+	}
+
+	JsonValue::Object ParseObject()
+	{
+		JsonValue::Object object;
+		Expect('{');
+		if (Peek() == '}') { ++m_position; return object; }
+		while (true) {
+			if (Peek() != '"') Fail("expected key");
+			string key = ParseString();
+			Expect(':');
+			object.insert_or_assign(move(key), ParseValue());
+			if (Peek() == ',') { ++m_position; continue; }
+			Expect('}');
+			return object;
+		}
+	}
+
+	JsonValue::Array ParseArray()
+	{
+		JsonValue::Array array;
+		Expect('[');
+		if (Peek() == ']') { ++m_position; return array; }
+		while (true) {
+			array.push_back(ParseValue());
+			if (Peek() == ',') { ++m_position; continue; }
+			Expect(']');
+			return array;
+		}
+	}
+
+	double ParseNumber()
+	{
+		double value{};
+		const char* first = m_text.data() + m_position;
+		const char* last = m_text.data() + m_text.size();
+		auto [end, error] = from_chars(first, last, value);
+		if (error != errc{}) Fail("bad number");
+		m_position += static_cast<size_t>(end - first);
+		return value;
+	}
+
+	void AppendUtf8(string& out, unsigned codePoint)
+	{
+		if (codePoint < 0x80) {
+			out += static_cast<char>(codePoint);
+		}
+		else if (codePoint < 0x800) {
+			out += static_cast<char>(0xC0 | (codePoint >> 6));
+			out += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else if (codePoint < 0x10000) {
+			out += static_cast<char>(0xE0 | (codePoint >> 12));
+			out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else {
+			out += static_cast<char>(0xF0 | (codePoint >> 18));
+			out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+	}
+
+	unsigned ParseHex4()
+	{
+		if (m_position + 4 > m_text.size()) Fail("bad escape");
+		unsigned value{};
+		auto [end, error] = from_chars(m_text.data() + m_position, m_text.data() + m_position + 4, value, 16);
+		if (error != errc{} || end != m_text.data() + m_position + 4) Fail("bad escape");
+		m_position += 4;
+		return value;
+	}
+
+	string ParseString()
+	{
+		Expect('"');
+		string out;
+		while (true) {
+			if (m_position >= m_text.size()) Fail("unterminated string");
+			const char c = m_text[m_position++];
+			if (c == '"') return out;
+			if (c != '\\') { out += c; continue; }
+
+			if (m_position >= m_text.size()) Fail("unterminated string");
+			switch (m_text[m_position++])
+			{
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				unsigned codePoint = ParseHex4();
+				if (codePoint >= 0xD800 && codePoint < 0xDC00 && Consume("\\u")) {
+					const unsigned low = ParseHex4();
+					codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				AppendUtf8(out, codePoint);
+				break;
+			}
+			default: Fail("bad escape");
+			}
+		}
+	}
+
+private:
+	string_view m_text;
+	size_t m_position;
+};
+
+JsonValue JsonValue::Parse(string_view text)
+{
+	return JsonParser{ text }.ParseDocument();
+}
+
+double JsonValue::GetNumber() const
+{
+	if (!IsNumber()) throw runtime_error{ "json: value is not a number" };
+	return get<double>(m_value);
+}
+
+const string& JsonValue::GetString() const
+{
+	if (!IsString()) throw runtime_error{ "json: value is not a string" };
+	return get<string>(m_value);
+}
+
+const JsonValue::Array& JsonValue::GetArray() const
+{
+	if (!IsArray()) throw runtime_error{ "json: value is not an array" };
+	return get<Array>(m_value);
+}
+
+const JsonValue::Object& JsonValue::GetObject() const
+{
+	if (!IsObject()) throw runtime_error{ "json: value is not an object" };
+	return get<Object>(m_value);
+}
+
+bool JsonValue::GetBool() const
+{
+	if (!holds_alternative<bool>(m_value)) throw runtime_error{ "json: value is not a bool" };
+	return get<bool>(m_value);
+}
+
+bool JsonValue::Contains(string_view key) const
+{
+	return IsObject() && get<Object>(m_value).contains(key);
+}
+
+const JsonValue& JsonValue::operator[](string_view key) const
+{
+	static const JsonValue null;
+	if (!IsObject()) return null;
+	const auto& object = get<Object>(m_value);
+	auto it = object.find(key);
+	return it == object.end() ? null : it->second;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+	const auto& array = GetArray();
+	if (index >= array.size()) throw runtime_error{ "json: index out of range" };
+	return array[index];
+}
+
+size_t JsonValue::Size() const
+{
+	if (IsArray()) return get<Array>(m_value).size();
+	if (IsObject()) return get<Object>(m_value).size();
+	return 0;
+}
+
+double JsonValue::GetNumber(string_view key, double fallback) const
+{
+	const JsonValue& value = (*this)[key];
+	return value.IsNumber() ? value.GetNumber() : fallback;
+}
+
+int JsonValue::GetInt(string_view key, int fallback) const
+{
+	return static_cast<int>(GetNumber(key, fallback));
+}
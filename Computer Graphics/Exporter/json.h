@@ -0,0 +1,42 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+class JsonValue
+{
+public:
+	using Array = std::vector<JsonValue>;
+	using Object = std::map<std::string, JsonValue, std::less<>>;
+
+	JsonValue() = default;
+
+	static JsonValue Parse(std::string_view text);
+
+	bool IsNull() const { return std::holds_alternative<std::monostate>(m_value); }
+	bool IsNumber() const { return std::holds_alternative<double>(m_value); }
+	bool IsString() const { return std::holds_alternative<std::string>(m_value); }
+	bool IsArray() const { return std::holds_alternative<Array>(m_value); }
+	bool IsObject() const { return std::holds_alternative<Object>(m_value); }
+
+	double GetNumber() const;
+	const std::string& GetString() const;
+	const Array& GetArray() const;
+	const Object& GetObject() const;
+	bool GetBool() const;
+
+	bool Contains(std::string_view key) const;
+	const JsonValue& operator[](std::string_view key) const;
+	const JsonValue& operator[](size_t index) const;
+	size_t Size() const;
+
+	double GetNumber(std::string_view key, double fallback) const;
+	int GetInt(std::string_view key, int fallback) const;
+
+private:
+	friend class JsonParser;
+	std::variant<std::monostate, bool, double, std::string, Array, Object> m_value;
+};
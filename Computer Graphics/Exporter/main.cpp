@@ -1,8 +1,19 @@
 #include <iostream>
 #include <fstream>
+#include <filesystem>
 #include <string>
 #include <vector>
 #include <DirectXMath.h>
+#include "compressor.h"
+#include "dxc.h"
+#include "importer.h"
+#include "mipmap.h"
+#include "packer.h"
+#include "shaders.h"
+#include "staging.h"
+#include "terrain.h"
+#include "texturestreaming.h"
+#include "virtualtexture.h"
 using namespace std;
 using namespace DirectX;
 
@@ -313,8 +324,252 @@ void CreateCubeNormalMesh()
 	out.write(reinterpret_cast<const char*>(vertices.data()), sizeof(Vertex) * vertices.size());
 }
 
-int main()
+int ImportMesh(const string& fileName, const string& path)
 {
+	const ImportedMesh mesh = Importer::Import(fileName);
+	const auto& statistics = mesh.statistics;
+	const double megabytes = statistics.inputBytes / (1024.0 * 1024.0);
+	const double seconds = statistics.readSeconds + statistics.parseSeconds + statistics.buildSeconds;
+
+	size_t vertexCount = 0, indexCount = 0;
+	for (const auto& submesh : mesh.submeshes) {
+		vertexCount += submesh.vertices.size();
+		indexCount += submesh.indices.size();
+	}
+	cout << fileName << ": " << mesh.submeshes.size() << " submeshes, "
+		<< vertexCount << " vertices, " << indexCount / 3 << " triangles" << endl;
+	cout << "read " << statistics.readSeconds * 1000.0 << " ms, parse " << statistics.parseSeconds * 1000.0
+		<< " ms, build " << statistics.buildSeconds * 1000.0 << " ms (" << megabytes / seconds << " MB/s)" << endl;
+
+	for (const auto& written : Importer::WriteMesh(mesh, path)) cout << "wrote " << written << endl;
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	try {
+		const string command = argc > 1 ? argv[1] : "";
+		if (command == "import" && argc > 2) {
+			string path = argc > 3 ? argv[3] : "../Resources/Meshes/" + filesystem::u8path(argv[2]).stem().string();
+			return ImportMesh(argv[2], path);
+		}
+		if (command == "pack" && argc > 3) {
+			bool compress = false;
+			uint32_t alignment = 64;
+			for (int i = 4; i < argc; ++i) {
+				const string option = argv[i];
+				if (option == "--compress") compress = true;
+				else if (option == "--align" && i + 1 < argc) alignment = static_cast<uint32_t>(stoul(argv[++i]));
+			}
+			Packer::Pack(argv[2], argv[3], compress, alignment);
+			return 0;
+		}
+		if (command == "packbench" && argc > 3) {
+			Packer::Benchmark(argv[2], argv[3], argc > 4 ? stoi(argv[4]) : 5);
+			return 0;
+		}
+		if (command == "iobench" && argc > 2) {
+			const size_t ioThreads = argc > 3 ? stoul(argv[3]) : 2;
+			const uint64_t blockSize = argc > 4 ? stoull(argv[4]) * 1024 : 256 * 1024;
+			Packer::IoBenchmark(argv[2], ioThreads, blockSize);
+			return 0;
+		}
+		if (command == "compress" && argc > 4) {
+			Compressor::Compress(argv[2], argv[3], Compressor::ParseFormat(argv[4]),
+				argc > 5 ? Compressor::ParseQuality(argv[5]) : BcQuality::Normal);
+			return 0;
+		}
+		if (command == "mips" && argc > 3) {
+			MipOptions options;
+			for (int i = 4; i < argc; ++i) {
+				const string option = argv[i];
+				if (option == "--coverage" && i + 1 < argc) options.alphaCoverage = stof(argv[++i]);
+				else options.filter = Mipmap::ParseFilter(option);
+			}
+			DdsImage image = Dds::Read(argv[2]);
+			Mipmap::Generate(image, options);
+			Dds::Write(argv[3], image);
+			cout << "wrote " << image.mipCount << " mips (" << argv[3] << ")" << endl;
+			return 0;
+		}
+		if (command == "array" && argc > 3) {
+			vector<DdsImage> images;
+			for (int i = 3; i < argc; ++i) images.push_back(Dds::Read(argv[i]));
+			const DdsImage image = Dds::MakeArray(images);
+			Dds::Write(argv[2], image);
+			// Each source texture needed a descriptor of its own; the array is one SRV and one resource.
+			cout << "wrote " << image.arraySize << " slices, " << image.mipCount << " mips (" << argv[2] << "), "
+				<< image.arraySize << " descriptors -> 1" << endl;
+			return 0;
+		}
+		if (command == "mipbench") {
+			vector<uint32_t> sizes;
+			for (int i = 2; i < argc; ++i) sizes.push_back(static_cast<uint32_t>(stoul(argv[i])));
+			Mipmap::Benchmark(sizes.empty() ? vector<uint32_t>{ 4096, 8192 } : sizes, 3);
+			return 0;
+		}
+		if (command == "vtbake" && argc > 4) {
+			VirtualTextureOptions options;
+			for (int i = 5; i + 1 < argc; i += 2) {
+				const string option = argv[i];
+				if (option == "--size") options.size = static_cast<uint32_t>(stoul(argv[i + 1]));
+				else if (option == "--page") options.pageSize = static_cast<uint32_t>(stoul(argv[i + 1]));
+				else if (option == "--repeat") options.detailRepeat = stof(argv[i + 1]);
+			}
+			VirtualTexture::Bake(argv[2], argv[3], argv[4], options);
+			return 0;
+		}
+		if (command == "vtsim") {
+			const auto argument = [&](int index, uint32_t value) { return argc > index ? static_cast<uint32_t>(stoul(argv[index])) : value; };
+			VirtualTexture::Simulate(argument(2, 64), argument(3, 256), argument(4, 16), argument(5, 2));
+			return 0;
+		}
+		if (command == "mipsim") {
+			const auto argument = [&](int index, uint32_t value) { return argc > index ? static_cast<uint32_t>(stoul(argv[index])) : value; };
+			TextureStreaming::Simulate(argument(2, 128), argument(3, 1200), uint64_t{ argument(4, 128) } << 20, uint64_t{ argument(5, 8192) } << 10);
+			return 0;
+		}
+		if (command == "shaders" && argc > 2) {
+			filesystem::path cacheDirectory;
+			bool debug = false;
+			for (int i = 3; i < argc; ++i) {
+				const string option = argv[i];
+				if (option == "--debug") debug = true;
+				else cacheDirectory = option;
+			}
+			Shaders::Compile(argv[2], cacheDirectory, debug);
+			return 0;
+		}
+		if (command == "dxc" && argc > 2) {
+			filesystem::path outputDirectory;
+			string compiler = "dxc";
+			bool debug = false;
+			for (int i = 3; i < argc; ++i) {
+				const string option = argv[i];
+				if (option == "--debug") debug = true;
+				else if (option == "--compiler" && i + 1 < argc) compiler = argv[++i];
+				else outputDirectory = option;
+			}
+			Dxc::Build(argv[2], outputDirectory, compiler, debug);
+			return 0;
+		}
+		if (command == "dxccheck") {
+			Dxc::Check();
+			return 0;
+		}
+		if (command == "psohash") {
+			Shaders::CheckPipelineHash();
+			return 0;
+		}
+		if (command == "heightbench") {
+			Terrain::Benchmark(argc > 2 ? argv[2] : "", argc > 3 ? stoul(argv[3]) : 1000000);
+			return 0;
+		}
+		if (command == "cullbench") {
+			Terrain::CullBenchmark(argc > 2 ? stoi(argv[2]) : 4097, argc > 3 ? stoi(argv[3]) : 64);
+			return 0;
+		}
+		if (command == "lodbench") {
+			Terrain::LodBenchmark(argc > 2 ? stoi(argv[2]) : 257, argc > 3 ? stoi(argv[3]) : 64,
+				argc > 4 ? stof(argv[4]) : 32.f);
+			return 0;
+		}
+		if (command == "tessbench") {
+			Terrain::TessellationBenchmark(argc > 2 ? stoi(argv[2]) : 1025, argc > 3 ? stoi(argv[3]) : 64,
+				argc > 4 ? stof(argv[4]) : 1.f);
+			return 0;
+		}
+		if (command == "raybench") {
+			Terrain::RaycastBenchmark(argc > 2 ? stoi(argv[2]) : 1025, argc > 3 ? stoul(argv[3]) : 1000000);
+			return 0;
+		}
+		if (command == "buildbench") {
+			vector<int> sizes;
+			for (int i = 2; i < argc; ++i) sizes.push_back(stoi(argv[i]));
+			Terrain::BuildBenchmark(sizes.empty() ? vector<int>{ 257, 513, 1025, 2049, 4097 } : sizes);
+			return 0;
+		}
+		if (command == "patchbench") {
+			Terrain::PatchBenchmark(argc > 2 ? stoi(argv[2]) : 1025, argc > 3 ? stoi(argv[3]) : 64,
+				argc > 4 ? stoi(argv[4]) : 32);
+			return 0;
+		}
+		if (command == "cook" && argc > 3) {
+			// As the game bakes them for a height map that is not cooked (Settings::TerrainNormalTexelsPerCell).
+			int normalTexelsPerCell = 2;
+			for (int i = 4; i + 1 < argc; i += 2) {
+				if (string{ argv[i] } == "--normals") normalTexelsPerCell = stoi(argv[i + 1]);
+			}
+			Terrain::Cook(argv[2], argv[3], normalTexelsPerCell);
+			return 0;
+		}
+		if (command == "cookbench") {
+			Terrain::CookBenchmark(argc > 2 ? stoi(argv[2]) : 1025);
+			return 0;
+		}
+		if (command == "normalbench") {
+			vector<int> sizes;
+			for (int i = 3; i < argc; ++i) sizes.push_back(stoi(argv[i]));
+			Terrain::NormalBenchmark(sizes.empty() ? vector<int>{ 257, 1025, 4097 } : sizes, argc > 2 ? stoi(argv[2]) : 2);
+			return 0;
+		}
+		if (command == "tile" && argc > 3) {
+			int tileCells = 64;
+			bool wide = false;
+			for (int i = 4; i < argc; ++i) {
+				const string option = argv[i];
+				if (option == "--16") wide = true;
+				else if (option == "--tile" && i + 1 < argc) tileCells = stoi(argv[++i]);
+			}
+			Terrain::Tile(argv[2], argv[3], tileCells, wide);
+			return 0;
+		}
+		if (command == "tilebench") {
+			Terrain::TileBenchmark(argc > 2 ? stoi(argv[2]) : 4097, argc > 3 ? stoi(argv[3]) : 64,
+				argc > 4 ? stoi(argv[4]) == 16 : true);
+			return 0;
+		}
+		if (command == "ddsbench" && argc > 2) {
+			Staging::Benchmark(argv[2], argc > 3 ? stoi(argv[3]) : 5);
+			return 0;
+		}
+		if (!command.empty()) {
+			cerr << "usage: Exporter import <mesh.obj|mesh.gltf|mesh.glb> [output path without extension]" << endl;
+			cerr << "       Exporter pack <output.pack> <root> [--compress] [--align bytes]" << endl;
+			cerr << "       Exporter packbench <input.pack> <root> [iterations]" << endl;
+			cerr << "       Exporter iobench <root|input.pack> [io threads] [block KB]" << endl;
+			cerr << "       Exporter ddsbench <root|input.pack> [iterations]" << endl;
+			cerr << "       Exporter mips <input.dds> <output.dds> [box|kaiser] [--coverage alpha threshold]" << endl;
+			cerr << "       Exporter mipbench [size...]" << endl;
+			cerr << "       Exporter array <output.dds> <input.dds...>" << endl;
+			cerr << "       Exporter vtbake <base.dds> <detail.dds> <output.vt> [--size texels] [--page texels] [--repeat detail tiles]" << endl;
+			cerr << "       Exporter vtsim [pages per side] [slots] [uploads per frame] [latency frames]" << endl;
+			cerr << "       Exporter mipsim [textures] [frames] [resident budget MB] [frame upload budget KB]" << endl;
+			cerr << "       Exporter shaders <shaders.json> [cache directory] [--debug]" << endl;
+			cerr << "       Exporter psohash" << endl;
+			cerr << "       Exporter dxc <shaders.json> [output directory] [--compiler dxc path] [--debug]" << endl;
+			cerr << "       Exporter dxccheck" << endl;
+			cerr << "       Exporter heightbench [HeightMap.binary] [queries]" << endl;
+			cerr << "       Exporter cullbench [height map side] [frames]" << endl;
+			cerr << "       Exporter lodbench [height map side] [frames] [first LOD range]" << endl;
+			cerr << "       Exporter tessbench [height map side] [frames] [pixel error]" << endl;
+			cerr << "       Exporter raybench [height map side] [rays]" << endl;
+			cerr << "       Exporter buildbench [height map side...]" << endl;
+			cerr << "       Exporter patchbench [height map side] [frames] [vertex cache entries]" << endl;
+			cerr << "       Exporter cook <HeightMap.binary|.r16> <output.terrain> [--normals texels per cell]" << endl;
+			cerr << "       Exporter cookbench [height map side]" << endl;
+			cerr << "       Exporter normalbench [texels per cell] [height map side...]" << endl;
+			cerr << "       Exporter tile <HeightMap.binary|.r16> <output.tiles> [--tile cells] [--16]" << endl;
+			cerr << "       Exporter tilebench [height map side] [tile cells] [8|16]" << endl;
+			cerr << "       Exporter compress <input.dds> <output.dds> <bc1|bc3|bc4|bc5|bc6h|bc7> [fast|normal|high]" << endl;
+			return 1;
+		}
+	}
+	catch (const exception& e) {
+		cerr << e.what() << endl;
+		return 1;
+	}
+
 	//CreateCubeMesh();
 	//CreateCubeIndexMesh();
 	//CreateSkyboxMesh();
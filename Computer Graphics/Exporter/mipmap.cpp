@@ -0,0 +1,390 @@
+#include "mipmap.h"
+#include "../Common/parallel.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <DirectXPackedVector.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIP_USE_SSE2
+#endif
+
+using namespace std;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	using Clock = chrono::steady_clock;
+
+	constexpr float KaiserRadius = 3.0f;	// In destination texels.
+	constexpr float KaiserAlpha = 4.0f;
+
+	// Source texels and weights of every destination texel along one axis.
+	struct Taps
+	{
+		vector<uint32_t>	offsets;	// Destination texel i uses [offsets[i], offsets[i + 1]).
+		vector<uint32_t>	indices;
+		vector<float>		weights;
+	};
+
+	// A level being filtered, as linear RGBA floats.
+	struct Level
+	{
+		uint32_t		width = 0;
+		uint32_t		height = 0;
+		vector<float>	pixels;
+	};
+
+	float BesselI0(float x)
+	{
+		float sum = 1.0f, term = 1.0f;
+		for (int k = 1; k < 20; ++k) {
+			term *= (x / (2.0f * k)) * (x / (2.0f * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	float Sinc(float x)
+	{
+		if (fabs(x) < 1e-6f) return 1.0f;
+		const float angle = 3.14159265f * x;
+		return sin(angle) / angle;
+	}
+
+	Taps GetTaps(MipFilter filter, uint32_t sourceSize, uint32_t destinationSize)
+	{
+		Taps taps;
+		taps.offsets.reserve(destinationSize + 1);
+		const float scale = static_cast<float>(sourceSize) / destinationSize;
+		for (uint32_t i = 0; i < destinationSize; ++i) {
+			taps.offsets.push_back(static_cast<uint32_t>(taps.indices.size()));
+			const float center = (i + 0.5f) * scale;
+			const float support = filter == MipFilter::Box ? 0.5f * scale : KaiserRadius * scale;
+			const int first = static_cast<int>(floor(center - support));
+			const int last = static_cast<int>(ceil(center + support));
+
+			float sum = 0.0f;
+			const size_t begin = taps.weights.size();
+			for (int j = first; j < last; ++j) {
+				float weight;
+				if (filter == MipFilter::Box) {
+					weight = min(j + 1.0f, center + support) - max(static_cast<float>(j), center - support);
+				}
+				else {
+					const float x = (j + 0.5f - center) / scale;
+					const float window = 1.0f - (x / KaiserRadius) * (x / KaiserRadius);
+					weight = window > 0.0f ? Sinc(x) * BesselI0(KaiserAlpha * sqrt(window)) / BesselI0(KaiserAlpha) : 0.0f;
+				}
+				if (weight == 0.0f) continue;
+				// Clamp addressing: taps past the edge repeat the edge texel.
+				taps.indices.push_back(static_cast<uint32_t>(clamp(j, 0, static_cast<int>(sourceSize) - 1)));
+				taps.weights.push_back(weight);
+				sum += weight;
+			}
+			for (size_t k = begin; k < taps.weights.size(); ++k) taps.weights[k] /= sum;
+		}
+		taps.offsets.push_back(static_cast<uint32_t>(taps.indices.size()));
+		return taps;
+	}
+
+	// destination[i] += weight * source[i] over `count` RGBA texels.
+	void Accumulate(float* destination, const float* source, float weight, size_t count)
+	{
+#ifdef MIP_USE_SSE2
+		const __m128 w = _mm_set1_ps(weight);
+		for (size_t i = 0; i < count * 4; i += 4) {
+			_mm_storeu_ps(destination + i, _mm_add_ps(_mm_loadu_ps(destination + i), _mm_mul_ps(w, _mm_loadu_ps(source + i))));
+		}
+#else
+		for (size_t i = 0; i < count * 4; ++i) destination[i] += weight * source[i];
+#endif
+	}
+
+	void FilterRow(const float* source, const Taps& taps, float* destination, uint32_t width)
+	{
+		for (uint32_t x = 0; x < width; ++x) {
+#ifdef MIP_USE_SSE2
+			__m128 sum = _mm_setzero_ps();
+			for (uint32_t k = taps.offsets[x]; k < taps.offsets[x + 1]; ++k) {
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(taps.weights[k]), _mm_loadu_ps(source + taps.indices[k] * 4)));
+			}
+			_mm_storeu_ps(destination + x * 4, sum);
+#else
+			float sum[4]{};
+			for (uint32_t k = taps.offsets[x]; k < taps.offsets[x + 1]; ++k) {
+				for (int c = 0; c < 4; ++c) sum[c] += taps.weights[k] * source[taps.indices[k] * 4 + c];
+			}
+			memcpy(destination + x * 4, sum, sizeof(sum));
+#endif
+		}
+	}
+
+	const array<float, 256>& GetSrgbToLinear()
+	{
+		static const array<float, 256> table = [] {
+			array<float, 256> values{};
+			for (int i = 0; i < 256; ++i) {
+				const float v = i / 255.0f;
+				values[i] = v <= 0.04045f ? v / 12.92f : pow((v + 0.055f) / 1.055f, 2.4f);
+			}
+			return values;
+			}();
+		return table;
+	}
+
+	// Indexed by linear value * 65535, which is finer than any 8-bit sRGB step.
+	const vector<uint8_t>& GetLinearToSrgb()
+	{
+		static const vector<uint8_t> table = [] {
+			vector<uint8_t> values(65536);
+			for (size_t i = 0; i < values.size(); ++i) {
+				const float v = i / 65535.0f;
+				const float encoded = v <= 0.0031308f ? v * 12.92f : 1.055f * pow(v, 1.0f / 2.4f) - 0.055f;
+				values[i] = static_cast<uint8_t>(lround(encoded * 255.0f));
+			}
+			return values;
+			}();
+		return table;
+	}
+
+	uint8_t ToUnorm8(float value)
+	{
+		return static_cast<uint8_t>(lround(clamp(value, 0.0f, 1.0f) * 255.0f));
+	}
+
+	uint8_t ToSrgb8(float value)
+	{
+		return GetLinearToSrgb()[static_cast<size_t>(lround(clamp(value, 0.0f, 1.0f) * 65535.0f))];
+	}
+
+	void ReadRow(const std::byte* surface, DdsFormat format, uint32_t width, uint32_t y, float* row)
+	{
+		const auto& toLinear = GetSrgbToLinear();
+		const bool srgb = Dds::IsSrgb(format);
+		const size_t elementSize = Dds::GetElementSize(format);
+		const auto* bytes = reinterpret_cast<const uint8_t*>(surface) + size_t{ y } * width * elementSize;
+		for (uint32_t x = 0; x < width; ++x, bytes += elementSize, row += 4) {
+			switch (format)
+			{
+			case DdsFormat::R32G32B32A32Float:
+				memcpy(row, bytes, 16);
+				break;
+			case DdsFormat::R16G16B16A16Float: {
+				HALF half[4];
+				memcpy(half, bytes, sizeof(half));
+				for (int c = 0; c < 4; ++c) row[c] = XMConvertHalfToFloat(half[c]);
+				break;
+			}
+			case DdsFormat::R8G8B8A8Unorm:
+			case DdsFormat::R8G8B8A8UnormSrgb:
+			case DdsFormat::B8G8R8A8Unorm:
+			case DdsFormat::B8G8R8X8Unorm:
+			case DdsFormat::B8G8R8A8UnormSrgb: {
+				const bool bgr = format != DdsFormat::R8G8B8A8Unorm && format != DdsFormat::R8G8B8A8UnormSrgb;
+				for (int c = 0; c < 3; ++c) {
+					const uint8_t value = bytes[bgr ? 2 - c : c];
+					row[c] = srgb ? toLinear[value] : value / 255.0f;
+				}
+				row[3] = format == DdsFormat::B8G8R8X8Unorm ? 1.0f : bytes[3] / 255.0f;
+				break;
+			}
+			default:
+				throw invalid_argument{ "mips: unsupported format " + to_string(static_cast<uint32_t>(format)) };
+			}
+		}
+	}
+
+	void WriteRow(const float* row, float alphaScale, DdsFormat format, uint32_t width, uint32_t y, std::byte* surface)
+	{
+		const bool srgb = Dds::IsSrgb(format);
+		const size_t elementSize = Dds::GetElementSize(format);
+		auto* bytes = reinterpret_cast<uint8_t*>(surface) + size_t{ y } * width * elementSize;
+		for (uint32_t x = 0; x < width; ++x, bytes += elementSize, row += 4) {
+			const float alpha = min(row[3] * alphaScale, 1.0f);
+			switch (format)
+			{
+			case DdsFormat::R32G32B32A32Float: {
+				const float pixel[4]{ row[0], row[1], row[2], alpha };
+				memcpy(bytes, pixel, sizeof(pixel));
+				break;
+			}
+			case DdsFormat::R16G16B16A16Float: {
+				const HALF half[4]{ XMConvertFloatToHalf(row[0]), XMConvertFloatToHalf(row[1]), XMConvertFloatToHalf(row[2]), XMConvertFloatToHalf(alpha) };
+				memcpy(bytes, half, sizeof(half));
+				break;
+			}
+			default: {
+				const bool bgr = format != DdsFormat::R8G8B8A8Unorm && format != DdsFormat::R8G8B8A8UnormSrgb;
+				for (int c = 0; c < 3; ++c) bytes[bgr ? 2 - c : c] = srgb ? ToSrgb8(row[c]) : ToUnorm8(row[c]);
+				bytes[3] = format == DdsFormat::B8G8R8X8Unorm ? 255 : ToUnorm8(alpha);
+				break;
+			}
+			}
+		}
+	}
+
+	// Filters `source` (read a row at a time through `readRow`) into a width x height level. Each
+	// worker takes a band of destination rows and keeps its horizontally filtered source rows in a
+	// small ring, so no full-size intermediate image is needed.
+	template <typename ReadRow>
+	Level Downsample(uint32_t sourceWidth, uint32_t sourceHeight, ReadRow&& readRow, uint32_t width, uint32_t height, MipFilter filter)
+	{
+		const Taps horizontal = GetTaps(filter, sourceWidth, width);
+		const Taps vertical = GetTaps(filter, sourceHeight, height);
+		uint32_t ringSize = 1;
+		for (uint32_t y = 0; y < height; ++y) {
+			const uint32_t first = vertical.indices[vertical.offsets[y]];
+			const uint32_t last = vertical.indices[vertical.offsets[y + 1] - 1];
+			ringSize = max(ringSize, last - first + 1);
+		}
+
+		Level level;
+		level.width = width;
+		level.height = height;
+		level.pixels.resize(size_t{ width } * height * 4);
+		Parallel::ForRange(0, height, [&](size_t firstRow, size_t lastRow) {
+			vector<float> sourceRow(size_t{ sourceWidth } * 4);
+			vector<float> ring(size_t{ ringSize } * width * 4);
+			vector<int64_t> ringRows(ringSize, -1);
+			for (size_t y = firstRow; y < lastRow; ++y) {
+				float* destination = level.pixels.data() + y * width * 4;
+				for (uint32_t k = vertical.offsets[y]; k < vertical.offsets[y + 1]; ++k) {
+					const uint32_t row = vertical.indices[k];
+					float* filtered = ring.data() + size_t{ row % ringSize } * width * 4;
+					if (ringRows[row % ringSize] != row) {
+						FilterRow(readRow(row, sourceRow.data()), horizontal, filtered, width);
+						ringRows[row % ringSize] = row;
+					}
+					Accumulate(destination, filtered, vertical.weights[k], width);
+				}
+			}
+			});
+		return level;
+	}
+
+	// Scale that makes the fraction of alpha values above `threshold` equal `coverage`.
+	float GetAlphaScale(const Level& level, float threshold, float coverage)
+	{
+		vector<float> alpha(size_t{ level.width } * level.height);
+		for (size_t i = 0; i < alpha.size(); ++i) alpha[i] = level.pixels[i * 4 + 3];
+		const size_t covered = static_cast<size_t>(lround(coverage * alpha.size()));
+		if (covered == 0) return 1.0f;
+		const auto nth = alpha.end() - static_cast<ptrdiff_t>(covered);
+		nth_element(alpha.begin(), nth, alpha.end());
+		return *nth > 0.0f ? min(threshold / *nth * 1.0001f, 64.0f) : 1.0f;
+	}
+
+	float GetCoverage(const std::byte* surface, DdsFormat format, uint32_t width, uint32_t height, float threshold)
+	{
+		vector<float> row(size_t{ width } * 4);
+		size_t covered = 0;
+		for (uint32_t y = 0; y < height; ++y) {
+			ReadRow(surface, format, width, y, row.data());
+			for (uint32_t x = 0; x < width; ++x) covered += row[x * 4 + 3] > threshold;
+		}
+		return static_cast<float>(covered) / (size_t{ width } * height);
+	}
+}
+
+MipFilter Mipmap::ParseFilter(string_view name)
+{
+	if (name == "box") return MipFilter::Box;
+	if (name == "kaiser") return MipFilter::Kaiser;
+	throw invalid_argument{ "mips: unknown filter " + string{ name } };
+}
+
+void Mipmap::Generate(DdsImage& image, const MipOptions& options)
+{
+	if (Dds::IsBlockCompressed(image.format)) throw invalid_argument{ "mips: source is block compressed" };
+
+	DdsImage result;
+	result.format = image.format;
+	result.width = image.width;
+	result.height = image.height;
+	result.arraySize = image.arraySize;
+	result.cubeMap = image.cubeMap;
+	result.mipCount = 1;
+	while ((max(image.width, image.height) >> result.mipCount) > 0) ++result.mipCount;
+	result.data.resize(Dds::GetSubresourceOffset(result, result.arraySize, 0));
+
+	const size_t sourceSize = Dds::GetSurfaceSize(image.format, image.width, image.height);
+	for (uint32_t slice = 0; slice < image.arraySize; ++slice) {
+		const std::byte* source = image.data.data() + Dds::GetSubresourceOffset(image, slice, 0);
+		memcpy(result.data.data() + Dds::GetSubresourceOffset(result, slice, 0), source, sourceSize);
+
+		const float coverage = options.alphaCoverage > 0.0f ?
+			GetCoverage(source, image.format, image.width, image.height, options.alphaCoverage) : 0.0f;
+
+		Level previous;
+		for (uint32_t mip = 1; mip < result.mipCount; ++mip) {
+			const uint32_t width = Dds::GetMipSize(image.width, mip);
+			const uint32_t height = Dds::GetMipSize(image.height, mip);
+			// Each level is filtered from the previous unscaled one; only the written texels get the alpha scale.
+			Level level = mip == 1 ?
+				Downsample(image.width, image.height, [&](uint32_t y, float* row) {
+					ReadRow(source, image.format, image.width, y, row);
+					return static_cast<const float*>(row);
+					}, width, height, options.filter) :
+				Downsample(previous.width, previous.height, [&](uint32_t y, float*) {
+					return static_cast<const float*>(previous.pixels.data() + size_t{ y } * previous.width * 4);
+					}, width, height, options.filter);
+
+			const float alphaScale = options.alphaCoverage > 0.0f ? GetAlphaScale(level, options.alphaCoverage, coverage) : 1.0f;
+			std::byte* destination = result.data.data() + Dds::GetSubresourceOffset(result, slice, mip);
+			Parallel::For(0, height, [&](size_t y) {
+				WriteRow(level.pixels.data() + y * width * 4, alphaScale, image.format, width, static_cast<uint32_t>(y), destination);
+				});
+			previous = move(level);
+		}
+	}
+	image = move(result);
+}
+
+void Mipmap::Benchmark(const vector<uint32_t>& sizes, int iterations)
+{
+	iterations = max(iterations, 1);
+	for (const uint32_t size : sizes) {
+		// Smooth color with noise and a hard-edged alpha pattern, like a foliage atlas.
+		DdsImage source;
+		source.format = DdsFormat::R8G8B8A8UnormSrgb;
+		source.width = source.height = size;
+		source.data.resize(Dds::GetSurfaceSize(source.format, size, size));
+		Parallel::For(0, size, [&](size_t y) {
+			uint32_t state = static_cast<uint32_t>(y) * 2654435761u + 1;
+			auto* row = reinterpret_cast<uint8_t*>(source.data.data()) + y * size * 4;
+			for (uint32_t x = 0; x < size; ++x) {
+				state = state * 1664525u + 1013904223u;
+				const int noise = static_cast<int>(state >> 28) - 8;
+				row[x * 4 + 0] = static_cast<uint8_t>(clamp(static_cast<int>(x * 255 / size) + noise, 0, 255));
+				row[x * 4 + 1] = static_cast<uint8_t>(clamp(static_cast<int>(y * 255 / size) + noise, 0, 255));
+				row[x * 4 + 2] = static_cast<uint8_t>(clamp(128 + noise * 4, 0, 255));
+				row[x * 4 + 3] = ((x / 7 + y / 13) % 3 == 0) ? 255 : 0;
+			}
+			});
+
+		const pair<const char*, MipOptions> cases[]{
+			{ "box", { MipFilter::Box, 0.0f } },
+			{ "kaiser", { MipFilter::Kaiser, 0.0f } },
+			{ "kaiser + alpha coverage", { MipFilter::Kaiser, 0.5f } },
+		};
+		for (const auto& [name, options] : cases) {
+			double seconds = 0.0;
+			for (int i = 0; i < iterations; ++i) {
+				DdsImage image = source;
+				const auto start = Clock::now();
+				Generate(image, options);
+				seconds += chrono::duration<double>(Clock::now() - start).count();
+			}
+			seconds /= iterations;
+			cout << size << "x" << size << " " << name << ": " << seconds * 1000.0 << " ms, "
+				<< static_cast<double>(size) * size / 1e6 / seconds << " source Mpixel/s on " << Parallel::GetWorkerCount() << " workers" << endl;
+		}
+	}
+}
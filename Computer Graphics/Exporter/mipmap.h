@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "dds.h"
+
+enum class MipFilter
+{
+	Box,
+	Kaiser,
+};
+
+struct MipOptions
+{
+	MipFilter	filter = MipFilter::Kaiser;
+
+	// When above zero, alpha in every mip is scaled so the fraction of texels above this value
+	// matches mip 0, which keeps alpha-tested sprites (grass) from thinning out in the distance.
+	float		alphaCoverage = 0.0f;
+};
+
+namespace Mipmap
+{
+	// "box" or "kaiser".
+	MipFilter ParseFilter(std::string_view name);
+
+	// Replaces the mips of every slice with a full chain filtered down from mip 0. sRGB formats are
+	// filtered in linear space. Works on the uncompressed formats Dds reads.
+	void Generate(DdsImage& image, const MipOptions& options);
+
+	// Times Generate on a generated sRGB RGBA8 source of each size with every filter.
+	void Benchmark(const std::vector<uint32_t>& sizes, int iterations);
+}
@@ -0,0 +1,246 @@
+#include "packer.h"
+#include "../Common/assetpack.h"
+#include "../Common/ioqueue.h"
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+	using Clock = chrono::steady_clock;
+
+	vector<filesystem::path> ListFiles(const filesystem::path& root, const filesystem::path& exclude = {})
+	{
+		vector<filesystem::path> files;
+		for (const auto& entry : filesystem::recursive_directory_iterator(root)) {
+			if (!entry.is_regular_file()) continue;
+			if (!exclude.empty() && filesystem::equivalent(entry.path(), exclude)) continue;
+			files.push_back(entry.path());
+		}
+		ranges::sort(files);
+		return files;
+	}
+
+	vector<std::byte> ReadFile(const filesystem::path& path)
+	{
+		ifstream in(path, ios::binary);
+		if (!in) throw runtime_error{ "cannot open " + path.string() };
+		vector<std::byte> data(static_cast<size_t>(filesystem::file_size(path)));
+		in.read(reinterpret_cast<char*>(data.data()), static_cast<streamsize>(data.size()));
+		return data;
+	}
+
+	// Drops the file's pages from the OS cache so the next read comes from the device.
+	void EvictFromCache(const filesystem::path& path)
+	{
+#ifdef _WIN32
+		// Opening a file unbuffered flushes and purges its cached pages when no one else holds it open.
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		const int file = open(path.c_str(), O_RDONLY);
+		if (file < 0) return;
+		posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+		close(file);
+#endif
+	}
+
+	// Reads one byte per page so mapped views are actually faulted in.
+	uint64_t Touch(span<const std::byte> data)
+	{
+		uint64_t sum = 0;
+		for (size_t i = 0; i < data.size(); i += 4096) sum += to_integer<uint8_t>(data[i]);
+		return sum;
+	}
+
+	struct BenchmarkResult
+	{
+		double		seconds = 0.0;
+		uint64_t	bytes = 0;
+		uint64_t	checksum = 0;
+	};
+
+	BenchmarkResult LoadLoose(const vector<filesystem::path>& files)
+	{
+		BenchmarkResult result;
+		const auto start = Clock::now();
+		for (const auto& file : files) {
+			const auto data = ReadFile(file);
+			result.bytes += data.size();
+			result.checksum += Touch(data);
+		}
+		result.seconds = chrono::duration<double>(Clock::now() - start).count();
+		return result;
+	}
+
+	BenchmarkResult LoadPacked(const filesystem::path& packPath)
+	{
+		BenchmarkResult result;
+		const auto start = Clock::now();
+		const AssetPack pack{ packPath };
+		for (const auto& entry : pack.GetEntries()) {
+			const AssetData data = pack.Load(entry);
+			result.bytes += data.GetSize();
+			result.checksum += Touch(data.GetData());
+		}
+		result.seconds = chrono::duration<double>(Clock::now() - start).count();
+		return result;
+	}
+
+	void Print(const char* label, const BenchmarkResult& result, size_t files)
+	{
+		cout << label << ": " << files << " files, " << result.seconds * 1000.0 << " ms, "
+			<< result.bytes / (1024.0 * 1024.0) / result.seconds << " MB/s" << endl;
+	}
+}
+
+void Packer::Pack(const filesystem::path& output, const filesystem::path& root, bool compress, uint32_t alignment)
+{
+	const bool outputInRoot = filesystem::exists(output);
+	const auto files = ListFiles(root, outputInRoot ? output : filesystem::path{});
+
+	AssetPackWriter writer{ output, alignment };
+	uint64_t inputBytes = 0;
+	for (const auto& file : files) {
+		const auto data = ReadFile(file);
+		inputBytes += data.size();
+		writer.Add(filesystem::relative(file, root).generic_string(), data, compress);
+	}
+	writer.Finish();
+
+	cout << "packed " << files.size() << " files, " << inputBytes << " bytes -> "
+		<< writer.GetWrittenBytes() << " bytes (" << output.string() << ")" << endl;
+}
+
+void Packer::Benchmark(const filesystem::path& pack, const filesystem::path& root, int iterations)
+{
+	const auto files = ListFiles(root, pack);
+	const size_t entries = AssetPack{ pack }.GetEntries().size();
+
+	for (const auto& file : files) EvictFromCache(file);
+	Print("loose cold", LoadLoose(files), files.size());
+	EvictFromCache(pack);
+	Print("pack  cold", LoadPacked(pack), entries);
+
+	BenchmarkResult loose, packed;
+	for (int i = 0; i < iterations; ++i) {
+		const auto l = LoadLoose(files);
+		const auto p = LoadPacked(pack);
+		loose.seconds += l.seconds;
+		loose.bytes += l.bytes;
+		packed.seconds += p.seconds;
+		packed.bytes += p.bytes;
+	}
+	Print("loose warm", loose, files.size());
+	Print("pack  warm", packed, entries);
+
+	// Views from a mounted pack hold it, so they stay readable once it is unmounted and released.
+	vector<string> names;
+	vector<AssetData> views;
+	{
+		auto mounted = make_shared<AssetPack>(pack);
+		Assets::Mount(mounted, root);
+		for (const auto& entry : mounted->GetEntries()) {
+			names.emplace_back(mounted->GetName(entry));
+			views.push_back(Assets::Load(root / names.back()));
+		}
+		Assets::Unmount();
+	}
+	for (size_t i = 0; i < views.size(); ++i) {
+		const auto file = ReadFile(root / names[i]);
+		if (!ranges::equal(views[i].GetData(), file)) throw runtime_error{ "packbench: " + names[i] + " changed after the unmount" };
+	}
+	cout << views.size() << " entries read back intact after the pack was unmounted" << endl;
+}
+
+void Packer::IoBenchmark(const filesystem::path& input, size_t ioThreads, uint64_t blockSize)
+{
+	const bool isPack = filesystem::is_regular_file(input);
+	const auto files = isPack ? vector<filesystem::path>{ input } : ListFiles(input);
+	blockSize = max<uint64_t>(blockSize, 4096);
+
+	for (const auto& file : files) EvictFromCache(file);
+	BenchmarkResult baseline;
+	if (isPack) baseline = LoadPacked(input);
+	else baseline = LoadLoose(files);
+	Print("ifstream cold", baseline, files.size());
+
+	for (const auto& file : files) EvictFromCache(file);
+	IoQueue queue{ ioThreads };
+	vector<vector<std::byte>> buffers;
+	vector<future<void>> done;
+
+	const auto start = Clock::now();
+	if (isPack) {
+		const AssetPack pack{ input };
+		const auto file = queue.Open(input);
+		buffers.reserve(pack.GetEntries().size());
+		for (const auto& entry : pack.GetEntries()) {
+			auto& buffer = buffers.emplace_back(entry.size);
+			IoQueue::Request request;
+			request.file = file;
+			request.offset = entry.offset;
+			request.size = entry.storedSize;
+			request.destination = buffer;
+			request.compressed = (entry.flags & AssetPackEntry::Compressed) != 0;
+			done.push_back(queue.Enqueue(request));
+		}
+	}
+	else {
+		buffers.reserve(files.size());
+		for (const auto& path : files) {
+			const auto file = queue.Open(path);
+			auto& buffer = buffers.emplace_back(queue.GetFileSize(file));
+			for (uint64_t offset = 0; offset < buffer.size(); offset += blockSize) {
+				IoQueue::Request request;
+				request.file = file;
+				request.offset = offset;
+				request.size = min<uint64_t>(blockSize, buffer.size() - offset);
+				request.destination = span{ buffer }.subspan(offset, request.size);
+				done.push_back(queue.Enqueue(request));
+			}
+		}
+	}
+	for (auto& request : done) request.get();
+	const double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+	BenchmarkResult queued;
+	queued.seconds = seconds;
+	for (const auto& buffer : buffers) queued.bytes += buffer.size();
+	Print("io queue cold", queued, buffers.size());
+
+	const IoStatistics statistics = queue.GetStatistics();
+	cout << "requests " << statistics.requests << ", batches " << statistics.batches
+		<< ", coalesced " << statistics.coalescedRequests << ", max queue depth " << statistics.maxQueueDepth << endl;
+	cout << "read " << statistics.bytesRead / (1024.0 * 1024.0) << " MB, delivered "
+		<< statistics.bytesDelivered / (1024.0 * 1024.0) << " MB" << endl;
+	cout << "latency p50 < " << statistics.GetLatencyPercentile(0.5) << " us, p90 < "
+		<< statistics.GetLatencyPercentile(0.9) << " us, p99 < " << statistics.GetLatencyPercentile(0.99) << " us" << endl;
+	for (size_t i = 0; i < statistics.latencyHistogram.size(); ++i) {
+		if (!statistics.latencyHistogram[i]) continue;
+		cout << "  [" << setw(8) << (uint64_t{ 1 } << i) << ", " << setw(8) << (uint64_t{ 2 } << i) << ") us: "
+			<< statistics.latencyHistogram[i] << endl;
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+
+namespace Packer
+{
+	// Packs every regular file under `root` with its root-relative path as the entry name.
+	void Pack(const std::filesystem::path& output, const std::filesystem::path& root, bool compress, uint32_t alignment);
+
+	// Compares loading every file under `root` one by one against loading the same data from
+	// the memory-mapped `pack`, first with the OS file cache dropped (cold) and then warm. Then
+	// mounts the pack, unmounts it with every entry still loaded and throws unless each entry
+	// still matches its file.
+	void Benchmark(const std::filesystem::path& pack, const std::filesystem::path& root, int iterations);
+
+	// Reads every file under `input` (or every entry of `input` when it is a pack) through IoQueue
+	// in `blockSize` requests and prints throughput, batching, queue depth and latency statistics
+	// next to a blocking ifstream baseline. Both runs start with the files dropped from the OS cache.
+	void IoBenchmark(const std::filesystem::path& input, size_t ioThreads, uint64_t blockSize);
+}
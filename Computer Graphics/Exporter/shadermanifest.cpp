@@ -0,0 +1,46 @@
+#include "shadermanifest.h"
+#include "json.h"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+	// "NAME" defines NAME as 1, "NAME=VALUE" as VALUE.
+	Shaders::Program ParseProgram(const JsonValue& value)
+	{
+		Shaders::Program program;
+		program.file = value["file"].GetString();
+		program.entry = value["entry"].GetString();
+		program.target = value["target"].GetString();
+		if (!value.Contains("defines")) return program;
+		for (const JsonValue& define : value["defines"].GetArray()) {
+			const string& text = define.GetString();
+			const size_t equals = text.find('=');
+			program.names.push_back(text.substr(0, equals));
+			program.values.push_back(equals == string::npos ? "1" : text.substr(equals + 1));
+		}
+		return program;
+	}
+}
+
+Shaders::Manifest Shaders::ReadManifest(const filesystem::path& path)
+{
+	ifstream in{ path, ios::binary };
+	if (!in) throw runtime_error{ "shaders: cannot open " + path.string() };
+	const string text{ istreambuf_iterator<char>{ in }, istreambuf_iterator<char>{} };
+	const JsonValue root = JsonValue::Parse(text);
+	const auto get = [&](string_view key, const char* fallback) {
+		return root.Contains(key) ? root[key].GetString() : string{ fallback };
+	};
+
+	Manifest manifest;
+	manifest.sourceDirectory = path.parent_path();
+	manifest.cacheDirectory = manifest.sourceDirectory / get("cache", "Cache");
+	manifest.dxilDirectory = manifest.sourceDirectory / get("dxil", "Cache/DXIL");
+	manifest.shaderModel = get("shaderModel", "6_2");
+	for (const JsonValue& value : root["programs"].GetArray()) manifest.programs.push_back(ParseProgram(value));
+	return manifest;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace Shaders
+{
+	struct Program
+	{
+		std::string					file;
+		std::string					entry;
+		std::string					target;			// FXC target, such as ps_5_1.
+		std::vector<std::string>	names;
+		std::vector<std::string>	values;
+	};
+
+	struct Manifest
+	{
+		std::filesystem::path		sourceDirectory;	// The manifest's own directory.
+		std::filesystem::path		cacheDirectory;
+		std::filesystem::path		dxilDirectory;
+		std::string					shaderModel;		// Of the DXIL set, such as 6_2.
+		std::vector<Program>		programs;
+	};
+
+	// A JSON object whose "programs" array holds { "file", "entry", "target", "defines" } entries;
+	// "cache", "dxil" and "shaderModel" default to Cache, Cache/DXIL and 6_2. Files and directories
+	// are relative to the manifest.
+	Manifest ReadManifest(const std::filesystem::path& path);
+}
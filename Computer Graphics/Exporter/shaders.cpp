@@ -0,0 +1,314 @@
+#include "shaders.h"
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#endif
+#include "shadermanifest.h"
+#include "../Common/parallel.h"
+#include "../Common/pipelinehash.h"
+#include "../Common/shadercache.h"
+#include <d3d12shader.h>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	// What a pipeline description points to.
+	struct PipelineStorage
+	{
+		vector<uint8_t>						shaders[5];		// VS, PS, DS, HS and GS bytecode.
+		string								names[3];		// Stream output and input element semantics.
+		vector<D3D12_SO_DECLARATION_ENTRY>	streamOutput;
+		vector<UINT>						strides;
+		vector<D3D12_INPUT_ELEMENT_DESC>	inputLayout;
+	};
+
+	// A description with every hashed field away from zero. The description and the arrays are
+	// filled with `padding` first and then set field by field, so only their padding holds it.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC MakePipelineDescription(PipelineStorage& storage, uint8_t padding)
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC desc;
+		memset(&desc, padding, sizeof(desc));
+		desc.pRootSignature = nullptr;
+		D3D12_SHADER_BYTECODE* shaders[5]{ &desc.VS, &desc.PS, &desc.DS, &desc.HS, &desc.GS };
+		for (int i = 0; i < 5; ++i) {
+			storage.shaders[i].resize(16 + i * 4);
+			for (size_t j = 0; j < storage.shaders[i].size(); ++j) storage.shaders[i][j] = static_cast<uint8_t>(i * 31 + j);
+			shaders[i]->pShaderBytecode = storage.shaders[i].data();
+			shaders[i]->BytecodeLength = storage.shaders[i].size();
+		}
+
+		storage.names[0] = "SV_POSITION";
+		storage.names[1] = "POSITION";
+		storage.names[2] = "TEXCOORD";
+		storage.streamOutput.resize(1);
+		memset(storage.streamOutput.data(), padding, sizeof(D3D12_SO_DECLARATION_ENTRY));
+		auto& entry = storage.streamOutput[0];
+		entry.Stream = 1;
+		entry.SemanticName = storage.names[0].c_str();
+		entry.SemanticIndex = 1;
+		entry.StartComponent = 1;
+		entry.ComponentCount = 3;
+		entry.OutputSlot = 1;
+		storage.strides.assign({ 16, 32 });
+		desc.StreamOutput.pSODeclaration = storage.streamOutput.data();
+		desc.StreamOutput.NumEntries = 1;
+		desc.StreamOutput.pBufferStrides = storage.strides.data();
+		desc.StreamOutput.NumStrides = 2;
+		desc.StreamOutput.RasterizedStream = 1;
+
+		desc.BlendState.AlphaToCoverageEnable = TRUE;
+		desc.BlendState.IndependentBlendEnable = TRUE;
+		for (auto& target : desc.BlendState.RenderTarget) {
+			target.BlendEnable = TRUE;
+			target.LogicOpEnable = TRUE;
+			target.SrcBlend = D3D12_BLEND_SRC_ALPHA;
+			target.DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+			target.BlendOp = D3D12_BLEND_OP_ADD;
+			target.SrcBlendAlpha = D3D12_BLEND_ONE;
+			target.DestBlendAlpha = D3D12_BLEND_ZERO;
+			target.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+			target.LogicOp = D3D12_LOGIC_OP_NOOP;
+			target.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+		}
+		desc.SampleMask = 0xFFFFFFFF;
+
+		auto& rasterizer = desc.RasterizerState;
+		rasterizer.FillMode = D3D12_FILL_MODE_SOLID;
+		rasterizer.CullMode = D3D12_CULL_MODE_BACK;
+		rasterizer.FrontCounterClockwise = TRUE;
+		rasterizer.DepthBias = 100;
+		rasterizer.DepthBiasClamp = 0.5f;
+		rasterizer.SlopeScaledDepthBias = 1.5f;
+		rasterizer.DepthClipEnable = TRUE;
+		rasterizer.MultisampleEnable = TRUE;
+		rasterizer.AntialiasedLineEnable = TRUE;
+		rasterizer.ForcedSampleCount = 1;
+		rasterizer.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_ON;
+
+		auto& depthStencil = desc.DepthStencilState;
+		depthStencil.DepthEnable = TRUE;
+		depthStencil.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+		depthStencil.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+		depthStencil.StencilEnable = TRUE;
+		depthStencil.StencilReadMask = 0x0F;
+		depthStencil.StencilWriteMask = 0xF0;
+		for (auto* face : { &depthStencil.FrontFace, &depthStencil.BackFace }) {
+			face->StencilFailOp = D3D12_STENCIL_OP_KEEP;
+			face->StencilDepthFailOp = D3D12_STENCIL_OP_INCR;
+			face->StencilPassOp = D3D12_STENCIL_OP_KEEP;
+			face->StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+		}
+
+		storage.inputLayout.resize(2);
+		memset(storage.inputLayout.data(), padding, storage.inputLayout.size() * sizeof(D3D12_INPUT_ELEMENT_DESC));
+		for (UINT i = 0; i < 2; ++i) {
+			auto& element = storage.inputLayout[i];
+			element.SemanticName = storage.names[1 + i].c_str();
+			element.SemanticIndex = i + 1;
+			element.Format = i == 0 ? DXGI_FORMAT_R32G32B32_FLOAT : DXGI_FORMAT_R32G32_FLOAT;
+			element.InputSlot = i + 1;
+			element.AlignedByteOffset = 12 * i + 4;
+			element.InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA;
+			element.InstanceDataStepRate = i + 1;
+		}
+		desc.InputLayout.pInputElementDescs = storage.inputLayout.data();
+		desc.InputLayout.NumElements = 2;
+
+		desc.IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_0xFFFF;
+		desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_PATCH;
+		desc.NumRenderTargets = 2;
+		for (auto& format : desc.RTVFormats) format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.RTVFormats[1] = DXGI_FORMAT_R16G16B16A16_FLOAT;
+		desc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+		desc.SampleDesc.Count = 4;
+		desc.SampleDesc.Quality = 1;
+		desc.NodeMask = 1;
+		desc.CachedPSO.pCachedBlob = nullptr;
+		desc.CachedPSO.CachedBlobSizeInBytes = 0;
+		desc.Flags = D3D12_PIPELINE_STATE_FLAG_TOOL_DEBUG;
+		return desc;
+	}
+
+	template <typename T>
+	void Bump(T& value)
+	{
+		if constexpr (is_enum_v<T>) value = static_cast<T>(static_cast<underlying_type_t<T>>(value) + 1);
+		else value = static_cast<T>(value + 1);
+	}
+}
+
+void Shaders::Compile(const filesystem::path& manifest, const filesystem::path& cacheDirectory, bool debug)
+{
+	const Manifest list = ReadManifest(manifest);
+	const filesystem::path cache = !cacheDirectory.empty() ? cacheDirectory : list.cacheDirectory;
+	const UINT flags = debug ? D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION : 0;
+	ShaderCache shaderCache{ list.sourceDirectory, cache, flags };
+
+	// 0 where the bytecode does not reflect.
+	vector<UINT> instructionCounts(list.programs.size(), 0);
+	const auto start = chrono::steady_clock::now();
+	Parallel::For(0, list.programs.size(), [&](size_t index) {
+		const Program& program = list.programs[index];
+		vector<D3D_SHADER_MACRO> defines;
+		for (size_t i = 0; i < program.names.size(); ++i) {
+			defines.push_back({ program.names[i].c_str(), program.values[i].c_str() });
+		}
+		defines.push_back({ nullptr, nullptr });
+		const auto byteCode = shaderCache.Compile(program.file, defines.data(), program.entry, program.target);
+
+		Microsoft::WRL::ComPtr<ID3D12ShaderReflection> reflection;
+		D3D12_SHADER_DESC shaderDesc{};
+		if (SUCCEEDED(D3DReflect(byteCode->GetBufferPointer(), byteCode->GetBufferSize(), IID_PPV_ARGS(&reflection)))) {
+			reflection->GetDesc(&shaderDesc);
+		}
+		instructionCounts[index] = shaderDesc.InstructionCount;
+		});
+	const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+	const auto statistics = shaderCache.GetStatistics();
+	cout << list.programs.size() << " programs in " << elapsed.count() << " ms: " << statistics.misses << " compiled ("
+		<< statistics.compileSeconds * 1000.0 << " ms in the compiler), " << statistics.hits << " already cached, "
+		<< statistics.filesRead << " files read, " << statistics.preprocessed << " preprocessed (" << cache.string() << ")" << endl;
+	for (size_t index = 0; index < list.programs.size(); ++index) {
+		const Program& program = list.programs[index];
+		cout << "  " << program.file << " " << program.entry << " " << program.target;
+		for (size_t i = 0; i < program.names.size(); ++i) cout << " " << program.names[i] << "=" << program.values[i];
+		cout << ": " << instructionCounts[index] << " instructions" << endl;
+	}
+}
+
+void Shaders::CheckPipelineHash()
+{
+	const auto check = [](bool condition, const string& what) {
+		if (!condition) throw runtime_error{ "pipeline hash: " + what };
+		};
+	constexpr uint64_t Seed = 0x5EED;
+	PipelineStorage storage;
+	const D3D12_GRAPHICS_PIPELINE_STATE_DESC base = MakePipelineDescription(storage, 0x00);
+	const uint64_t key = PipelineHash::Hash(base, Seed);
+
+	// Equal contents at other addresses, and the same arrays refilled with other padding.
+	PipelineStorage elsewhere;
+	check(PipelineHash::Hash(MakePipelineDescription(elsewhere, 0x00), Seed) == key, "a copy elsewhere in memory changes the key");
+	const D3D12_GRAPHICS_PIPELINE_STATE_DESC padded = MakePipelineDescription(storage, 0xCD);
+	check(memcmp(&padded, &base, sizeof(base)) != 0, "the description has no padding to test");
+	check(PipelineHash::Hash(padded, Seed) == key, "padding changes the key");
+	check(PipelineHash::Hash(base, Seed + 1) != key, "the seed does not change the key");
+
+	using Change = function<void(D3D12_GRAPHICS_PIPELINE_STATE_DESC&, PipelineStorage&)>;
+#define FIELD(field) { #field, [](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, PipelineStorage& storage) { (void)desc; (void)storage; Bump(field); } }
+	const vector<pair<string, Change>> changes{
+		{ "VS bytes", [](auto&, auto& storage) { storage.shaders[0].back() ^= 1; } },
+		{ "PS bytes", [](auto&, auto& storage) { storage.shaders[1].back() ^= 1; } },
+		{ "DS bytes", [](auto&, auto& storage) { storage.shaders[2].back() ^= 1; } },
+		{ "HS bytes", [](auto&, auto& storage) { storage.shaders[3].back() ^= 1; } },
+		{ "GS bytes", [](auto&, auto& storage) { storage.shaders[4].back() ^= 1; } },
+		{ "VS length", [](auto& desc, auto&) { --desc.VS.BytecodeLength; } },
+		{ "GS length", [](auto& desc, auto&) { --desc.GS.BytecodeLength; } },
+		FIELD(storage.streamOutput[0].Stream),
+		{ "stream output semantic", [](auto&, auto& storage) { storage.names[0] = "SV_Position"; storage.streamOutput[0].SemanticName = storage.names[0].c_str(); } },
+		FIELD(storage.streamOutput[0].SemanticIndex),
+		FIELD(storage.streamOutput[0].StartComponent),
+		FIELD(storage.streamOutput[0].ComponentCount),
+		FIELD(storage.streamOutput[0].OutputSlot),
+		{ "desc.StreamOutput.NumEntries", [](auto& desc, auto&) { desc.StreamOutput.NumEntries = 0; } },
+		FIELD(storage.strides[1]),
+		{ "desc.StreamOutput.NumStrides", [](auto& desc, auto&) { desc.StreamOutput.NumStrides = 1; } },
+		FIELD(desc.StreamOutput.RasterizedStream),
+		FIELD(desc.BlendState.AlphaToCoverageEnable),
+		FIELD(desc.BlendState.IndependentBlendEnable),
+		FIELD(desc.BlendState.RenderTarget[0].BlendEnable),
+		FIELD(desc.BlendState.RenderTarget[0].LogicOpEnable),
+		FIELD(desc.BlendState.RenderTarget[0].SrcBlend),
+		FIELD(desc.BlendState.RenderTarget[0].DestBlend),
+		FIELD(desc.BlendState.RenderTarget[0].BlendOp),
+		FIELD(desc.BlendState.RenderTarget[0].SrcBlendAlpha),
+		FIELD(desc.BlendState.RenderTarget[0].DestBlendAlpha),
+		FIELD(desc.BlendState.RenderTarget[0].BlendOpAlpha),
+		FIELD(desc.BlendState.RenderTarget[0].LogicOp),
+		FIELD(desc.BlendState.RenderTarget[0].RenderTargetWriteMask),
+		FIELD(desc.BlendState.RenderTarget[7].BlendEnable),
+		FIELD(desc.BlendState.RenderTarget[7].RenderTargetWriteMask),
+		FIELD(desc.SampleMask),
+		FIELD(desc.RasterizerState.FillMode),
+		FIELD(desc.RasterizerState.CullMode),
+		FIELD(desc.RasterizerState.FrontCounterClockwise),
+		FIELD(desc.RasterizerState.DepthBias),
+		FIELD(desc.RasterizerState.DepthBiasClamp),
+		FIELD(desc.RasterizerState.SlopeScaledDepthBias),
+		FIELD(desc.RasterizerState.DepthClipEnable),
+		FIELD(desc.RasterizerState.MultisampleEnable),
+		FIELD(desc.RasterizerState.AntialiasedLineEnable),
+		FIELD(desc.RasterizerState.ForcedSampleCount),
+		FIELD(desc.RasterizerState.ConservativeRaster),
+		FIELD(desc.DepthStencilState.DepthEnable),
+		FIELD(desc.DepthStencilState.DepthWriteMask),
+		FIELD(desc.DepthStencilState.DepthFunc),
+		FIELD(desc.DepthStencilState.StencilEnable),
+		FIELD(desc.DepthStencilState.StencilReadMask),
+		FIELD(desc.DepthStencilState.StencilWriteMask),
+		FIELD(desc.DepthStencilState.FrontFace.StencilFailOp),
+		FIELD(desc.DepthStencilState.FrontFace.StencilDepthFailOp),
+		FIELD(desc.DepthStencilState.FrontFace.StencilPassOp),
+		FIELD(desc.DepthStencilState.FrontFace.StencilFunc),
+		FIELD(desc.DepthStencilState.BackFace.StencilFailOp),
+		FIELD(desc.DepthStencilState.BackFace.StencilDepthFailOp),
+		FIELD(desc.DepthStencilState.BackFace.StencilPassOp),
+		FIELD(desc.DepthStencilState.BackFace.StencilFunc),
+		{ "input element semantic", [](auto&, auto& storage) { storage.names[2] = "NORMAL"; storage.inputLayout[1].SemanticName = storage.names[2].c_str(); } },
+		FIELD(storage.inputLayout[1].SemanticIndex),
+		FIELD(storage.inputLayout[1].Format),
+		FIELD(storage.inputLayout[1].InputSlot),
+		FIELD(storage.inputLayout[1].AlignedByteOffset),
+		FIELD(storage.inputLayout[1].InputSlotClass),
+		FIELD(storage.inputLayout[1].InstanceDataStepRate),
+		{ "desc.InputLayout.NumElements", [](auto& desc, auto&) { desc.InputLayout.NumElements = 1; } },
+		FIELD(desc.IBStripCutValue),
+		FIELD(desc.PrimitiveTopologyType),
+		{ "desc.NumRenderTargets", [](auto& desc, auto&) { desc.NumRenderTargets = 1; } },
+		FIELD(desc.RTVFormats[0]),
+		FIELD(desc.RTVFormats[1]),
+		FIELD(desc.DSVFormat),
+		FIELD(desc.SampleDesc.Count),
+		FIELD(desc.SampleDesc.Quality),
+		FIELD(desc.NodeMask),
+		FIELD(desc.Flags),
+	};
+	// What the key leaves out: the root signature and cached blob, and formats past the targets.
+	const vector<pair<string, Change>> ignored{
+		{ "desc.pRootSignature", [](auto& desc, auto&) { desc.pRootSignature = reinterpret_cast<ID3D12RootSignature*>(&desc); } },
+		{ "desc.CachedPSO", [](auto& desc, auto& storage) { desc.CachedPSO = { storage.shaders[0].data(), storage.shaders[0].size() }; } },
+		FIELD(desc.RTVFormats[2]),
+	};
+#undef FIELD
+
+	set<uint64_t> keys{ key };
+	for (const auto& [name, change] : changes) {
+		PipelineStorage changed;
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = MakePipelineDescription(changed, 0x00);
+		change(desc, changed);
+		check(keys.insert(PipelineHash::Hash(desc, Seed)).second, name + " does not change the key");
+	}
+	for (const auto& [name, change] : ignored) {
+		PipelineStorage changed;
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = MakePipelineDescription(changed, 0x00);
+		change(desc, changed);
+		check(PipelineHash::Hash(desc, Seed) == key, name + " changes the key");
+	}
+	cout << "pipeline hash: " << changes.size() << " field changes each give a new key; copies elsewhere in memory, "
+		<< "other padding and " << ignored.size() << " fields left out keep it" << endl;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <filesystem>
+
+namespace Shaders
+{
+	// Compiles every program listed in a manifest (see ReadManifest) into a ShaderCache directory,
+	// offline, so the game loads bytecode instead of compiling at startup. The cache goes to the
+	// manifest's "cache" directory unless `cacheDirectory` is given.
+	// `debug` must match the game's configuration, since the flags are part of every key. Prints
+	// each program's instruction count from D3DReflect, so variants of one entry point, such as the
+	// terrain's DOMAIN_MAIN with and without NORMAL_MAP, can be compared.
+	void Compile(const std::filesystem::path& manifest, const std::filesystem::path& cacheDirectory, bool debug);
+
+	// Checks the game's pipeline cache key (see PipelineHash) on a description with every field
+	// set: copies at other addresses and with other padding keep the key, changing any hashed field
+	// (the last byte of each shader, each state, element and format) gives a new one, and the root
+	// signature, cached blob and unused formats leave it alone. Throws on the first failure.
+	void CheckPipelineHash();
+}
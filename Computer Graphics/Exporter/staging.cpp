@@ -0,0 +1,153 @@
+#include "staging.h"
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#endif
+#include "../Common/assetpack.h"
+#include "../Common/DDSTextureLoader12.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	using Clock = chrono::steady_clock;
+
+	struct StagingResult
+	{
+		size_t		textures = 0;
+		uint64_t	fileBytes = 0;
+		uint64_t	stagedBytes = 0;
+		double		readSeconds = 0.0;
+		double		parseSeconds = 0.0;
+		double		stageSeconds = 0.0;
+
+		StagingResult& operator+=(const StagingResult& other)
+		{
+			textures += other.textures;
+			fileBytes += other.fileBytes;
+			stagedBytes += other.stagedBytes;
+			readSeconds += other.readSeconds;
+			parseSeconds += other.parseSeconds;
+			stageSeconds += other.stageSeconds;
+			return *this;
+		}
+	};
+
+	double Seconds(Clock::time_point start, Clock::time_point end)
+	{
+		return chrono::duration<double>(end - start).count();
+	}
+
+	AssetData ReadFile(const filesystem::path& path)
+	{
+		ifstream in(path, ios::binary);
+		if (!in) throw runtime_error{ "cannot open " + path.string() };
+		vector<std::byte> data(static_cast<size_t>(filesystem::file_size(path)));
+		in.read(reinterpret_cast<char*>(data.data()), static_cast<streamsize>(data.size()));
+		return AssetData{ move(data) };
+	}
+
+	// `upload` stands in for a mapped upload heap; it only grows, so steady-state runs do not allocate.
+	StagingResult Stage(size_t count, const function<AssetData(size_t)>& load, vector<uint8_t>& upload)
+	{
+		StagingResult result;
+		vector<D3D12_SUBRESOURCE_DATA> subresources;
+		vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts;
+		vector<UINT> numRows;
+		for (size_t i = 0; i < count; ++i) {
+			const auto start = Clock::now();
+			const AssetData data = load(i);
+			const auto read = Clock::now();
+
+			D3D12_RESOURCE_DESC desc{};
+			UINT64 uploadSize{};
+			if (FAILED(DirectX::LoadDDSTextureDataFromMemory(nullptr, reinterpret_cast<const uint8_t*>(data.GetData().data()),
+				data.GetSize(), 0, DirectX::DDS_LOADER_DEFAULT, &desc, subresources)) ||
+				FAILED(DirectX::GetDDSUploadFootprints(desc, 0, layouts, numRows, &uploadSize))) {
+				throw runtime_error{ "cannot parse texture " + to_string(i) };
+			}
+			if (upload.size() < uploadSize) upload.resize(static_cast<size_t>(uploadSize));
+			const auto parsed = Clock::now();
+
+			DirectX::WriteDDSSubresources(upload.data(), layouts, numRows, subresources);
+			const auto staged = Clock::now();
+
+			++result.textures;
+			result.fileBytes += data.GetSize();
+			result.stagedBytes += uploadSize;
+			result.readSeconds += Seconds(start, read);
+			result.parseSeconds += Seconds(read, parsed);
+			result.stageSeconds += Seconds(parsed, staged);
+		}
+		return result;
+	}
+
+	void Print(const char* label, const StagingResult& result)
+	{
+		const double total = result.readSeconds + result.parseSeconds + result.stageSeconds;
+		cout << label << ": " << result.textures << " textures, " << result.fileBytes / (1024.0 * 1024.0) << " MB, read "
+			<< result.readSeconds * 1000.0 << " ms, parse " << result.parseSeconds * 1e6 / result.textures << " us/texture, stage "
+			<< result.stagedBytes / (1024.0 * 1024.0) / result.stageSeconds << " MB/s, total "
+			<< result.fileBytes / (1024.0 * 1024.0) / total << " MB/s" << endl;
+	}
+
+	bool IsTexture(const filesystem::path& path)
+	{
+		string extension = path.extension().string();
+		ranges::transform(extension, extension.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+		return extension == ".dds";
+	}
+}
+
+void Staging::Benchmark(const filesystem::path& input, int iterations)
+{
+	vector<uint8_t> upload;
+	StagingResult heap, mapped;
+	iterations = max(iterations, 1);
+
+	if (filesystem::is_regular_file(input)) {
+		// Pack entries are views into the pack mapping, so there is no heap variant to compare with.
+		const AssetPack pack{ input };
+		vector<const AssetPackEntry*> entries;
+		for (const auto& entry : pack.GetEntries()) {
+			if (IsTexture(filesystem::path{ pack.GetName(entry) })) entries.push_back(&entry);
+		}
+		if (entries.empty()) throw runtime_error{ "no .dds entries in " + input.string() };
+
+		const auto load = [&](size_t i) { return pack.Load(*entries[i]); };
+		Stage(entries.size(), load, upload);
+		for (int i = 0; i < iterations; ++i) mapped += Stage(entries.size(), load, upload);
+		Print("pack  ", mapped);
+		return;
+	}
+
+	vector<filesystem::path> files;
+	for (const auto& entry : filesystem::recursive_directory_iterator(input)) {
+		if (entry.is_regular_file() && IsTexture(entry.path())) files.push_back(entry.path());
+	}
+	if (files.empty()) throw runtime_error{ "no .dds files under " + input.string() };
+	ranges::sort(files);
+
+	const auto loadHeap = [&](size_t i) { return ReadFile(files[i]); };
+	const auto loadMapped = [&](size_t i) { return AssetData{ MappedFile{ files[i] } }; };
+	Stage(files.size(), loadHeap, upload);
+	for (int i = 0; i < iterations; ++i) {
+		heap += Stage(files.size(), loadHeap, upload);
+		mapped += Stage(files.size(), loadMapped, upload);
+	}
+	Print("heap  ", heap);
+	Print("mapped", mapped);
+}
@@ -0,0 +1,1318 @@
+#include "terrain.h"
+#include "../Common/heightfield.h"
+#include "../Common/heightpyramid.h"
+#include "../Common/ioqueue.h"
+#include "../Common/lz.h"
+#include "../Common/mappedfile.h"
+#include "../Common/terrainnormals.h"
+#include "../Common/terrainpackage.h"
+#include "../Common/terrainpatches.h"
+#include "../Common/terrainquadtree.h"
+#include "../Common/terraintessellation.h"
+#include "../Common/terraintiles.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	using Clock = chrono::steady_clock;
+
+	// terrain.hlsl's BernsteinBasis.
+	void BernsteinBasis(float t, float* basis)
+	{
+		const float invT = 1.f - t;
+		basis[0] = invT * invT * invT * invT;
+		basis[1] = 4.f * t * invT * invT * invT;
+		basis[2] = 6.f * t * t * invT * invT;
+		basis[3] = 4.f * t * t * t * invT;
+		basis[4] = t * t * t * t;
+	}
+
+	// TerrainMesh's evaluation before Heightfield, kept as the baseline to time the new paths against.
+	class RowHeights
+	{
+	public:
+		RowHeights(const vector<float>& heights, int length) : m_height(length, vector<float>(length)), m_length{ length }
+		{
+			for (size_t offset = 0; auto& line : m_height) {
+				for (auto& dot : line) dot = heights[offset++];
+			}
+		}
+
+		float GetHeight(float x, float z) const
+		{
+			const float low = static_cast<float>(-m_length / 2), high = static_cast<float>(+m_length / 2);
+			if (low > x || high < x || low > z || high < z) return 0.f;
+			// Clamped like Heightfield; this used to read past the last row and column at the far edge.
+			const int last = (m_length - 1) / 4 * 4 - 4;
+			const int nx = static_cast<int>(x + m_length / 2);
+			const int nz = static_cast<int>(z + m_length / 2);
+			const int sx = min(nx - nx % 4, last);
+			const int sz = min(nz - nz % 4, last);
+			const float fx = x + m_length / 2;
+			const float fz = z + m_length / 2;
+
+			float basisU[5], basisV[5];
+			BernsteinBasis((fx - sx) / 4.f, basisU);
+			BernsteinBasis((fz - sz) / 4.f, basisV);
+
+			float sum = 0.f;
+			for (int i = 0; i < 5; ++i) {
+				const auto& line = m_height[sz + i];
+				sum += basisV[i] * (basisU[0] * line[sx] + basisU[1] * line[sx + 1] + basisU[2] * line[sx + 2] +
+					basisU[3] * line[sx + 3] + basisU[4] * line[sx + 4]);
+			}
+			return sum;
+		}
+
+	private:
+		vector<vector<float>> m_height;
+		int m_length;
+	};
+
+	// What the domain shader draws at (x, z), read through the index buffer
+	// TerrainPatches::WritePatchIndices writes: the reference Heightfield must match bit for bit.
+	// u runs from the patch's low x and v from its high z, like the domain location, and the sums
+	// are CubicBezierSum's and LineBezierSum's in their order.
+	class DomainHeights
+	{
+	public:
+		DomainHeights(span<const float> heights, int length) :
+			m_heights{ heights }, m_length{ length }, m_patchCount{ max((length - 1) / Heightfield::PatchLength, 0) }
+		{
+			vector<DirectX::XMUINT2> patchOrder;
+			for (int pz = 0; pz < m_patchCount; ++pz) {
+				for (int px = 0; px < m_patchCount; ++px) patchOrder.emplace_back(px, pz);
+			}
+			m_indices.resize(patchOrder.size() * TerrainPatches::PatchVertices);
+			TerrainPatches::WritePatchIndices(length, patchOrder, m_indices);
+		}
+
+		float GetHeight(float x, float z) const
+		{
+			constexpr int side = Heightfield::PatchLength;
+			const float half = static_cast<float>(m_length / 2);
+			if (-half > x || half < x || -half > z || half < z || m_patchCount == 0) return 0.f;
+			const float fx = x + half;
+			const float fz = z + half;
+			const int px = min(static_cast<int>(fx) / side, m_patchCount - 1);
+			const int pz = min(static_cast<int>(fz) / side, m_patchCount - 1);
+
+			float basisU[5], basisV[5];
+			BernsteinBasis((fx - px * side) / static_cast<float>(side), basisU);
+			BernsteinBasis(((pz + 1) * side - fz) / static_cast<float>(side), basisV);
+
+			// WriteGrid's vertices are the samples in order, so an index picks the sample.
+			const uint32_t* patch = m_indices.data() + (static_cast<size_t>(pz) * m_patchCount + px) * TerrainPatches::PatchVertices;
+			float sum = 0.f;
+			for (int i = 0; i < 5; ++i) {
+				float line = 0.f;
+				for (int j = 0; j < 5; ++j) line += basisU[j] * m_heights[patch[i * 5 + j]];
+				sum += basisV[i] * line;
+			}
+			return sum;
+		}
+
+	private:
+		span<const float> m_heights;
+		vector<uint32_t> m_indices;
+		int m_length;
+		int m_patchCount;
+	};
+
+	// Rolling hills in byte steps, scaled like the game's height map.
+	vector<float> GenerateHeights(int length)
+	{
+		vector<float> heights(static_cast<size_t>(length) * length);
+		for (int z = 0; z < length; ++z) {
+			for (int x = 0; x < length; ++x) {
+				const float value = 128.f + 60.f * sin(x * 0.05f) * cos(z * 0.07f) + 30.f * sin((x + z) * 0.21f);
+				heights[static_cast<size_t>(z) * length + x] = floor(value) / 3.f;
+			}
+		}
+		return heights;
+	}
+
+	vector<float> LoadHeights(const filesystem::path& heightMap, int& length)
+	{
+		if (heightMap.empty()) {
+			length = 257;
+			return GenerateHeights(length);
+		}
+
+		vector<float> heights;
+		ifstream in{ heightMap, ios::binary };
+		if (!in) throw runtime_error{ "cannot open " + heightMap.string() };
+		const vector<char> bytes{ istreambuf_iterator<char>{ in }, istreambuf_iterator<char>{} };
+		// A .r16 map holds little-endian 16-bit samples over the same range as the byte ones.
+		const bool wide = heightMap.extension() == ".r16";
+		length = static_cast<int>(sqrt(static_cast<double>(bytes.size() / (wide ? 2 : 1))));
+		if (length < 5) throw runtime_error{ heightMap.string() + " is not a height map" };
+		heights.resize(static_cast<size_t>(length) * length);
+		for (size_t i = 0; i < heights.size(); ++i) {
+			if (wide) {
+				const unsigned sample = static_cast<unsigned char>(bytes[2 * i]) | static_cast<unsigned char>(bytes[2 * i + 1]) << 8;
+				heights[i] = static_cast<float>(sample) / 257.f / 3.f;
+			}
+			else {
+				heights[i] = static_cast<float>(static_cast<unsigned char>(bytes[i])) / 3.f;
+			}
+		}
+		return heights;
+	}
+
+	struct TiledFile
+	{
+		TerrainTiling::FileHeader	header;
+		uint64_t					rawBytes;		// The tiles' samples before compression.
+		uint64_t					fileBytes;
+		uint32_t					compressedTiles;
+	};
+
+	// Cuts `length` rows of `length` heights into tiles of `tileCells` cells and writes them as a
+	// tiled height map (see TerrainTiling::FileHeader). Heights in byte steps of 1/3, like the
+	// game's maps, keep those steps exactly in 8 bits; anything else spreads its range over the samples.
+	TiledFile WriteTiles(const vector<float>& heights, int length, TerrainTiling::SampleFormat format, int tileCells,
+		const filesystem::path& output)
+	{
+		using namespace TerrainTiling;
+
+		if (tileCells < Heightfield::PatchLength || tileCells % Heightfield::PatchLength != 0) {
+			throw runtime_error{ "tile size must be a multiple of " + to_string(Heightfield::PatchLength) };
+		}
+		TiledFile file{};
+		FileHeader& header = file.header;
+		header.format = static_cast<uint32_t>(format);
+		header.length = static_cast<uint32_t>(length);
+		header.tileCells = static_cast<uint32_t>(tileCells);
+		header.tilesPerSide = static_cast<uint32_t>((length - 1 + tileCells - 1) / tileCells);
+		header.overviewStep = tileCells % 8 == 0 ? static_cast<uint32_t>(tileCells / 8) : Heightfield::PatchLength;
+		Validate(header);
+
+		const uint32_t maxSample = format == SampleFormat::Unorm16 ? 0xFFFF : 0xFF;
+		const bool byteSteps = format == SampleFormat::Unorm8 && all_of(heights.begin(), heights.end(), [](float height) {
+			const float sample = height * 3.f;
+			return sample >= 0.f && sample <= 255.f && abs(sample - round(sample)) < 1e-3f; });
+		if (byteSteps) {
+			header.heightOffset = 0.f;
+			header.heightScale = 1.f / 3.f;
+		}
+		else {
+			const auto [low, high] = minmax_element(heights.begin(), heights.end());
+			header.heightOffset = *low;
+			header.heightScale = max(*high - *low, 1e-6f) / static_cast<float>(maxSample);
+		}
+
+		// Past the grid, its last row and column repeat.
+		const uint32_t sampleBytes = GetSampleBytes(format);
+		const auto append = [&](vector<byte>& out, uint32_t x, uint32_t z) {
+			const float height = heights[static_cast<size_t>(min<uint32_t>(z, length - 1)) * length + min<uint32_t>(x, length - 1)];
+			const auto sample = static_cast<uint32_t>(clamp(lround((height - header.heightOffset) / header.heightScale), 0l,
+				static_cast<long>(maxSample)));
+			out.push_back(static_cast<byte>(sample & 0xFF));
+			if (sampleBytes == 2) out.push_back(static_cast<byte>(sample >> 8));
+		};
+
+		vector<byte> overview;
+		const uint32_t overviewSide = GetOverviewSide(header);
+		for (uint32_t z = 0; z < overviewSide; ++z) {
+			for (uint32_t x = 0; x < overviewSide; ++x) append(overview, x * header.overviewStep, z * header.overviewStep);
+		}
+
+		vector<TileEntry> entries(static_cast<size_t>(header.tilesPerSide) * header.tilesPerSide);
+		vector<byte> tiles, samples;
+		uint64_t offset = GetOverviewOffset(header) + overview.size();
+		for (uint32_t tz = 0; tz < header.tilesPerSide; ++tz) {
+			for (uint32_t tx = 0; tx < header.tilesPerSide; ++tx) {
+				samples.clear();
+				for (uint32_t z = 0; z < GetTileSide(header); ++z) {
+					for (uint32_t x = 0; x < GetTileSide(header); ++x) append(samples, tx * header.tileCells + x, tz * header.tileCells + z);
+				}
+				EncodeDeltas(header, samples);
+				const vector<byte> compressed = Lz::Compress(samples);
+				const bool smaller = compressed.size() < samples.size();
+				const vector<byte>& stored = smaller ? compressed : samples;
+				entries[static_cast<size_t>(tz) * header.tilesPerSide + tx] = { offset, static_cast<uint32_t>(stored.size()), smaller };
+				tiles.insert(tiles.end(), stored.begin(), stored.end());
+				offset += stored.size();
+				file.rawBytes += samples.size();
+				file.compressedTiles += smaller;
+			}
+		}
+
+		ofstream out{ output, ios::binary };
+		if (!out) throw runtime_error{ "cannot create " + output.string() };
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(TileEntry));
+		out.write(reinterpret_cast<const char*>(overview.data()), overview.size());
+		out.write(reinterpret_cast<const char*>(tiles.data()), tiles.size());
+		if (!out) throw runtime_error{ "cannot write " + output.string() };
+		file.fileBytes = offset;
+		return file;
+	}
+
+	// The game's terrain vertex, with the constructor emplace_back used.
+	struct PatchVertex
+	{
+		PatchVertex() = default;
+		PatchVertex(const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT2& uv0, const DirectX::XMFLOAT2& uv1) :
+			position{ position }, uv0{ uv0 }, uv1{ uv1 } {}
+
+		DirectX::XMFLOAT3	position;
+		DirectX::XMFLOAT2	uv0;
+		DirectX::XMFLOAT2	uv1;
+	};
+
+	// TerrainMesh's control points before TerrainPatches, grown one vertex at a time.
+	void CreatePatches(const Heightfield& heightfield, span<const DirectX::XMUINT2> patchOrder, vector<PatchVertex>& vertices)
+	{
+		constexpr int side = Heightfield::PatchLength;
+		const int length = heightfield.GetLength();
+		for (const auto& patch : patchOrder) {
+			const int xStart = static_cast<int>(patch.x) * side, zEnd = static_cast<int>(patch.y) * side;
+			const int xEnd = xStart + side, zStart = zEnd + side;
+			for (int z = zStart; z >= zEnd; --z) {
+				for (int x = xStart; x <= xEnd; ++x) {
+					const DirectX::XMFLOAT2 uv0{ static_cast<float>(x) / (length - 1), 1.f - static_cast<float>(z) / (length - 1) };
+					const DirectX::XMFLOAT2 uv1{ static_cast<float>(x - xStart) / side, static_cast<float>(zStart - z) / side };
+					vertices.emplace_back(DirectX::XMFLOAT3{ static_cast<float>(x - length / 2), heightfield.GetSample(x, z),
+						static_cast<float>(z - length / 2) }, uv0, uv1);
+				}
+			}
+		}
+	}
+
+	using TerrainPackage::GridVertex;
+
+	// TerrainMesh::CdlodGrid over Heightfield::PatchLength: the CDLOD heights the game displaces by.
+	constexpr int LodSamplesPerCell = 2;
+
+	// Vertex shader invocations of indexed draws of `ranges` of patches, each starting with an empty
+	// FIFO post-transform cache of `cacheSize` entries.
+	uint64_t CountTransforms(span<const uint32_t> indices, span<const TerrainQuadtree::Range> ranges, int cacheSize)
+	{
+		uint64_t misses = 0;
+		vector<uint32_t> cache(max(cacheSize, 1));
+		for (const auto& range : ranges) {
+			size_t filled = 0, next = 0;
+			const size_t first = static_cast<size_t>(range.first) * TerrainPatches::PatchVertices;
+			const size_t last = first + static_cast<size_t>(range.count) * TerrainPatches::PatchVertices;
+			for (size_t i = first; i < last; ++i) {
+				if (find(cache.begin(), cache.begin() + filled, indices[i]) != cache.begin() + filled) continue;
+				++misses;
+				cache[next] = indices[i];
+				next = (next + 1) % cache.size();
+				filled = min(filled + 1, cache.size());
+			}
+		}
+		return misses;
+	}
+
+	template <typename Function>
+	double Time(Function&& function)
+	{
+		const auto start = Clock::now();
+		function();
+		return chrono::duration<double>(Clock::now() - start).count();
+	}
+}
+
+void Terrain::Benchmark(const filesystem::path& heightMap, size_t queries)
+{
+	int length = 0;
+	vector<float> heights = LoadHeights(heightMap, length);
+	const RowHeights rows{ heights, length };
+	const Heightfield heightfield{ move(heights), length };
+	const DomainHeights reference{ heightfield.GetSamples(), length };
+
+	// Grass-like scattering over the whole map, slightly past its edges.
+	mt19937 random{ 1 };
+	const float half = static_cast<float>(length / 2) + 1.f;
+	uniform_real_distribution<float> coordinate{ -half, half };
+	vector<DirectX::XMFLOAT2> points(queries);
+	for (auto& point : points) point = { coordinate(random), coordinate(random) };
+
+	vector<float> expected(queries), scalar(queries), batched(queries);
+	for (size_t i = 0; i < queries; ++i) expected[i] = reference.GetHeight(points[i].x, points[i].y);
+	const double rowSeconds = Time([&] { for (size_t i = 0; i < queries; ++i) scalar[i] = rows.GetHeight(points[i].x, points[i].y); });
+	const double scalarSeconds = Time([&] { for (size_t i = 0; i < queries; ++i) scalar[i] = heightfield.GetHeight(points[i].x, points[i].y); });
+	const double batchedSeconds = Time([&] { heightfield.GetHeights(points, batched); });
+
+	const auto report = [&](const char* name, double seconds) {
+		cout << name << ": " << seconds * 1000.0 << " ms, " << seconds * 1e9 / max<size_t>(queries, 1) << " ns/query" << endl;
+	};
+	cout << length << "x" << length << " heights, " << queries << " queries" << endl;
+	report("rows, scalar", rowSeconds);
+	report("heightfield, scalar", scalarSeconds);
+	report("heightfield, batched", batchedSeconds);
+
+	const size_t bytes = queries * sizeof(float);
+	if (memcmp(expected.data(), scalar.data(), bytes) != 0 || memcmp(expected.data(), batched.data(), bytes) != 0) {
+		throw runtime_error{ "heightbench: heightfield results differ from the domain shader's" };
+	}
+	cout << "all results identical to the domain shader's" << endl;
+}
+
+void Terrain::CullBenchmark(int length, int frames)
+{
+	using namespace DirectX;
+
+	length = max(length, 5);
+	frames = max(frames, 1);
+	const Heightfield heightfield{ GenerateHeights(length), length };
+	const TerrainQuadtree quadtree{ heightfield };
+	const float half = static_cast<float>(length / 2);
+
+	// A camera circling inside the map, looking ahead and a little down, as the game sets its lens;
+	// the light's box follows it like a shadow map fitted to the view would.
+	vector<XMMATRIX> frustums;
+	for (int frame = 0; frame < frames; ++frame) {
+		const float angle = XM_2PI * frame / frames;
+		const XMVECTOR eye = XMVectorSet(cos(angle) * half * 0.5f, 120.f, sin(angle) * half * 0.5f, 0.f);
+		const XMVECTOR at = XMVectorAdd(eye, XMVectorSet(-sin(angle), -0.3f, cos(angle), 0.f));
+		frustums.push_back(XMMatrixLookAtLH(eye, at, XMVectorSet(0.f, 1.f, 0.f, 0.f)) *
+			XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.f / 9.f, 0.1f, 1000.f));
+		const XMVECTOR light = XMVectorAdd(eye, XMVectorSet(200.f, 300.f, 100.f, 0.f));
+		frustums.push_back(XMMatrixLookAtLH(light, eye, XMVectorSet(0.f, 1.f, 0.f, 0.f)) *
+			XMMatrixOrthographicOffCenterLH(-128.f, 128.f, -128.f, 128.f, 0.f, 1000.f));
+	}
+
+	vector<TerrainQuadtree::Range> tree, patches;
+	double treeSeconds = 0.0, patchSeconds = 0.0;
+	uint64_t visible = 0, ranges = 0;
+	for (const XMMATRIX& frustum : frustums) {
+		uint32_t treeVisible = 0, patchVisible = 0;
+		treeSeconds += Time([&] { treeVisible = quadtree.Cull(frustum, tree); });
+		patchSeconds += Time([&] { patchVisible = quadtree.CullPatches(frustum, patches); });
+		if (treeVisible != patchVisible || tree.size() != patches.size() ||
+			!equal(tree.begin(), tree.end(), patches.begin(), [](const auto& a, const auto& b) { return a.first == b.first && a.count == b.count; })) {
+			throw runtime_error{ "cullbench: the quadtree and the patch by patch test disagree" };
+		}
+		visible += treeVisible;
+		ranges += tree.size();
+	}
+
+	const size_t count = frustums.size();
+	cout << length << "x" << length << " heights, " << quadtree.GetPatchOrder().size() << " patches, " << count << " frustums" << endl;
+	cout << "visible: " << visible / count << " patches in " << ranges / count << " draws on average" << endl;
+	cout << "quadtree: " << treeSeconds * 1e6 / count << " us/frustum" << endl;
+	cout << "patch by patch: " << patchSeconds * 1e6 / count << " us/frustum" << endl;
+}
+
+void Terrain::LodBenchmark(int length, int frames, float firstRange)
+{
+	using namespace DirectX;
+
+	length = max(length, 5);
+	frames = max(frames, 1);
+	const Heightfield heightfield{ GenerateHeights(length), length };
+	const TerrainQuadtree quadtree{ heightfield };
+	const float half = static_cast<float>(length / 2);
+	const int patchCount = heightfield.GetPatchCount();
+	constexpr int patchLength = Heightfield::PatchLength;
+
+	// Squeezes the whole map well inside the clip volume, so nothing is culled.
+	const XMMATRIX everything = XMMatrixScaling(1e-4f, 1e-4f, 1e-4f) * XMMatrixTranslation(0.f, 0.f, 0.5f);
+
+	struct Cover
+	{
+		int level = -1;
+		float morphStart = 0.f, morphEnd = 0.f;
+	};
+	vector<Cover> covers;
+	const auto check = [&](const XMFLOAT3& eye, const vector<TerrainQuadtree::LodNode>& nodes) {
+		covers.assign(static_cast<size_t>(patchCount) * patchCount, Cover{});
+		for (const auto& node : nodes) {
+			int side = static_cast<int>(node.size) / patchLength;
+			int px = static_cast<int>(node.x + half) / patchLength, pz = static_cast<int>(node.z + half) / patchLength;
+			if (node.quadrant != TerrainQuadtree::WholeNode) {
+				side /= 2;
+				px += static_cast<int>(node.quadrant & 1) * side;
+				pz += static_cast<int>(node.quadrant >> 1) * side;
+			}
+			for (int z = pz; z < pz + side; ++z) {
+				for (int x = px; x < px + side; ++x) {
+					if (x >= patchCount || z >= patchCount) throw runtime_error{ "lodbench: a node reaches past the map" };
+					Cover& cover = covers[static_cast<size_t>(z) * patchCount + x];
+					if (cover.level >= 0) throw runtime_error{ "lodbench: nodes overlap" };
+					cover = { static_cast<int>(node.level), node.morphStart, node.morphEnd };
+				}
+			}
+		}
+
+		for (int z = 0; z < patchCount; ++z) {
+			for (int x = 0; x < patchCount; ++x) {
+				const Cover& cover = covers[static_cast<size_t>(z) * patchCount + x];
+				if (cover.level < 0) throw runtime_error{ "lodbench: a patch is not covered" };
+				// The edges shared with the neighbours at +x and +z, one point per height sample.
+				for (int axis = 0; axis < 2; ++axis) {
+					const int nx = x + (axis == 0), nz = z + (axis == 1);
+					if (nx >= patchCount || nz >= patchCount) continue;
+					const Cover& neighbour = covers[static_cast<size_t>(nz) * patchCount + nx];
+					if (abs(neighbour.level - cover.level) > 1) throw runtime_error{ "lodbench: neighbours differ by more than one level" };
+					if (neighbour.level == cover.level) continue;
+					const Cover& finer = neighbour.level < cover.level ? neighbour : cover;
+					const Cover& coarser = neighbour.level < cover.level ? cover : neighbour;
+					for (int step = 0; step <= patchLength; ++step) {
+						const float ex = static_cast<float>(nx * patchLength + (axis == 1) * step) - half;
+						const float ez = static_cast<float>(nz * patchLength + (axis == 0) * step) - half;
+						const float dx = ex - eye.x, dy = heightfield.GetHeight(ex, ez) - eye.y, dz = ez - eye.z;
+						const float distance = sqrt(dx * dx + dy * dy + dz * dz);
+						if (distance < finer.morphEnd || distance > coarser.morphStart) {
+							throw runtime_error{ "lodbench: a seam between levels " + to_string(finer.level) + " and " +
+								to_string(coarser.level) + " cracks at distance " + to_string(distance) };
+						}
+					}
+				}
+			}
+		}
+	};
+
+	vector<TerrainQuadtree::LodNode> nodes;
+	double cameraSeconds = 0.0, lightSeconds = 0.0;
+	uint64_t cameraNodes = 0, lightNodes = 0, allNodes = 0;
+	for (int frame = 0; frame < frames; ++frame) {
+		// A third-person camera over the ground, as in CullBenchmark's path.
+		const float angle = XM_2PI * frame / frames;
+		XMFLOAT3 eye{ cos(angle) * half * 0.5f, 0.f, sin(angle) * half * 0.5f };
+		eye.y = heightfield.GetHeight(eye.x, eye.z) + 10.f;
+		const XMVECTOR eyePosition = XMLoadFloat3(&eye);
+		const XMVECTOR at = XMVectorAdd(eyePosition, XMVectorSet(-sin(angle), -0.3f, cos(angle), 0.f));
+		const XMMATRIX camera = XMMatrixLookAtLH(eyePosition, at, XMVectorSet(0.f, 1.f, 0.f, 0.f)) *
+			XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.f / 9.f, 0.1f, 1000.f);
+		const XMVECTOR light = XMVectorAdd(eyePosition, XMVectorSet(200.f, 300.f, 100.f, 0.f));
+		const XMMATRIX shadow = XMMatrixLookAtLH(light, eyePosition, XMVectorSet(0.f, 1.f, 0.f, 0.f)) *
+			XMMatrixOrthographicOffCenterLH(-128.f, 128.f, -128.f, 128.f, 0.f, 1000.f);
+
+		cameraSeconds += Time([&] { quadtree.SelectLods(eye, firstRange, camera, nodes); });
+		cameraNodes += nodes.size();
+		lightSeconds += Time([&] { quadtree.SelectLods(eye, firstRange, shadow, nodes); });
+		lightNodes += nodes.size();
+
+		quadtree.SelectLods(eye, firstRange, everything, nodes);
+		allNodes += nodes.size();
+		check(eye, nodes);
+	}
+
+	cout << length << "x" << length << " heights, " << quadtree.GetLevelCount() << " levels, first range " << firstRange
+		<< ", " << frames << " eyes" << endl;
+	cout << "unculled: " << allNodes / frames << " nodes on average, every selection covers each patch once without cracks" << endl;
+	cout << "camera: " << cameraNodes / frames << " nodes, " << cameraSeconds * 1e6 / frames << " us/selection" << endl;
+	cout << "shadow: " << lightNodes / frames << " nodes, " << lightSeconds * 1e6 / frames << " us/selection" << endl;
+}
+
+void Terrain::TessellationBenchmark(int length, int frames, float pixelError)
+{
+	using namespace DirectX;
+
+	length = max(length, 5);
+	frames = max(frames, 1);
+	const Heightfield heightfield{ GenerateHeights(length), length };
+	const TerrainQuadtree quadtree{ heightfield };
+	const auto& patchOrder = quadtree.GetPatchOrder();
+	const TerrainTessellation tessellation{ heightfield, patchOrder };
+	const float half = static_cast<float>(length / 2);
+	const int patchCount = heightfield.GetPatchCount();
+	constexpr int patchLength = Heightfield::PatchLength;
+	const float pixelsPerUnit = 1080.f / (2.f * tan(0.125f * XM_PI));
+
+	// Where each patch of the grid sits in the mesh's order.
+	vector<uint32_t> places(static_cast<size_t>(patchCount) * patchCount);
+	for (uint32_t patch = 0; patch < patchOrder.size(); ++patch) {
+		places[static_cast<size_t>(patchOrder[patch].y) * patchCount + patchOrder[patch].x] = patch;
+	}
+	const vector<TerrainQuadtree::Range> all{ { 0, static_cast<uint32_t>(patchOrder.size()) } };
+
+	using Factors = TerrainTessellation::PatchFactors;
+	vector<Factors> fast(patchOrder.size()), reference(patchOrder.size());
+	vector<TerrainQuadtree::Range> ranges;
+	double fastSeconds = 0.0, referenceSeconds = 0.0, factorSum = 0.0;
+	uint64_t visible = 0, edges = 0, capped = 0;
+	float worstError = 0.f;
+	for (int frame = 0; frame < frames; ++frame) {
+		const float angle = XM_2PI * frame / frames;
+		XMFLOAT3 eye{ cos(angle) * half * 0.5f, 0.f, sin(angle) * half * 0.5f };
+		eye.y = heightfield.GetHeight(eye.x, eye.z) + 10.f;
+		const XMVECTOR eyePosition = XMLoadFloat3(&eye);
+		const XMVECTOR at = XMVectorAdd(eyePosition, XMVectorSet(-sin(angle), -0.3f, cos(angle), 0.f));
+		const XMMATRIX camera = XMMatrixLookAtLH(eyePosition, at, XMVectorSet(0.f, 1.f, 0.f, 0.f)) *
+			XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.f / 9.f, 0.1f, 1000.f);
+
+		visible += quadtree.Cull(camera, ranges);
+		// Whichever runs first reads the bounds from memory for both, so the two take turns.
+		const auto timeFast = [&] { fastSeconds += Time([&] { tessellation.Compute(eye, pixelsPerUnit, pixelError, ranges, fast.data()); }); };
+		const auto timeReference = [&] { referenceSeconds += Time([&] {
+			tessellation.ComputeReference(eye, pixelsPerUnit, pixelError, ranges, reference.data()); }); };
+		if (frame % 2 == 0) {
+			timeFast();
+			timeReference();
+		}
+		else {
+			timeReference();
+			timeFast();
+		}
+
+		// The checks cover every patch, seen or not.
+		tessellation.Compute(eye, pixelsPerUnit, pixelError, all, fast.data());
+		tessellation.ComputeReference(eye, pixelsPerUnit, pixelError, all, reference.data());
+		if (memcmp(fast.data(), reference.data(), fast.size() * sizeof(Factors)) != 0) {
+			throw runtime_error{ "tessbench: the SSE factors differ from the reference" };
+		}
+
+		for (int pz = 0; pz < patchCount; ++pz) {
+			for (int px = 0; px < patchCount; ++px) {
+				const Factors& factors = fast[places[static_cast<size_t>(pz) * patchCount + px]];
+				if ((px + 1 < patchCount && factors.edges[2] != fast[places[static_cast<size_t>(pz) * patchCount + px + 1]].edges[0]) ||
+					(pz + 1 < patchCount && factors.edges[1] != fast[places[static_cast<size_t>(pz + 1) * patchCount + px]].edges[3])) {
+					throw runtime_error{ "tessbench: neighbouring patches disagree on a shared edge" };
+				}
+
+				// The u = 0, v = 0, u = 1 and v = 1 edges as (x, z) from t = 0 to 1.
+				const float x0 = static_cast<float>(px * patchLength) - half, z0 = static_cast<float>(pz * patchLength) - half;
+				const float x1 = x0 + patchLength, z1 = z0 + patchLength;
+				const XMFLOAT4 lines[4]{ { x0, z0, x0, z1 }, { x0, z1, x1, z1 }, { x1, z0, x1, z1 }, { x0, z0, x1, z0 } };
+				for (int edge = 0; edge < 4; ++edge) {
+					const float factor = factors.edges[edge];
+					factorSum += factor;
+					++edges;
+					// A factor at the cap of the edge's densest point may leave more error.
+					int density = 0;
+					for (int k = 0; k <= patchLength; ++k) {
+						const float t = static_cast<float>(k) / patchLength;
+						density = max(density, tessellation.GetDensity(
+							static_cast<int>(lines[edge].x + (lines[edge].z - lines[edge].x) * t + half),
+							static_cast<int>(lines[edge].y + (lines[edge].w - lines[edge].y) * t + half)));
+					}
+					if (factor == TerrainTessellation::GetMaxFactor(density)) {
+						++capped;
+						continue;
+					}
+					const auto point = [&](float t) {
+						const float x = lines[edge].x + (lines[edge].z - lines[edge].x) * t;
+						const float z = lines[edge].y + (lines[edge].w - lines[edge].y) * t;
+						return XMFLOAT3{ x, heightfield.GetHeight(x, z), z };
+					};
+					// Fractional partitioning: whole segments 1/factor long, and shorter ones.
+					for (float start = 0.f; start < 1.f; start += 1.f / factor) {
+						const float end = min(start + 1.f / factor, 1.f);
+						const XMFLOAT3 a = point(start), b = point(end);
+						for (int sample = 1; sample < 8; ++sample) {
+							const float s = sample / 8.f;
+							const XMFLOAT3 p = point(start + (end - start) * s);
+							const float dx = p.x - eye.x, dy = p.y - eye.y, dz = p.z - eye.z;
+							const float distance = sqrt(dx * dx + dy * dy + dz * dz);
+							const float error = abs(p.y - (a.y + (b.y - a.y) * s)) * pixelsPerUnit / distance;
+							worstError = max(worstError, error);
+							// The bound is tight on parabolic edges; the slack is for GetHeight's float rounding.
+							if (error > pixelError * 1.01f) {
+								throw runtime_error{ "tessbench: an edge at factor " + to_string(factor) + " is off by " +
+									to_string(error) + " pixels" };
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	cout << length << "x" << length << " heights, " << patchOrder.size() << " patches, " << frames << " eyes, "
+		<< pixelError << " pixel error" << endl;
+	cout << "edges: factor " << factorSum / max<uint64_t>(edges, 1) << " on average, " << capped * 100.0 / max<uint64_t>(edges, 1)
+		<< "% capped, worst uncapped error " << worstError << " pixels" << endl;
+	cout << "visible: " << visible / frames << " patches" << endl;
+	cout << "SSE: " << fastSeconds * 1e6 / frames << " us/frame" << endl;
+	cout << "reference: " << referenceSeconds * 1e6 / frames << " us/frame" << endl;
+}
+
+void Terrain::RaycastBenchmark(int length, size_t rays)
+{
+	using namespace DirectX;
+
+	length = max(length, 5);
+	const Heightfield heightfield{ GenerateHeights(length), length };
+	unique_ptr<HeightPyramid> built;
+	const double buildSeconds = Time([&] { built = make_unique<HeightPyramid>(heightfield); });
+	const HeightPyramid& pyramid = *built;
+
+	// Every cell's bounds must hold the surface over it, sampled on a 9x9 lattice.
+	const float half = static_cast<float>(length / 2);
+	const int cells = pyramid.GetSide(0);
+	for (int z = 0; z < cells; ++z) {
+		for (int x = 0; x < cells; ++x) {
+			const HeightPyramid::Bounds& bounds = pyramid.GetBounds(0, x, z);
+			for (int sz = 0; sz <= 8; ++sz) {
+				for (int sx = 0; sx <= 8; ++sx) {
+					const float height = heightfield.GetHeight(x + sx / 8.f - half, z + sz / 8.f - half);
+					if (height < bounds.minY || height > bounds.maxY) {
+						throw runtime_error{ "raybench: the surface leaves the bounds of cell (" + to_string(x) + ", " +
+							to_string(z) + ")" };
+					}
+				}
+			}
+		}
+	}
+
+	// A quarter each: picking rays down from above the ground, grazing picking rays that skim it
+	// towards the horizon, sight lines between nearby points just above it and sight lines across
+	// the map. Each kind takes one run of the queries, so each is timed on its own.
+	enum Kind { Picking, Grazing, Sight, LongSight, KindCount };
+	static constexpr const char* kindNames[]{ "picking", "grazing", "sight lines", "long sight lines" };
+	const auto getFirst = [&](int kind) { return rays * kind / KindCount; };
+	mt19937 random{ 1 };
+	uniform_real_distribution<float> coordinate{ -half, half }, unit{ 0.f, 1.f };
+	vector<HeightPyramid::Ray> queries(rays);
+	for (int kind = 0; kind < KindCount; ++kind) {
+		for (size_t i = getFirst(kind); i < getFirst(kind + 1); ++i) {
+			XMFLOAT3 from{ coordinate(random), 0.f, coordinate(random) };
+			const float yaw = XM_2PI * unit(random);
+			if (kind == Picking || kind == Grazing) {
+				from.y = heightfield.GetHeight(from.x, from.z) + 2.f + 58.f * unit(random);
+				const float pitch = XMConvertToRadians(kind == Picking ? 5.f + 75.f * unit(random) : 0.5f + 4.5f * unit(random));
+				queries[i] = { from, XMFLOAT3{ cos(pitch) * cos(yaw), -sin(pitch), cos(pitch) * sin(yaw) }, 2.f * length };
+				continue;
+			}
+			from.y = heightfield.GetHeight(from.x, from.z) + 1.7f;
+			XMFLOAT3 to{ coordinate(random), 0.f, coordinate(random) };
+			if (kind == Sight) {
+				const float distance = 100.f * unit(random);
+				to = { clamp(from.x + distance * cos(yaw), -half, half), 0.f, clamp(from.z + distance * sin(yaw), -half, half) };
+			}
+			to.y = heightfield.GetHeight(to.x, to.z) + 1.7f;
+			queries[i] = { from, XMFLOAT3{ to.x - from.x, to.y - from.y, to.z - from.z }, 1.f };
+		}
+	}
+
+	// The best of three interleaved rounds, so neither walk pays alone for a cold cache or a busy machine.
+	vector<float> single(rays), batched(rays), reference(rays);
+	double singleSeconds[KindCount], referenceSeconds[KindCount], batchedSeconds = numeric_limits<double>::max();
+	fill(begin(singleSeconds), end(singleSeconds), numeric_limits<double>::max());
+	fill(begin(referenceSeconds), end(referenceSeconds), numeric_limits<double>::max());
+	for (int round = 0; round < 3; ++round) {
+		for (int kind = 0; kind < KindCount; ++kind) {
+			const size_t first = getFirst(kind), last = getFirst(kind + 1);
+			referenceSeconds[kind] = min(referenceSeconds[kind], Time([&] { for (size_t i = first; i < last; ++i) reference[i] = pyramid.IntersectCells(queries[i]); }));
+			singleSeconds[kind] = min(singleSeconds[kind], Time([&] { for (size_t i = first; i < last; ++i) single[i] = pyramid.Intersect(queries[i]); }));
+		}
+		batchedSeconds = min(batchedSeconds, Time([&] { pyramid.Intersect(queries, batched); }));
+	}
+
+	// The pyramid may enter a cell through a node's corner the cell walk crossed a step apart, so
+	// the two agree on every hit to within the surface check below, not bit for bit.
+	if (memcmp(batched.data(), single.data(), rays * sizeof(float)) != 0) {
+		throw runtime_error{ "raybench: batched queries differ from single ones" };
+	}
+	for (size_t i = 0; i < rays; ++i) {
+		const float length = sqrt(queries[i].direction.x * queries[i].direction.x +
+			queries[i].direction.y * queries[i].direction.y + queries[i].direction.z * queries[i].direction.z);
+		if ((single[i] == HeightPyramid::Miss) != (reference[i] == HeightPyramid::Miss) ||
+			(single[i] != HeightPyramid::Miss && abs(single[i] - reference[i]) * length > 1e-2f)) {
+			throw runtime_error{ "raybench: ray " + to_string(i) + " differs from the walk through every cell" };
+		}
+	}
+	size_t hits = 0;
+	for (size_t i = 0; i < rays; ++i) {
+		if (single[i] == HeightPyramid::Miss) continue;
+		++hits;
+		const auto& ray = queries[i];
+		const float t = single[i];
+		const float y = ray.origin.y + t * ray.direction.y;
+		if (abs(y - heightfield.GetHeight(ray.origin.x + t * ray.direction.x, ray.origin.z + t * ray.direction.z)) > 1e-2f) {
+			throw runtime_error{ "raybench: ray " + to_string(i) + " stops off the surface" };
+		}
+	}
+
+	const auto report = [&](const char* name, double seconds, size_t count) {
+		cout << name << ": " << seconds * 1000.0 << " ms, " << count / max(seconds, 1e-9) / 1e6 << " Mrays/s" << endl;
+	};
+	const auto reportKinds = [&](const char* name, const double* seconds) {
+		double total = 0.0;
+		for (int kind = 0; kind < KindCount; ++kind) total += seconds[kind];
+		report(name, total, rays);
+		for (int kind = 0; kind < KindCount; ++kind) report((string{ "  " } + kindNames[kind]).c_str(), seconds[kind], getFirst(kind + 1) - getFirst(kind));
+	};
+	cout << length << "x" << length << " heights, " << pyramid.GetLevelCount() << " levels built in "
+		<< buildSeconds * 1000.0 << " ms, " << rays << " rays, " << hits * 100.0 / max<size_t>(rays, 1) << "% hit" << endl;
+	reportKinds("every cell", referenceSeconds);
+	reportKinds("pyramid", singleSeconds);
+	report("pyramid, batched", batchedSeconds, rays);
+}
+
+void Terrain::BuildBenchmark(const vector<int>& sizes)
+{
+	const auto report = [](const char* name, double before, double after) {
+		cout << "  " << name << ": " << before * 1000.0 << " ms -> " << after * 1000.0 << " ms, "
+			<< before / max(after, 1e-9) << "x" << endl;
+	};
+	cout << Parallel::GetWorkerCount() << " workers" << endl;
+	for (int length : sizes) {
+		length = max(length, 5);
+		const Heightfield heightfield{ GenerateHeights(length), length };
+		const TerrainQuadtree quadtree{ heightfield };
+		const auto& patchOrder = quadtree.GetPatchOrder();
+
+		vector<int> referenceDensities, densities;
+		const double referenceDensitySeconds = Time([&] { referenceDensities = TerrainTessellation::ComputeDensitiesReference(heightfield); });
+		const double densitySeconds = Time([&] { densities = TerrainTessellation::ComputeDensities(heightfield); });
+		if (densities != referenceDensities) {
+			throw runtime_error{ "buildbench: the SSE densities differ from the reference at " + to_string(length) };
+		}
+
+		vector<PatchVertex> grown, written;
+		const double grownSeconds = Time([&] { CreatePatches(heightfield, patchOrder, grown); });
+		const double writtenSeconds = Time([&] {
+			written.resize(patchOrder.size() * TerrainPatches::PatchVertices);
+			TerrainPatches::WriteControlPoints<PatchVertex>(heightfield, patchOrder, written);
+			});
+		if (grown.size() != written.size() || memcmp(grown.data(), written.data(), grown.size() * sizeof(PatchVertex)) != 0) {
+			throw runtime_error{ "buildbench: the parallel control points differ from the serial ones at " + to_string(length) };
+		}
+
+		// The constructor computes the densities as well; both sides pay for them once more.
+		const double serialSeconds = Time([&] { TerrainTessellation{ heightfield, patchOrder, 1 }; });
+		const double parallelSeconds = Time([&] { TerrainTessellation{ heightfield, patchOrder }; });
+
+		const double before = referenceDensitySeconds + grownSeconds + serialSeconds;
+		const double after = densitySeconds + writtenSeconds + parallelSeconds;
+		cout << length << "x" << length << " heights, " << patchOrder.size() << " patches, "
+			<< written.size() * sizeof(PatchVertex) / 1024 << " KB of control points" << endl;
+		report("densities", referenceDensitySeconds, densitySeconds);
+		report("control points", grownSeconds, writtenSeconds);
+		report("tessellation", serialSeconds, parallelSeconds);
+		report("total", before, after);
+	}
+}
+
+void Terrain::PatchBenchmark(int length, int frames, int cacheSize)
+{
+	using namespace DirectX;
+
+	length = max(length, 5);
+	frames = max(frames, 1);
+	cacheSize = max(cacheSize, 1);
+	const Heightfield heightfield{ GenerateHeights(length), length };
+	const TerrainQuadtree quadtree{ heightfield };
+	const auto& patchOrder = quadtree.GetPatchOrder();
+	const size_t patches = patchOrder.size();
+	constexpr size_t patchVertices = TerrainPatches::PatchVertices;
+
+	vector<PatchVertex> controlPoints(patches * patchVertices);
+	vector<GridVertex> grid(static_cast<size_t>(length) * length);
+	vector<uint32_t> indices(patches * patchVertices);
+	const double controlPointSeconds = Time([&] { TerrainPatches::WriteControlPoints<PatchVertex>(heightfield, patchOrder, controlPoints); });
+	const double gridSeconds = Time([&] {
+		TerrainPatches::WriteGrid<GridVertex>(heightfield, grid);
+		TerrainPatches::WritePatchIndices(length, patchOrder, indices);
+		});
+	for (size_t i = 0; i < indices.size(); ++i) {
+		const GridVertex& shared = grid[indices[i]];
+		if (memcmp(&shared.position, &controlPoints[i].position, sizeof(XMFLOAT3)) != 0 ||
+			memcmp(&shared.uv0, &controlPoints[i].uv0, sizeof(XMFLOAT2)) != 0) {
+			throw runtime_error{ "patchbench: control point " + to_string(i) + " differs from its grid sample" };
+		}
+	}
+
+	// Both layouts fetch one patch index per draw instance.
+	struct Traffic
+	{
+		uint64_t	patches = 0;
+		uint64_t	transforms = 0;
+	};
+	const auto measure = [&](span<const TerrainQuadtree::Range> ranges) {
+		Traffic traffic;
+		for (const auto& range : ranges) traffic.patches += range.count;
+		traffic.transforms = CountTransforms(indices, ranges, cacheSize);
+		return traffic;
+	};
+	const vector<TerrainQuadtree::Range> all{ { 0, static_cast<uint32_t>(patches) } };
+	const Traffic whole = measure(all);
+
+	Traffic culled;
+	vector<TerrainQuadtree::Range> ranges;
+	const float half = static_cast<float>(length / 2);
+	for (int frame = 0; frame < frames; ++frame) {
+		const float angle = XM_2PI * frame / frames;
+		XMFLOAT3 eye{ cos(angle) * half * 0.5f, 0.f, sin(angle) * half * 0.5f };
+		eye.y = heightfield.GetHeight(eye.x, eye.z) + 10.f;
+		const XMVECTOR eyePosition = XMLoadFloat3(&eye);
+		const XMVECTOR at = XMVectorAdd(eyePosition, XMVectorSet(-sin(angle), -0.3f, cos(angle), 0.f));
+		const XMMATRIX camera = XMMatrixLookAtLH(eyePosition, at, XMVectorSet(0.f, 1.f, 0.f, 0.f)) *
+			XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.f / 9.f, 0.1f, 1000.f);
+		quadtree.Cull(camera, ranges);
+		const Traffic traffic = measure(ranges);
+		culled.patches += traffic.patches;
+		culled.transforms += traffic.transforms;
+	}
+
+	const uint64_t patchBytes = patches * sizeof(uint32_t);
+	const uint64_t beforeBytes = controlPoints.size() * sizeof(PatchVertex) + patchBytes;
+	const uint64_t afterBytes = grid.size() * sizeof(GridVertex) + indices.size() * sizeof(uint32_t) + patchBytes;
+	cout << length << "x" << length << " heights, " << patches << " patches, " << cacheSize << "-entry vertex cache" << endl;
+	cout << "memory: " << beforeBytes / 1024 << " KB -> " << afterBytes / 1024 << " KB (vertices "
+		<< controlPoints.size() * sizeof(PatchVertex) / 1024 << " KB -> " << grid.size() * sizeof(GridVertex) / 1024
+		<< " KB, indices " << indices.size() * sizeof(uint32_t) / 1024 << " KB), built in "
+		<< controlPointSeconds * 1000.0 << " ms -> " << gridSeconds * 1000.0 << " ms" << endl;
+	const auto report = [&](const char* name, const Traffic& traffic, int draws) {
+		const uint64_t controlPoints = traffic.patches * patchVertices;
+		const uint64_t before = controlPoints * sizeof(PatchVertex) + traffic.patches * sizeof(uint32_t);
+		const uint64_t after = controlPoints * sizeof(uint32_t) + traffic.transforms * sizeof(GridVertex) +
+			traffic.patches * sizeof(uint32_t);
+		cout << name << ": " << traffic.patches / draws << " patches, input assembly " << before / draws / 1024 << " KB -> "
+			<< after / draws / 1024 << " KB (" << static_cast<double>(before) / max<uint64_t>(after, 1) << "x), vertex shader "
+			<< controlPoints / draws << " -> " << traffic.transforms / draws << " invocations" << endl;
+	};
+	report("whole terrain", whole, 1);
+	report("culled, per frame", culled, frames);
+}
+
+void Terrain::Cook(const filesystem::path& heightMap, const filesystem::path& output, int normalTexelsPerCell)
+{
+	int length = 0;
+	const Heightfield heightfield{ LoadHeights(heightMap, length), length };
+	vector<byte> package;
+	const double seconds = Time([&] { package = TerrainPackage::Cook(heightfield, normalTexelsPerCell, LodSamplesPerCell); });
+
+	ofstream out{ output, ios::binary };
+	out.write(reinterpret_cast<const char*>(package.data()), package.size());
+	if (!out) throw runtime_error{ "cannot write " + output.string() };
+
+	static constexpr const char* names[]{ "heights", "vertices", "indices", "quadtree", "tessellation", "pyramid", "normals", "CDLOD heights" };
+	static_assert(size(names) == static_cast<size_t>(TerrainPackage::Section::Count));
+	const auto contents = TerrainPackage::Read(package);
+	cout << "wrote " << output.string() << ": " << length << "x" << length << " heights, " << package.size() / 1024
+		<< " KB cooked in " << seconds * 1000.0 << " ms" << endl;
+	for (size_t i = 0; i < size(names); ++i) cout << "  " << names[i] << ": " << contents.header.sections[i].size / 1024 << " KB" << endl;
+}
+
+void Terrain::CookBenchmark(int length)
+{
+	using namespace DirectX;
+
+	length = max(length, 5);
+	const vector<float> source = GenerateHeights(length);
+	const filesystem::path packagePath = filesystem::temp_directory_path() / "cookbench.terrain";
+	double cookSeconds = 0.0;
+	{
+		const Heightfield heightfield{ source, length };
+		vector<byte> package;
+		cookSeconds = Time([&] { package = TerrainPackage::Cook(heightfield, 1, LodSamplesPerCell); });
+		ofstream out{ packagePath, ios::binary };
+		out.write(reinterpret_cast<const char*>(package.data()), package.size());
+		if (!out) throw runtime_error{ "cookbench: cannot write " + packagePath.string() };
+	}
+
+	// What the game builds at load, as it builds it; every buffer is copied out once as its upload would.
+	struct Loaded
+	{
+		unique_ptr<Heightfield>				heightfield;
+		unique_ptr<TerrainQuadtree>			quadtree;
+		unique_ptr<TerrainTessellation>		tessellation;
+		unique_ptr<HeightPyramid>			pyramid;
+		vector<byte>						upload;
+	};
+	const auto upload = [](Loaded& loaded, auto elements) {
+		const auto bytes = as_bytes(span{ elements });
+		loaded.upload.insert(loaded.upload.end(), bytes.begin(), bytes.end());
+	};
+	enum Stage { Read, Heights, Quadtree, Tessellation, Pyramid, Buffers, StageCount };
+	static constexpr const char* stageNames[]{ "read", "heightfield", "quadtree", "tessellation", "pyramid", "buffers" };
+
+	double built[StageCount]{};
+	Loaded fromHeights;
+	built[Read] = Time([&] {
+		ifstream in{ packagePath, ios::binary };
+		vector<char> bytes(filesystem::file_size(packagePath));
+		if (!in.read(bytes.data(), bytes.size())) throw runtime_error{ "cookbench: cannot read " + packagePath.string() };
+		});
+	built[Heights] = Time([&] { fromHeights.heightfield = make_unique<Heightfield>(source, length); });
+	const Heightfield& heightfield = *fromHeights.heightfield;
+	built[Quadtree] = Time([&] { fromHeights.quadtree = make_unique<TerrainQuadtree>(heightfield); });
+	const auto& patchOrder = fromHeights.quadtree->GetPatchOrder();
+	built[Tessellation] = Time([&] { fromHeights.tessellation = make_unique<TerrainTessellation>(heightfield, patchOrder); });
+	built[Pyramid] = Time([&] { fromHeights.pyramid = make_unique<HeightPyramid>(heightfield); });
+	built[Buffers] = Time([&] {
+		vector<GridVertex> vertices(static_cast<size_t>(length) * length);
+		TerrainPatches::WriteGrid<GridVertex>(heightfield, vertices);
+		vector<uint32_t> indices(patchOrder.size() * TerrainPatches::PatchVertices);
+		TerrainPatches::WritePatchIndices(length, patchOrder, indices);
+		upload(fromHeights, vertices);
+		upload(fromHeights, indices);
+		upload(fromHeights, TerrainPatches::GetLodHeights(heightfield, LodSamplesPerCell));
+		});
+
+	double cooked[StageCount]{};
+	Loaded fromPackage;
+	MappedFile file;
+	TerrainPackage::Contents contents;
+	cooked[Read] = Time([&] {
+		file = MappedFile{ packagePath };
+		contents = TerrainPackage::Read(file.GetData());
+		});
+	cooked[Heights] = Time([&] {
+		fromPackage.heightfield = make_unique<Heightfield>(vector<float>(contents.heights.begin(), contents.heights.end()), length);
+		});
+	cooked[Quadtree] = Time([&] { fromPackage.quadtree = make_unique<TerrainQuadtree>(contents.quadtree); });
+	cooked[Tessellation] = Time([&] { fromPackage.tessellation = make_unique<TerrainTessellation>(contents.tessellation); });
+	cooked[Pyramid] = Time([&] { fromPackage.pyramid = make_unique<HeightPyramid>(*fromPackage.heightfield, contents.pyramid); });
+	cooked[Buffers] = Time([&] {
+		upload(fromPackage, contents.vertices);
+		upload(fromPackage, contents.indices);
+		upload(fromPackage, contents.lodHeights);
+		});
+
+	if (fromPackage.upload != fromHeights.upload) throw runtime_error{ "cookbench: the cooked buffers differ from the built ones" };
+	if (fromPackage.quadtree->Cook() != fromHeights.quadtree->Cook()) {
+		throw runtime_error{ "cookbench: the cooked quadtree differs from the built one" };
+	}
+	if (fromPackage.tessellation->Cook() != fromHeights.tessellation->Cook()) {
+		throw runtime_error{ "cookbench: the cooked tessellation differs from the built one" };
+	}
+	if (fromPackage.pyramid->Cook() != fromHeights.pyramid->Cook()) {
+		throw runtime_error{ "cookbench: the cooked pyramid differs from the built one" };
+	}
+	if (contents.normals.size() != static_cast<size_t>(TerrainNormals::GetSide(heightfield, 1)) * TerrainNormals::GetSide(heightfield, 1)) {
+		throw runtime_error{ "cookbench: the cooked normals do not cover the grid" };
+	}
+
+	// Restored, they still answer like the built ones.
+	const float half = static_cast<float>(length / 2);
+	const float pixelsPerUnit = 1080.f / (2.f * tan(0.125f * XM_PI));
+	vector<TerrainQuadtree::Range> builtRanges, cookedRanges;
+	vector<TerrainTessellation::PatchFactors> builtFactors(patchOrder.size()), cookedFactors(patchOrder.size());
+	for (int frame = 0; frame < 8; ++frame) {
+		const float angle = XM_2PI * frame / 8;
+		XMFLOAT3 eye{ cos(angle) * half * 0.5f, 0.f, sin(angle) * half * 0.5f };
+		eye.y = heightfield.GetHeight(eye.x, eye.z) + 10.f;
+		const XMVECTOR eyePosition = XMLoadFloat3(&eye);
+		const XMVECTOR at = XMVectorAdd(eyePosition, XMVectorSet(-sin(angle), -0.3f, cos(angle), 0.f));
+		const XMMATRIX camera = XMMatrixLookAtLH(eyePosition, at, XMVectorSet(0.f, 1.f, 0.f, 0.f)) *
+			XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.f / 9.f, 0.1f, 1000.f);
+		fromHeights.quadtree->Cull(camera, builtRanges);
+		fromPackage.quadtree->Cull(camera, cookedRanges);
+		fromHeights.tessellation->Compute(eye, pixelsPerUnit, 1.f, builtRanges, builtFactors.data());
+		fromPackage.tessellation->Compute(eye, pixelsPerUnit, 1.f, builtRanges, cookedFactors.data());
+		const HeightPyramid::Ray ray{ eye, XMFLOAT3{ -sin(angle) * half, -10.f, cos(angle) * half }, 1.f };
+		if (builtRanges.size() != cookedRanges.size() ||
+			!equal(builtRanges.begin(), builtRanges.end(), cookedRanges.begin(), [](const auto& a, const auto& b) { return a.first == b.first && a.count == b.count; }) ||
+			memcmp(builtFactors.data(), cookedFactors.data(), builtFactors.size() * sizeof(TerrainTessellation::PatchFactors)) != 0 ||
+			fromHeights.pyramid->Intersect(ray) != fromPackage.pyramid->Intersect(ray)) {
+			throw runtime_error{ "cookbench: the cooked terrain answers differently at frame " + to_string(frame) };
+		}
+	}
+
+	double builtTotal = 0.0, cookedTotal = 0.0;
+	cout << length << "x" << length << " heights, " << file.GetSize() / 1024 << " KB package cooked in "
+		<< cookSeconds * 1000.0 << " ms, " << Parallel::GetWorkerCount() << " workers" << endl;
+	for (int stage = 0; stage < StageCount; ++stage) {
+		// Building reads only the height map; the package's read is its mapping and validation.
+		cout << "  " << stageNames[stage] << ": " << (stage == Read ? 0.0 : built[stage] * 1000.0) << " ms -> "
+			<< cooked[stage] * 1000.0 << " ms" << endl;
+		builtTotal += stage == Read ? 0.0 : built[stage];
+		cookedTotal += cooked[stage];
+	}
+	cout << "  total: " << builtTotal * 1000.0 << " ms -> " << cookedTotal * 1000.0 << " ms; reading the whole package takes "
+		<< built[Read] * 1000.0 << " ms" << endl;
+
+	file = MappedFile{};
+	filesystem::remove(packagePath);
+}
+
+void Terrain::NormalBenchmark(const vector<int>& sizes, int texelsPerCell)
+{
+	using namespace DirectX;
+
+	texelsPerCell = max(texelsPerCell, 1);
+	const size_t workerCount = Parallel::GetWorkerCount();
+	cout << workerCount << " workers, " << texelsPerCell << " texels per cell" << endl;
+	for (int length : sizes) {
+		length = max(length, 5);
+		const Heightfield heightfield{ GenerateHeights(length), length };
+
+		vector<uint32_t> reference, serial, parallel;
+		const double referenceSeconds = Time([&] { reference = TerrainNormals::BakeReference(heightfield, texelsPerCell); });
+		const double serialSeconds = Time([&] { serial = TerrainNormals::Bake(heightfield, texelsPerCell, 1); });
+		const double parallelSeconds = Time([&] { parallel = TerrainNormals::Bake(heightfield, texelsPerCell, workerCount); });
+		if (serial != reference || parallel != reference) {
+			throw runtime_error{ "normalbench: the SSE bake differs from the reference at " + to_string(length) };
+		}
+
+		// Bilinear between the packed x and z of the four texels around a grid position, y rebuilt
+		// from them, as the pixel shader reads the map.
+		const int side = TerrainNormals::GetSide(heightfield, texelsPerCell);
+		const auto sample = [&](float x, float z) {
+			const float texelX = clamp(x * texelsPerCell, 0.f, side - 1.f), texelZ = clamp(z * texelsPerCell, 0.f, side - 1.f);
+			const int cornerX = min(static_cast<int>(texelX), side - 2), cornerZ = min(static_cast<int>(texelZ), side - 2);
+			const float tx = texelX - cornerX, tz = texelZ - cornerZ;
+			const auto texel = [&](int dx, int dz) {
+				return TerrainNormals::Unpack(parallel[static_cast<size_t>(cornerZ + dz) * side + cornerX + dx]);
+			};
+			const XMFLOAT3 n00 = texel(0, 0), n10 = texel(1, 0), n01 = texel(0, 1), n11 = texel(1, 1);
+			const float normalX = lerp(lerp(n00.x, n10.x, tx), lerp(n01.x, n11.x, tx), tz);
+			const float normalZ = lerp(lerp(n00.z, n10.z, tx), lerp(n01.z, n11.z, tx), tz);
+			return XMFLOAT3{ normalX, sqrt(max(1.f - normalX * normalX - normalZ * normalZ, 0.f)), normalZ };
+		};
+
+		constexpr int points = 1 << 18;
+		mt19937 random{ 1 };
+		uniform_real_distribution<float> coordinate{ 0.f, static_cast<float>(length - 1) };
+		double errorSum = 0.0, maxError = 0.0;
+		for (int i = 0; i < points; ++i) {
+			const float x = coordinate(random), z = coordinate(random);
+			const XMFLOAT3 exact = TerrainNormals::GetNormal(heightfield, x, z), baked = sample(x, z);
+			const double error = acos(clamp(static_cast<double>(exact.x) * baked.x + static_cast<double>(exact.y) * baked.y +
+				static_cast<double>(exact.z) * baked.z, -1.0, 1.0)) * 180.0 / 3.14159265358979323846;
+			errorSum += error;
+			maxError = max(maxError, error);
+		}
+
+		cout << length << "x" << length << " heights: " << side << "x" << side << " texels, "
+			<< reference.size() * sizeof(uint32_t) / 1024 << " KB" << endl;
+		cout << "  reference " << referenceSeconds * 1000.0 << " ms, SSE " << serialSeconds * 1000.0 << " ms ("
+			<< referenceSeconds / max(serialSeconds, 1e-9) << "x), on " << workerCount << " workers "
+			<< parallelSeconds * 1000.0 << " ms (" << referenceSeconds / max(parallelSeconds, 1e-9) << "x)" << endl;
+		cout << "  filtered map against the surface: " << errorSum / points << " degrees on average, "
+			<< maxError << " at most" << endl;
+	}
+}
+
+void Terrain::Tile(const filesystem::path& heightMap, const filesystem::path& output, int tileCells, bool wide)
+{
+	int length = 0;
+	const vector<float> heights = LoadHeights(heightMap, length);
+	const TiledFile file = WriteTiles(heights, length, wide ? TerrainTiling::SampleFormat::Unorm16 :
+		TerrainTiling::SampleFormat::Unorm8, tileCells, output);
+	const uint32_t tiles = file.header.tilesPerSide * file.header.tilesPerSide;
+	cout << "wrote " << output.string() << ": " << length << "x" << length << " heights in " << tiles << " tiles of "
+		<< tileCells << "x" << tileCells << " cells, " << (wide ? 16 : 8) << "-bit, " << file.compressedTiles << "/" << tiles
+		<< " compressed, " << file.rawBytes << " -> " << file.fileBytes << " bytes" << endl;
+}
+
+void Terrain::TileBenchmark(int length, int tileCells, bool wide)
+{
+	using namespace DirectX;
+	using namespace TerrainTiling;
+
+	length = max(length, 5);
+	const vector<float> source = GenerateHeights(length);
+	const filesystem::path tilesPath = filesystem::temp_directory_path() / "tilebench.tiles";
+	TiledFile file{};
+	const double writeSeconds = Time([&] { file = WriteTiles(source, length, wide ? SampleFormat::Unorm16 : SampleFormat::Unorm8,
+		tileCells, tilesPath); });
+	const FileHeader& header = file.header;
+	const uint32_t tilesPerSide = header.tilesPerSide;
+	cout << length << "x" << length << " heights, " << tilesPerSide * tilesPerSide << " tiles of " << tileCells << "x" << tileCells
+		<< " cells, " << (wide ? 16 : 8) << "-bit, " << file.compressedTiles << " compressed, " << file.rawBytes << " -> "
+		<< file.fileBytes << " bytes, written in " << writeSeconds * 1000.0 << " ms" << endl;
+
+	// The whole file read back is the reference: within half a step of the source everywhere.
+	vector<float> decoded;
+	{
+		ifstream in{ tilesPath, ios::binary };
+		const vector<char> bytes{ istreambuf_iterator<char>{ in }, istreambuf_iterator<char>{} };
+		FileHeader read;
+		decoded = ReadHeights(as_bytes(span{ bytes }), read);
+	}
+	float quantization = 0.f;
+	for (size_t i = 0; i < source.size(); ++i) quantization = max(quantization, abs(decoded[i] - source[i]));
+	if (quantization > header.heightScale * 0.5f + 1e-4f) throw runtime_error{ "tilebench: samples off by more than half a step" };
+	const Heightfield reference{ decoded, length };
+
+	// Synthetic camera paths through the cache alone, loads landing `Latency` frames after they
+	// start: a flyover along the diagonal, an orbit and random teleports.
+	constexpr int FrameCount = 1200, Latency = 4, TeleportInterval = 120;
+	constexpr float Radius = 1.5f;
+	constexpr uint32_t SlotCount = 48, FrameLoadBudget = 8;
+	const float extent = static_cast<float>(tilesPerSide);
+	const auto moveEye = [&](int route, int frame, mt19937& random, XMFLOAT2& eye) {
+		const float progress = static_cast<float>(frame) / FrameCount;
+		if (route == 0) eye = { extent * (0.1f + 0.8f * progress), extent * (0.1f + 0.8f * progress) };
+		else if (route == 1) eye = { extent * (0.5f + 0.3f * cos(XM_2PI * progress)), extent * (0.5f + 0.3f * sin(XM_2PI * progress)) };
+		else if (frame % TeleportInterval == 0) {
+			uniform_real_distribution<float> position{ 0.f, extent };
+			eye = { position(random), position(random) };
+		}
+	};
+	for (const auto& [route, name] : { pair{ 0, "flyover" }, pair{ 1, "orbit" }, pair{ 2, "teleport" } }) {
+		TerrainTileCache cache{ tilesPerSide, SlotCount, FrameLoadBudget };
+		deque<pair<int, uint32_t>> inFlight;	// (frame due, tile)
+		mt19937 random{ 7 };
+		XMFLOAT2 eye{};
+		uint64_t settleFrames = 0, teleports = 0, misses = 0;
+		int lastTeleport = 0;
+		bool settling = false;
+		double cacheSeconds = 0.0;
+		for (int frame = 0; frame < FrameCount; ++frame) {
+			moveEye(route, frame, random, eye);
+			if (route == 2 && frame % TeleportInterval == 0) {
+				if (settling) settleFrames += frame - lastTeleport;
+				lastTeleport = frame;
+				settling = frame > 0;
+				teleports += settling;
+			}
+
+			// The tile under a point, clamped to the grid.
+			const auto tileAt = [&](float x, float z) {
+				const uint32_t last = tilesPerSide - 1;
+				return min(static_cast<uint32_t>(clamp(z, 0.f, extent)), last) * tilesPerSide + min(static_cast<uint32_t>(clamp(x, 0.f, extent)), last);
+			};
+			misses += !cache.IsResident(tileAt(eye.x, eye.y));
+
+			vector<uint32_t> before;
+			for (uint32_t tile = 0; tile < tilesPerSide * tilesPerSide; ++tile) {
+				if (cache.IsResident(tile)) before.push_back(tile);
+			}
+			vector<TerrainTileCache::Load> loads;
+			cacheSeconds += Time([&] { loads = cache.Update(eye.x, eye.y, Radius); });
+			if (loads.size() > FrameLoadBudget || cache.GetResidentCount() + cache.GetLoadingCount() > SlotCount) {
+				throw runtime_error{ "tilebench: the cache went over its budget or its slots" };
+			}
+			for (const auto& load : loads) {
+				if (cache.IsResident(load.tile) || binary_search(before.begin(), before.end(), load.tile)) {
+					throw runtime_error{ "tilebench: the cache loaded a resident tile" };
+				}
+				inFlight.emplace_back(frame + Latency, load.tile);
+			}
+			// A wanted tile that was resident must stay so.
+			const uint32_t eyeTile = tileAt(eye.x, eye.y);
+			if (binary_search(before.begin(), before.end(), eyeTile) && !cache.IsResident(eyeTile)) {
+				throw runtime_error{ "tilebench: the cache evicted the tile under the eye" };
+			}
+			while (!inFlight.empty() && inFlight.front().first <= frame) {
+				cache.CompleteLoad(inFlight.front().second);
+				inFlight.pop_front();
+			}
+
+			if (settling) {
+				bool settled = true;
+				for (int dz = -1; dz <= 1; ++dz) {
+					for (int dx = -1; dx <= 1; ++dx) settled &= cache.IsResident(tileAt(eye.x + dx, eye.y + dz));
+				}
+				if (settled) {
+					settleFrames += frame - lastTeleport;
+					settling = false;
+				}
+			}
+		}
+
+		const auto& statistics = cache.GetStatistics();
+		cout << name << ": " << 100.0 * statistics.hits / max<uint64_t>(statistics.requests, 1) << "% wanted tiles resident, "
+			<< misses << " frames with the eye's tile missing, " << static_cast<double>(statistics.loads) / statistics.frames
+			<< " loads/frame, " << static_cast<double>(statistics.evictions) / statistics.frames << " evictions/frame";
+		if (teleports > 0) cout << ", " << static_cast<double>(settleFrames) / teleports << " frames to settle after a teleport";
+		cout << " (" << cacheSeconds * 1e6 / FrameCount << " us/frame in the cache)" << endl;
+	}
+
+	// The flyover again through real reads: resident heights must match the whole grid bit for
+	// bit, seams included, and the overview must stand in everywhere else.
+	IoQueue queue{ 1, 1 };
+	TerrainTileStream stream{ queue, tilesPath, SlotCount, FrameLoadBudget };
+	const float half = static_cast<float>(length / 2), cells = static_cast<float>(tileCells);
+	const float low = *min_element(decoded.begin(), decoded.end()), high = *max_element(decoded.begin(), decoded.end());
+	const float covered = static_cast<float>((length - 1) / Heightfield::PatchLength * Heightfield::PatchLength) - half;
+	uint64_t queries = 0, resident = 0;
+	float fallbackError = 0.f;
+	mt19937 random{ 11 };
+	uniform_real_distribution<float> offset{ -2.f * cells, 2.f * cells };
+	const auto check = [&](float x, float z) {
+		const float height = stream.GetHeight(x, z);
+		if (abs(x) > half || abs(z) > half) {
+			if (height != 0.f) throw runtime_error{ "tilebench: a height outside the grid is not 0" };
+			return;
+		}
+		++queries;
+		if (stream.IsResident(x, z)) {
+			++resident;
+			// Past the whole grid's last patch only the tiles have a surface.
+			if (x > covered || z > covered) return;
+			if (height != reference.GetHeight(x, z)) {
+				throw runtime_error{ "tilebench: a streamed height differs at (" + to_string(x) + ", " + to_string(z) + ")" };
+			}
+			return;
+		}
+		if (!(height >= low - 1e-3f && height <= high + 1e-3f)) throw runtime_error{ "tilebench: a fallback height is out of range" };
+		fallbackError = max(fallbackError, abs(height - reference.GetHeight(x, z)));
+	};
+	double streamSeconds = 0.0;
+	const double elapsed = Time([&] {
+		for (int frame = 0; frame < FrameCount; ++frame) {
+			XMFLOAT2 eye{};
+			moveEye(0, frame, random, eye);
+			const float x = eye.x * cells - half, z = eye.y * cells - half;
+			streamSeconds += Time([&] { stream.Update(x, z, Radius * cells); });
+			for (int i = 0; i < 64; ++i) check(x + offset(random), z + offset(random));
+		}
+		stream.WaitIdle();
+	});
+
+	// Along every seam near the end of the path, once everything has arrived.
+	XMFLOAT2 end{};
+	moveEye(0, FrameCount - 1, random, end);
+	const float endX = end.x * cells - half, endZ = end.y * cells - half;
+	stream.Preload(endX, endZ, Radius * cells);
+	const uint64_t before = resident;
+	for (float edge = -1.f; edge <= 1.f; edge += 1.f) {
+		const float edgeX = (floor(end.x) + edge) * cells - half, edgeZ = (floor(end.y) + edge) * cells - half;
+		for (float t = -cells; t <= cells; t += 0.37f) {
+			check(edgeX, endZ + t);
+			check(endX + t, edgeZ);
+		}
+	}
+	if (resident == before) throw runtime_error{ "tilebench: nothing resident at the end of the path" };
+
+	// The game's start: it draws each slot's tile from the slot's samples and the overview
+	// elsewhere, so every slot must hold its tile's part of the whole grid, tiles past the grid
+	// repeating its last sample, and the tiles within the radius of the centre must be resident.
+	TerrainTileStream start{ queue, tilesPath, SlotCount, FrameLoadBudget };
+	start.Preload(0.f, 0.f, Radius * cells);
+	for (uint32_t slot = 0; slot < SlotCount; ++slot) {
+		const uint32_t tile = start.GetCache().GetSlotTile(slot);
+		if (tile == TerrainTileCache::NoSlot) continue;
+		if (start.GetCache().GetResidentSlot(tile) != slot) throw runtime_error{ "tilebench: a slot and its tile disagree" };
+		const Heightfield& samples = start.GetSlot(slot);
+		const int originX = static_cast<int>(tile % tilesPerSide * header.tileCells), originZ = static_cast<int>(tile / tilesPerSide * header.tileCells);
+		for (int z = 0; z < samples.GetLength(); ++z) {
+			for (int x = 0; x < samples.GetLength(); ++x) {
+				const size_t gridX = min(originX + x, length - 1), gridZ = min(originZ + z, length - 1);
+				if (samples.GetSample(x, z) != decoded[gridZ * length + gridX]) throw runtime_error{ "tilebench: a slot's sample differs" };
+			}
+		}
+	}
+	uint64_t startSamples = 0;
+	for (uint32_t z = 0; z < static_cast<uint32_t>(length); ++z) {
+		for (uint32_t x = 0; x < static_cast<uint32_t>(length); ++x) {
+			const float sample = start.GetSample(x, z), fx = static_cast<float>(x) - half, fz = static_cast<float>(z) - half;
+			if (start.IsResident(fx, fz)) {
+				++startSamples;
+				if (sample != decoded[static_cast<size_t>(z) * length + x]) throw runtime_error{ "tilebench: a preloaded sample differs" };
+			}
+			else if (fx * fx + fz * fz <= Radius * cells * Radius * cells) {
+				throw runtime_error{ "tilebench: a sample near the start was not preloaded" };
+			}
+			else if (!(sample >= low - 1e-3f && sample <= high + 1e-3f)) {
+				throw runtime_error{ "tilebench: a fallback sample is out of range" };
+			}
+		}
+	}
+
+	cout << "streamed: " << 100.0 * resident / max<uint64_t>(queries, 1) << "% of queries from resident tiles, fallback off by at most "
+		<< fallbackError << ", " << stream.GetBytesRead() << " bytes read for " << stream.GetBytesLoaded() << " bytes of samples, "
+		<< streamSeconds * 1e6 / FrameCount << " us/frame in Update, " << elapsed * 1000.0 << " ms in all" << endl;
+	cout << "preloaded " << start.GetCache().GetResidentCount() << " tiles around the centre, " << startSamples
+		<< " samples from them" << endl;
+	cout << "quantization off by at most " << quantization << "; resident heights identical to the whole grid" << endl;
+	filesystem::remove(tilesPath);
+}
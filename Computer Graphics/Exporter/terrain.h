@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+namespace Terrain
+{
+	// Answers `queries` random height queries on the height map (a square of byte heights, as the
+	// game loads it; a generated 257x257 one when `heightMap` is empty) three ways: the former
+	// row-of-rows scalar evaluation, Heightfield::GetHeight and Heightfield::GetHeights. Prints the
+	// times and throws unless the last two agree bit for bit with the domain shader's evaluation
+	// over TerrainPatches::WritePatchIndices' control points.
+	void Benchmark(const std::filesystem::path& heightMap, size_t queries);
+
+	// Culls a generated `length` x `length` height map against `frames` camera and shadow frustums
+	// along a path over it, with TerrainQuadtree::Cull and patch by patch. Prints the times and
+	// the visible patches and draw ranges, and throws unless both find the same patches.
+	void CullBenchmark(int length, int frames);
+
+	// Selects CDLOD nodes on a generated `length` x `length` height map for `frames` eyes along a
+	// path over it, level 0 reaching `firstRange`. Checks every selection without a frustum: each
+	// patch covered once, neighbours at most one level apart and, on every seam between levels,
+	// the finer grid fully morphed while the coarser has not started. Prints the times and node
+	// counts of the camera and shadow selections, and throws on the first failed check.
+	void LodBenchmark(int length, int frames, float firstRange);
+
+	// Computes TerrainTessellation's factors on a generated `length` x `length` height map for
+	// `frames` eyes along a path over it, allowing `pixelError` pixels at a 1080-pixel-high 45°
+	// view. Checks that the SSE pass matches the reference bit for bit, that patches sharing an edge
+	// agree on its factor, and that every edge tessellated at its factor stays within the error
+	// unless the factor is capped. Prints the times for the visible patches and throws on failure.
+	void TessellationBenchmark(int length, int frames, float pixelError);
+
+	// Casts `rays` random rays at a generated `length` x `length` height map through a
+	// HeightPyramid: a quarter each of steep and grazing picking rays down from above the ground and
+	// of short and map-wide sight lines between points just above it. Checks that every cell's
+	// bounds hold the surface, that the pyramid's walk finds the hits of the walk through every cell
+	// and that every hit lies on the surface. Prints the build time and the ray rates, each kind's
+	// single-threaded and all batched, and throws on failure.
+	void RaycastBenchmark(int length, size_t rays);
+
+	// Builds the CPU side of the terrain mesh for a generated height map of each of `sizes` sides,
+	// as TerrainMesh did and as it does now: the densities one point at a time, then the control
+	// points grown one vertex at a time and the tessellation bounds on one thread, against the SSE
+	// densities over threads of rows and patches written in parallel into a vector sized up front.
+	// Prints each stage's times and throws unless both build the same densities and vertices.
+	void BuildBenchmark(const std::vector<int>& sizes);
+
+	// Lays a generated `length` x `length` height map out for the tessellated terrain as the mesh
+	// did, 25 control points of its own per patch, and as it does now, every sample once with 25
+	// indices per patch, and throws unless both give the hull shader the same control points.
+	// Prints the buffer memory of each and the bytes the input assembler fetches for the whole
+	// terrain and for the patches of `frames` cameras along a path over it, with shared samples
+	// reused through a `cacheSize`-entry FIFO post-transform cache flushed at every draw.
+	void PatchBenchmark(int length, int frames, int cacheSize);
+
+	// Cooks the height map (a square of byte heights, as the game loads it, or of little-endian
+	// 16-bit ones in a .r16 file) into a terrain package at `output` (see TerrainPackage) that the
+	// game maps and uploads instead of building the mesh, with normals baked at `normalTexelsPerCell`.
+	void Cook(const std::filesystem::path& heightMap, const std::filesystem::path& output, int normalTexelsPerCell);
+
+	// Cooks a generated `length` x `length` height map, then loads the terrain the way the game
+	// builds it from heights and the way it maps the package, and throws unless both hold the same
+	// buffers, quadtree, tessellation bounds and pyramid. Prints each stage's load time next to
+	// the time to read the file.
+	void CookBenchmark(int length);
+
+	// Bakes the normals of a generated height map of each of `sizes` sides at `texelsPerCell`, one
+	// texel at a time on one thread and with the SSE bake on one thread and on every worker, and
+	// throws unless all three bake the same texels. Prints the times, the map's size and how far
+	// the map, filtered as the terrain's pixel shader filters it, strays from the surface's normal
+	// at random points.
+	void NormalBenchmark(const std::vector<int>& sizes, int texelsPerCell);
+
+	// Cuts the height map (a square of byte heights, as the game loads it, or of little-endian
+	// 16-bit ones in a .r16 file) into tiles of `tileCells` cells and writes them to `output` as
+	// a tiled height map with 8-bit samples, or 16-bit ones when `wide`.
+	void Tile(const std::filesystem::path& heightMap, const std::filesystem::path& output, int tileCells, bool wide);
+
+	// Writes a generated `length` x `length` height map in tiles of `tileCells` cells, reads it
+	// back and checks it against the source. Replays a flyover, an orbit and random teleports
+	// through a TerrainTileCache, checking its budgets and that it never evicts the tile under the
+	// eye, then streams the flyover from the file through a TerrainTileStream, checking that
+	// resident heights match the whole grid bit for bit, seams included, and that the overview
+	// stands in elsewhere, and preloads the tiles around the centre as the game starts, checking its
+	// samples there. Prints hit rates, load and eviction traffic, and throws on failure.
+	void TileBenchmark(int length, int tileCells, bool wide);
+}
@@ -0,0 +1,192 @@
+#include "texturestreaming.h"
+#include "../Common/mipstreaming.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	using Clock = chrono::steady_clock;
+
+	constexpr uint64_t TileBytes = 64 * 1024;
+	constexpr uint32_t EvictionDelay = 120;
+
+	// A texture as the streamer should see it, kept apart from the streamer to check its plans.
+	struct Mirror
+	{
+		MipStreamer::TextureId	id = 0;
+		uint32_t				side = 0;
+		vector<uint64_t>		mipBytes;
+		uint32_t				tailMip = 0;
+		uint32_t				residentMip = 0;
+		uint32_t				wantedMip = 0;
+	};
+
+	struct Object
+	{
+		float		x = 0.0f;
+		float		z = 0.0f;
+		float		size = 0.0f;	// The texture covers the object once.
+		uint32_t	texture = 0;	// Index into the mirrors.
+	};
+
+	// BC1 mips in 64 KB tiles; the mips smaller than a tile share one as the packed tail.
+	Mirror MakeTexture(uint32_t side)
+	{
+		Mirror texture;
+		texture.side = side;
+		const uint32_t mipCount = bit_width(side);
+		texture.mipBytes.assign(mipCount, 0);
+		while (texture.tailMip < mipCount) {
+			const uint64_t texels = max(side >> texture.tailMip, 4u);
+			const uint64_t bytes = texels * texels / 2;
+			if (bytes < TileBytes) break;
+			texture.mipBytes[texture.tailMip++] = bytes;
+		}
+		texture.mipBytes[texture.tailMip] = TileBytes;
+		texture.residentMip = texture.tailMip;
+		texture.wantedMip = texture.tailMip;
+		return texture;
+	}
+
+	void Check(bool condition, uint32_t frame, const string& what)
+	{
+		if (!condition) throw runtime_error{ "mip streaming: frame " + to_string(frame) + ": " + what };
+	}
+}
+
+void TextureStreaming::Simulate(uint32_t textureCount, uint32_t frames, uint64_t residentBudget, uint64_t frameUploadBudget)
+{
+	// A 1080p 45-degree view 2 units above a 256-unit field, seeing objects up to 256 units away.
+	constexpr float WorldSize = 256.0f, Height = 2.0f, FarDistance = 256.0f, FovY = 0.785398f, Pi = 3.14159265f;
+	constexpr float ViewportHeight = 1080.0f;
+	constexpr uint32_t SettleFrames = EvictionDelay + 60;
+	if (textureCount == 0 || frames == 0) throw invalid_argument{ "mip streaming: nothing to simulate" };
+
+	cout << "mip streamer: " << textureCount << " textures on " << textureCount * 4 << " objects, "
+		<< residentBudget / (1024.0 * 1024.0) << " MB resident, " << frameUploadBudget / 1024.0 << " KB/frame, "
+		<< frames << " frames of flight and " << SettleFrames << " still" << endl;
+	for (const auto& [budget, name] : { pair{ residentBudget, "full budget" }, pair{ residentBudget / 4, "quarter budget" } }) {
+		MipStreamer streamer{ budget, frameUploadBudget, EvictionDelay };
+		mt19937 random{ 5 };
+		uniform_int_distribution<uint32_t> sideShift{ 0, 3 }, textureIndex{ 0, textureCount - 1 };
+		uniform_real_distribution<float> position{ -0.5f * WorldSize, 0.5f * WorldSize }, size{ 2.0f, 32.0f };
+
+		vector<Mirror> textures;
+		vector<uint32_t> textureOfId;
+		const auto add = [&](uint32_t index) {
+			Mirror texture = MakeTexture(512u << sideShift(random));
+			texture.id = streamer.Register(texture.mipBytes, texture.tailMip);
+			if (textureOfId.size() <= texture.id) textureOfId.resize(texture.id + 1);
+			textureOfId[texture.id] = index;
+			textures[index] = move(texture);
+			};
+		textures.resize(textureCount);
+		for (uint32_t index = 0; index < textureCount; ++index) add(index);
+
+		vector<Object> objects(textureCount * 4);
+		for (Object& object : objects) object = { position(random), position(random), size(random), textureIndex(random) };
+
+		uint64_t uploads = 0, evictions = 0, streamedBytes = 0, peakResident = 0, shortfall = 0;
+		uint32_t settledFrame = 0;
+		Clock::duration streamerTime{};
+		for (uint32_t frame = 0; frame < frames + SettleFrames; ++frame) {
+			// Halfway, a quarter of the textures leave and new ones take their objects.
+			if (frame == frames / 2) {
+				for (uint32_t index = 0; index < textureCount; index += 4) {
+					streamer.Unregister(textures[index].id);
+					add(index);
+				}
+			}
+
+			const float progress = static_cast<float>(min(frame, frames - 1)) / frames;
+			const float eyeX = (-0.45f + 0.9f * progress) * WorldSize, eyeZ = 0.2f * WorldSize * sin(2 * Pi * progress);
+			for (Mirror& texture : textures) texture.wantedMip = texture.tailMip;
+			for (const Object& object : objects) {
+				const float dx = object.x - eyeX, dz = object.z - eyeZ;
+				const float distance = max(sqrt(dx * dx + Height * Height + dz * dz) - 0.5f * object.size, 0.5f);
+				if (distance > FarDistance) continue;
+
+				Mirror& texture = textures[object.texture];
+				const uint32_t mip = MipStreaming::GetRequiredMip(texture.side / object.size,
+					MipStreaming::GetPixelsPerUnit(distance, FovY, ViewportHeight), static_cast<uint32_t>(texture.mipBytes.size()));
+				streamer.Request(texture.id, mip);
+				texture.wantedMip = min(texture.wantedMip, mip);
+			}
+
+			const auto start = Clock::now();
+			const auto plan = streamer.Update();
+			streamerTime += Clock::now() - start;
+
+			// A texture either gains or loses mips in a frame: uploads stay at or above what it
+			// wants, evictions below it, so the order between the two lists does not matter.
+			vector<int> change(textureCount, 0);
+			for (const auto& eviction : plan.evictions) {
+				Mirror& texture = textures.at(textureOfId.at(eviction.texture));
+				Check(eviction.mip == texture.residentMip, frame, "an eviction skipped a finer resident mip");
+				Check(eviction.mip < texture.tailMip, frame, "the mip tail was evicted");
+				Check(eviction.mip < texture.wantedMip, frame, "a wanted mip was evicted");
+				Check(change[textureOfId[eviction.texture]] <= 0, frame, "a texture gained and lost mips");
+				change[textureOfId[eviction.texture]] = -1;
+				++texture.residentMip;
+			}
+			uint64_t frameBytes = 0;
+			for (const auto& upload : plan.uploads) {
+				Mirror& texture = textures.at(textureOfId.at(upload.texture));
+				Check(upload.mip + 1 == texture.residentMip, frame, "an upload skipped a coarser mip");
+				Check(upload.mip >= texture.wantedMip, frame, "a mip nobody wants was uploaded");
+				Check(change[textureOfId[upload.texture]] >= 0, frame, "a texture gained and lost mips");
+				change[textureOfId[upload.texture]] = 1;
+				--texture.residentMip;
+				frameBytes += texture.mipBytes[upload.mip];
+			}
+			Check(frameBytes <= frameUploadBudget || plan.uploads.size() == 1, frame, "the frame upload budget was exceeded");
+
+			uint64_t residentBytes = 0, tailBytes = 0;
+			bool settled = true;
+			for (const Mirror& texture : textures) {
+				Check(streamer.GetResidentMip(texture.id) == texture.residentMip, frame, "the resident mips differ");
+				Check(streamer.GetWantedMip(texture.id) == texture.wantedMip, frame, "the wanted mips differ");
+				for (uint32_t mip = texture.residentMip; mip < texture.mipBytes.size(); ++mip) residentBytes += texture.mipBytes[mip];
+				tailBytes += texture.mipBytes[texture.tailMip];
+				shortfall += texture.residentMip > texture.wantedMip;
+				settled = settled && texture.residentMip == texture.wantedMip;
+			}
+			Check(streamer.GetResidentBytes() == residentBytes, frame, "the resident bytes differ");
+			Check(residentBytes <= max(budget, tailBytes), frame, "the resident budget was exceeded");
+
+			if (frame >= frames && settled && settledFrame == 0) settledFrame = frame - frames + 1;
+			uploads += plan.uploads.size();
+			evictions += plan.evictions.size();
+			streamedBytes += frameBytes;
+			peakResident = max(peakResident, residentBytes);
+		}
+
+		// Still, every texture should end at the mip it wants when all of them fit.
+		uint64_t wantedBytes = 0;
+		for (const Mirror& texture : textures) {
+			for (uint32_t mip = texture.wantedMip; mip < texture.mipBytes.size(); ++mip) wantedBytes += texture.mipBytes[mip];
+		}
+		const bool fits = wantedBytes <= budget;
+		if (fits) Check(settledFrame > 0, frames + SettleFrames - 1, "the resident mips never reached the wanted ones");
+
+		const chrono::duration<double, milli> elapsed = streamerTime;
+		const double totalFrames = frames + SettleFrames;
+		cout << name << ": " << static_cast<double>(uploads) / totalFrames << " uploads/frame, "
+			<< static_cast<double>(evictions) / totalFrames << " evictions/frame, "
+			<< streamedBytes / (1024.0 * 1024.0) << " MB streamed, peak " << peakResident / (1024.0 * 1024.0) << " MB resident, "
+			<< 100.0 * shortfall / (totalFrames * textureCount) << "% texture-frames short of the wanted mip, "
+			<< wantedBytes / (1024.0 * 1024.0) << " MB wanted at rest";
+		if (fits) cout << " (settled " << settledFrame << " frames after stopping)";
+		else cout << " (over budget)";
+		cout << " (" << elapsed.count() / totalFrames << " ms/frame in the streamer)" << endl;
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+
+namespace TextureStreaming
+{
+	// Drives a MipStreamer as the game does for `textureCount` BC1 textures of 512 to 4096 texels,
+	// laid on objects scattered over a field that a camera flies across for `frames` frames, then
+	// holds still while the streamer settles; halfway, a quarter of the textures are swapped for new
+	// ones. Mirrors every plan and throws unless the resident bytes stay within `residentBudget`,
+	// each frame's uploads within `frameUploadBudget` (or a single upload), uploads come one mip at a
+	// time from coarse to fine and never below what a texture wants, evictions take only the finest
+	// resident mip of a texture that wants it no longer and never its tail, and, once still, every
+	// texture reaches the mip it wants when the budget holds them all. Prints the traffic.
+	void Simulate(uint32_t textureCount, uint32_t frames, uint64_t residentBudget, uint64_t frameUploadBudget);
+}
@@ -0,0 +1,387 @@
+#include "virtualtexture.h"
+#include "bc.h"
+#include "dds.h"
+#include "mipmap.h"
+#include "../Common/pagecache.h"
+#include "../Common/parallel.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace VirtualTexturing;
+
+namespace
+{
+	using Clock = chrono::steady_clock;
+
+	struct Level
+	{
+		uint32_t		width = 0;
+		uint32_t		height = 0;
+		vector<float>	pixels;		// Linear RGBA.
+	};
+
+	struct Layer
+	{
+		vector<Level>	levels;
+		bool			srgb = false;
+	};
+
+	struct Color
+	{
+		float r, g, b, a;
+	};
+
+	float SrgbToLinear(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	const vector<uint8_t>& GetLinearToSrgb()
+	{
+		static const vector<uint8_t> table = [] {
+			vector<uint8_t> values(4096);
+			for (size_t i = 0; i < values.size(); ++i) {
+				const float value = i / 4095.0f;
+				const float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * pow(value, 1.0f / 2.4f) - 0.055f;
+				values[i] = static_cast<uint8_t>(lround(srgb * 255.0f));
+			}
+			return values;
+			}();
+		return table;
+	}
+
+	// Block-compressed and BGRA sources become RGBA8 with the same sRGB-ness.
+	DdsImage DecodeToRgba8(const DdsImage& source)
+	{
+		DdsImage image;
+		image.format = Dds::IsSrgb(source.format) ? DdsFormat::R8G8B8A8UnormSrgb : DdsFormat::R8G8B8A8Unorm;
+		image.width = source.width;
+		image.height = source.height;
+		image.mipCount = source.mipCount;
+		image.data.resize(Dds::GetSubresourceOffset(image, 1, 0));
+
+		for (uint32_t mip = 0; mip < source.mipCount; ++mip) {
+			const uint32_t width = Dds::GetMipSize(source.width, mip);
+			const uint32_t height = Dds::GetMipSize(source.height, mip);
+			const auto* in = reinterpret_cast<const uint8_t*>(source.data.data() + Dds::GetSubresourceOffset(source, 0, mip));
+			auto* out = reinterpret_cast<uint8_t*>(image.data.data() + Dds::GetSubresourceOffset(image, 0, mip));
+
+			if (!Dds::IsBlockCompressed(source.format)) {
+				for (size_t i = 0; i < size_t{ width } * height; ++i, in += Dds::GetElementSize(source.format), out += 4) {
+					switch (source.format)
+					{
+					case DdsFormat::R8G8B8A8Unorm:
+					case DdsFormat::R8G8B8A8UnormSrgb:
+						copy(in, in + 4, out);
+						break;
+					case DdsFormat::B8G8R8A8Unorm:
+					case DdsFormat::B8G8R8A8UnormSrgb:
+					case DdsFormat::B8G8R8X8Unorm:
+						out[0] = in[2];
+						out[1] = in[1];
+						out[2] = in[0];
+						out[3] = source.format == DdsFormat::B8G8R8X8Unorm ? 255 : in[3];
+						break;
+					default:
+						throw invalid_argument{ "vtbake: unsupported source format " + to_string(static_cast<uint32_t>(source.format)) };
+					}
+				}
+				continue;
+			}
+
+			const size_t blockSize = Dds::GetElementSize(source.format);
+			for (uint32_t by = 0; by < height; by += 4) {
+				for (uint32_t bx = 0; bx < width; bx += 4, in += blockSize) {
+					uint8_t rgba[64];
+					switch (source.format)
+					{
+					case DdsFormat::BC1Unorm:
+					case DdsFormat::BC1UnormSrgb:
+						BC::DecodeBC1(in, rgba);
+						break;
+					case DdsFormat::BC3Unorm:
+					case DdsFormat::BC3UnormSrgb:
+						BC::DecodeBC3(in, rgba);
+						break;
+					case DdsFormat::BC7Unorm:
+					case DdsFormat::BC7UnormSrgb:
+						if (!BC::DecodeBC7(in, rgba)) throw runtime_error{ "vtbake: bad BC7 block" };
+						break;
+					default:
+						throw invalid_argument{ "vtbake: unsupported source format " + to_string(static_cast<uint32_t>(source.format)) };
+					}
+					for (uint32_t y = 0; y < 4 && by + y < height; ++y) {
+						for (uint32_t x = 0; x < 4 && bx + x < width; ++x) {
+							copy(rgba + (y * 4 + x) * 4, rgba + (y * 4 + x) * 4 + 4, out + (size_t{ by + y } * width + bx + x) * 4);
+						}
+					}
+				}
+			}
+		}
+		return image;
+	}
+
+	Layer LoadLayer(const filesystem::path& path)
+	{
+		const DdsImage source = Dds::Read(path);
+		if (source.arraySize != 1) throw invalid_argument{ "vtbake: " + path.string() + " is not a single 2D texture" };
+
+		DdsImage image = DecodeToRgba8(source);
+		if (image.mipCount == 1 && (image.width > 1 || image.height > 1)) Mipmap::Generate(image, MipOptions{});
+
+		Layer layer;
+		layer.srgb = Dds::IsSrgb(image.format);
+		layer.levels.resize(image.mipCount);
+		for (uint32_t mip = 0; mip < image.mipCount; ++mip) {
+			Level& level = layer.levels[mip];
+			level.width = Dds::GetMipSize(image.width, mip);
+			level.height = Dds::GetMipSize(image.height, mip);
+			level.pixels.resize(size_t{ level.width } * level.height * 4);
+			const auto* in = reinterpret_cast<const uint8_t*>(image.data.data() + Dds::GetSubresourceOffset(image, 0, mip));
+			for (size_t i = 0; i < level.pixels.size(); ++i) {
+				const float value = in[i] / 255.0f;
+				level.pixels[i] = layer.srgb && i % 4 != 3 ? SrgbToLinear(value) : value;
+			}
+		}
+		return layer;
+	}
+
+	// The level whose texels are closest to `texelsPerSample` mip-0 texels each.
+	const Level& SelectLevel(const vector<Level>& levels, float texelsPerSample)
+	{
+		const float mip = floor(log2(max(texelsPerSample, 1.0f)));
+		return levels[min(static_cast<size_t>(mip), levels.size() - 1)];
+	}
+
+	Color SampleBilinear(const Level& level, float u, float v, bool wrap)
+	{
+		const float x = u * level.width - 0.5f;
+		const float y = v * level.height - 0.5f;
+		const float fx = x - floor(x);
+		const float fy = y - floor(y);
+		const auto address = [wrap](int coordinate, uint32_t size) {
+			const int extent = static_cast<int>(size);
+			return static_cast<size_t>(wrap ? (coordinate % extent + extent) % extent : clamp(coordinate, 0, extent - 1));
+			};
+		const size_t x0 = address(static_cast<int>(floor(x)), level.width), x1 = address(static_cast<int>(floor(x)) + 1, level.width);
+		const size_t y0 = address(static_cast<int>(floor(y)), level.height), y1 = address(static_cast<int>(floor(y)) + 1, level.height);
+
+		float result[4];
+		for (size_t c = 0; c < 4; ++c) {
+			const float top = level.pixels[(y0 * level.width + x0) * 4 + c] * (1.0f - fx) + level.pixels[(y0 * level.width + x1) * 4 + c] * fx;
+			const float bottom = level.pixels[(y1 * level.width + x0) * 4 + c] * (1.0f - fx) + level.pixels[(y1 * level.width + x1) * 4 + c] * fx;
+			result[c] = top * (1.0f - fy) + bottom * fy;
+		}
+		return { result[0], result[1], result[2], result[3] };
+	}
+
+	struct Camera
+	{
+		float	x, z;
+		float	yaw;
+	};
+
+	enum class Path
+	{
+		Flyover,	// Corner to corner.
+		Orbit,		// A circle looking at the centre.
+		Teleport,	// A random spot every two seconds.
+	};
+}
+
+void VirtualTexture::Bake(const filesystem::path& base, const filesystem::path& detail,
+	const filesystem::path& output, const VirtualTextureOptions& options)
+{
+	if (!has_single_bit(options.size) || !has_single_bit(options.pageSize) || options.pageSize > options.size) {
+		throw invalid_argument{ "vtbake: size and page size must be powers of two" };
+	}
+	if (options.border % 4 != 0 || options.border >= options.pageSize) throw invalid_argument{ "vtbake: border must be a multiple of 4 below the page size" };
+
+	FileHeader header;
+	header.pageSize = options.pageSize;
+	header.border = options.border;
+	header.pagesPerSide = options.size / options.pageSize;
+	header.mipCount = GetMipCount(header.pagesPerSide);
+	if (header.mipCount > MaxMipCount) throw invalid_argument{ "vtbake: too many pages" };
+
+	const auto start = Clock::now();
+	const Layer baseLayer = LoadLayer(base);
+	const Layer detailLayer = LoadLayer(detail);
+	const vector<Level>& baseLevels = baseLayer.levels;
+	const vector<Level>& detailLevels = detailLayer.levels;
+	const bool srgb = baseLayer.srgb;
+	header.format = static_cast<uint32_t>(srgb ? DdsFormat::BC1UnormSrgb : DdsFormat::BC1Unorm);
+
+	const uint32_t slotSize = options.pageSize + 2 * options.border;
+	const uint32_t blocksPerSide = slotSize / 4;
+	header.pageBytes = blocksPerSide * blocksPerSide * static_cast<uint32_t>(Dds::GetElementSize(DdsFormat::BC1Unorm));
+
+	ofstream out(output, ios::binary);
+	if (!out) throw runtime_error{ "cannot create " + output.string() };
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	const auto& toSrgb = GetLinearToSrgb();
+	uint64_t texelCount = 0, pageCount = 0;
+	for (uint32_t mip = 0; mip < header.mipCount; ++mip) {
+		const uint32_t side = GetPagesPerSide(header.pagesPerSide, mip);
+		const uint32_t mipSize = options.size >> mip;
+		const Level& baseLevel = SelectLevel(baseLevels, static_cast<float>(baseLevels[0].width) / mipSize);
+		const Level& detailLevel = SelectLevel(detailLevels, detailLevels[0].width * options.detailRepeat / mipSize);
+
+		// Pages of one mip are independent; border texels clamp at the edge of the virtual texture.
+		vector<std::byte> pages(size_t{ side } * side * header.pageBytes);
+		Parallel::For(0, size_t{ side } * side, [&](size_t index) {
+			const uint32_t pageX = static_cast<uint32_t>(index % side);
+			const uint32_t pageY = static_cast<uint32_t>(index / side);
+			auto* block = reinterpret_cast<uint8_t*>(pages.data() + index * header.pageBytes);
+			for (uint32_t by = 0; by < slotSize; by += 4) {
+				for (uint32_t bx = 0; bx < slotSize; bx += 4, block += 8) {
+					uint8_t rgba[64];
+					for (uint32_t i = 0; i < 16; ++i) {
+						const int x = clamp(static_cast<int>(pageX * options.pageSize + bx + i % 4) - static_cast<int>(options.border), 0, static_cast<int>(mipSize) - 1);
+						const int y = clamp(static_cast<int>(pageY * options.pageSize + by + i / 4) - static_cast<int>(options.border), 0, static_cast<int>(mipSize) - 1);
+						const float u = (x + 0.5f) / mipSize;
+						const float v = (y + 0.5f) / mipSize;
+						const Color a = SampleBilinear(baseLevel, u, v, false);
+						const Color b = SampleBilinear(detailLevel, u * options.detailRepeat, v * options.detailRepeat, true);
+						const float color[4]{ 0.5f * (a.r + b.r), 0.5f * (a.g + b.g), 0.5f * (a.b + b.b), 0.5f * (a.a + b.a) };
+						for (uint32_t c = 0; c < 4; ++c) {
+							const float value = clamp(color[c], 0.0f, 1.0f);
+							rgba[i * 4 + c] = srgb && c != 3 ? toSrgb[static_cast<size_t>(lround(value * 4095.0f))] :
+								static_cast<uint8_t>(lround(value * 255.0f));
+						}
+					}
+					BC::EncodeBC1(rgba, block, BcQuality::Normal);
+				}
+			}
+			});
+		out.write(reinterpret_cast<const char*>(pages.data()), static_cast<streamsize>(pages.size()));
+		texelCount += uint64_t{ side } * side * slotSize * slotSize;
+		pageCount += uint64_t{ side } * side;
+	}
+	if (!out) throw runtime_error{ "cannot write " + output.string() };
+
+	const chrono::duration<double> elapsed = Clock::now() - start;
+	const double megabytes = (sizeof(header) + pageCount * header.pageBytes) / (1024.0 * 1024.0);
+	cout << "wrote " << output.string() << ": " << options.size << "^2 virtual texels, " << header.mipCount << " mips, "
+		<< pageCount << " pages of " << options.pageSize << "+" << options.border << "x2 (" << megabytes << " MB) in "
+		<< elapsed.count() << " s (" << texelCount / elapsed.count() / 1e6 << " Mtexel/s on " << Parallel::GetWorkerCount() << " workers)" << endl;
+}
+
+void VirtualTexture::Simulate(uint32_t pagesPerSide, uint32_t slotCount, uint32_t frameUploadBudget, uint32_t latency)
+{
+	// A 1080p view at feedback resolution over flat 256-unit terrain, 6 units up and looking 25 degrees down.
+	constexpr uint32_t FeedbackWidth = 240, FeedbackHeight = 135, ScreenHeight = 1080;
+	constexpr uint32_t PageSize = 128, FrameCount = 1200;
+	constexpr float WorldSize = 256.0f, Height = 6.0f, Pitch = -0.436f, FovY = 1.047f, Pi = 3.14159265f;
+	const float texelsPerUnit = pagesPerSide * PageSize / WorldSize;
+	const float tanHalfFov = tan(FovY * 0.5f);
+	const float aspect = static_cast<float>(FeedbackWidth) / FeedbackHeight;
+
+	const auto render = [&](const Camera& camera, const PageCache& cache, vector<uint32_t>& feedback) {
+		feedback.clear();
+		uint32_t hits = 0;
+		const float forward[3]{ sin(camera.yaw) * cos(Pitch), sin(Pitch), cos(camera.yaw) * cos(Pitch) };
+		const float right[3]{ cos(camera.yaw), 0.0f, -sin(camera.yaw) };
+		const float up[3]{ -sin(camera.yaw) * sin(Pitch), cos(Pitch), -cos(camera.yaw) * sin(Pitch) };
+		for (uint32_t j = 0; j < FeedbackHeight; ++j) {
+			for (uint32_t i = 0; i < FeedbackWidth; ++i) {
+				const float sx = (2.0f * (i + 0.5f) / FeedbackWidth - 1.0f) * aspect * tanHalfFov;
+				const float sy = (1.0f - 2.0f * (j + 0.5f) / FeedbackHeight) * tanHalfFov;
+				float direction[3];
+				for (int c = 0; c < 3; ++c) direction[c] = forward[c] + sx * right[c] + sy * up[c];
+				const float length = sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+				if (direction[1] >= 0.0f) continue;
+
+				const float t = Height / -direction[1];
+				const float u = (camera.x + t * direction[0]) / WorldSize + 0.5f;
+				const float v = (camera.z + t * direction[2]) / WorldSize + 0.5f;
+				if (u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f) continue;
+
+				// The texel footprint stretches by 1 / sin(grazing angle) along the view direction.
+				const float distance = t * length;
+				const float texelsPerPixel = texelsPerUnit * 2.0f * distance * tanHalfFov / ScreenHeight / (-direction[1] / length);
+				const uint32_t mip = min(static_cast<uint32_t>(max(floor(log2(max(texelsPerPixel, 1.0f))), 0.0f)), cache.GetMipCount() - 1);
+				const uint32_t side = GetPagesPerSide(pagesPerSide, mip);
+				const uint32_t page = PackPage(mip, static_cast<uint32_t>(u * side), static_cast<uint32_t>(v * side));
+				feedback.push_back(page);
+				if (cache.IsResident(page)) ++hits;
+			}
+		}
+		return hits;
+		};
+
+	cout << "page cache: " << pagesPerSide << "^2 pages of " << PageSize << "^2, " << slotCount << " slots, "
+		<< frameUploadBudget << " uploads/frame, " << latency << " frames latency" << endl;
+	constexpr uint32_t TeleportInterval = 120;
+	for (const auto& [path, name] : { pair{ Path::Flyover, "flyover" }, pair{ Path::Orbit, "orbit" }, pair{ Path::Teleport, "teleport" } }) {
+		PageCache cache{ pagesPerSide, slotCount, frameUploadBudget };
+		deque<pair<uint32_t, uint32_t>> inFlight;	// (frame due, page)
+		mt19937 random{ 7 };
+		uniform_real_distribution<float> position{ -0.4f * WorldSize, 0.4f * WorldSize }, angle{ 0.0f, 2.0f * Pi };
+
+		vector<uint32_t> feedback;
+		Camera camera{};
+		uint64_t samples = 0, hits = 0, settleFrames = 0, teleports = 0;
+		size_t peakUploads = 0;
+		uint32_t lastTeleport = 0;
+		bool settling = false;
+		Clock::duration cacheTime{};
+		for (uint32_t frame = 0; frame < FrameCount; ++frame) {
+			const float progress = static_cast<float>(frame) / FrameCount;
+			if (path == Path::Flyover) {
+				const float offset = -0.4f * WorldSize + 0.8f * WorldSize * progress;
+				camera = { offset, offset, Pi / 4 };
+			}
+			else if (path == Path::Orbit) {
+				camera = { 60.0f * cos(2 * Pi * progress), 60.0f * sin(2 * Pi * progress), -2 * Pi * progress - Pi / 2 };
+			}
+			else if (frame % TeleportInterval == 0) {
+				// A jump that never settled counts as taking the whole interval.
+				if (settling) settleFrames += frame - lastTeleport;
+				camera = { position(random), position(random), angle(random) };
+				lastTeleport = frame;
+				settling = frame > 0;
+				teleports += settling;
+			}
+
+			const uint32_t frameHits = render(camera, cache, feedback);
+			samples += feedback.size();
+			hits += frameHits;
+			if (settling && frameHits >= 0.95 * feedback.size()) {
+				settleFrames += frame - lastTeleport;
+				settling = false;
+			}
+
+			const auto start = Clock::now();
+			cache.AddFeedback(feedback);
+			const auto uploads = cache.Update();
+			cacheTime += Clock::now() - start;
+			peakUploads = max(peakUploads, uploads.size());
+			for (const auto& upload : uploads) inFlight.emplace_back(frame + latency, upload.page);
+			while (!inFlight.empty() && inFlight.front().first <= frame) {
+				cache.CompleteUpload(inFlight.front().second);
+				inFlight.pop_front();
+			}
+		}
+		const chrono::duration<double, milli> elapsed = cacheTime;
+
+		const auto& statistics = cache.GetStatistics();
+		cout << name << ": " << 100.0 * hits / max<uint64_t>(samples, 1) << "% samples at the wanted mip, "
+			<< static_cast<double>(statistics.uploads) / statistics.frames << " uploads/frame (peak " << peakUploads << "), "
+			<< static_cast<double>(statistics.evictions) / statistics.frames << " evictions/frame, "
+			<< cache.GetResidentCount() << "/" << slotCount << " slots resident";
+		if (teleports > 0) cout << ", " << static_cast<double>(settleFrames) / teleports << " frames to settle after a teleport";
+		cout << " (" << elapsed.count() / FrameCount << " ms/frame in the cache)" << endl;
+	}
+}
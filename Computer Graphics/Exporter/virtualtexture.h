@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+
+struct VirtualTextureOptions
+{
+	uint32_t	size = 8192;		// Virtual texels per side at mip 0.
+	uint32_t	pageSize = 128;
+	uint32_t	border = 4;
+	float		detailRepeat = 64.0f;	// Detail tiles across the virtual texture (terrain length / patch length).
+};
+
+namespace VirtualTexture
+{
+	// Bakes the terrain's base layer blended half and half with the tiled detail layer, as the
+	// terrain shader did, into BC1 pages of a .vt file (see VirtualTexturing::FileHeader). Sources
+	// are RGBA8 or BC1/BC3/BC7 DDS files; missing source mips are generated.
+	void Bake(const std::filesystem::path& base, const std::filesystem::path& detail,
+		const std::filesystem::path& output, const VirtualTextureOptions& options);
+
+	// Replays simulated terrain feedback (a flyover, an orbit and random teleports) through a
+	// PageCache with `slotCount` slots and reports hit rate, upload and eviction traffic, and how
+	// many frames a teleport takes to settle. Uploads land `latency` frames after they start.
+	void Simulate(uint32_t pagesPerSide, uint32_t slotCount, uint32_t frameUploadBudget, uint32_t latency);
+}